@@ -37,6 +37,13 @@ e.g.
 u8 u8String[] = "A string to print.\n\r"
 DebugPrintf(u8String);
 
+u32 DebugPrintfNoCopy(u8* u8String_)
+Same as DebugPrintf but the string is sent directly from where it is instead of being copied to the message queue.
+Use this for strings that never change (string literals, static or global constant messages).
+e.g.
+static u8 au8String[] = "A constant string to print.\n\r"
+DebugPrintfNoCopy(au8String);
+
 void DebugLineFeed(void)
 Queues a <CR><LF> sequence to the debug UART.
 e.g.
@@ -56,6 +63,15 @@ u8 u8MyBuffer[SCANF_BUFFER_SIZE]
 u8 u8NumChars;
 u8NumChars = DebugScanf(u8MyBuffer);
 
+u32 DebugTelemetryWrite(u8 u8Channel_, u32 u32Size_, const u8* pu8Data_)
+Sends up to DEBUG_TELEMETRY_MAX_PAYLOAD bytes of binary data as one frame on the debug UART, mixed in with the 
+ASCII output.  The record is the channel ID, the data and a CRC16 (Crc16Ccitt over the channel ID and data, high
+byte first).  It is COBS encoded so it has no 0x00 bytes and is sent between two 0x00 delimiters.  ASCII strings
+never contain 0x00, so a host splits the stream at every 0x00 and anything that does not decode with a good CRC is
+text (see host/telemetry_decoder.c).  Returns the message token, or 0 if the frame could not be queued.
+e.g.
+DebugTelemetryWrite(DEBUG_TELEMETRY_CHANNEL_MESSAGING, sizeof(MessageQueueStatsType), (u8*)&psQueue->sStats);
+
 
 DISCLAIMER: THIS CODE IS PROVIDED WITHOUT ANY WARRANTY OR GUARANTEES.  USERS MAY
 USE THIS CODE FOR DEVELOPMENT AND EXAMPLE PURPOSES ONLY.  ENGENUICS TECHNOLOGIES
@@ -118,7 +134,7 @@ DebugCommandType Debug_au8Commands[DEBUG_COMMANDS] = { {DEBUG_CMD_NAME00, DebugC
                                                        {DEBUG_CMD_NAME01, DebugCommandLedTestToggle},
                                                        {DEBUG_CMD_NAME02, DebugCommandSysTimeToggle},
                                                        {DEBUG_CMD_NAME03, DebugCommandDummy},
-                                                       {DEBUG_CMD_NAME04, DebugCommandDummy},
+                                                       {DEBUG_CMD_NAME04, DebugCommandMessagingStats},
                                                        {DEBUG_CMD_NAME05, DebugCommandDummy},
                                                        {DEBUG_CMD_NAME06, DebugCommandDummy},
                                                        {DEBUG_CMD_NAME07, DebugCommandDummy} 
@@ -132,7 +148,7 @@ DebugCommandType Debug_au8Commands[DEBUG_COMMANDS] = { {DEBUG_CMD_NAME00, DebugC
                                                        {DEBUG_CMD_NAME01, DebugCommandLedTestToggle},
                                                        {DEBUG_CMD_NAME02, DebugCommandSysTimeToggle},
                                                        {DEBUG_CMD_NAME03, DebugCommandCaptouchValuesToggle},
-                                                       {DEBUG_CMD_NAME04, DebugCommandDummy},
+                                                       {DEBUG_CMD_NAME04, DebugCommandMessagingStats},
                                                        {DEBUG_CMD_NAME05, DebugCommandDummy},
                                                        {DEBUG_CMD_NAME06, DebugCommandDummy},
                                                        {DEBUG_CMD_NAME07, DebugCommandDummy} 
@@ -179,6 +195,36 @@ u32 DebugPrintf(u8* u8String_)
 } /* end DebugPrintf() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugPrintfNoCopy
+
+Description:
+Sends a text string to the debug UART without copying it into the message queue.
+
+Requires:
+  - u8String_ is a NULL-terminated C-string that will not change until the message is sent (i.e. a string
+    literal, a static or a global message)
+  - The debug UART resource has been setup for the debug application.
+
+Promises:
+  - The string is queued to the debug UART.
+  - The message token is returned
+*/
+u32 DebugPrintfNoCopy(u8* u8String_)
+{
+  u8* pu8Parser = u8String_;
+  u32 u32Size = 0;
+  
+  while(*pu8Parser != NULL)
+  {
+    u32Size++;
+    pu8Parser++;
+  }
+  return( UartWriteDataNoCopy(Debug_Uart, u32Size, u8String_) );
+ 
+} /* end DebugPrintfNoCopy() */
+
+
 /*----------------------------------------------------------------------------------------------------------------------
 Function: DebugLineFeed
 
@@ -193,9 +239,9 @@ Promises:
 */
 void DebugLineFeed(void)
 {
-  u8 au8Linefeed[] = {ASCII_LINEFEED, ASCII_CARRIAGE_RETURN};
+  static u8 au8Linefeed[] = {ASCII_LINEFEED, ASCII_CARRIAGE_RETURN};
   
-  UartWriteData(Debug_Uart, sizeof(au8Linefeed), &au8Linefeed[0]);
+  UartWriteDataNoCopy(Debug_Uart, sizeof(au8Linefeed), &au8Linefeed[0]);
 
 } /* end DebugLineFeed() */
 
@@ -298,6 +344,51 @@ u8 DebugScanf(u8* au8Buffer_)
 } /* end DebugScanf() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugTelemetryWrite
+
+Description:
+Queues a binary telemetry frame to the debug UART.  Frame on the wire:
+0x00, COBS(channel ID, data, CRC16 high byte, CRC16 low byte), 0x00
+
+Requires:
+  - u32Size_ is 1 to DEBUG_TELEMETRY_MAX_PAYLOAD
+  - pu8Data_ points to u32Size_ bytes
+  - The debug UART resource has been setup for the debug application.
+
+Promises:
+  - The frame is queued to the debug UART as one message and the message token is returned
+  - Returns 0 if u32Size_ is not valid or the message could not be queued
+*/
+u32 DebugTelemetryWrite(u8 u8Channel_, u32 u32Size_, const u8* pu8Data_)
+{
+  u8 au8Record[DEBUG_TELEMETRY_RECORD_SIZE];
+  u8 au8Frame[DEBUG_TELEMETRY_FRAME_SIZE];
+  u32 u32FrameSize;
+  u16 u16Crc;
+  
+  if( (u32Size_ == 0) || (u32Size_ > DEBUG_TELEMETRY_MAX_PAYLOAD) )
+  {
+    return(0);
+  }
+  
+  /* Channel ID, data and CRC */
+  au8Record[0] = u8Channel_;
+  memcpy(&au8Record[1], pu8Data_, u32Size_);
+  u16Crc = Crc16Ccitt(CRC16_CCITT_INIT, au8Record, u32Size_ + 1);
+  au8Record[u32Size_ + 1] = (u8)(u16Crc >> 8);
+  au8Record[u32Size_ + 2] = (u8)u16Crc;
+  
+  /* Stuff the record between the delimiters */
+  au8Frame[0] = 0x00;
+  u32FrameSize = CobsEncode(&au8Frame[1], au8Record, u32Size_ + 3) + 1;
+  au8Frame[u32FrameSize++] = 0x00;
+  
+  return( UartWriteData(Debug_Uart, u32FrameSize, au8Frame) );
+ 
+} /* end DebugTelemetryWrite() */
+
+
 /*----------------------------------------------------------------------------------------------------------------------
 Function: SystemStatusReport
 
@@ -398,10 +489,14 @@ void DebugInitialize(void)
 
   /* Request the UART resource to be used for the Debug application */
   sUartConfig.UartPeripheral     = DEBUG_UART;
+  sUartConfig.u32BaudRate        = 0;
+  sUartConfig.FlowControl        = UART_FLOW_NONE;
   sUartConfig.pu8RxBufferAddress = &Debug_au8RxBuffer[0];
   sUartConfig.pu8RxNextByte      = &Debug_pu8RxBufferNextChar;
   sUartConfig.u16RxBufferSize    = DEBUG_RX_BUFFER_SIZE;
   sUartConfig.fnRxCallback       = DebugRxCallback;
+  sUartConfig.u8TxReservedSlots  = DEBUG_TX_RESERVED_SLOTS;
+  sUartConfig.eTxPriority        = MSG_PRIORITY_LOW;
   
   Debug_Uart = UartRequest(&sUartConfig);
   
@@ -414,7 +509,7 @@ void DebugInitialize(void)
   /* Otherwise send the first message, set "good" flag and head to Idle */
   else
   {
-    DebugPrintf(Debug_au8StartupMsg);   
+    DebugPrintfNoCopy(Debug_au8StartupMsg);   
     G_u32ApplicationFlags |= _APPLICATION_FLAGS_DEBUG;
     Debug_pfnStateMachine = DebugSM_Idle;
   }
@@ -447,21 +542,21 @@ void DebugRunActiveState(void)
 Function DebugRxCallback()
 
 Description:
-Call back function used when character received.
+Call back function used when characters are received.
 
 Requires:
-  - None
+  - u16Count_ is the number of new characters in Debug_au8RxBuffer (less than DEBUG_RX_BUFFER_SIZE)
 
 Promises:
-  - Safely advances Debug_pu8RxBufferNextChar.
+  - Safely advances Debug_pu8RxBufferNextChar by u16Count_.
 */
-void DebugRxCallback(void)
+void DebugRxCallback(u16 u16Count_)
 {
   /* Safely advance the NextChar pointer */
-  Debug_pu8RxBufferNextChar++;
-  if(Debug_pu8RxBufferNextChar == &Debug_au8RxBuffer[DEBUG_RX_BUFFER_SIZE])
+  Debug_pu8RxBufferNextChar += u16Count_;
+  if(Debug_pu8RxBufferNextChar >= &Debug_au8RxBuffer[DEBUG_RX_BUFFER_SIZE])
   {
-    Debug_pu8RxBufferNextChar = &Debug_au8RxBuffer[0];
+    Debug_pu8RxBufferNextChar -= DEBUG_RX_BUFFER_SIZE;
   }
   
 } /* end DebugRxCallback() */
@@ -563,12 +658,12 @@ static void DebugCommandLedTestToggle(void)
   if(G_u32DebugFlags & _DEBUG_LED_TEST_ENABLE)
   {
     G_u32DebugFlags &= ~_DEBUG_LED_TEST_ENABLE;
-    DebugPrintf(G_au8MessageOFF);
+    DebugPrintfNoCopy(G_au8MessageOFF);
   }
   else
   {
     G_u32DebugFlags |= _DEBUG_LED_TEST_ENABLE;
-    DebugPrintf(G_au8MessageON);
+    DebugPrintfNoCopy(G_au8MessageON);
     
 #ifdef MPG1
     LedOn(WHITE);
@@ -748,16 +843,135 @@ static void DebugCommandSysTimeToggle(void)
   if(G_u32DebugFlags & _DEBUG_TIME_WARNING_ENABLE)
   {
     G_u32DebugFlags &= ~_DEBUG_TIME_WARNING_ENABLE;
-    DebugPrintf(G_au8MessageOFF);
+    DebugPrintfNoCopy(G_au8MessageOFF);
   }
   else
   {
     G_u32DebugFlags |= _DEBUG_TIME_WARNING_ENABLE;
-    DebugPrintf(G_au8MessageON);
+    DebugPrintfNoCopy(G_au8MessageON);
   }
   
 } /* end DebugCommandSysTimeToggle() */
 
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugCommandMessagingStats
+
+Description:
+Prints one line for each message queue: slots in use / reserved, high-water mark, rejected messages and the 
+WAITING and SENDING latency histograms.  Each line is queued as a single message so the report does not use
+up the debug port's share of the message pool.  A last line gives the number of timed out transfers that reset each
+SSP peripheral.
+*/
+static void DebugCommandMessagingStats(void)
+{
+  u8 au8Heading[] = "\n\rQueue use/res highwater rejected appended | wait ms | send ms  (bins 0 1 2 4 8 16 32 64+)\n\r";
+  u8 au8Line[DEBUG_STATS_LINE_SIZE];
+  const MessageQueueType* psQueue;
+  const u8* pu8Name;
+  u8* pu8Parser;
+  u8 u8Index = 0;
+  
+  DebugPrintf(au8Heading);
+  
+  while( (psQueue = MessagingGetQueue(u8Index++)) != NULL )
+  {
+    pu8Parser = &au8Line[0];
+    
+    /* Name and occupancy */
+    for(pu8Name = psQueue->pu8Name; (pu8Name != NULL) && (*pu8Name != '\0'); pu8Name++)
+    {
+      *pu8Parser++ = *pu8Name;
+    }
+    *pu8Parser++ = ' ';
+    pu8Parser = DebugAppendNumber(pu8Parser, psQueue->u8InUse);
+    *pu8Parser++ = '/';
+    pu8Parser = DebugAppendNumber(pu8Parser, psQueue->u8Reserved);
+    *pu8Parser++ = ' ';
+    pu8Parser = DebugAppendNumber(pu8Parser, psQueue->sStats.u8HighWater);
+    *pu8Parser++ = ' ';
+    pu8Parser = DebugAppendNumber(pu8Parser, psQueue->sStats.u32Rejected);
+    *pu8Parser++ = ' ';
+    pu8Parser = DebugAppendNumber(pu8Parser, psQueue->sStats.u32Appended);
+    
+    /* Latency histograms */
+    *pu8Parser++ = ' ';
+    *pu8Parser++ = '|';
+    for(u8 i = 0; i < MSG_LATENCY_BUCKETS; i++)
+    {
+      *pu8Parser++ = ' ';
+      pu8Parser = DebugAppendNumber(pu8Parser, psQueue->sStats.au32WaitLatency[i]);
+    }
+    
+    *pu8Parser++ = ' ';
+    *pu8Parser++ = '|';
+    for(u8 i = 0; i < MSG_LATENCY_BUCKETS; i++)
+    {
+      *pu8Parser++ = ' ';
+      pu8Parser = DebugAppendNumber(pu8Parser, psQueue->sStats.au32SendLatency[i]);
+    }
+
+    *pu8Parser++ = '\n';
+    *pu8Parser++ = '\r';
+    *pu8Parser   = '\0';
+    DebugPrintf(au8Line);
+  }
+  
+  /* SSP bus health */
+  pu8Parser = &au8Line[0];
+  for(pu8Name = "SSP resets US0/US1/US2 "; *pu8Name != '\0'; pu8Name++)
+  {
+    *pu8Parser++ = *pu8Name;
+  }
+  pu8Parser = DebugAppendNumber(pu8Parser, SspGetRecoveryCount(USART0));
+  *pu8Parser++ = '/';
+  pu8Parser = DebugAppendNumber(pu8Parser, SspGetRecoveryCount(USART1));
+  *pu8Parser++ = '/';
+  pu8Parser = DebugAppendNumber(pu8Parser, SspGetRecoveryCount(USART2));
+  *pu8Parser++ = '\n';
+  *pu8Parser++ = '\r';
+  *pu8Parser   = '\0';
+  DebugPrintf(au8Line);
+  
+  DebugLineFeed();
+  
+} /* end DebugCommandMessagingStats() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DebugAppendNumber
+
+Description:
+Writes a number in ASCII without leading zeros.
+
+Requires:
+  - pu8Destination_ has room for up to 10 characters
+
+Promises:
+  - The digits of u32Number_ are written starting at pu8Destination_ (no terminator)
+  - Returns a pointer to the location after the last digit
+*/
+static u8* DebugAppendNumber(u8* pu8Destination_, u32 u32Number_)
+{
+  u8 au8Digits[10];
+  u8 u8Count = 0;
+  
+  /* Build the digits backwards then copy them in order */
+  do
+  {
+    au8Digits[u8Count++] = (u32Number_ % 10) + 0x30;
+    u32Number_ /= 10;
+  } while(u32Number_ != 0);
+  
+  while(u8Count != 0)
+  {
+    *pu8Destination_++ = au8Digits[--u8Count];
+  }
+  
+  return(pu8Destination_);
+  
+} /* end DebugAppendNumber() */
+
 #ifdef MPGL2 /* MPGL2 only tests */
 /*----------------------------------------------------------------------------------------------------------------------
 Function: DebugCommandCaptouchValuesToggle
@@ -775,12 +989,12 @@ static void DebugCommandCaptouchValuesToggle(void)
   if(G_u32DebugFlags & _DEBUG_CAPTOUCH_VALUES_ENABLE)
   {
     G_u32DebugFlags &= ~_DEBUG_CAPTOUCH_VALUES_ENABLE;
-    DebugPrintf(G_au8MessageOFF);
+    DebugPrintfNoCopy(G_au8MessageOFF);
   }
   else
   {
     G_u32DebugFlags |= _DEBUG_CAPTOUCH_VALUES_ENABLE;
-    DebugPrintf(G_au8MessageON);
+    DebugPrintfNoCopy(G_au8MessageON);
     DebugPrintf(au8CaptouchOnMessage);
   }
   
@@ -882,7 +1096,7 @@ void DebugSM_Idle(void)
           Debug_pu8CmdBufferNextChar = &Debug_au8CommandBuffer[0];
           Debug_u16CommandSize = 0;
 
-          Debug_u32CurrentMessageToken = DebugPrintf(au8CommandOverflow);
+          Debug_u32CurrentMessageToken = DebugPrintfNoCopy(au8CommandOverflow);
         }
         break;
       }
@@ -970,7 +1184,7 @@ void DebugSM_CheckCmd(void)
   /* Otherwise print an error message and return to Idle */
   else
   { 
-    DebugPrintf(au8InvalidCommand);
+    DebugPrintfNoCopy(au8InvalidCommand);
     Debug_pfnStateMachine = DebugSM_Idle;
   }
 
@@ -1005,7 +1219,7 @@ void DebugSM_Error(void)
   
   /* Flag an error and report it (if possible) */
   G_u32DebugFlags |= _DEBUG_FLAG_ERROR;
-  DebugPrintf(au8DebugErrorMsg);
+  DebugPrintfNoCopy(au8DebugErrorMsg);
   DebugPrintNumber( (u32)(Debug_u8ErrorCode) );
   DebugLineFeed();
   
@@ -12,6 +12,7 @@ File: debug.h
 #define DEBUG_RX_BUFFER_SIZE           (u32)128             /* Size of debug buffer for incoming messages */
 #define DEBUG_CMD_BUFFER_SIZE          (u32)64              /* Size of debug buffer for a command */
 #define DEBUG_SCANF_BUFFER_SIZE        (u8)128              /* Size of buffer for scanf messages */
+#define DEBUG_TX_RESERVED_SLOTS        (u8)2                /* Message pool slots kept for debug output */
 
 /* G_u32DebugFlags */
 #define _DEBUG_LED_TEST_ENABLE         (u32)0x00000001      /* Flag if LED test is enabled */
@@ -29,6 +30,16 @@ File: debug.h
 
 #define MAX_TASK_NAME_SIZE             (u8)10               /* Maximum string size for task name reported in SystemStatusReport */
 
+/* Binary telemetry frames on the debug UART (see DebugTelemetryWrite) */
+#define DEBUG_TELEMETRY_MAX_PAYLOAD    (u16)200             /* Largest struct that can be sent in one frame */
+#define DEBUG_TELEMETRY_RECORD_SIZE    (u16)(DEBUG_TELEMETRY_MAX_PAYLOAD + 3)    /* Channel ID + payload + CRC16 */
+#define DEBUG_TELEMETRY_FRAME_SIZE     (u16)(COBS_ENCODED_SIZE(DEBUG_TELEMETRY_RECORD_SIZE) + 2)  /* Encoded record between two 0x00 delimiters */
+
+#define DEBUG_TELEMETRY_CHANNEL_MESSAGING  (u8)0x01         /* Message queue statistics */
+#define DEBUG_TELEMETRY_CHANNEL_ANT        (u8)0x02         /* ANT data */
+#define DEBUG_TELEMETRY_CHANNEL_CAPTOUCH   (u8)0x03         /* Captouch samples */
+#define DEBUG_TELEMETRY_CHANNEL_USER       (u8)0x80         /* First channel ID left to user applications */
+
 /**********************************************************************************************************************
 Type Definitions
 **********************************************************************************************************************/
@@ -56,7 +67,7 @@ typedef struct
 #define DEBUG_CMD_NAME01        "Toggle LED test                 "  /* Command 1: Test that allows characters to toggle LEDs */
 #define DEBUG_CMD_NAME02        "Toggle system timing warning    "  /* Command 2: Prints message if system tick has advanced more than 1 between main loop sleeps (i.e. tasks are taking too long) */
 #define DEBUG_CMD_NAME03        "Dummy3                          "  /* Command 3: */
-#define DEBUG_CMD_NAME04        "Dummy4                          "  /* Command 4: */
+#define DEBUG_CMD_NAME04        "Show messaging statistics       "  /* Command 4: Prints the occupancy and latency counters of each message queue and the SSP reset counts */
 #define DEBUG_CMD_NAME05        "Dummy5                          "  /* Command 5: */
 #define DEBUG_CMD_NAME06        "Dummy6                          "  /* Command 6: */
 #define DEBUG_CMD_NAME07        "Dummy7                          "  /* Command 7: */
@@ -69,12 +80,13 @@ typedef struct
 #define DEBUG_CMD_NAME01        "Toggle LED test                 "  /* Command 1: Test that allows characters to toggle LEDs */
 #define DEBUG_CMD_NAME02        "Toggle system timing warning    "  /* Command 2: Prints message if system tick has advanced more than 1 between main loop sleeps (i.e. tasks are taking too long) */
 #define DEBUG_CMD_NAME03        "Toggle Captouch value display   "  /* Command 2: Test that shows Captouch sense values on debug port */
-#define DEBUG_CMD_NAME04        "Dummy4                          "  /* Command 4: */
+#define DEBUG_CMD_NAME04        "Show messaging statistics       "  /* Command 4: Prints the occupancy and latency counters of each message queue and the SSP reset counts */
 #define DEBUG_CMD_NAME05        "Dummy5                          "  /* Command 5: */
 #define DEBUG_CMD_NAME06        "Dummy6                          "  /* Command 6: */
 #define DEBUG_CMD_NAME07        "Dummy7                          "  /* Command 7: */
 #endif /* MPGL1 */
 
+#define DEBUG_STATS_LINE_SIZE   (u16)256                            /* Size of buffer for one line of the messaging statistics */
 
 #define DEBUG_UART_TIMEOUT      (u32)2000                           /* Max time in ms for a command/message to be sent */
 
@@ -92,9 +104,11 @@ typedef struct
 /* Public Functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 u32 DebugPrintf(u8* u8String_);
+u32 DebugPrintfNoCopy(u8* u8String_);
 void DebugLineFeed(void);       
 void DebugPrintNumber(u32 u32Number_);
 u8 DebugScanf(u8* au8Buffer_);
+u32 DebugTelemetryWrite(u8 u8Channel_, u32 u32Size_, const u8* pu8Data_);
 
 void SystemStatusReport(void);
 
@@ -104,7 +118,7 @@ void SystemStatusReport(void);
 /*--------------------------------------------------------------------------------------------------------------------*/
 void DebugInitialize(void);                   
 void DebugRunActiveState(void);
-void DebugRxCallback(void);
+void DebugRxCallback(u16 u16Count_);
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -116,6 +130,8 @@ static void DebugCommandDummy(void);
 static void DebugCommandLedTestToggle(void);
 static void DebugLedTestCharacter(u8 u8Char_);
 static void DebugCommandSysTimeToggle(void);
+static void DebugCommandMessagingStats(void);
+static u8* DebugAppendNumber(u8* pu8Destination_, u32 u32Number_);
 
 #ifdef MPGL1 /* MPGL1-specific debug functions */
 #endif /* MPGL1 */
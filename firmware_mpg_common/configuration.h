@@ -276,6 +276,11 @@ Board-specific ANT definitions are kept here
 #define ANT_SRDY_CLEAR_REG     (AT91C_BASE_PIOB->PIO_CODR = PB_24_ANT_SRDY)            
 #define ANT_SRDY_SET_REG       (AT91C_BASE_PIOB->PIO_SODR = PB_24_ANT_SRDY)
 
+/* Timer channel that times the SRDY pulses requested from the SSP interrupt */
+#define ANT_SRDY_TIMER         AT91C_BASE_TC0
+#define ANT_SRDY_TIMER_ID      AT91C_ID_TC0
+#define ANT_SRDY_IRQHandler    TC0_IrqHandler
+
 #define ANT_RESET_CLEAR_REG    (AT91C_BASE_PIOB->PIO_CODR = PB_21_ANT_RESET)
 #define ANT_RESET_SET_REG      (AT91C_BASE_PIOB->PIO_SODR = PB_21_ANT_RESET)
 
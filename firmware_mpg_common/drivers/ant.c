@@ -199,6 +199,73 @@ static void AntSrdyPulse(void)
 } /* end AntSrdyPulse() */
 
 
+/*-----------------------------------------------------------------------------
+Function: AntSrdyPulseStart
+
+Description:
+Starts an SRDY pulse with the same timing as AntSrdyPulse() but returns right away: ANT_SRDY_TIMER counts out the 
+delay and the pulse width and ANT_SRDY_IRQHandler() drives the line.  This is what the flow control callbacks use so 
+the SSP interrupt does not sit in a delay loop for every byte.
+
+Requires:
+  - ANT_SRDY_TIMER has been set up by AntInitialize()
+  - No pulse is in progress (the next byte cannot arrive before SRDY has been pulsed for the last one)
+
+Promises:
+  - The timer is restarted from 0: SRDY is asserted at RA and deasserted at RC
+*/
+static void AntSrdyPulseStart(void)
+{
+  ANT_SRDY_TIMER->TC_CCR = AT91C_TC_SWTRG;
+
+} /* end AntSrdyPulseStart() */
+
+
+/*-----------------------------------------------------------------------------
+Interrupt Service Routine: ANT_SRDY_IRQHandler
+
+Description:
+Drives SRDY from the RA and RC compares of the pulse started by AntSrdyPulseStart().
+
+Requires:
+  - ISRs cannot require anything
+
+Promises:
+  - SRDY is asserted on the RA compare and deasserted on the RC compare
+  - If the interrupt was held off past RC, SRDY is asserted now and the timer is restarted with RC at 
+    ANT_SRDY_TC_RC_WIDTH (below RA) so the deassert still comes a full pulse width later; RC is put back on the 
+    deassert
+*/
+void ANT_SRDY_IRQHandler(void)
+{
+  u32 u32Status;
+  
+  /* Reading the status register clears the flags */
+  u32Status = ANT_SRDY_TIMER->TC_SR;
+  
+  /* Both compares have passed so the deassert is already due: time the pulse width from now instead */
+  if( (u32Status & (AT91C_TC_CPAS | AT91C_TC_CPCS)) == (AT91C_TC_CPAS | AT91C_TC_CPCS) )
+  {
+    SYNC_SRDY_ASSERT();
+    ANT_SRDY_TIMER->TC_RC  = ANT_SRDY_TC_RC_WIDTH;
+    ANT_SRDY_TIMER->TC_CCR = AT91C_TC_SWTRG;
+    return;
+  }
+  
+  if(u32Status & AT91C_TC_CPAS)
+  {
+    SYNC_SRDY_ASSERT();
+  }
+  
+  if(u32Status & AT91C_TC_CPCS)
+  {
+    SYNC_SRDY_DEASSERT();
+    ANT_SRDY_TIMER->TC_RC = ANT_SRDY_TC_RC_INIT;
+  }
+  
+} /* end ANT_SRDY_IRQHandler() */
+
+
 /*-----------------------------------------------------------------------------
 Function: AntRxMessage
 
@@ -480,7 +547,7 @@ void AntInitialize(void)
 
   if(G_u32SystemFlags & _SYSTEM_STARTUP_NO_ANT)
   {
-    DebugPrintf(G_au8AntMessageNoAnt);
+    DebugPrintfNoCopy(G_au8AntMessageNoAnt);
     Ant_pfnStateMachine = AntSM_NoResponse;
   }
   else
@@ -489,7 +556,7 @@ void AntInitialize(void)
     AT91C_BASE_PIOB->PIO_OER = PB_21_ANT_RESET;
     
     /* Announce on the debug port that ANT setup is starting and intialize pointers */
-    DebugPrintf(G_au8AntMessageInit);
+    DebugPrintfNoCopy(G_au8AntMessageInit);
     G_sAntApplicationMsgList = 0;
     Ant_psDataOutgoingMsgList = 0;
     
@@ -506,6 +573,22 @@ void AntInitialize(void)
     G_stAntSetupData.AntFrequency        = ANT_FREQUENCY_DEFAULT;
     G_stAntSetupData.AntTxPower          = ANT_TX_POWER_DEFAULT;
     
+    /* Set up the timer for the SRDY pulses requested by the flow control callbacks; the counter clock is enabled 
+    but only runs from a software trigger up to RC */
+    AT91C_BASE_PMC->PMC_PCER |= (1 << ANT_SRDY_TIMER_ID);
+    ANT_SRDY_TIMER->TC_CCR = AT91C_TC_CLKDIS;
+    ANT_SRDY_TIMER->TC_CMR = ANT_SRDY_TC_CMR_INIT;
+    ANT_SRDY_TIMER->TC_RA  = ANT_SRDY_TC_RA_INIT;
+    ANT_SRDY_TIMER->TC_RC  = ANT_SRDY_TC_RC_INIT;
+    ANT_SRDY_TIMER->TC_IDR = 0xFFFFFFFF;
+    ANT_SRDY_TIMER->TC_IER = AT91C_TC_CPAS | AT91C_TC_CPCS;
+    (void)ANT_SRDY_TIMER->TC_SR;
+    ANT_SRDY_TIMER->TC_CCR = AT91C_TC_CLKEN;
+    
+    /* The timer's NVIC priority is set above the serial handlers by InterruptSetup() (see interrupts.h) */
+    NVIC_ClearPendingIRQ( (IRQn_Type)ANT_SRDY_TIMER_ID );
+    NVIC_EnableIRQ( (IRQn_Type)ANT_SRDY_TIMER_ID );
+    
     /* Configure the SSP resource to be used for the application */
     Ant_sSspConfig.SspPeripheral      = ANT_SPI;
     Ant_sSspConfig.pCsGpioAddress     = ANT_SPI_CS_GPIO;
@@ -517,6 +600,8 @@ void AntInitialize(void)
     Ant_sSspConfig.pu8RxBufferAddress = Ant_au8AntRxBuffer;
     Ant_sSspConfig.ppu8RxNextByte     = &Ant_pu8AntRxBufferNextChar;
     Ant_sSspConfig.u16RxBufferSize    = ANT_RX_BUFFER_SIZE;
+    Ant_sSspConfig.u8TxReservedSlots  = ANT_TX_RESERVED_SLOTS;
+    Ant_sSspConfig.eTxPriority        = MSG_PRIORITY_HIGH;
 
     Ant_Ssp = SspRequest(&Ant_sSspConfig);
     ANT_SSP_FLAGS = 0;
@@ -527,7 +612,7 @@ void AntInitialize(void)
     /* Report status out the debug port */
     if(G_u32ApplicationFlags & _APPLICATION_FLAGS_ANT)  
     {
-      DebugPrintf(G_au8AntMessageOk);
+      DebugPrintfNoCopy(G_au8AntMessageOk);
       DebugPrintf(Ant_u8AntVersion);
       DebugLineFeed();
       
@@ -539,7 +624,7 @@ void AntInitialize(void)
       /* The ANT device is not responding -- it may be dead, or it may not yet
       be loaded with any firmware.  Regardless, float all of the interface lines so 
       that any programmer or other firmware will not be impacted by the Host MCU */
-      DebugPrintf(G_au8AntMessageInitFail);
+      DebugPrintfNoCopy(G_au8AntMessageInitFail);
 
       /* Make sure all ANT pins are on the PIO controller */
       u32AntPortAPins = ANT_PIOA_PINS;
@@ -795,7 +880,16 @@ u8 AntExpectResponse(u8 u8ExpectedMessageID_, u32 u32TimeoutMS_)
   if( bTimeout )
   {
     DebugPrintf(au8AntExpectMsgFail);
-    /* !!!! What clean-up should be done here?  Reset ANT and restart init? */
+    
+    /* Drop the Tx message if ANT never took it so it does not go out ahead of the next command.  If it is already 
+    being clocked out it cannot be cancelled, so AntSM_TransmitMessage() cleans up when its status is final. */
+    if( (Ant_u32CurrentTxMessageToken != 0) && CancelMessage(Ant_u32CurrentTxMessageToken) )
+    {
+      G_u32AntFlags &= ~_ANT_FLAGS_TX_IN_PROGRESS;
+      AntDeQueueOutgoingMessage();
+      Ant_u32CurrentTxMessageToken = 0;
+    }
+    /* !!!! What other clean-up should be done here?  Reset ANT and restart init? */
   }
 
   return(u8ReturnValue);
@@ -810,13 +904,14 @@ Description:
 Callback function to toggle flow control during transmission.  The peripheral task
 sending the message must invoke this function after each byte.  
 
-Note: Since this function is called from an ISR, it should execute as quickly as possible. 
+Note: Since this function is called from an ISR, it should execute as quickly as possible so the 
+SRDY pulse is timed by ANT_SRDY_TIMER instead of a delay loop. 
 
 Requires:
   - 
 
 Promises:
-  - SRDY is toggled
+  - An SRDY pulse is started
   - Ant_u32TxByteCounter incremented
 */
 
@@ -824,7 +919,7 @@ void AntTxFlowControlCallback(void)
 {
   /* Count the byte and toggle flow control lines */
   Ant_u32TxByteCounter++; 
-  AntSrdyPulse();
+  AntSrdyPulseStart();
 
 } /* end AntTxFlowControlCallback() */
 
@@ -837,9 +932,7 @@ Callback function to toggle flow control during reception.  The peripheral task
 receiving the message must invoke this function after each byte.  
 
 Note: Since this function is called from an ISR, it should execute as quickly as possible. 
-Unfortunately, AntSrdyPulse() takes some time but the duty cycle of this interrupt
-is low enough that we can survive (this interrupt priority could be dropped below everything
-else to mitigate any issues).
+The SRDY pulse is only started here and is timed by ANT_SRDY_TIMER (see AntSrdyPulseStart()).
 
 Requires:
   - ISRs are off already since this is totally not re-entrant
@@ -850,7 +943,7 @@ Requires:
 Promises:
   - Ant_pu8AntRxBufferNextChar is advanced safely so it is ready to receive the next byte
   - Ant_u32RxByteCounter incremented
-  - SRDY is toggled if _ANT_FLAGS_RX_IN_PROGRESS is set
+  - An SRDY pulse is started if _ANT_FLAGS_RX_IN_PROGRESS is set
 */
 void AntRxFlowControlCallback(void)
 {
@@ -866,7 +959,7 @@ void AntRxFlowControlCallback(void)
   /* Only toggle SRDY if a reception is flagged in progress */
   if( G_u32AntFlags & _ANT_FLAGS_RX_IN_PROGRESS )
   {
-    AntSrdyPulse();
+    AntSrdyPulseStart();
   }
   
 } /* end AntRxFlowControlCallback() */
@@ -1074,38 +1167,38 @@ static u8 AntProcessMessage(void)
         switch(au8MessageCopy[BUFFER_INDEX_RESPONSE_MESG_ID])
         {
           case MESG_OPEN_CHANNEL_ID:
-            DebugPrintf(G_au8AntMessageOpen);
+            DebugPrintfNoCopy(G_au8AntMessageOpen);
             G_u32AntFlags |= _ANT_FLAGS_CHANNEL_OPEN;
             G_u32AntFlags &= ~_ANT_FLAGS_CHANNEL_OPEN_PENDING;
             break;
 
           case MESG_CLOSE_CHANNEL_ID:
-            DebugPrintf(G_au8AntMessageClose);
+            DebugPrintfNoCopy(G_au8AntMessageClose);
             G_u32AntFlags &= ~(_ANT_FLAGS_CHANNEL_CLOSE_PENDING | _ANT_FLAGS_CHANNEL_OPEN);
             break;
 
           case MESG_ASSIGN_CHANNEL_ID:
-            DebugPrintf(G_au8AntMessageAssign);
+            DebugPrintfNoCopy(G_au8AntMessageAssign);
             break;
 
           case MESG_UNASSIGN_CHANNEL_ID:
-            DebugPrintf(G_au8AntMessageUnassign);
+            DebugPrintfNoCopy(G_au8AntMessageUnassign);
             G_u32AntFlags &= ~(ANT_CONFIGURED | _ANT_FLAGS_CHANNEL_OPEN_PENDING | _ANT_FLAGS_CHANNEL_CLOSE_PENDING | _ANT_FLAGS_CHANNEL_OPEN);
             break;
  
           default:
-            DebugPrintf(G_au8AntMessageUnhandled);
+            DebugPrintfNoCopy(G_au8AntMessageUnhandled);
             break;
         } /* end switch */
         
         /* All messages print an "ok" or "fail" */
         if( au8MessageCopy[BUFFER_INDEX_RESPONSE_CODE] == RESPONSE_NO_ERROR ) 
         {
-          DebugPrintf(G_au8AntMessageOk);
+          DebugPrintfNoCopy(G_au8AntMessageOk);
         }
         else
         {
-          DebugPrintf(G_au8AntMessageFail);
+          DebugPrintfNoCopy(G_au8AntMessageFail);
           G_u32AntFlags |= _ANT_FLAGS_CMD_ERROR;
         }
 
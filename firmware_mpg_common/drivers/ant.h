@@ -54,6 +54,13 @@ typedef struct
 #define ANT_SRDY_DELAY            (u32)200      /* A loop-kill delay to provide guaranteed minimum space for SRDY messages */
 #define ANT_SRDY_PERIOD           (u32)20       /* A loop-kill delay to stretch the SRDY pulse out */
 
+/* SRDY pulse timer: waveform mode counting TIMER_CLOCK1 (MCK/2 = 24MHz) up to RC where it stops.  RA and RC give the
+same delay and width as the ANT_SRDY_DELAY and ANT_SRDY_PERIOD loops (ANT_ACTIVITY_LOOP_CYCLES per loop at 48MHz). */
+#define ANT_SRDY_TC_CMR_INIT      (u32)(AT91C_TC_CLKS_TIMER_DIV1_CLOCK | AT91C_TC_CPCSTOP | AT91C_TC_WAVESEL_UP_AUTO | AT91C_TC_WAVE)
+#define ANT_SRDY_TC_RA_INIT       (u32)440      /* SRDY is asserted 18.3us after the trigger */
+#define ANT_SRDY_TC_RC_INIT       (u32)480      /* SRDY is deasserted 1.7us after that and the counter stops */
+#define ANT_SRDY_TC_RC_WIDTH      (u32)(ANT_SRDY_TC_RC_INIT - ANT_SRDY_TC_RA_INIT) /* RC for timing only the pulse width */
+
 #define ANT_TX_TIMEOUT            (u32)100      /* Time in ms max to wait for Tx to ANT */
 
 #if 1
@@ -138,6 +145,7 @@ typedef struct
 /* #### end of default channel configuration parameters ####*/
 
 #define ANT_RX_BUFFER_SIZE                (u16)256
+#define ANT_TX_RESERVED_SLOTS             (u8)4         /* Message pool slots kept for ANT transmit messages */
 
 #define ANT_RESET_WAIT_MS                 (u32)100
 #define ANT_RESTART_DELAY_MS              (u32)1000
@@ -157,6 +165,7 @@ typedef struct
 /* ANT Private Serial-layer Functions */
 static void AntSyncSerialInitialize(void);
 static void AntSrdyPulse(void);
+static void AntSrdyPulseStart(void);
 static void AntRxMessage(void);
 static void AntAbortMessage(void);
 static void AdvanceAntRxBufferCurrentChar(void);
@@ -170,6 +179,7 @@ bool AntTxMessage(u8 *pu8AntTxMessage_);
 u8 AntExpectResponse(u8 u8ExpectedMessageID_, u32 u32TimeoutMS_);
 void AntTxFlowControlCallback(void);
 void AntRxFlowControlCallback(void);
+void ANT_SRDY_IRQHandler(void);
 u8 AntCalculateTxChecksum(u8* pu8Message_);
 bool AntQueueOutgoingMessage(u8 *pu8Message_);
 void AntDeQueueApplicationMessage(void);
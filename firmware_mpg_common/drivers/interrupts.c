@@ -59,6 +59,9 @@ void InterruptSetup(void)
     ((u32*)(AT91C_BASE_NVIC->NVIC_IPR))[i] = au32PriorityConfig[i];
   }
   
+  /* NVIC_SetPriority() shifts the level itself for core exceptions */
+  NVIC_SetPriority(SysTick_IRQn, SYSTICK_PRIORITY);
+  
   /* Disable all interrupts and ensure pending bits are clear */
   for(u8 i = 0; i < SAM3U2_INTERRUPT_SOURCES; i++)
   {
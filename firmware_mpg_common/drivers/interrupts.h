@@ -79,24 +79,22 @@ the AT91SAM3U4 header file and as "Peripheral Identifiers" on page 42 of the 10-
 Interrupt number / peripheral identifier has nothing to do with the corresponding interrupt priority.
 Interrupt priorities are set by loading a priority slot with an interrupt number.
 
-Priority -1 (core exception)
-SysTick
-
 Priority 0
-AT91C_ID_TC0    (22) // Timer Counter 0
+AT91C_ID_TC0    (22) // Timer Counter 0: ANT SRDY pulse (ANT_SRDY_TIMER), must preempt everything below
 AT91C_ID_WDG    ( 4) // WATCHDOG TIMER
 
 Priority 1
+SysTick              // Core exception, set with SYSTICK_PRIORITY
+AT91C_ID_DBGU   ( 8) // DBGU (UART)
+AT91C_ID_US0    (13) // USART 0
+AT91C_ID_US1    (14) // USART 1
 AT91C_ID_US2    (15) // USART 2
+AT91C_ID_TWI0   (18) // TWI 0
+The serial handlers share one level so those that use the message queues cannot preempt each other.
 
 Priority 2
-AT91C_ID_TWI0   (18) // TWI 0
 AT91C_ID_SPI0   (20) // Serial Peripheral Interface
 
-Priority 3
-AT91C_ID_US0    (13) // USART 0
-AT91C_ID_US1    (14) // USART 1
-
 Priority 4
 AT91C_ID_TC1    (23) // Timer Counter 1
 AT91C_ID_TC2    (24) // Timer Counter 2
@@ -110,6 +108,7 @@ All unused interrupt sources will be set to priority 31.
 */
 
 #define PRIORITY_REGISTERS          (u8)8
+#define SYSTICK_PRIORITY            (u32)1      /* SysTick runs below the ANT SRDY pulse timer */
 
 #define IPR0_INIT (u32)0xF0F000F0
 /* Bit Set Description
@@ -197,7 +196,7 @@ All unused interrupt sources will be set to priority 31.
     00 [0] "
 */
 
-#define IPR2_INIT (u32)0x5050F0F0
+#define IPR2_INIT (u32)0x5050F010
 /* Bit Set Description
     31 [0] (11) // Parallel IO Controller B priority 5
     30 [1] "
@@ -229,9 +228,9 @@ All unused interrupt sources will be set to priority 31.
     09 [0] "
     08 [0] "
 
-    07 [1] ( 8) // DBGU priority 15
-    06 [1] "
-    05 [1] "
+    07 [0] ( 8) // DBGU priority 1
+    06 [0] "
+    05 [0] "
     04 [1] "
 
     03 [0] Unimplemented
@@ -240,11 +239,11 @@ All unused interrupt sources will be set to priority 31.
     00 [0] "
 */
 
-#define IPR3_INIT (u32)0xF0303050
+#define IPR3_INIT (u32)0x10101050
 /* Bit Set Description
-    31 [1] (15) // USART 2 priority 15
-    30 [1] "
-    29 [1] "
+    31 [0] (15) // USART 2 priority 1
+    30 [0] "
+    29 [0] "
     28 [1] "
 
     27 [0] Unimplemented
@@ -252,9 +251,9 @@ All unused interrupt sources will be set to priority 31.
     25 [0] "
     24 [0] "
 
-    23 [0] (14) // USART 1 priority 3
+    23 [0] (14) // USART 1 priority 1
     22 [0] "
-    21 [1] "
+    21 [0] "
     20 [1] "
 
     19 [0] Unimplemented
@@ -262,9 +261,9 @@ All unused interrupt sources will be set to priority 31.
     17 [0] "
     16 [0] "
 
-    15 [0] (13) // USART 0 priority 3
+    15 [0] (13) // USART 0 priority 1
     14 [0] "
-    13 [1] "
+    13 [0] "
     12 [1] "
 
     11 [0] Unimplemented
@@ -283,7 +282,7 @@ All unused interrupt sources will be set to priority 31.
     00 [0] "
 */
 
-#define IPR4_INIT (u32)0xF020F0F0
+#define IPR4_INIT (u32)0xF010F0F0
 /* Bit Set Description
     31 [1] (19) // TWI 1 priority 15
     30 [1] "
@@ -295,10 +294,10 @@ All unused interrupt sources will be set to priority 31.
     25 [0] "
     24 [0] "
 
-    23 [0] (18) // TWI 0 priority 2
+    23 [0] (18) // TWI 0 priority 1
     22 [0] "
-    21 [1] "
-    20 [0] "
+    21 [0] "
+    20 [1] "
 
     19 [0] Unimplemented
     18 [0] "
@@ -15,34 +15,141 @@ TYPES
 MessageStateType: enum status of a message in the queue
 EMPTY, WAITING, SENDING, RECEIVING, COMPLETE, TIMEOUT, ABANDONED, NOT_FOUND
 
-MessageType: linked-list style entry with token, size, data pointer and next MessageType pointer
+MessageType: queue entry with token, size, data pointer, owning queue and its index in the pool.
+The data of copied messages is held in a variable-length record in a ring-buffer arena so small messages only use
+the space they need and long messages stay contiguous for a single PDC transfer.
 
-MessageSlot: member of the message queue holding the free/full status of a particular queue location and a pointer to its data
+MessageQueueType: a peripheral's transmit queue.  It is a single-producer / single-consumer ring of pool indices: 
+QueueMessage() (task context) is the only writer of the tail and the peripheral that sends the messages is the only 
+writer of the head, so messages can be added while the peripheral ISR removes them without masking interrupts.
+Each queue also has a slot reservation, a priority class and statistics.
 
-MessageStatus: token, state and timestamp of a message in the queue
+MessageQueueStatsType: counters kept for each queue: rejected messages, pool high-water mark and log2 histograms of 
+the time messages spend WAITING and SENDING.  The counters are updated in the same constant-time paths that change 
+message status so they are always on.  Clients can read them from their peripheral object 
+(e.g. MySsp->sTransmitQueue.sStats.u32Rejected) and a host test can read the struct from its own queues.
+
+MessagePriorityType: MSG_PRIORITY_LOW, MSG_PRIORITY_NORMAL, MSG_PRIORITY_HIGH
+
+MessageStatus: token, state, timestamp and optional finish notification of a message in the queue
+
+MessageNotifyType: a callback and/or an event bit that a client can attach to a message token so it does not have
+to poll QueryMessageStatus()
 
 FUNCTIONS
 Public:
+const MessageQueueType* MessagingGetQueue(u8 u8Index_)
+Returns the u8Index_th queue that has been configured, or NULL past the last one.  Used to list the statistics of 
+every peripheral queue (see the debug "messaging statistics" command).
+
 MessageStateType QueryMessageStatus(u32 u32Token_)
 Queries the current status of the message with u32Token.  If the message has completed or timed out, the query will
-cause the message status to be removed from the status queue.
+cause the message status to be removed from the status queue.  Statuses are stored at (token & STATUS_QUEUE_MASK) 
+so the lookup does not depend on the size of the status queue.
+
+bool SetMessageNotify(u32 u32Token_, MessageNotifyType* psNotify_)
+Attaches a notification to a queued message.  When the message becomes COMPLETE, TIMEOUT or ABANDONED the 
+callback is run and the event bit is set, both from the context that changes the status (usually the peripheral ISR).
+If the message already finished, the notification fires right away.  The status is not cleared by the notification
+so the client can still call QueryMessageStatus().
+e.g.
+static volatile u32 u32MyEvents;
+static MessageNotifyType sMyNotify = {NULL, &u32MyEvents, _MY_EVENT_TX_DONE};
+SetMessageNotify(SspWriteData(MySsp, u32Size, au8Data), &sMyNotify);
+
+bool CancelMessage(u32 u32Token_)
+Stops a message from being sent and sets its status to ABANDONED.  A message that is still WAITING is dropped 
+with every other piece of it if it was split, and the peripheral skips it; if a piece has already started the whole
+message is left alone.  A message that is in progress is only stopped if its peripheral supports it (see pfnAbort); 
+e.g. an SSP master can stop its PDC transfer but a slave cannot since the master is driving the clock.  Returns FALSE 
+if the message cannot be stopped or has already finished.
+e.g. after a response timeout: CancelMessage(u32MyToken);
 
 Protected:
 void MessagingInitialize(void)
 One-time call to start the messaging application.
 
-u32 QueueMessage(MessageType** eTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_)
+u32 QueueMessage(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, u8* pu8MessageData_)
 Adds a message to the correct data queue, assigns a token which is posted to the status queue and returned to the client.
 This function is Protected because tasks that can queue messages should be managed carefully and not granted free reign
-to queue messages.  The message queue is a finite resource with TX_QUEUE_SIZE slots available for messages.
+to queue messages.  The message queue is a finite resource with TX_QUEUE_SIZE slots available for messages
+and MSG_ARENA_SIZE bytes of payload storage.
 We avoid dynamic allocation due to the inherent issues with fragmentation on resource-limited systems.
-
-void DeQueueMessage(MessageType** pTargetQueue_)
+Free slots are tracked in a bitmap and found with CLZ, and the message is written at the queue's ring tail, so
+the cost of queuing does not depend on the pool size or on the queue depth.  A message of up to MSG_MAX_COPIED_LENGTH
+bytes goes in one arena record so the peripheral sends it with one transfer.  It is only split in two when the free 
+arena space is divided between the end and the start of the arena; a split message is queued completely or not at 
+all.  Longer messages are refused and flagged with _MESSAGING_TX_TOO_LONG: send them with QueueMessageNoCopy().
+If the queue has _MSG_QUEUE_COALESCE set and its last message is a copied message that is still WAITING with room 
+for the new data, the data is appended to that message and its token is returned instead of using a new slot, 
+status entry and transfer.  The two writes then share one token (cancelling either cancels both).  The message is
+held with _MESSAGE_STARTED while it grows so a peripheral cannot claim it half written, even from its ISR.
+If the queue has _MSG_QUEUE_BIT_REVERSE set, the bits of every byte are reversed as the data is copied (see 
+ReverseBits()) so an LSB-first peripheral can send the message with its DMA.
+
+u32 QueueMessageNoCopy(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, const u8* pu8MessageData_)
+Same as QueueMessage except the data is not copied: the message points at the caller's memory and the peripheral
+sends straight from it.  The memory must not change until the token is COMPLETE (or the message is otherwise finished),
+so this is meant for constant strings in flash and buffers that the caller does not touch while the message is queued.
+The message is never split so it can be any size.
+
+u32 QueueMessageTransfer(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, const u8* pu8TxData_, u8* pu8RxData_, u8 u8DriverFlags_)
+Same as QueueMessageNoCopy but the message also holds a receive buffer (pu8RxData) for a full-duplex peripheral such 
+as an SSP master, which fills it while the message is clocked out.  pu8TxData_ may be NULL if the peripheral sends 
+filler bytes.  u8DriverFlags_ is put in the _MESSAGE_DRIVER_MASK bits of u8Flags before the message is visible to 
+the peripheral, so a driver can mark how the message is to be handled (e.g. SSP transaction segments).  Only drivers 
+that handle pu8RxData and their own u8Flags bits should use this.
+
+bool MessageQueueConfigure(MessageQueueType* psTargetQueue_, u8 u8Reserved_, MessagePriorityType ePriority_)
+Sets how many Msg_Pool slots are kept for a queue and the priority class used when it borrows from the shared slots.
+Peripheral drivers call this when a client requests the peripheral.  Returns FALSE if the reservation does not fit.
+e.g. a debug port that logs heavily can be MSG_PRIORITY_LOW with no reservation while the LCD and ANT reserve slots 
+and are MSG_PRIORITY_HIGH so their traffic is still accepted when the debug output has filled the shared region.
+
+MessageType* MessageQueuePeek(MessageQueueType* psTargetQueue_)
+Returns the oldest message in a queue (the one to send next, or the one being sent) or NULL if the queue is empty.
+Cancelled messages at the front are released on the way.  Only the peripheral that consumes the queue may call this.
+
+MessageType* MessageQueuePeekNext(MessageQueueType* psTargetQueue_)
+Returns the message after the front one (or NULL) so a peripheral can load it into its PDC "next" registers while the
+front message is still being sent.  Nothing is released; the caller must still claim the message.
+
+bool MessageClaim(MessageType* psMessage_)
+Called by a peripheral just before it starts a message.  It marks the message _MESSAGE_STARTED unless it was cancelled
+first; a started message can no longer be cancelled in place (CancelMessage() and the sweeper use the same atomic
+test), so peripherals may start messages from their ISR while task context cancels them.  It also returns FALSE while
+QueueMessage() is appending to the message; the peripheral tries again later.
+
+void MessageUnclaim(MessageType* psMessage_)
+Gives back a claimed message that never started moving (e.g. one loaded in the PDC "next" registers when the 
+transfer in front of it was aborted) so it is sent later or can be cancelled again.
+
+void DeQueueMessage(MessageQueueType* psTargetQueue_)
 Removes a message from the message queue (typically since all the bytes have been submitted to the communication peripheral
-which is sending the message.  The message status is updated in the status queue.
+which is sending the message.  The message slot is found from its stored pool index.
+
+The pool bitmap and slot counters are updated with LDREX/STREX so slots can be taken in task context and returned
+from any peripheral ISR without disabling interrupts.
 
 void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_)
-Changes the status of a message in the statue queue.
+Changes the status of a message in the statue queue.  This is called from peripheral interrupts so it is constant time.
+
+CLEANING:
+Every MSG_STATUS_CLEANING_TIME the state machine makes an incremental pass over Msg_Pool and Msg_StatusQueue, checking 
+only a few entries each 1ms tick.  WAITING messages older than MSG_STATUS_WAITING_TIME have their status set to 
+TIMEOUT and are marked cancelled unless the peripheral has claimed them; the peripheral releases the slot when it 
+reaches them in its queue.  Messages still 
+SENDING or RECEIVING after MSG_STATUS_SENDING_TIME are set to TIMEOUT and _MESSAGING_SENDING_TIMEOUT is flagged; their 
+slot stays with the peripheral since the PDC may still be using it.  Final statuses that nobody queried are cleared after 
+MSG_STATUS_COMPLETE_TIME (COMPLETE) or MSG_STATUS_TIMEOUT_TIME (TIMEOUT, ABANDONED).
+
+HOST BUILDS:
+This file does not touch any peripheral so it is also compiled on a PC by ../host/Makefile: "make test" runs the 
+regression tests in messaging_test.c (token rollover, split messages, queue full, sweeper, stress) and "make bench" 
+runs messaging_bench.c.  ../host/configuration.h is the stub that stands in for the project configuration.h: it 
+keeps u32 at 32 bits on a 64-bit PC so tokens roll over as on the target, and supplies single-threaded versions of 
+the intrinsics used here (__CLZ, __LDREXB/__STREXB, __LDREXW/__STREXW, __CLREX, __DMB).  The programs include 
+messaging.c directly so they can check the static counters, and advance G_u32SystemTime1ms themselves.
 
 **********************************************************************************************************************/
 
@@ -71,14 +178,34 @@ Variable names shall start with "Msg_" and be declared as static.
 static fnCode_type Messaging_pfnStateMachine;            /* The state machine function pointer */
 static u32 Msg_u32Token;                                 /* Incrementing message token used for all external communications */
 
-static MessageSlot Msg_Pool[TX_QUEUE_SIZE];              /* Array of MessageSlot used for the transmit queue */
-static u8 Msg_u8QueuedMessageCount;                      /* Number of messages slots currently occupied */
+static MessageType Msg_Pool[TX_QUEUE_SIZE];              /* Array of MessageType used for the transmit queue */
+static volatile u32 Msg_au32FreeSlots[MSG_POOL_WORDS];   /* Bitmap of free slots in Msg_Pool: slot n is bit (31 - n % 32) of word n / 32 */
+static volatile u8 Msg_u8QueuedMessageCount;             /* Number of messages slots currently occupied */
+static u8 Msg_u8ReservedSlots;                           /* Sum of the slot reservations of all queues */
+static volatile u8 Msg_u8SharedInUse;                    /* Slots held by queues beyond their reservation */
+
+static MessageQueueType* Msg_apsQueues[MSG_MAX_QUEUES];  /* Queues that have been configured, for statistics */
+static u8 Msg_u8QueueCount;                              /* Number of entries in Msg_apsQueues */
+
+/* Shared slots that a queue of each MessagePriorityType must leave free */
+static const u8 Msg_au8SharedHeadroom[] = {MSG_SHARED_HEADROOM_LOW, MSG_SHARED_HEADROOM_NORMAL, 0};
+
+/* Payloads of copied messages are stored in the arena as records: one header word (size in words including the header 
+and the _MSG_ARENA_RECORD_FREE flag) followed by the data.  Records are taken at Msg_u16ArenaHead and reclaimed in 
+order from Msg_u16ArenaTail once they are marked free.  Only task context (QueueMessage) moves the head and tail;
+freeing a record from an ISR just sets its free flag. */
+static u32 Msg_au32Arena[MSG_ARENA_WORDS];               /* Payload storage for copied messages */
+static u16 Msg_u16ArenaHead;                             /* Word index where the next record will be written */
+static u16 Msg_u16ArenaTail;                             /* Word index of the oldest record not yet reclaimed */
+
+static u8 Msg_u8SweepSlot;                               /* Next Msg_Pool slot to check in the current cleaning pass */
+static u16 Msg_u16SweepStatus;                           /* Next Msg_StatusQueue entry to check in the current cleaning pass */
 
 /* A separate status queue needs to be maintained since the message information in Msg_Pool will be lost when the message
 has been dequeued.  Applications must be able to query to determine the status of their message, particularly if
-it has been sent. */
+it has been sent.  A message's status lives at index (token & STATUS_QUEUE_MASK); since tokens are handed out in 
+order, the entry is reused by the token STATUS_QUEUE_SIZE later and the stored token tells which one is there. */
 static MessageStatus Msg_StatusQueue[STATUS_QUEUE_SIZE]; /* Array of MessageStatus used to monitor message status */
-static MessageStatus* Msg_pNextStatus;                   /* Pointer to next available message status */
 
 
 /**********************************************************************************************************************
@@ -93,40 +220,34 @@ Function Definitions
 Function: QueryMessageStatus()
 
 Description:
-Checks the state of a message.  If the state is COMPLETE or TIMEOUT, the status is deleted from the message queue.
-Since the queue is quite short, most of the time it will hold very little entires.  New entries are always filled at the front,
-using a simple linear search starting at index 0.
+Checks the state of a message.  If the state is COMPLETE, TIMEOUT or ABANDONED, the status is deleted from the 
+message queue.
+The status entry is found directly from the token; the token stored in the entry is the generation check that 
+makes sure the entry has not since been reused by a newer message.
 
 Requires:
   - u32Token_ is the token of the message of interest
 
 Promises:
   - Returns MessageStateType indicating the status of the message
-  - if the message is found in COMPLETE or TIMEOUT state, the status is removed from the queue
+  - if the message is found in COMPLETE, TIMEOUT or ABANDONED state, the status is removed from the queue
 */
 MessageStateType QueryMessageStatus(u32 u32Token_)
 {
-  MessageStateType eStatus   = NOT_FOUND;
-  MessageStatus* pListParser = &Msg_StatusQueue[0];
+  MessageStateType eStatus = NOT_FOUND;
+  MessageStatus* psStatus  = &Msg_StatusQueue[u32Token_ & STATUS_QUEUE_MASK];
   
-  /* Brute force search for the token - the queue will never be large enough on this system to require a more
-  intelligent search algorithm */
-  while( (pListParser->u32Token != u32Token_) && (pListParser != &Msg_StatusQueue[STATUS_QUEUE_SIZE]) )
-  {
-    pListParser++;
-  }
-
-  /* If the token was found pListParser is pointing at it, take appropriate action */
-  if(pListParser != &Msg_StatusQueue[STATUS_QUEUE_SIZE])
+  /* If the entry still belongs to the token, take appropriate action */
+  if(psStatus->u32Token == u32Token_)
   {
     /* Save the status */
-    eStatus = pListParser->eState;
+    eStatus = psStatus->eState;
 
     /* Release the slot if the message state is final (the client must deal with it now) */
-    if( (eStatus == COMPLETE) || (eStatus == TIMEOUT) )
+    if( (eStatus == COMPLETE) || (eStatus == TIMEOUT) || (eStatus == ABANDONED) )
     {
-      pListParser->u32Token = 0;
-      pListParser->eState = EMPTY;
+      psStatus->u32Token = 0;
+      psStatus->eState = EMPTY;
     }
   }
 
@@ -135,6 +256,205 @@ MessageStateType QueryMessageStatus(u32 u32Token_)
 } /* end QueryMessageStatus() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SetMessageNotify()
+
+Description:
+Attaches a notification to a message so the client is told as soon as the message finishes instead of polling.
+
+Requires:
+  - u32Token_ is the token of a message returned by a driver write function
+  - psNotify_ points to a notification owned by the client that stays valid until it fires;
+    fnCallback must be short since it typically runs in an interrupt
+
+Promises:
+  - Returns TRUE and stores psNotify_ with the message status if the message is still in progress
+  - Returns TRUE and fires psNotify_ immediately if the message has already finished
+  - Returns FALSE if the token is not in the status queue
+*/
+bool SetMessageNotify(u32 u32Token_, MessageNotifyType* psNotify_)
+{
+  MessageStatus* psStatus = &Msg_StatusQueue[u32Token_ & STATUS_QUEUE_MASK];
+  MessageNotifyType* psNotify;
+  
+  if( (u32Token_ == 0) || (psStatus->u32Token != u32Token_) )
+  {
+    return(FALSE);
+  }
+  
+  /* Arm the notification first so a status change from an interrupt right now cannot be missed */
+  MessageArmNotify(psStatus, psNotify_);
+  
+  if( (psStatus->eState == COMPLETE) || (psStatus->eState == TIMEOUT) || (psStatus->eState == ABANDONED) )
+  {
+    /* Only fire if the interrupt did not already take the notification */
+    psNotify = MessageTakeNotify(psStatus);
+    if(psNotify != NULL)
+    {
+      MessageNotify(psNotify);
+    }
+  }
+  
+  return(TRUE);
+  
+} /* end SetMessageNotify() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: CancelMessage()
+
+Description:
+Stops a message that is no longer wanted so the peripheral does not spend bus time on it.
+A WAITING message is found in its queue and cancelled together with the other pieces of the same split message.
+The pieces are first held one by one, in queue order, with the same atomic test as MessageClaim() so the peripheral 
+cannot start any of them while the rest are cancelled; a split message is therefore dropped completely or not at 
+all and never goes out in part.  A message that is being sent is handed to the peripheral's pfnAbort function.
+
+Requires:
+  - Called from task context; a peripheral may claim a WAITING message from its ISR at any time and from then on
+    the message is handled as in progress
+  - u32Token_ is the token of a message returned by a driver write function
+
+Promises:
+  - Returns TRUE if the message will not be sent (any further) and the status of each of its pieces is ABANDONED
+  - Returns FALSE if the token is unknown, the message already finished, the peripheral cannot stop it, or another 
+    piece of a split message has already started (the message is then left as it was)
+*/
+bool CancelMessage(u32 u32Token_)
+{
+  MessageStatus* psStatus = &Msg_StatusQueue[u32Token_ & STATUS_QUEUE_MASK];
+  MessageQueueType* psQueue;
+  MessageType* psMessage;
+  u8 u8Position;
+  u8 u8FirstPiece;
+  u8 u8LastPiece;
+  u8 u8Held;
+  u8 u8Tail;
+  bool bFound = FALSE;
+  
+  if( (u32Token_ == 0) || (psStatus->u32Token != u32Token_) )
+  {
+    return(FALSE);
+  }
+  
+  psQueue = psStatus->psQueue;
+  
+  /* A message that has not started is cancelled in place along with the rest of its split message */
+  if(psStatus->eState == WAITING)
+  {
+    u8Position   = psQueue->u8Head;
+    u8FirstPiece = u8Position;
+    u8Tail       = psQueue->u8Tail;
+    
+    /* Find the pieces from the first one to the one without _MESSAGE_SPLIT */
+    while(u8Position != u8Tail)
+    {
+      psMessage = &Msg_Pool[psQueue->au8Ring[u8Position & MSG_QUEUE_RING_MASK]];
+      u8Position++;
+      
+      if(psMessage->u32Token == u32Token_)
+      {
+        bFound = TRUE;
+        break;
+      }
+      
+      /* A new message starts after the last piece of a split message */
+      if( !(psMessage->u8Flags & _MESSAGE_SPLIT) )
+      {
+        u8FirstPiece = u8Position;
+      }
+    }
+    
+    if(!bFound)
+    {
+      return(FALSE);
+    }
+    
+    while( (psMessage->u8Flags & _MESSAGE_SPLIT) && (u8Position != u8Tail) )
+    {
+      psMessage = &Msg_Pool[psQueue->au8Ring[u8Position & MSG_QUEUE_RING_MASK]];
+      u8Position++;
+    }
+    u8LastPiece = u8Position;
+    
+    /* Hold every piece so the peripheral cannot start one of them while the others are cancelled */
+    for(u8Position = u8FirstPiece; u8Position != u8LastPiece; u8Position++)
+    {
+      psMessage = &Msg_Pool[psQueue->au8Ring[u8Position & MSG_QUEUE_RING_MASK]];
+      if( !MessageAtomicSetFlag(&psMessage->u8Flags, _MESSAGE_STARTED, _MESSAGE_STARTED | _MESSAGE_CANCELLED) )
+      {
+        break;
+      }
+    }
+    
+    /* All held: nothing but this function changes their flags now, so they are cancelled with plain writes */
+    if(u8Position == u8LastPiece)
+    {
+      for(u8Position = u8FirstPiece; u8Position != u8LastPiece; u8Position++)
+      {
+        psMessage = &Msg_Pool[psQueue->au8Ring[u8Position & MSG_QUEUE_RING_MASK]];
+        psMessage->u8Flags = (psMessage->u8Flags & ~_MESSAGE_STARTED) | _MESSAGE_CANCELLED;
+        UpdateMessageStatus(psMessage->u32Token, ABANDONED);
+      }
+      
+      return(TRUE);
+    }
+    
+    /* A piece was started (or cancelled) first: give back the holds so the message carries on as it was */
+    u8Held = u8Position;
+    for(u8Position = u8FirstPiece; u8Position != u8Held; u8Position++)
+    {
+      Msg_Pool[psQueue->au8Ring[u8Position & MSG_QUEUE_RING_MASK]].u8Flags &= ~_MESSAGE_STARTED;
+    }
+    
+    /* Only a message in one piece that the peripheral claimed just now is handled as in progress below; aborting 
+    one piece of a split message would still send the rest */
+    if( (u8LastPiece != (u8)(u8FirstPiece + 1)) || (psStatus->eState == WAITING) )
+    {
+      return(FALSE);
+    }
+  }
+  
+  /* Anything else can only be stopped if it is the message the peripheral is working on */
+  if( (psStatus->eState == SENDING) || (psStatus->eState == RECEIVING) || (psStatus->eState == TIMEOUT) )
+  {
+    u8Position = psQueue->u8Head;
+    if( (u8Position != psQueue->u8Tail) && (psQueue->pfnAbort != NULL) &&
+        (Msg_Pool[psQueue->au8Ring[u8Position & MSG_QUEUE_RING_MASK]].u32Token == u32Token_) )
+    {
+      return( psQueue->pfnAbort(psQueue) );
+    }
+  }
+  
+  return(FALSE);
+  
+} /* end CancelMessage() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessagingGetQueue()
+
+Description:
+Returns one of the queues that have been set up with MessageQueueConfigure() so its statistics can be read.
+
+Requires:
+  - u8Index_ counts from 0
+
+Promises:
+  - Returns a pointer to the queue if u8Index_ is less than the number of configured queues; otherwise NULL
+*/
+const MessageQueueType* MessagingGetQueue(u8 u8Index_)
+{
+  if(u8Index_ >= Msg_u8QueueCount)
+  {
+    return(NULL);
+  }
+  
+  return(Msg_apsQueues[u8Index_]);
+  
+} /* end MessagingGetQueue() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Protected Functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -144,114 +464,136 @@ Function: QueueMessage
 
 Description:
 Allocates one of the positions in the message queue to the calling function's send queue.
+A message takes one slot and one arena record unless the arena's free space is split by its end, in which case the
+message is split there too (see MessageArenaPieceSize()).  All the pieces are allocated before any of them is
+published so a message is either queued completely or not at all.
+On a _MSG_QUEUE_COALESCE queue a message that fits in the last queued message is appended to it instead.
 
 Requires:
-  - eTargetTxBuffer_ is the peripheral transmit buffer where the message will be queued
-  - u32MessageSize_ is the size of the message data array in bytes
+  - psTargetQueue_ is the peripheral transmit queue where the message will be queued
+  - u32MessageSize_ is the size of the message data array in bytes, at most MSG_MAX_COPIED_LENGTH
   - pu8MessageData_ points to the message data array
   - Msg_Pool should not be full 
 
 Promises:
-  - The message is inserted into the target list and assigned a token
-  - If the message is created successfully, the message token is returned; otherwise, NULL is returned
+  - The message is inserted at the tail of the target queue and assigned a token (one token per piece)
+  - If the message is created successfully, the token of the last piece is returned; otherwise, NULL is returned
+    and nothing is queued
+  - A message of 0 bytes returns NULL without touching the statistics or flags; a message longer than 
+    MSG_MAX_COPIED_LENGTH also sets _MESSAGING_TX_TOO_LONG, and one that does not fit now is counted in u32Rejected
+    and sets _MESSAGING_TX_QUEUE_FULL
+  - If the message was appended to the last queued message, that message's token is returned
 */
-u32 QueueMessage(MessageType** eTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_)
+u32 QueueMessage(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, u8* pu8MessageData_)
 {
-  MessageSlot *psSlotParser;
   MessageType *psNewMessage;
-  MessageType *psListParser;
+  u8 au8Pieces[TX_QUEUE_SIZE];
+  u8 u8PieceCount = 0;
   u32 u32BytesRemaining = u32MessageSize_;
   u32 u32CurrentMessageSize = 0;
+  u32 u32Token;
+  
+  /* Nothing to send */
+  if(u32MessageSize_ == 0)
+  {
+    return(0);
+  }
+  
+  /* A message longer than the whole arena can never be queued */
+  if(u32MessageSize_ > MSG_MAX_COPIED_LENGTH)
+  {
+    G_u32MessagingFlags |= _MESSAGING_TX_TOO_LONG;
+    return(0);
+  }
+  
+  /* Small messages can ride along with the last message if it has not started */
+  u32Token = MessageQueueAppend(psTargetQueue_, u32MessageSize_, pu8MessageData_);
+  if(u32Token != 0)
+  {
+    return(u32Token);
+  }
   
   /* Check for available space in the message pool */
   if(Msg_u8QueuedMessageCount == TX_QUEUE_SIZE)
   {
+    psTargetQueue_->sStats.u32Rejected++;
     G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_FULL;
     return(0);
   }
 
-  /* Space available, so proceed with allocation.  Though only one message is queued at a time, we
-  use a while loop to handle messages that are too big and must be split into different slots.  The slots
-  are always sequential and the message processor will send the bytes continuously across slots */
+  /* Space available, so proceed with allocation.  A message is only split where the arena's free space is.  
+  The slots are always sequential in the queue and the message processor will send the bytes continuously across slots */
   while(u32BytesRemaining)
   {
-    Msg_u8QueuedMessageCount++;
+    u32CurrentMessageSize = MessageArenaPieceSize(u32BytesRemaining);
     
-    /* Flag if we're above the high watermark */
-    if(Msg_u8QueuedMessageCount >= TX_QUEUE_WATERMARK)
+    /* Grab a free slot and the payload space */
+    psNewMessage = MessagePoolAllocate(psTargetQueue_);
+    if(psNewMessage != NULL)
     {
-      G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_ALMOST_FULL;
-    }
-    else
-    {
-      G_u32MessagingFlags &= ~_MESSAGING_TX_QUEUE_ALMOST_FULL;
-    }
-    
-    /* Find an empty slot: this is non-circular and there must be at least one free slot if we're here */
-    psSlotParser = &Msg_Pool[0];
-    while(!psSlotParser->bFree)
-    {
-      psSlotParser++;
+      psNewMessage->pu8Message = MessageArenaAllocate(u32CurrentMessageSize, &psNewMessage->u16ArenaRecord);
+      if(psNewMessage->pu8Message == NULL)
+      {
+        /* No arena record to release, so give back only the slot */
+        psNewMessage->u8Flags |= _MESSAGE_NO_COPY;
+        MessagePoolFree(psNewMessage);
+        psNewMessage = NULL;
+      }
     }
     
-    /* Allocate the slot and set the message pointer */
-    psSlotParser->bFree = FALSE;
-    psNewMessage = &(psSlotParser->Message);
-  
-    /* Check the message size and split the message up if necessary */
-    if(u32BytesRemaining > MAX_TX_MESSAGE_LENGTH)
-    {
-      u32CurrentMessageSize = MAX_TX_MESSAGE_LENGTH;
-      u32BytesRemaining -= MAX_TX_MESSAGE_LENGTH;
-    }
-    else
+    /* Give back any pieces already taken so a partial message is never sent */
+    if(psNewMessage == NULL)
     {
-      u32CurrentMessageSize = u32BytesRemaining;
-      u32BytesRemaining = 0;
+      while(u8PieceCount)
+      {
+        MessagePoolFree(&Msg_Pool[au8Pieces[--u8PieceCount]]);
+      }
+      
+      psTargetQueue_->sStats.u32Rejected++;
+      G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_FULL;
+      return(0);
     }
     
     /* Copy all the data to the allocated message structure */
-    psNewMessage->u32Token      = Msg_u32Token;
-    psNewMessage->u32Size       = u32CurrentMessageSize;
-    psNewMessage->psNextMessage = NULL;
+    psNewMessage->u32Size = u32CurrentMessageSize;
+    MessageCopyData(psTargetQueue_, psNewMessage->pu8Message, pu8MessageData_, u32CurrentMessageSize);
+    pu8MessageData_ += u32CurrentMessageSize;
     
-    /* Add the data into the payload */
-    for(u32 i = 0; i < psNewMessage->u32Size; i++)
-    {
-      *(psNewMessage->pu8Message + i) = *pu8MessageData_++;
-    }
+    au8Pieces[u8PieceCount++] = psNewMessage->u8PoolIndex;
+    u32BytesRemaining -= u32CurrentMessageSize;
+  } /* end while */
+    
+  /* Flag if we're above the high watermark */
+  if(Msg_u8QueuedMessageCount >= TX_QUEUE_WATERMARK)
+  {
+    G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_ALMOST_FULL;
+  }
+  else
+  {
+    G_u32MessagingFlags &= ~_MESSAGING_TX_QUEUE_ALMOST_FULL;
+  }
   
-    /* Link the new message into the client's transmit buffer */
-    /* Handle an empty list */
-    if(*eTargetTxBuffer_ == NULL)
-    {
-      *eTargetTxBuffer_ = psNewMessage;
-    }
-
-    /* Add the message to the end of the list */
-    else
+  /* Assign the tokens and publish the pieces in order */
+  for(u8 i = 0; i < u8PieceCount; i++)
+  {
+    psNewMessage = &Msg_Pool[au8Pieces[i]];
+    psNewMessage->u32Token = Msg_u32Token;
+    psNewMessage->u32Timestamp = G_u32SystemTime1ms;
+    if(i != (u8PieceCount - 1))
     {
-      /* Find the last node */
-      psListParser =  *eTargetTxBuffer_;
-      while(psListParser->psNextMessage != NULL)
-      {
-        psListParser = psListParser->psNextMessage;
-      }
-     
-      /* Found the end: add the new node */
-      psListParser->psNextMessage = psNewMessage;
+      psNewMessage->u8Flags |= _MESSAGE_SPLIT;
     }
   
-    /* Update the Public status of the message in the status queue */
-    AddNewMessageStatus(Msg_u32Token);
+    /* Post the status first so it is in place when the peripheral picks up the message, then publish it */
+    AddNewMessageStatus(Msg_u32Token, psTargetQueue_);
+    MessageQueuePush(psTargetQueue_, psNewMessage);
   
     /* Increment message token and catch the rollover every 4 billion messages... Token 0 is not allowed. */
     if(++Msg_u32Token == 0)
     {
       Msg_u32Token = 1;
     }
-  
-  } /* end while */
+  }
 
   /* Return only the current (and highest) message token, as it will be the last portion to be sent if the message was split up */
   return(psNewMessage->u32Token);
@@ -260,188 +602,1293 @@ u32 QueueMessage(MessageType** eTargetTxBuffer_, u32 u32MessageSize_, u8* pu8Mes
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-Function: DeQueueMessage
+Function: QueueMessageNoCopy
 
 Description:
-Removes a message from a message queue and adds it back to the pool.
+Allocates one of the positions in the message queue to the calling function's send queue but leaves the data
+where it is.  The peripheral will send directly from pu8MessageData_.
 
 Requires:
-  - pTargetQueue_ points to the list queue where the message to be deleted is located
-  - pTargetQueue_ is a FIFO linked-list where the message that needs to be killed is at the front of the list
-  - The message to be removed has been completely sent and is no longer in use
-  - New message cannot be added into the list during this function (via interrupts)
+  - psTargetQueue_ is the peripheral transmit queue where the message will be queued
+  - u32MessageSize_ is the size of the message data array in bytes
+  - pu8MessageData_ points to the message data array which may be in flash; if it is in RAM, the caller
+    must not change it until the returned token is no longer WAITING or SENDING
+  - Msg_Pool should not be full 
 
 Promises:
-  - The first message in the list is deleted; the list is hooked back up
-  - The message space is added back to the available message queue
+  - The message is inserted at the tail of the target queue as a single message (never split) and assigned a token
+  - If the message is created successfully, the message token is returned; otherwise, NULL is returned
 */
-void DeQueueMessage(MessageType** pTargetQueue_)
+u32 QueueMessageNoCopy(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, const u8* pu8MessageData_)
 {
-  MessageSlot *psSlotParser;
-      
-  /* Make sure there is a message to kill */
-  if(*pTargetQueue_ == NULL)
-  {
-    G_u32MessagingFlags |= _DEQUEUE_GOT_NULL;
-    return;
-  }
-  
-  /* Find the message's slot: this message pool is non-circular and the message must be one of the slots */
-  psSlotParser = &Msg_Pool[0];
-  while( (&psSlotParser->Message != *pTargetQueue_) && (psSlotParser != &Msg_Pool[TX_QUEUE_SIZE]) )
-  {
-    psSlotParser++;
-  }
-
-  /* Make sure the message has been found */
-  if(psSlotParser == &Msg_Pool[TX_QUEUE_SIZE])
-  {
-    G_u32MessagingFlags |= _DEQUEUE_MSG_NOT_FOUND;
-    return;
-  }
-
-  /* Unhook the message from the current owner's queue and put it back in the pool */
-  *pTargetQueue_ = (*pTargetQueue_)->psNextMessage;
-  psSlotParser->bFree = TRUE;
-  Msg_u8QueuedMessageCount--;
+  return( QueueMessageTransfer(psTargetQueue_, u32MessageSize_, pu8MessageData_, NULL, 0) );
   
-} /* end DeQueueMessage() */
+} /* end QueueMessageNoCopy() */
 
 
-/*--------------------------------------------------------------------------------------------------------------------
-Function: MessagingInitialize
+/*----------------------------------------------------------------------------------------------------------------------
+Function: QueueMessageTransfer
 
 Description:
-Initializes the State Machine and its variables.
+Queues a full-duplex transfer: like QueueMessageNoCopy() the transmit data is left where it is, and the message also
+carries the address where the peripheral puts the bytes it receives while the message is clocked out.
 
 Requires:
-  - No messaging in progress
+  - psTargetQueue_ is the transmit queue of a peripheral that supports receive buffers in messages (see pu8RxData)
+  - u32MessageSize_ is the number of bytes to transmit and receive
+  - pu8TxData_ points to the data to send (it may be in flash) or is NULL if the peripheral should send its own 
+    filler bytes; if it is in RAM, the caller must not change it until the returned token is no longer WAITING, 
+    SENDING or RECEIVING
+  - pu8RxData_ has room for u32MessageSize_ bytes and is left alone by the caller until the token has finished, or 
+    is NULL for a message that only transmits
+  - u8DriverFlags_ only uses _MESSAGE_DRIVER_MASK bits; their meaning belongs to the peripheral driver
 
 Promises:
-  - Message queues are zeroed
-  - Flags and state machine are initialized
+  - The message is inserted at the tail of the target queue as a single message (never split) and assigned a token
+  - If the message is created successfully, the message token is returned; otherwise, NULL is returned
 */
-void MessagingInitialize(void)
+u32 QueueMessageTransfer(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, const u8* pu8TxData_, u8* pu8RxData_, u8 u8DriverFlags_)
 {
-  /* Inititalize variables */
-  Msg_u8QueuedMessageCount = 0;
-  Msg_u32Token = 1;
-
-  /* Ensure all message slots are deallocated and the message status queue is empty */
-  for(u16 i = 0; i < TX_QUEUE_SIZE; i++)
+  MessageType *psNewMessage;
+  u32 u32Token;
+  
+  /* Grab a free slot */
+  psNewMessage = MessagePoolAllocate(psTargetQueue_);
+  if(psNewMessage == NULL)
   {
-    Msg_Pool[i].bFree = TRUE;
+    psTargetQueue_->sStats.u32Rejected++;
+    G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_FULL;
+    return(0);
   }
-
-  for(u16 i = 0; i < STATUS_QUEUE_SIZE; i++)
+  
+  /* Flag if we're above the high watermark */
+  if(Msg_u8QueuedMessageCount >= TX_QUEUE_WATERMARK)
   {
-    Msg_StatusQueue[i].u32Token = 0;
-    Msg_StatusQueue[i].eState = EMPTY;
-    Msg_StatusQueue[i].u32Timestamp = 0;
+    G_u32MessagingFlags |= _MESSAGING_TX_QUEUE_ALMOST_FULL;
+  }
+  else
+  {
+    G_u32MessagingFlags &= ~_MESSAGING_TX_QUEUE_ALMOST_FULL;
   }
 
-  Msg_pNextStatus = &Msg_StatusQueue[0];
-
-  G_u32MessagingFlags = 0;
-  Messaging_pfnStateMachine = MessagingIdle;
-
-} /* end MessagingInitialize() */
+  /* Point the message at the caller's data */
+  psNewMessage->u32Token      = Msg_u32Token;
+  psNewMessage->u32Timestamp  = G_u32SystemTime1ms;
+  psNewMessage->u32Size       = u32MessageSize_;
+  psNewMessage->pu8Message    = (u8*)pu8TxData_;
+  psNewMessage->pu8RxData     = pu8RxData_;
+  psNewMessage->u8Flags      |= _MESSAGE_NO_COPY | (u8DriverFlags_ & _MESSAGE_DRIVER_MASK);
+  
+  /* Post the status, publish the message at the end of the client's transmit queue and advance the token */
+  AddNewMessageStatus(Msg_u32Token, psTargetQueue_);
+  MessageQueuePush(psTargetQueue_, psNewMessage);
+  u32Token = Msg_u32Token;
+  
+  if(++Msg_u32Token == 0)
+  {
+    Msg_u32Token = 1;
+  }
+  
+  return(u32Token);
+  
+} /* end QueueMessageTransfer() */
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-Function MessagingRunActiveState()
+Function: MessageQueuePeek
 
 Description:
-Selects and runs one iteration of the current state in the state machine.
-All state machines have a TOTAL of 1ms to execute, so on average n state machines
-may take 1ms / n to execute.
+Returns the message at the front of a queue.  Messages that were cancelled while waiting are released here since
+the consumer is the only one allowed to move the head of the queue.
 
 Requires:
-  - State machine function pointer points at current state
+  - Called only by the consumer of psTargetQueue_ (the peripheral sending its messages)
 
 Promises:
-  - Calls the function to pointed by the state machine function pointer
+  - Cancelled messages at the front of the queue are removed and their slots released
+  - Returns a pointer to the oldest message that is not cancelled, or NULL if there is none
 */
-void MessagingRunActiveState(void)
+MessageType* MessageQueuePeek(MessageQueueType* psTargetQueue_)
 {
-  Messaging_pfnStateMachine();
-
-} /* end MessagingRunActiveState */
+  MessageType* psMessage;
+  u8 u8Head = psTargetQueue_->u8Head;
+  
+  while(u8Head != psTargetQueue_->u8Tail)
+  {
+    /* Read the ring entry only after the tail that published it */
+    __DMB();
+    psMessage = &Msg_Pool[psTargetQueue_->au8Ring[u8Head & MSG_QUEUE_RING_MASK]];
+    if( !(psMessage->u8Flags & _MESSAGE_CANCELLED) )
+    {
+      return(psMessage);
+    }
+    
+    /* Hand the ring position back before the slot so the pool can never hold more than the ring */
+    psTargetQueue_->u8Head = ++u8Head;
+    MessagePoolFree(psMessage);
+  }
+  
+  return(NULL);
+  
+} /* end MessageQueuePeek() */
 
 
 /*----------------------------------------------------------------------------------------------------------------------
-Function: UpdateMessageStatus()
+Function: MessageQueuePeekNext
 
 Description:
-Changes the status of a message in the statue queue.
+Returns the message behind the front of a queue so a peripheral can chain it after the one it is sending.
 
 Requires:
-  - u32Token_ is message that should be in the status queue
-  - eNewState_ is the desired status setting for the message
+  - Called only by the consumer of psTargetQueue_ 
+  - The front message was returned by MessageQueuePeek() and has been claimed
 
 Promises:
-  - eState of the message is set to eNewState_
+  - Returns a pointer to the second message in the queue, or NULL if there is none.  The message may have been 
+    cancelled; MessageClaim() tells the caller if it can be used.
 */
-void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_)
+MessageType* MessageQueuePeekNext(MessageQueueType* psTargetQueue_)
 {
-  MessageStatus* pListParser = &Msg_StatusQueue[0];
+  u8 u8Head = psTargetQueue_->u8Head;
   
-  /* Search for the token */
-  while( (pListParser->u32Token != u32Token_) && (pListParser != &Msg_StatusQueue[STATUS_QUEUE_SIZE]) )
-  {
-    pListParser++;
-  }
-
-  /* If the token was found, change the status */
-  if(pListParser != &Msg_StatusQueue[STATUS_QUEUE_SIZE])
+  if( (u8)(psTargetQueue_->u8Tail - u8Head) < 2 )
   {
-    pListParser->eState = eNewState_;
+    return(NULL);
   }
   
-} /* end UpdateMessageStatus() */
-
+  /* Read the ring entry only after the tail that published it */
+  __DMB();
+  return( &Msg_Pool[psTargetQueue_->au8Ring[(u8)(u8Head + 1) & MSG_QUEUE_RING_MASK]] );
+  
+} /* end MessageQueuePeekNext() */
 
-/*--------------------------------------------------------------------------------------------------------------------*/
-/* Private functions */
-/*--------------------------------------------------------------------------------------------------------------------*/
 
 /*----------------------------------------------------------------------------------------------------------------------
-Function: AddNewMessageStatus()
+Function: MessageClaim
 
 Description:
-Adds a new mesage into the status queue.  Due to the tendancy of applications to forget that they wrote
-a message here, this buffer is circular and will overwite the oldest message if it needs space for a 
-new message.
+Takes ownership of a queued message for its peripheral just before the transfer starts.  After this the message 
+can only be stopped through the queue's pfnAbort function.
 
 Requires:
-  - u32Token_ is the message of interest
+  - Called only by the consumer of the message's queue (task or interrupt context)
+  - psMessage_ was returned by MessageQueuePeek() or MessageQueuePeekNext() and has not been claimed yet
 
 Promises:
-  - A new status is created indexed by u32Token_
+  - If the message has not been cancelled and is not held by MessageQueueAppend(), _MESSAGE_STARTED is set and TRUE 
+    is returned
+  - Otherwise returns FALSE: a cancelled message is released by the next MessageQueuePeek() that reaches it and a 
+    message being appended to can be claimed once QueueMessage() returns
 */
-static void AddNewMessageStatus(u32 u32Token_)
+bool MessageClaim(MessageType* psMessage_)
 {
-  /* Install the new message message */
-  Msg_pNextStatus->u32Token = u32Token_;
-  Msg_pNextStatus->eState = WAITING;
-  Msg_pNextStatus->u32Timestamp = G_u32SystemTime1ms;
+  return( MessageAtomicSetFlag(&psMessage_->u8Flags, _MESSAGE_STARTED, _MESSAGE_CANCELLED | _MESSAGE_STARTED) );
   
-  /* Safely advance the pointer */
-  Msg_pNextStatus++;
-  if(Msg_pNextStatus == &Msg_StatusQueue[STATUS_QUEUE_SIZE])
-  {
-    Msg_pNextStatus = &Msg_StatusQueue[0];
-  }
-  
-} /* end AddNewMessageStatus() */
+} /* end MessageClaim() */
 
 
-/**********************************************************************************************************************
-State Machine Function Definitions
-**********************************************************************************************************************/
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageUnclaim
+
+Description:
+Returns a claimed message to the WAITING messages of its queue.
+
+Requires:
+  - Called from task context by the consumer of the message's queue with its interrupt disabled, so nothing else 
+    changes u8Flags at the same time
+  - psMessage_ was claimed with MessageClaim() but none of it has been transferred and its status is still WAITING
+
+Promises:
+  - _MESSAGE_STARTED is cleared 
+*/
+void MessageUnclaim(MessageType* psMessage_)
+{
+  psMessage_->u8Flags &= ~_MESSAGE_STARTED;
+  
+} /* end MessageUnclaim() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: DeQueueMessage
+
+Description:
+Removes a message from a message queue and adds it back to the pool.
+
+Requires:
+  - psTargetQueue_ points to the queue where the message to be deleted is located
+  - The message that needs to be killed is at the front of the queue (as returned by MessageQueuePeek())
+  - The message to be removed has been completely sent and is no longer in use
+  - Called only by the consumer of psTargetQueue_; the producer may add messages at the same time
+
+Promises:
+  - The first message in the queue is removed
+  - The message space is added back to the available message queue
+*/
+void DeQueueMessage(MessageQueueType* psTargetQueue_)
+{
+  MessageType *psMessage;
+  u8 u8Head = psTargetQueue_->u8Head;
+      
+  /* Make sure there is a message to kill */
+  if(u8Head == psTargetQueue_->u8Tail)
+  {
+    G_u32MessagingFlags |= _DEQUEUE_GOT_NULL;
+    return;
+  }
+  
+  /* Make sure the ring entry actually belongs to the pool */
+  __DMB();
+  if(psTargetQueue_->au8Ring[u8Head & MSG_QUEUE_RING_MASK] >= TX_QUEUE_SIZE)
+  {
+    G_u32MessagingFlags |= _DEQUEUE_MSG_NOT_FOUND;
+    return;
+  }
+  psMessage = &Msg_Pool[psTargetQueue_->au8Ring[u8Head & MSG_QUEUE_RING_MASK]];
+
+  /* Move the head past the message and put it back in the pool */
+  psTargetQueue_->u8Head = u8Head + 1;
+  MessagePoolFree(psMessage);
+  
+} /* end DeQueueMessage() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageQueueConfigure
+
+Description:
+Sets the slot reservation and priority class of a transmit queue.
+
+Requires:
+  - psTargetQueue_ is a peripheral transmit queue with no messages in it
+  - u8Reserved_ is the number of Msg_Pool slots that only this queue may use (0 for none)
+  - ePriority_ is the class used when the queue needs more than its reserved slots
+
+Promises:
+  - If the total of all reservations stays within MSG_POOL_MAX_RESERVED, the queue takes the new reservation and 
+    priority, its statistics are cleared and TRUE is returned
+  - The queue is added to the list returned by MessagingGetQueue() the first time it is configured (if there is room)
+  - Otherwise the queue is unchanged, _MESSAGING_RESERVE_FAILED is set and FALSE is returned
+*/
+bool MessageQueueConfigure(MessageQueueType* psTargetQueue_, u8 u8Reserved_, MessagePriorityType ePriority_)
+{
+  bool bListed = FALSE;
+  
+  if( (Msg_u8ReservedSlots - psTargetQueue_->u8Reserved + u8Reserved_) > MSG_POOL_MAX_RESERVED )
+  {
+    G_u32MessagingFlags |= _MESSAGING_RESERVE_FAILED;
+    return(FALSE);
+  }
+  
+  Msg_u8ReservedSlots -= psTargetQueue_->u8Reserved;
+  Msg_u8ReservedSlots += u8Reserved_;
+  
+  psTargetQueue_->u8Reserved  = u8Reserved_;
+  psTargetQueue_->u8Priority  = (u8)ePriority_;
+  memset(&psTargetQueue_->sStats, 0, sizeof(MessageQueueStatsType));
+  
+  /* Keep track of the queue for the statistics report */
+  for(u8 i = 0; i < Msg_u8QueueCount; i++)
+  {
+    if(Msg_apsQueues[i] == psTargetQueue_)
+    {
+      bListed = TRUE;
+    }
+  }
+  
+  if( !bListed && (Msg_u8QueueCount < MSG_MAX_QUEUES) )
+  {
+    Msg_apsQueues[Msg_u8QueueCount++] = psTargetQueue_;
+  }
+  
+  return(TRUE);
+  
+} /* end MessageQueueConfigure() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------
+Function: MessagingInitialize
+
+Description:
+Initializes the State Machine and its variables.
+
+Requires:
+  - No messaging in progress
+
+Promises:
+  - Message queues are zeroed
+  - Flags and state machine are initialized
+*/
+void MessagingInitialize(void)
+{
+  /* Inititalize variables */
+  Msg_u8QueuedMessageCount = 0;
+  Msg_u8ReservedSlots = 0;
+  Msg_u8SharedInUse = 0;
+  Msg_u8QueueCount = 0;
+  Msg_u32Token = 1;
+
+  /* Ensure all message slots and arena space are deallocated and the message status queue is empty */
+  Msg_u16ArenaHead = 0;
+  Msg_u16ArenaTail = 0;
+  
+  for(u16 i = 0; i < TX_QUEUE_SIZE; i++)
+  {
+    Msg_Pool[i].u8PoolIndex = (u8)i;
+  }
+
+  for(u8 i = 0; i < MSG_POOL_WORDS; i++)
+  {
+    Msg_au32FreeSlots[i] = 0;
+  }
+  
+  for(u16 i = 0; i < TX_QUEUE_SIZE; i++)
+  {
+    Msg_au32FreeSlots[i / 32] |= (u32)0x80000000 >> (i % 32);
+  }
+
+  for(u16 i = 0; i < STATUS_QUEUE_SIZE; i++)
+  {
+    Msg_StatusQueue[i].u32Token = 0;
+    Msg_StatusQueue[i].eState = EMPTY;
+    Msg_StatusQueue[i].u32Timestamp = 0;
+    Msg_StatusQueue[i].u8NotifyArmed = 0;
+    Msg_StatusQueue[i].psNotify = NULL;
+    Msg_StatusQueue[i].psQueue = NULL;
+  }
+
+  G_u32MessagingFlags = 0;
+  Messaging_pfnStateMachine = MessagingIdle;
+
+} /* end MessagingInitialize() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function MessagingRunActiveState()
+
+Description:
+Selects and runs one iteration of the current state in the state machine.
+All state machines have a TOTAL of 1ms to execute, so on average n state machines
+may take 1ms / n to execute.
+
+Requires:
+  - State machine function pointer points at current state
+
+Promises:
+  - Calls the function to pointed by the state machine function pointer
+*/
+void MessagingRunActiveState(void)
+{
+  Messaging_pfnStateMachine();
+
+} /* end MessagingRunActiveState */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UpdateMessageStatus()
+
+Description:
+Changes the status of a message in the statue queue.  The time spent in the previous state is added to the
+queue's latency statistics when a message starts and when it completes.
+
+Requires:
+  - u32Token_ is message that should be in the status queue
+  - eNewState_ is the desired status setting for the message
+
+Promises:
+  - eState of the message is set to eNewState_ and the timestamp is updated
+  - WAITING -> SENDING/RECEIVING and SENDING/RECEIVING -> COMPLETE are counted in the queue's latency histograms
+*/
+void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_)
+{
+  MessageStatus* psStatus = &Msg_StatusQueue[u32Token_ & STATUS_QUEUE_MASK];
+  MessageNotifyType* psNotify;
+  bool bInProgress;
+  u8 u8Bin;
+  
+  /* If the token is still in the queue, change the status */
+  if(psStatus->u32Token == u32Token_)
+  {
+    bInProgress = (bool)( (psStatus->eState == SENDING) || (psStatus->eState == RECEIVING) );
+    u8Bin = MessageLatencyBin(G_u32SystemTime1ms - psStatus->u32Timestamp);
+    
+    if( (psStatus->eState == WAITING) && ( (eNewState_ == SENDING) || (eNewState_ == RECEIVING) ) )
+    {
+      psStatus->psQueue->sStats.au32WaitLatency[u8Bin]++;
+    }
+    else if(bInProgress && (eNewState_ == COMPLETE) )
+    {
+      psStatus->psQueue->sStats.au32SendLatency[u8Bin]++;
+    }
+    
+    psStatus->eState = eNewState_;
+    psStatus->u32Timestamp = G_u32SystemTime1ms;
+    
+    /* Fire the client's notification once the message is finished.  Task context (e.g. CancelMessage()) and an 
+    ISR can both get here for the same status, so the notification is taken atomically and fires only once. */
+    if( (eNewState_ == COMPLETE) || (eNewState_ == TIMEOUT) || (eNewState_ == ABANDONED) )
+    {
+      psNotify = MessageTakeNotify(psStatus);
+      if(psNotify != NULL)
+      {
+        MessageNotify(psNotify);
+      }
+    }
+  }
+  
+} /* end UpdateMessageStatus() */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Private functions */
+/*--------------------------------------------------------------------------------------------------------------------*/
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: AddNewMessageStatus()
+
+Description:
+Adds a new mesage into the status queue.  Due to the tendancy of applications to forget that they wrote
+a message here, the entry for a token is simply overwritten by the token STATUS_QUEUE_SIZE messages later
+which makes the buffer behave as if it were circular.
+
+Requires:
+  - u32Token_ is the message of interest
+  - psQueue_ is the queue the message was added to
+
+Promises:
+  - A new status is created at index (u32Token_ & STATUS_QUEUE_MASK)
+*/
+static void AddNewMessageStatus(u32 u32Token_, MessageQueueType* psQueue_)
+{
+  MessageStatus* psStatus = &Msg_StatusQueue[u32Token_ & STATUS_QUEUE_MASK];
+
+  /* Install the new message message */
+  psStatus->u32Token = u32Token_;
+  psStatus->eState = WAITING;
+  psStatus->u32Timestamp = G_u32SystemTime1ms;
+  psStatus->u8NotifyArmed = 0;
+  psStatus->psNotify = NULL;
+  psStatus->psQueue = psQueue_;
+  
+} /* end AddNewMessageStatus() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageLatencyBin()
+
+Description:
+Finds the log2 histogram bin for a latency.  CLZ makes this constant time so it can be used from interrupts.
+
+Requires:
+  - u32Latency_ is in ms
+
+Promises:
+  - Returns 0 for 0ms, n for 2^(n-1) to 2^n - 1 ms, capped at MSG_LATENCY_BUCKETS - 1
+*/
+static u8 MessageLatencyBin(u32 u32Latency_)
+{
+  u32 u32Bin;
+  
+  if(u32Latency_ == 0)
+  {
+    return(0);
+  }
+  
+  u32Bin = 32 - __CLZ(u32Latency_);
+  if(u32Bin >= MSG_LATENCY_BUCKETS)
+  {
+    u32Bin = MSG_LATENCY_BUCKETS - 1;
+  }
+  
+  return( (u8)u32Bin );
+  
+} /* end MessageLatencyBin() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageNotify()
+
+Description:
+Fires a client's message notification.
+
+Requires:
+  - psNotify_ points to a valid notification
+
+Promises:
+  - The callback is run if there is one
+  - u32EventBit is set in *pu32EventFlags if there is a flag register
+*/
+static void MessageNotify(MessageNotifyType* psNotify_)
+{
+  if(psNotify_->pu32EventFlags != NULL)
+  {
+    *psNotify_->pu32EventFlags |= psNotify_->u32EventBit;
+  }
+  
+  if(psNotify_->fnCallback != NULL)
+  {
+    psNotify_->fnCallback();
+  }
+  
+} /* end MessageNotify() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageTakeNotify()
+
+Description:
+Removes the notification from a status entry.  u8NotifyArmed is cleared with LDREXB/STREXB so that when task context 
+and an ISR both finish the same message, only one of them sees it armed and gets the notification.  No interrupts are
+masked, so this is safe from any priority.
+
+Requires:
+  - psStatus_ points to an entry of Msg_StatusQueue
+
+Promises:
+  - Returns the notification that was armed (NULL if none) and leaves psStatus_->u8NotifyArmed 0
+*/
+static MessageNotifyType* MessageTakeNotify(MessageStatus* psStatus_)
+{
+  u8 u8Armed;
+  
+  do
+  {
+    u8Armed = __LDREXB(&psStatus_->u8NotifyArmed);
+    if(u8Armed == 0)
+    {
+      __CLREX();
+      return(NULL);
+    }
+  } while( __STREXB(0, &psStatus_->u8NotifyArmed) );
+  
+  /* psNotify was written before u8NotifyArmed was set (see MessageArmNotify()) */
+  __DMB();
+  return(psStatus_->psNotify);
+  
+} /* end MessageTakeNotify() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageArmNotify()
+
+Description:
+Attaches a notification to a status entry.  A notification that is already armed is taken back first so the pointer
+is never changed while an ISR could be reading it.
+
+Requires:
+  - Only called from task context (SetMessageNotify())
+  - psStatus_ points to an entry of Msg_StatusQueue; psNotify_ points to a valid notification
+
+Promises:
+  - psStatus_->psNotify is psNotify_ and u8NotifyArmed is 1; the pointer is visible before the flag
+*/
+static void MessageArmNotify(MessageStatus* psStatus_, MessageNotifyType* psNotify_)
+{
+  (void)MessageTakeNotify(psStatus_);
+  
+  psStatus_->psNotify = psNotify_;
+  __DMB();
+  psStatus_->u8NotifyArmed = 1;
+  
+} /* end MessageArmNotify() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageCancel()
+
+Description:
+Marks a queued message that has not been claimed by its peripheral so the peripheral drops it instead of sending it.
+The flag test and set is atomic with MessageClaim() so exactly one of them wins.
+
+Requires:
+  - Called from task context
+  - psMessage_ is in a queue
+  - eReason_ is the final state to report (TIMEOUT or ABANDONED)
+
+Promises:
+  - If the message is neither started nor already cancelled: _MESSAGE_CANCELLED is set, the message status is set 
+    to eReason_ (firing any notification) and TRUE is returned.  The token is read first since the peripheral may 
+    release the slot as soon as the flag is set.
+  - Otherwise returns FALSE and nothing is changed
+*/
+static bool MessageCancel(MessageType* psMessage_, MessageStateType eReason_)
+{
+  u32 u32Token = psMessage_->u32Token;
+  
+  if( !MessageAtomicSetFlag(&psMessage_->u8Flags, _MESSAGE_CANCELLED, _MESSAGE_STARTED | _MESSAGE_CANCELLED) )
+  {
+    return(FALSE);
+  }
+  
+  UpdateMessageStatus(u32Token, eReason_);
+  return(TRUE);
+  
+} /* end MessageCancel() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessagePoolAllocate()
+
+Description:
+Takes the lowest numbered free slot out of Msg_Pool for psTargetQueue_.  The queue first uses its reserved slots 
+and then borrows from the shared region if its priority class allows it.  Slots are tracked in the Msg_au32FreeSlots 
+bitmap with slot 0 in the MSB of word 0, so CLZ of a non-zero word gives the free slot number directly.  The search 
+is one word per 32 slots and does not depend on how many slots are in use.
+The counters and bitmap are claimed with LDREX/STREX so a slot freed by an ISR in the middle of this is never lost.
+
+Requires:
+  - Called from task context
+  - Msg_au32FreeSlots is up to date
+
+Promises:
+  - Returns a pointer to the allocated message and clears its bit in Msg_au32FreeSlots
+  - The message is assigned to psTargetQueue_, its flags are cleared except _MESSAGE_SHARED_SLOT, and the queue's 
+    slot counts are incremented
+  - Msg_u8QueuedMessageCount is incremented
+  - Returns NULL if the queue may not have another slot or no slots are free
+*/
+static MessageType* MessagePoolAllocate(MessageQueueType* psTargetQueue_)
+{
+  MessageType* psMessage = NULL;
+  bool bShared = FALSE;
+  u32 u32Word;
+  u32 u32Index;
+  
+  /* Take a reserved slot if there is one left, otherwise borrow from the shared region as long as the 
+  priority headroom is kept */
+  if( !MessageAtomicIncrementBelow(&psTargetQueue_->u8ReservedInUse, psTargetQueue_->u8Reserved) )
+  {
+    if( !MessageAtomicIncrementBelow(&Msg_u8SharedInUse, 
+                                     (TX_QUEUE_SIZE - Msg_u8ReservedSlots) - Msg_au8SharedHeadroom[psTargetQueue_->u8Priority]) )
+    {
+      return(NULL);
+    }
+    
+    bShared = TRUE;
+  }
+  
+  /* The admission counts guarantee a free slot, but check anyway */
+  for(u8 i = 0; (i < MSG_POOL_WORDS) && (psMessage == NULL); i++)
+  {
+    do
+    {
+      u32Word = __LDREXW(&Msg_au32FreeSlots[i]);
+      if(u32Word == 0)
+      {
+        __CLREX();
+        break;
+      }
+      
+      u32Index = __CLZ(u32Word);
+    } while( __STREXW(u32Word & ~((u32)0x80000000 >> u32Index), &Msg_au32FreeSlots[i]) );
+    
+    if(u32Word != 0)
+    {
+      psMessage = &Msg_Pool[(i * 32) + u32Index];
+    }
+  }
+  
+  if(psMessage == NULL)
+  {
+    MessageAtomicDecrement(bShared ? &Msg_u8SharedInUse : &psTargetQueue_->u8ReservedInUse);
+    return(NULL);
+  }
+  
+  psMessage->psQueue   = psTargetQueue_;
+  psMessage->pu8RxData = NULL;
+  psMessage->u8Flags   = bShared ? _MESSAGE_SHARED_SLOT : 0;
+  
+  MessageAtomicIncrementBelow(&Msg_u8QueuedMessageCount, TX_QUEUE_SIZE);
+  MessageAtomicIncrementBelow(&psTargetQueue_->u8InUse, TX_QUEUE_SIZE);
+  if(psTargetQueue_->u8InUse > psTargetQueue_->sStats.u8HighWater)
+  {
+    psTargetQueue_->sStats.u8HighWater = psTargetQueue_->u8InUse;
+  }
+  
+  return(psMessage);
+  
+} /* end MessagePoolAllocate() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessagePoolFree()
+
+Description:
+Returns a message slot to Msg_Pool using the index stored in the message.  The payload record of a copied message
+is released back to the arena.  The counters and bitmap are updated with LDREX/STREX since peripheral ISRs of 
+different priorities can free slots while task context allocates them.
+
+Requires:
+  - psMessage_ points to an allocated message in Msg_Pool
+
+Promises:
+  - The message's arena record is flagged free if it has one
+  - The slot's bit is set in Msg_au32FreeSlots
+  - The slot is given back to the reserved or shared count of the message's queue
+  - Msg_u8QueuedMessageCount is decremented
+*/
+static void MessagePoolFree(MessageType* psMessage_)
+{
+  MessageQueueType* psQueue = (MessageQueueType*)psMessage_->psQueue;
+  u8 u8Index = psMessage_->u8PoolIndex;
+  u32 u32Word;
+  
+  if( !(psMessage_->u8Flags & _MESSAGE_NO_COPY) )
+  {
+    MessageArenaFree(psMessage_->u16ArenaRecord);
+  }
+  
+  if(psMessage_->u8Flags & _MESSAGE_SHARED_SLOT)
+  {
+    MessageAtomicDecrement(&Msg_u8SharedInUse);
+  }
+  else
+  {
+    MessageAtomicDecrement(&psQueue->u8ReservedInUse);
+  }
+  MessageAtomicDecrement(&psQueue->u8InUse);
+  MessageAtomicDecrement(&Msg_u8QueuedMessageCount);
+  
+  /* The slot is usable again as soon as its bit is set, so this is last */
+  do
+  {
+    u32Word = __LDREXW(&Msg_au32FreeSlots[u8Index / 32]);
+  } while( __STREXW(u32Word | ((u32)0x80000000 >> (u8Index % 32)), &Msg_au32FreeSlots[u8Index / 32]) );
+  
+} /* end MessagePoolFree() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageAtomicIncrementBelow()
+
+Description:
+Increments a counter that is shared with interrupts if it is below a limit.
+
+Requires:
+  - pu8Counter_ points to a counter that is only changed with MessageAtomicIncrementBelow() and MessageAtomicDecrement()
+
+Promises:
+  - If *pu8Counter_ < u8Limit_, it is incremented and TRUE is returned; otherwise FALSE is returned
+*/
+static bool MessageAtomicIncrementBelow(volatile u8* pu8Counter_, u8 u8Limit_)
+{
+  u8 u8Count;
+  
+  do
+  {
+    u8Count = __LDREXB(pu8Counter_);
+    if(u8Count >= u8Limit_)
+    {
+      __CLREX();
+      return(FALSE);
+    }
+  } while( __STREXB(u8Count + 1, pu8Counter_) );
+  
+  return(TRUE);
+  
+} /* end MessageAtomicIncrementBelow() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageAtomicDecrement()
+
+Description:
+Decrements a counter that is shared with interrupts.
+
+Requires:
+  - *pu8Counter_ is not 0
+
+Promises:
+  - *pu8Counter_ is decremented
+*/
+static void MessageAtomicDecrement(volatile u8* pu8Counter_)
+{
+  u8 u8Count;
+  
+  do
+  {
+    u8Count = __LDREXB(pu8Counter_);
+  } while( __STREXB(u8Count - 1, pu8Counter_) );
+  
+} /* end MessageAtomicDecrement() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageAtomicSetFlag()
+
+Description:
+Sets flags in a message's u8Flags unless any of a set of other flags is already set.  Used so that a peripheral
+claiming a message and task context cancelling it cannot both succeed.
+
+Requires:
+  - pu8Flags_ points to the u8Flags of a message
+
+Promises:
+  - If none of u8Unless_ is set in *pu8Flags_, u8Set_ is set and TRUE is returned; otherwise FALSE is returned
+*/
+static bool MessageAtomicSetFlag(volatile u8* pu8Flags_, u8 u8Set_, u8 u8Unless_)
+{
+  u8 u8Flags;
+  
+  do
+  {
+    u8Flags = __LDREXB(pu8Flags_);
+    if(u8Flags & u8Unless_)
+    {
+      __CLREX();
+      return(FALSE);
+    }
+  } while( __STREXB(u8Flags | u8Set_, pu8Flags_) );
+  
+  return(TRUE);
+  
+} /* end MessageAtomicSetFlag() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageQueuePush()
+
+Description:
+Adds a message at the end of a queue.  The ring entry is written before the tail is moved so the consumer
+never sees a position that is not filled in yet.
+
+Requires:
+  - Called only by the producer of psTargetQueue_ (task context)
+  - psMessage_ is fully set up and its status has been posted
+  - The ring has room (guaranteed since MSG_QUEUE_RING_SIZE >= TX_QUEUE_SIZE)
+
+Promises:
+  - psMessage_ is the last message in psTargetQueue_
+*/
+static void MessageQueuePush(MessageQueueType* psTargetQueue_, MessageType* psMessage_)
+{
+  u8 u8Tail = psTargetQueue_->u8Tail;
+  
+  psTargetQueue_->au8Ring[u8Tail & MSG_QUEUE_RING_MASK] = psMessage_->u8PoolIndex;
+  __DMB();
+  psTargetQueue_->u8Tail = u8Tail + 1;
+  
+} /* end MessageQueuePush() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageQueueAppend()
+
+Description:
+Adds data to the end of the last message in a queue instead of queuing a new message.  This saves the slot, status
+entry, PDC setup and end-of-transfer interrupt of a new message, which adds up for clients that write a few bytes
+at a time (e.g. a debug port echoing characters).
+
+Requires:
+  - Called only by the producer of psTargetQueue_ (task context)
+  - The peripheral may claim messages from its ISR: the message is held with _MESSAGE_STARTED while it is extended 
+    so MessageClaim() fails on it until the new size is in place
+  - u32MessageSize_ is not 0
+
+Promises:
+  - If psTargetQueue_ has _MSG_QUEUE_COALESCE set and its last message is a copied, WAITING message with room for 
+    u32MessageSize_ more bytes (up to MAX_TX_MESSAGE_LENGTH and the space after its arena record), the data is 
+    appended to it, u32Appended is incremented and the message's token is returned
+  - Otherwise returns 0 and nothing is changed
+*/
+static u32 MessageQueueAppend(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, u8* pu8MessageData_)
+{
+  MessageType* psMessage;
+  MessageStatus* psStatus;
+  u8 u8Tail = psTargetQueue_->u8Tail;
+  
+  if( !(psTargetQueue_->u8Options & _MSG_QUEUE_COALESCE) || (psTargetQueue_->u8Head == u8Tail) )
+  {
+    return(0);
+  }
+  
+  psMessage = &Msg_Pool[psTargetQueue_->au8Ring[(u8)(u8Tail - 1) & MSG_QUEUE_RING_MASK]];
+  psStatus  = &Msg_StatusQueue[psMessage->u32Token & STATUS_QUEUE_MASK];
+  
+  /* Hold the message the same way a claim does so the peripheral cannot start it while it grows */
+  if( (psMessage->u8Flags & _MESSAGE_NO_COPY) ||
+      !MessageAtomicSetFlag(&psMessage->u8Flags, _MESSAGE_STARTED, _MESSAGE_CANCELLED | _MESSAGE_STARTED) )
+  {
+    return(0);
+  }
+  
+  /* Nothing else writes u8Flags while it is held (claims fail without writing) so it is released with a plain write */
+  if( (psStatus->u32Token != psMessage->u32Token) || (psStatus->eState != WAITING) ||
+      ((psMessage->u32Size + u32MessageSize_) > MAX_TX_MESSAGE_LENGTH) ||
+      !MessageArenaExtend(psMessage->u16ArenaRecord, psMessage->u32Size + u32MessageSize_) )
+  {
+    psMessage->u8Flags &= ~_MESSAGE_STARTED;
+    return(0);
+  }
+  
+  MessageCopyData(psTargetQueue_, psMessage->pu8Message + psMessage->u32Size, pu8MessageData_, u32MessageSize_);
+  psMessage->u32Size += u32MessageSize_;
+  psTargetQueue_->sStats.u32Appended++;
+  
+  /* The data and size must be visible before a claim can succeed */
+  __DMB();
+  psMessage->u8Flags &= ~_MESSAGE_STARTED;
+  
+  return(psMessage->u32Token);
+  
+} /* end MessageQueueAppend() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageCopyData()
+
+Description:
+Copies message data into its arena record the way the target queue needs it.
+
+Requires:
+  - pu8Destination_ points into an arena record with room for u32Size_ bytes
+
+Promises:
+  - u32Size_ bytes from pu8Source_ are copied to pu8Destination_, with the bits of each byte reversed if 
+    psTargetQueue_ has _MSG_QUEUE_BIT_REVERSE set
+*/
+static void MessageCopyData(MessageQueueType* psTargetQueue_, u8* pu8Destination_, const u8* pu8Source_, u32 u32Size_)
+{
+  if(psTargetQueue_->u8Options & _MSG_QUEUE_BIT_REVERSE)
+  {
+    ReverseBits(pu8Destination_, pu8Source_, u32Size_);
+  }
+  else
+  {
+    for(u32 i = 0; i < u32Size_; i++)
+    {
+      *pu8Destination_++ = *pu8Source_++;
+    }
+  }
+  
+} /* end MessageCopyData() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageArenaReclaim()
+
+Description:
+Moves the arena tail past the records that have been released, and restarts an empty arena at word 0 for the most 
+contiguous space.
+
+Requires:
+  - Only called from task context (the head and tail are not touched by interrupts)
+
+Promises:
+  - Msg_u16ArenaTail is at the oldest record still in use, or the head and tail are both 0 if there is none
+*/
+static void MessageArenaReclaim(void)
+{
+  while(Msg_u16ArenaTail != Msg_u16ArenaHead)
+  {
+    if(Msg_u16ArenaTail == MSG_ARENA_WORDS)
+    {
+      Msg_u16ArenaTail = 0;
+    }
+    else if(Msg_au32Arena[Msg_u16ArenaTail] & _MSG_ARENA_RECORD_FREE)
+    {
+      Msg_u16ArenaTail += (u16)(Msg_au32Arena[Msg_u16ArenaTail] & MSG_ARENA_RECORD_WORDS_MASK);
+    }
+    else
+    {
+      break;
+    }
+  }
+  
+  if(Msg_u16ArenaTail == Msg_u16ArenaHead)
+  {
+    Msg_u16ArenaTail = 0;
+    Msg_u16ArenaHead = 0;
+  }
+  
+} /* end MessageArenaReclaim() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageArenaPieceSize()
+
+Description:
+Works out how many bytes of a message the next arena record should hold.  A message stays in one record whenever 
+the arena has a contiguous space for it.  Only when the free space is divided by the end of the arena is the 
+message cut there: the first piece fills the end and the rest starts again at word 0.
+
+Requires:
+  - Only called from task context
+  - u32Size_ is no more than MSG_MAX_COPIED_LENGTH
+
+Promises:
+  - Returns u32Size_ if one record can hold it, or if the end of the arena has no room for any data
+  - Otherwise returns the number of bytes that fill the end of the arena
+*/
+static u32 MessageArenaPieceSize(u32 u32Size_)
+{
+  u16 u16Words = (u16)(1 + ((u32Size_ + 3) / 4));
+  u16 u16EndWords;
+  
+  MessageArenaReclaim();
+  
+  /* Same room rules as MessageArenaAllocate(): after the head, then at the start if the used space does not wrap */
+  if( (Msg_u16ArenaHead < Msg_u16ArenaTail) || ((Msg_u16ArenaHead + u16Words) <= MSG_ARENA_WORDS) ||
+      (u16Words < Msg_u16ArenaTail) )
+  {
+    return(u32Size_);
+  }
+  
+  /* A header and at least one data word must fit before the end */
+  u16EndWords = MSG_ARENA_WORDS - Msg_u16ArenaHead;
+  if(u16EndWords < 2)
+  {
+    return(u32Size_);
+  }
+  
+  return( (u32)(u16EndWords - 1) * 4 );
+  
+} /* end MessageArenaPieceSize() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageArenaAllocate()
+
+Description:
+Takes a record big enough for u32Size_ bytes from the head of the arena.  Records that have been freed are first 
+reclaimed from the tail (see MessageArenaReclaim()).  A record never wraps: if there is not enough room at the end of the arena, the remaining 
+words are marked as a free padding record and the new record starts at word 0.  One word between the head and the 
+tail is always left unused so that a full arena can be told apart from an empty one.
+
+Requires:
+  - Only called from task context (the head and tail are not touched by interrupts)
+  - u32Size_ is no more than MSG_MAX_COPIED_LENGTH
+
+Promises:
+  - Returns a pointer to the data area of the new record and loads its word index to *pu16Record_
+  - Returns NULL if the arena does not have a big enough contiguous space
+*/
+static u8* MessageArenaAllocate(u32 u32Size_, u16* pu16Record_)
+{
+  u16 u16Words = (u16)(1 + ((u32Size_ + 3) / 4));
+  u16 u16Record;
+  
+  MessageArenaReclaim();
+  
+  /* Used space is [tail, head): look for room after the head first and then at the start of the arena */
+  if(Msg_u16ArenaHead >= Msg_u16ArenaTail)
+  {
+    if( (Msg_u16ArenaHead + u16Words) <= MSG_ARENA_WORDS )
+    {
+      u16Record = Msg_u16ArenaHead;
+    }
+    else if(u16Words < Msg_u16ArenaTail)
+    {
+      /* Pad out the end of the arena so the tail skips it */
+      if(Msg_u16ArenaHead < MSG_ARENA_WORDS)
+      {
+        Msg_au32Arena[Msg_u16ArenaHead] = _MSG_ARENA_RECORD_FREE | (u32)(MSG_ARENA_WORDS - Msg_u16ArenaHead);
+      }
+      u16Record = 0;
+    }
+    else
+    {
+      return(NULL);
+    }
+  }
+  /* Used space wraps: the only room is between the head and the tail */
+  else
+  {
+    if( (Msg_u16ArenaHead + u16Words) < Msg_u16ArenaTail )
+    {
+      u16Record = Msg_u16ArenaHead;
+    }
+    else
+    {
+      return(NULL);
+    }
+  }
+
+  /* Write the record header before moving the head */
+  Msg_au32Arena[u16Record] = (u32)u16Words;
+  Msg_u16ArenaHead = u16Record + u16Words;
+  *pu16Record_ = u16Record;
+  
+  return( (u8*)&Msg_au32Arena[u16Record + 1] );
+  
+} /* end MessageArenaAllocate() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageArenaExtend()
+
+Description:
+Grows an arena record so it holds u32Size_ bytes.  Only the newest record can grow since it is the only one with 
+free space right after it.
+
+Requires:
+  - Only called from task context
+  - u16Record_ is a record in use and u32Size_ is no more than MSG_MAX_COPIED_LENGTH
+
+Promises:
+  - Returns TRUE if the record already has room for u32Size_ bytes or was grown into the free space after it
+  - Returns FALSE and leaves the arena unchanged otherwise
+*/
+static bool MessageArenaExtend(u16 u16Record_, u32 u32Size_)
+{
+  u16 u16Words = (u16)(1 + ((u32Size_ + 3) / 4));
+  u16 u16CurrentWords = (u16)(Msg_au32Arena[u16Record_] & MSG_ARENA_RECORD_WORDS_MASK);
+  u16 u16Extra;
+  
+  /* The last word of the record may already have room */
+  if(u16Words <= u16CurrentWords)
+  {
+    return(TRUE);
+  }
+  
+  if( (u16Record_ + u16CurrentWords) != Msg_u16ArenaHead )
+  {
+    return(FALSE);
+  }
+  
+  /* Same room rules as MessageArenaAllocate(): a record does not wrap and one word is left before the tail */
+  u16Extra = u16Words - u16CurrentWords;
+  if(Msg_u16ArenaHead >= Msg_u16ArenaTail)
+  {
+    if( (Msg_u16ArenaHead + u16Extra) > MSG_ARENA_WORDS )
+    {
+      return(FALSE);
+    }
+  }
+  else if( (Msg_u16ArenaHead + u16Extra) >= Msg_u16ArenaTail )
+  {
+    return(FALSE);
+  }
+  
+  Msg_au32Arena[u16Record_] = (u32)u16Words;
+  Msg_u16ArenaHead += u16Extra;
+  
+  return(TRUE);
+  
+} /* end MessageArenaExtend() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageArenaFree()
+
+Description:
+Releases an arena record.  The record is only flagged here; the space is reclaimed by MessageArenaAllocate once
+every record before it has also been released.  This is safe to call from an interrupt.
+
+Requires:
+  - u16Record_ is the word index of an allocated record
+
+Promises:
+  - _MSG_ARENA_RECORD_FREE is set in the record header
+*/
+static void MessageArenaFree(u16 u16Record_)
+{
+  Msg_au32Arena[u16Record_] |= _MSG_ARENA_RECORD_FREE;
+  
+} /* end MessageArenaFree() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageSweepSlot()
+
+Description:
+Checks one Msg_Pool slot for a message that has been in the queue too long.  
+Messages in progress are timed from their status (the time they started).  Messages that are WAITING, or whose status 
+has already been overwritten in the status queue by a later token, are timed from u32Timestamp, the time they were 
+queued, so a busy status queue cannot expire a message that was only just queued.
+Expired messages are only marked cancelled since the peripheral owns the head of the queue; the slot is released 
+when the peripheral reaches the message (see MessageQueuePeek()).  MessageCancel() is atomic with MessageClaim() 
+so a peripheral may start the message from its ISR while it is checked here.
+
+Requires:
+  - Called from task context
+  - u8Index_ is a valid Msg_Pool index
+
+Promises:
+  - A message queued more than MSG_STATUS_WAITING_TIME ago that has not been claimed has its status set to TIMEOUT 
+    and is marked _MESSAGE_CANCELLED
+  - An expired SENDING or RECEIVING message has its status set to TIMEOUT and _MESSAGING_SENDING_TIMEOUT is set
+*/
+static void MessageSweepSlot(u8 u8Index_)
+{
+  MessageType* psMessage = &Msg_Pool[u8Index_];
+  MessageStatus* psStatus;
+  u32 u32Age;
+  
+  /* Nothing to do for a free slot or one that is already cancelled */
+  if( (Msg_au32FreeSlots[u8Index_ / 32] & ((u32)0x80000000 >> (u8Index_ % 32))) ||
+      (psMessage->u8Flags & _MESSAGE_CANCELLED) )
+  {
+    return;
+  }
+
+  psStatus = &Msg_StatusQueue[psMessage->u32Token & STATUS_QUEUE_MASK];
+  
+  if(psStatus->u32Token == psMessage->u32Token)
+  {
+    /* Messages that are in progress belong to the peripheral: flag them but leave the slot alone */
+    if( (psStatus->eState == SENDING) || (psStatus->eState == RECEIVING) )
+    {
+      u32Age = G_u32SystemTime1ms - psStatus->u32Timestamp;
+      if(u32Age > MSG_STATUS_SENDING_TIME)
+      {
+        UpdateMessageStatus(psMessage->u32Token, TIMEOUT);
+        G_u32MessagingFlags |= _MESSAGING_SENDING_TIMEOUT;
+      }
+      return;
+    }
+    
+    if(psStatus->eState != WAITING)
+    {
+      return;
+    }
+  }
+  
+  /* Waiting too long: unless it has been claimed, report it and leave it for the peripheral to drop */
+  u32Age = G_u32SystemTime1ms - psMessage->u32Timestamp;
+  if(u32Age > MSG_STATUS_WAITING_TIME)
+  {
+    MessageCancel(psMessage, TIMEOUT);
+  }
+  
+} /* end MessageSweepSlot() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: MessageSweepStatus()
+
+Description:
+Clears one status queue entry if it is in a final state and has not been queried for too long.
+
+Requires:
+  - u16Index_ is a valid Msg_StatusQueue index
+
+Promises:
+  - A COMPLETE status older than MSG_STATUS_COMPLETE_TIME is cleared
+  - A TIMEOUT or ABANDONED status older than MSG_STATUS_TIMEOUT_TIME is cleared
+*/
+static void MessageSweepStatus(u16 u16Index_)
+{
+  MessageStatus* psStatus = &Msg_StatusQueue[u16Index_];
+  u32 u32Age = G_u32SystemTime1ms - psStatus->u32Timestamp;
+  
+  if( ( (psStatus->eState == COMPLETE) && (u32Age > MSG_STATUS_COMPLETE_TIME) ) ||
+      ( ( (psStatus->eState == TIMEOUT) || (psStatus->eState == ABANDONED) ) && (u32Age > MSG_STATUS_TIMEOUT_TIME) ) )
+  {
+    psStatus->u32Token = 0;
+    psStatus->eState = EMPTY;
+    psStatus->u8NotifyArmed = 0;
+    psStatus->psNotify = NULL;
+  }
+  
+} /* end MessageSweepStatus() */
+
+
+/**********************************************************************************************************************
+State Machine Function Definitions
+**********************************************************************************************************************/
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Do nothing for now */
+/* Wait for the next cleaning pass */
 void MessagingIdle(void)
 {
   static u32 u32CleaningTime = MSG_STATUS_CLEANING_TIME;
@@ -451,12 +1898,38 @@ void MessagingIdle(void)
   {
     u32CleaningTime = MSG_STATUS_CLEANING_TIME;
     
-    /* ??? Probably should add clean of the main message queue to detect any messages that have become stuck */
+    Msg_u8SweepSlot = 0;
+    Msg_u16SweepStatus = 0;
+    Messaging_pfnStateMachine = MessagingSweep;
   }
     
 } /* end MessagingIdle() */
 
 
+/*-------------------------------------------------------------------------------------------------------------------*/
+/* Cleaning pass in progress: check a bounded number of pool slots and status entries each tick so the 
+pass never takes much of the 1ms loop. */
+void MessagingSweep(void)
+{
+  for(u8 i = 0; (i < MSG_SWEEP_SLOTS_PER_TICK) && (Msg_u8SweepSlot < TX_QUEUE_SIZE); i++)
+  {
+    MessageSweepSlot(Msg_u8SweepSlot++);
+  }
+  
+  for(u8 i = 0; (i < MSG_SWEEP_STATUSES_PER_TICK) && (Msg_u16SweepStatus < STATUS_QUEUE_SIZE); i++)
+  {
+    MessageSweepStatus(Msg_u16SweepStatus++);
+  }
+  
+  /* Back to Idle when the whole pool and status queue have been checked */
+  if( (Msg_u8SweepSlot == TX_QUEUE_SIZE) && (Msg_u16SweepStatus == STATUS_QUEUE_SIZE) )
+  {
+    Messaging_pfnStateMachine = MessagingIdle;
+  }
+  
+} /* end MessagingSweep() */
+
+
 /*-------------------------------------------------------------------------------------------------------------------*/
 /* Handle an error */
 void MessagingError(void)          
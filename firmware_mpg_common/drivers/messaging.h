@@ -17,46 +17,134 @@ Constants / Definitions
 #define _MESSAGING_TX_QUEUE_ALMOST_FULL (u32)0x00000002
 #define _DEQUEUE_GOT_NULL               (u32)0x00000004
 #define _DEQUEUE_MSG_NOT_FOUND          (u32)0x00000008
+#define _MESSAGING_SENDING_TIMEOUT      (u32)0x00000010 /* A message was still sending after MSG_STATUS_SENDING_TIME */
+#define _MESSAGING_RESERVE_FAILED       (u32)0x00000020 /* A queue asked for more slots than MSG_POOL_MAX_RESERVED allows */
+#define _MESSAGING_TX_TOO_LONG          (u32)0x00000040 /* QueueMessage() was given more than MSG_MAX_COPIED_LENGTH bytes */
+
+/* MessageType u8Flags */
+#define _MESSAGE_NO_COPY                (u8)0x01       /* Payload is in caller-owned memory, not in the arena */
+#define _MESSAGE_SHARED_SLOT            (u8)0x02       /* The slot was borrowed from the shared region of Msg_Pool */
+#define _MESSAGE_CANCELLED              (u8)0x04       /* The message will not be sent; the consumer releases it when it reaches it */
+#define _MESSAGE_SPLIT                  (u8)0x08       /* More pieces of the same message follow this one in the queue */
+#define _MESSAGE_STARTED                (u8)0x10       /* The peripheral has claimed the message; it can only be stopped by pfnAbort */
+#define _MESSAGE_DRIVER_MASK            (u8)0xE0       /* Bits left to the peripheral driver: set when queued (see QueueMessageTransfer()) */
+
+/* MessageQueueType u8Options */
+#define _MSG_QUEUE_COALESCE             (u8)0x01       /* New data may be appended to the last queued message if it has not started */
+#define _MSG_QUEUE_BIT_REVERSE          (u8)0x02       /* Copied data has the bit order of each byte reversed (for LSB-first peripherals) */
   
-/* Tx buffer allocation: be aware of RAM usage when selecting the two parameters below.
-Queue size in bytes is TX_QUEUE_SIZE x MAX_TX_MESSAGE_LENGTH */
-
-#define TX_QUEUE_SIZE                   (u8)16         /* Number of messages allowed in the queue */
-#define MAX_TX_MESSAGE_LENGTH           (u16)128       /* Max bytes in message payload */
+/* Tx buffer allocation: be aware of RAM usage when selecting the parameters below.
+Each message uses a MessageType (28 bytes) in Msg_Pool and copied messages also use a record of 4 + size bytes 
+(rounded up to a multiple of 4) in the MSG_ARENA_SIZE byte arena.  Queue size in bytes is 
+(TX_QUEUE_SIZE x 28) + MSG_ARENA_SIZE.  Each MessageQueueType also holds a MSG_QUEUE_RING_SIZE byte ring. */
+
+#define TX_QUEUE_SIZE                   (u8)32         /* Number of messages allowed in the queue (max MSG_QUEUE_RING_SIZE) */
+#define MAX_TX_MESSAGE_LENGTH           (u16)256       /* Max bytes a message grows to by coalescing (see MessageQueueAppend()) */
+#define MSG_ARENA_SIZE                  (u16)1024      /* Bytes of payload storage for copied messages: multiple of 4 */
 #define TX_QUEUE_WATERMARK              (u8)(TX_QUEUE_SIZE - 2) /* Number of messages in the queue that will trigger a warning flag */
-#define STATUS_QUEUE_SIZE               (u8)64         /* Number of message statusi to maintain */
+#define STATUS_QUEUE_SIZE               (u16)64        /* Number of message statusi to maintain: MUST be a power of 2 */
+#define STATUS_QUEUE_MASK               (u32)(STATUS_QUEUE_SIZE - 1) /* AND to a token to get its index in the status queue */
+#define MSG_QUEUE_RING_SIZE             (u8)32         /* Entries in each queue ring: power of 2, at least TX_QUEUE_SIZE and max 128 */
+#define MSG_QUEUE_RING_MASK             (u8)(MSG_QUEUE_RING_SIZE - 1) /* AND to a ring position to get its array index */
+
+#define MSG_POOL_WORDS                  (u8)((TX_QUEUE_SIZE + 31) / 32) /* Number of u32 words in the free slot bitmap */
+
+/* Slots can be reserved for individual queues with MessageQueueConfigure(); the rest of the pool is shared.  A queue
+that has used its reservation borrows from the shared region only while more than the headroom for its priority
+class is still free there, so low priority traffic cannot take the last shared slots. */
+#define MSG_POOL_MAX_RESERVED           (u8)(TX_QUEUE_SIZE - 8) /* Max slots reserved across all queues */
+#define MSG_SHARED_HEADROOM_LOW         (u8)6          /* Shared slots a MSG_PRIORITY_LOW queue must leave free */
+#define MSG_SHARED_HEADROOM_NORMAL      (u8)2          /* Shared slots a MSG_PRIORITY_NORMAL queue must leave free */
+
+#define MSG_MAX_QUEUES                  (u8)8          /* Number of queues that can be listed for statistics */
+#define MSG_LATENCY_BUCKETS             (u8)8          /* Latency histogram bins: 0ms, 1ms, 2-3ms, 4-7ms ... 64ms and up */
+
+#define MSG_ARENA_WORDS                 (u16)(MSG_ARENA_SIZE / 4) /* Size of the arena in u32 words */
+#define MSG_MAX_COPIED_LENGTH           (u32)((MSG_ARENA_WORDS - 1) * 4) /* Longest copied message: one record (header + data) filling the empty arena */
+#define _MSG_ARENA_RECORD_FREE          (u32)0x80000000 /* Set in a record header when the record has been released */
+#define MSG_ARENA_RECORD_WORDS_MASK     (u32)0x0000FFFF /* AND to a record header to get the record size in words */
 
 #define MSG_STATUS_COMPLETE_TIME        (u32)1000      /* Max time in ms that a message status can sit in the status queue in a COMPLETE state */
 #define MSG_STATUS_WAITING_TIME         (u32)1000      /* Max time in ms that a message can sit in the queue in a WAITING state */
+#define MSG_STATUS_SENDING_TIME         (u32)1000      /* Max time in ms that a message can sit in a SENDING or RECEIVING state */
 #define MSG_STATUS_TIMEOUT_TIME         (u32)1500      /* Max time in ms that a message status can sit in the status queue in a TIMEOUT state */
 #define MSG_STATUS_CLEANING_TIME        (u32)1000      /* Time in ms between cleaning the message queue */
+#define MSG_SWEEP_SLOTS_PER_TICK        (u8)4          /* Msg_Pool slots checked per 1ms tick during a cleaning pass */
+#define MSG_SWEEP_STATUSES_PER_TICK     (u8)8          /* Msg_StatusQueue entries checked per 1ms tick during a cleaning pass */
 
 
 /**********************************************************************************************************************
 Type Definitions
 **********************************************************************************************************************/
 typedef enum {EMPTY = 0, WAITING, SENDING, RECEIVING, COMPLETE, TIMEOUT, ABANDONED, NOT_FOUND = 0xff} MessageStateType;
+typedef enum {MSG_PRIORITY_LOW = 0, MSG_PRIORITY_NORMAL, MSG_PRIORITY_HIGH} MessagePriorityType;
 
 /* Message struct for data messages */
 typedef struct
 {
   u32 u32Token;                         /* Unigue token for this message */
+  u32 u32Timestamp;                     /* G_u32SystemTime1ms when the message was queued (for the sweeper) */
   u32 u32Size;                          /* Size of the data payload in bytes */
-  u8 pu8Message[MAX_TX_MESSAGE_LENGTH]; /* Data payload array */
-  void* psNextMessage;                  /* Pointer to next message */
+  u8* pu8Message;                       /* Pointer to the data payload: arena record or caller-owned memory */
+  u8* pu8RxData;                        /* Where a full-duplex peripheral puts the bytes it receives; NULL if not used */
+  void* psQueue;                        /* The MessageQueueType the message is linked in */
+  u8 u8PoolIndex;                       /* Index of this message in Msg_Pool */
+  volatile u8 u8Flags;                  /* Message flags: CANCELLED and STARTED change atomically (see MessageClaim()) */
+  u16 u16ArenaRecord;                   /* Word index of the payload's record in Msg_au32Arena (copied messages only) */
 } MessageType;
 
+/* Counters kept for each queue; bin n of a latency histogram counts messages that took 2^(n-1) to 2^n - 1 ms 
+(bin 0 is under 1ms and the last bin has everything longer) */
+typedef struct
+{
+  u32 u32Rejected;                      /* Number of messages refused for lack of pool or arena space */
+  u32 u32Appended;                      /* Number of messages appended to the last queued message instead of taking a slot */
+  u8 u8HighWater;                       /* Most Msg_Pool slots the queue has held at once */
+  u8 au8Pad[3];                         /* Preserve 4-byte alignment */
+  u32 au32WaitLatency[MSG_LATENCY_BUCKETS]; /* Time from WAITING to SENDING or RECEIVING */
+  u32 au32SendLatency[MSG_LATENCY_BUCKETS]; /* Time from SENDING or RECEIVING to COMPLETE */
+} MessageQueueStatsType;
+
+/* Peripheral function that stops the transfer of the message at the front of psQueue_ (a MessageQueueType).  
+It returns FALSE if nothing is in progress or the transfer cannot be stopped safely. */
+typedef bool (*fnMessageAbortType)(void* psQueue_);
+
+/* Transmit queue owned by a peripheral: a single-producer / single-consumer ring of Msg_Pool indices.  The producer 
+(QueueMessage from task context) only writes u8Tail and the consumer (the peripheral, usually in its ISR) only writes 
+u8Head.  Both positions are free-running and masked with MSG_QUEUE_RING_MASK. */
+typedef struct
+{
+  u8 au8Ring[MSG_QUEUE_RING_SIZE];      /* Msg_Pool indices of the queued messages, oldest first */
+  volatile u8 u8Head;                   /* Position of the oldest message: written only by the consumer */
+  volatile u8 u8Tail;                   /* Position for the next message: written only by the producer */
+  u8 u8Reserved;                        /* Msg_Pool slots reserved for this queue */
+  u8 u8Priority;                        /* MessagePriorityType of all messages in this queue */
+  volatile u8 u8InUse;                  /* Msg_Pool slots currently held by this queue */
+  volatile u8 u8ReservedInUse;          /* Reserved slots currently held by this queue */
+  u8 u8Options;                         /* _MSG_QUEUE_xxx options set by the peripheral driver */
+  u8 u8Pad;                             /* Preserve 4-byte alignment */
+  const u8* pu8Name;                    /* Short name of the peripheral for the statistics report */
+  fnMessageAbortType pfnAbort;          /* Stops an in-progress transfer for CancelMessage(); NULL if not supported */
+  MessageQueueStatsType sStats;         /* Occupancy and latency counters */
+} MessageQueueType;
+
+/* Client-owned notification fired once when its message finishes (COMPLETE, TIMEOUT or ABANDONED) */
 typedef struct
 {
-  bool bFree;                           /* TRUE if message slot is available */
-  MessageType Message;                  /* The slot's message */
-} MessageSlot;
+  fnCode_type fnCallback;               /* Function to call when the message finishes (interrupt context); NULL if not used */
+  volatile u32* pu32EventFlags;         /* Flag register where u32EventBit is set when the message finishes; NULL if not used */
+  u32 u32EventBit;                      /* Bit(s) to set in *pu32EventFlags */
+} MessageNotifyType;
 
 typedef struct
 {
   u32 u32Token;                         /* Unigue token for this message; a token is never 0 */
   MessageStateType eState;              /* State of the message */
-  u32 u32Timestamp;                     /* Time the message status was posted */          
+  u32 u32Timestamp;                     /* Time the message status was posted or last changed */          
+  MessageNotifyType* psNotify;          /* Notification to fire when the message finishes; only valid while u8NotifyArmed */
+  MessageQueueType* psQueue;            /* Queue the message was added to (for latency statistics) */
+  volatile u8 u8NotifyArmed;            /* 1 while psNotify is waiting to fire; cleared with LDREXB/STREXB by whoever fires it */
+  u8 au8Pad[3];                         /* Preserve 4-byte alignment */
 } MessageStatus;
 
 
@@ -68,6 +156,9 @@ typedef struct
 /* Public functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 MessageStateType QueryMessageStatus(u32 u32Token_);
+bool SetMessageNotify(u32 u32Token_, MessageNotifyType* psNotify_);
+bool CancelMessage(u32 u32Token_);
+const MessageQueueType* MessagingGetQueue(u8 u8Index_);
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -76,8 +167,15 @@ MessageStateType QueryMessageStatus(u32 u32Token_);
 void MessagingInitialize(void);
 void MessagingRunActiveState(void);
 
-u32 QueueMessage(MessageType** eTargetTxBuffer_, u32 u32MessageSize_, u8* pu8MessageData_);
-void DeQueueMessage(MessageType** pTargetQueue_);
+u32 QueueMessage(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, u8* pu8MessageData_);
+u32 QueueMessageNoCopy(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, const u8* pu8MessageData_);
+u32 QueueMessageTransfer(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, const u8* pu8TxData_, u8* pu8RxData_, u8 u8DriverFlags_);
+MessageType* MessageQueuePeek(MessageQueueType* psTargetQueue_);
+MessageType* MessageQueuePeekNext(MessageQueueType* psTargetQueue_);
+bool MessageClaim(MessageType* psMessage_);
+void MessageUnclaim(MessageType* psMessage_);
+void DeQueueMessage(MessageQueueType* psTargetQueue_);
+bool MessageQueueConfigure(MessageQueueType* psTargetQueue_, u8 u8Reserved_, MessagePriorityType ePriority_);
 
 void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_);
 
@@ -85,13 +183,34 @@ void UpdateMessageStatus(u32 u32Token_, MessageStateType eNewState_);
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Private functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
-static void AddNewMessageStatus(u32 u32Token_);
+static void AddNewMessageStatus(u32 u32Token_, MessageQueueType* psQueue_);
+static u8 MessageLatencyBin(u32 u32Latency_);
+static void MessageNotify(MessageNotifyType* psNotify_);
+static MessageNotifyType* MessageTakeNotify(MessageStatus* psStatus_);
+static void MessageArmNotify(MessageStatus* psStatus_, MessageNotifyType* psNotify_);
+static bool MessageCancel(MessageType* psMessage_, MessageStateType eReason_);
+static void MessageSweepSlot(u8 u8Index_);
+static void MessageSweepStatus(u16 u16Index_);
+static MessageType* MessagePoolAllocate(MessageQueueType* psTargetQueue_);
+static void MessagePoolFree(MessageType* psMessage_);
+static bool MessageAtomicIncrementBelow(volatile u8* pu8Counter_, u8 u8Limit_);
+static void MessageAtomicDecrement(volatile u8* pu8Counter_);
+static bool MessageAtomicSetFlag(volatile u8* pu8Flags_, u8 u8Set_, u8 u8Unless_);
+static void MessageQueuePush(MessageQueueType* psTargetQueue_, MessageType* psMessage_);
+static u32 MessageQueueAppend(MessageQueueType* psTargetQueue_, u32 u32MessageSize_, u8* pu8MessageData_);
+static void MessageCopyData(MessageQueueType* psTargetQueue_, u8* pu8Destination_, const u8* pu8Source_, u32 u32Size_);
+static void MessageArenaReclaim(void);
+static u32 MessageArenaPieceSize(u32 u32Size_);
+static u8* MessageArenaAllocate(u32 u32Size_, u16* pu16Record_);
+static bool MessageArenaExtend(u16 u16Record_, u32 u32Size_);
+static void MessageArenaFree(u16 u16Record_);
 
 
 /***********************************************************************************************************************
 State Machine Declarations
 ***********************************************************************************************************************/
 void MessagingIdle(void);             
+void MessagingSweep(void);
 void MessagingError(void);         
 
 
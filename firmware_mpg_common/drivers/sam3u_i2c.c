@@ -193,7 +193,7 @@ Requires:
   - Initialization of the task
 
 Promises:
-  - Creates a 1-byte message at TWI0->pTransmitBuffer that will be sent by the TWI application
+  - Creates a 1-byte message at TWI0->sTransmitQueue that will be sent by the TWI application
     when it is available.
   - Returns the message token assigned to the message
 */
@@ -210,7 +210,7 @@ u32 TWI0WriteByte(u8 u8SlaveAddress_, u8 u8Byte_, TWIStopType Send_)
   else
   {
     /* Queue Message in message system */
-    u32Token = QueueMessage(&TWI0->pTransmitBuffer, 1, &u8Data);
+    u32Token = QueueMessage(&TWI0->sTransmitQueue, 1, &u8Data);
     if(u32Token)
     {
       /* Queue Relevant data for TWI register setup */
@@ -219,6 +219,7 @@ u32 TWI0WriteByte(u8 u8SlaveAddress_, u8 u8Byte_, TWIStopType Send_)
       TWI_MessageBuffer[TWI_MessageBufferNextIndex].u8Address     = u8SlaveAddress_;
       TWI_MessageBuffer[TWI_MessageBufferNextIndex].Stop          = Send_;
       TWI_MessageBuffer[TWI_MessageBufferNextIndex].u8Attempts    = 0;
+      TWI_MessageBuffer[TWI_MessageBufferNextIndex].u32Token      = u32Token;
       
       /* Not used by Transmit */
       TWI_MessageBuffer[TWI_MessageBufferNextIndex].pu8RxBuffer = NULL;
@@ -257,7 +258,7 @@ Requires:
   - u8Data_ points to the first byte of the data array
 
 Promises:
-  - adds the data message at TWI_Peripheral0->pTransmitBuffer buffer that will be sent by the TWI application
+  - adds the data message at TWI_Peripheral0->sTransmitQueue buffer that will be sent by the TWI application
     when it is available.
   - Returns the message token assigned to the message; 0 is returned if the message cannot be queued in which case
     G_u32MessagingFlags can be checked for the reason
@@ -274,7 +275,7 @@ u32 TWI0WriteData(u8 u8SlaveAddress_, u32 u32Size_, u8* u8Data_, TWIStopType Sen
   else
   {
     /* Queue Message in message system */
-    u32Token = QueueMessage(&TWI0->pTransmitBuffer, u32Size_, u8Data_);
+    u32Token = QueueMessage(&TWI0->sTransmitQueue, u32Size_, u8Data_);
     if(u32Token)
     {
       /* Queue Relevant data for TWI register setup */
@@ -283,6 +284,7 @@ u32 TWI0WriteData(u8 u8SlaveAddress_, u32 u32Size_, u8* u8Data_, TWIStopType Sen
       TWI_MessageBuffer[TWI_MessageBufferNextIndex].u8Address     = u8SlaveAddress_;
       TWI_MessageBuffer[TWI_MessageBufferNextIndex].Stop          = Send_;
       TWI_MessageBuffer[TWI_MessageBufferNextIndex].u8Attempts    = 0;
+      TWI_MessageBuffer[TWI_MessageBufferNextIndex].u32Token      = u32Token;
       
       /* Not used by Transmit */
       TWI_MessageBuffer[TWI_MessageBufferNextIndex].pu8RxBuffer = NULL;
@@ -338,7 +340,10 @@ void TWIInitialize(void)
   
   /* Initialize the TWI peripheral structures */
   TWI_Peripheral0.pBaseAddress    = AT91C_BASE_TWI0;
-  TWI_Peripheral0.pTransmitBuffer = NULL;
+  TWI_Peripheral0.sTransmitQueue.u8Head = 0;
+  TWI_Peripheral0.sTransmitQueue.u8Tail = 0;
+  TWI_Peripheral0.sTransmitQueue.pu8Name = "TWI0";
+  MessageQueueConfigure(&TWI_Peripheral0.sTransmitQueue, TWI_TX_RESERVED_SLOTS, MSG_PRIORITY_NORMAL);
   TWI_Peripheral0.pu8RxBuffer     = NULL;
   TWI_Peripheral0.u32Flags        = 0;
 
@@ -534,8 +539,29 @@ State Machine Function Definitions
 /* Wait for a transmit message to be queued.  Received data is handled in interrupts. */
 void TWISM_Idle(void)
 {
+  MessageType* psMessage;
+  
   if(TWI_MessageBufferNextIndex != TWI_MessageBufferCurIndex )
   {
+    /* A write whose message was cancelled by the messaging task is no longer at the front of the queue (or cannot
+    be claimed): drop it */
+    if(TWI_MessageBuffer[TWI_MessageBufferCurIndex].Direction == WRITE)
+    {
+      psMessage = MessageQueuePeek(&TWI0->sTransmitQueue);
+      if( (psMessage == NULL) || (psMessage->u32Token != TWI_MessageBuffer[TWI_MessageBufferCurIndex].u32Token) ||
+          !MessageClaim(psMessage) )
+      {
+        TWI_MessageBufferCurIndex++;
+        TWI_MessageQueueLength--;
+        if(TWI_MessageBufferCurIndex == TX_QUEUE_SIZE)
+        {
+          TWI_MessageBufferCurIndex = 0;
+        }
+        
+        return;
+      }
+    }
+    
     TWI0->pBaseAddress->TWI_MMR = TWI0_MMR_INIT;
     TWI0->pBaseAddress->TWI_CR = TWI0_CR_INIT;
     
@@ -545,12 +571,12 @@ void TWISM_Idle(void)
       TWI0->pBaseAddress->TWI_MMR |= ((TWI_MessageBuffer[TWI_MessageBufferCurIndex].u8Address << _TWI_MMR_ADDRESS_SHIFT));
       
       /* Set up to transmit the message */
-      TWI_u32CurrentBytesRemaining = TWI0->pTransmitBuffer->u32Size;
-      TWI_pu8CurrentTxData = TWI0->pTransmitBuffer->pu8Message;
+      TWI_u32CurrentBytesRemaining = psMessage->u32Size;
+      TWI_pu8CurrentTxData = psMessage->pu8Message;
       TWI0FillTxBuffer();    
       
       /* Update the message's status */
-      UpdateMessageStatus(TWI0->pTransmitBuffer->u32Token, SENDING);
+      UpdateMessageStatus(psMessage->u32Token, SENDING);
   
       /* Proceed to next state to let the current message send */
       TWI0->u32Flags |= (_TWI_TRANSMITTING | _TWI_TRANS_NOT_COMP);
@@ -623,8 +649,8 @@ void TWISM_Transmitting(void)
   if( !(TWI0->u32Flags & _TWI_TRANSMITTING) )
   {
     /* Update the status queue and then dequeue the message */
-    UpdateMessageStatus(TWI0->pTransmitBuffer->u32Token, COMPLETE);
-    DeQueueMessage(&TWI0->pTransmitBuffer);
+    UpdateMessageStatus(MessageQueuePeek(&TWI0->sTransmitQueue)->u32Token, COMPLETE);
+    DeQueueMessage(&TWI0->sTransmitQueue);
     
     /* Make sure _TWI_INIT_MODE flag is clear in case this was a manual cycle */
     TWI_u32Flags &= ~_TWI_INIT_MODE;
@@ -703,8 +729,8 @@ void TWISM_Error(void)
       if( TWI0->u32Flags & _TWI_TRANSMITTING )
       {
         /* Dequeue Msg and Update Status */ 
-        UpdateMessageStatus(TWI0->pTransmitBuffer->u32Token, ABANDONED);
-        DeQueueMessage(&TWI0->pTransmitBuffer);
+        UpdateMessageStatus(MessageQueuePeek(&TWI0->sTransmitQueue)->u32Token, ABANDONED);
+        DeQueueMessage(&TWI0->sTransmitQueue);
       }
     }
 
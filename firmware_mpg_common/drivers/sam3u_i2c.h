@@ -19,7 +19,7 @@ typedef enum {WRITE, READ} TWIMessageType;
 typedef struct 
 {
   AT91PS_TWI pBaseAddress;            /* Base address of the associated peripheral */
-  MessageType* pTransmitBuffer;       /* Pointer to the transmit message linked list */
+  MessageQueueType sTransmitQueue;    /* Transmit message queue (ring of pool indexes) */
   u8* pu8RxBuffer;                    /* Pointer to receive buffer in user application */
   u32 u32Flags;                       /* Flags for peripheral */
 } TWIPeripheralType;
@@ -30,6 +30,7 @@ typedef struct
   u32 u32Size;                        /* Size of the transfer */
   u8 u8Address;                       /* Slave address */
   u8 u8Attempts;                      /* Number of attempts taken to send msg */
+  u32 u32Token;                       /* Messaging token of a write (used to detect if it was cancelled) */
   
   /* Only Applicable to Write Operations */
   TWIStopType Stop;                   
@@ -62,6 +63,7 @@ Constants / Definitions
 
 #define TWI_TX_FIFO_SIZE               (u8)1             /* Size of the peripheral's transmit FIFO in bytes */
 #define TWI_RX_FIFO_SIZE               (u8)1             /* Size of the peripheral's receive FIFO in bytes */
+#define TWI_TX_RESERVED_SLOTS          (u8)2             /* Message pool slots kept for the TWI0 transmit queue */
 
 #define TWI_INIT_MSG_TIMEOUT           (u32)1000           /* Time in ms for init message to send */
 
@@ -9,9 +9,14 @@ the multitude of variants in slave device !CS requirements.
 This driver should work for SPI slaves with or without flow control, though you may need to make adjustments
 to how data is timed.  A slave with flow control requires callback functions to manage flow control lines.
 
-If LSB first transmission is required, we can't use the DMA if we let the SSP task manage the bit flipping.
-For high-traffic or low-power devices, you might consider flipping at the task level so that DMA
-can be used (the bytes would have to be pre-flipped for transmit and post-flipped on receive).
+The USART only shifts MSB first in SPI mode, so LSB_FIRST is done by reversing the bits of whole buffers in 
+software (ReverseBits(), four bytes at a time) so that the DMA can still be used:
+- Data queued with SspWriteByte() or SspWriteData() is reversed as it is copied into the message.
+- Data that is not copied (SspWriteDataNoCopy(), SspTransfer(), SspQueueSegment()) is sent as it is: the client 
+  reverses it ahead of time, e.g. once when a constant table is set up.
+- A Master transfer's receive buffer is reversed when the transfer completes.
+- A Slave's receive ring is reversed by the ISR at the end of each half and when CS is deasserted.
+- Only the byte-by-byte receiver of SPI_SLAVE_FLOW_CONTROL still reverses each byte as it arrives.
 
 API:
 SspPeripheralType* SspRequest(SspConfigurationType* psSspConfig_)
@@ -34,21 +39,72 @@ e.g.
 u8 au8SData[] = {1, 2, 3, 4, 5, 6};
 u32CurrentMessageToken = SspWriteData(&MyTaskSsp, sizeof(au8SData), au8Sting);
 
+u32 SspWriteDataNoCopy(SspPeripheralType* psSspPeripheral_, u32 u32Size_, const u8* pu8Data_)
+Same as SspWriteData but the data is not copied into the message queue: the PDC sends directly from pu8Data_.
+The data must not change until the message token is COMPLETE.  Use for constant data or buffers that the 
+application leaves alone while the message is sent.
+e.g. 
+static u8 au8SData[] = {1, 2, 3, 4, 5, 6};
+u32CurrentMessageToken = SspWriteDataNoCopy(&MyTaskSsp, sizeof(au8SData), au8SData);
+
 Master mode only:
-u32 SspReadByte(SspPeripheralType* psSspPeripheral_)
-Creates a dummy byte message of 1 byte to subsequently receive a byte. Returns the message token that can be monitored
-to see when the message has been sent, and thus when the received byte should be in the pre-configured receive buffer.
-e.g. u32CurrentMessageToken = SspReadByte(&MyTaskSsp);
+u32 SspTransfer(SspPeripheralType* psSspPeripheral_, const u8* pu8TxData_, u8* pu8RxData_, u32 u32Size_)
+Clocks out u32Size_ bytes from pu8TxData_ (or SSP_DUMMY_BYTEs if pu8TxData_ is NULL) and puts the u32Size_ bytes 
+received at the same time in pu8RxData_.  Both PDC channels run together so a command and its response, or a whole
+data block, are one transaction.  Neither buffer is copied: leave them alone until the token is COMPLETE.
+e.g. 
+static u8 au8Cmd[] = {0x40, 0, 0, 0, 0, 0x95, 0xFF, 0xFF};
+static u8 au8Response[sizeof(au8Cmd)];
+u32CurrentMessageToken = SspTransfer(&MyTaskSsp, au8Cmd, au8Response, sizeof(au8Cmd));
 
-u32 SspReadData(SspPeripheralType* psSspPeripheral_, u32 u32Size_)
-Creates a dummy byte array to subsequently receive u32Size_ bytes. Returns the message token that can be monitored
-to see when the message has been sent, and thus when the received data should be in the pre-configured receive buffer.
-e.g. u32CurrentMessageToken = SspReadData(&MyTaskSsp, 10);
+Master mode only:
+bool SspBeginTransaction(SspPeripheralType* psSspPeripheral_)
+u32 SspQueueSegment(SspPeripheralType* psSspPeripheral_, const u8* pu8TxData_, u8* pu8RxData_, u32 u32Size_, 
+                    SspSegmentPinType eSegmentPin_)
+u32 SspEndTransaction(SspPeripheralType* psSspPeripheral_)
+Groups messages into one bus transaction: CS is asserted for the first segment and stays asserted until the end of
+the transaction, even if the queue runs empty in between.  Each segment is a transmit (pu8RxData_ NULL) or a 
+transfer like SspTransfer() and sets the peripheral's segment pin (e.g. LCD A0) to eSegmentPin_ before its first 
+byte.  Segments with the same pin level follow each other in the PDC without a gap.  Neither buffer is copied.
+SspEndTransaction() returns the token of the end marker: it is COMPLETE once CS has been released.
+e.g.
+SspBeginTransaction(MyTaskSsp);
+SspQueueSegment(MyTaskSsp, au8Command, NULL, sizeof(au8Command), SSP_SEGMENT_PIN_LOW);
+SspQueueSegment(MyTaskSsp, au8Data, NULL, sizeof(au8Data), SSP_SEGMENT_PIN_HIGH);
+u32CurrentMessageToken = SspEndTransaction(MyTaskSsp);
+
+bool SspSetBaudRate(SspPeripheralType* psSspPeripheral_, u32 u32BaudRate_)
+Changes the SPI clock of a Master.  The new rate is loaded the next time a message starts with CS released, so a 
+transfer or transaction that is already running or queued under the current CS finishes at the old rate.
+e.g. SspSetBaudRate(MyTaskSsp, SSP_MAX_BAUD_RATE);
+
+u32 SspGetRecoveryCount(PeripheralType eSspPeripheral_)
+Returns how many Master transfers on the peripheral have timed out since startup (see TIMEOUTS below).  The count is
+kept across SspRelease() / SspRequest() so it can be used to watch the health of a bus in the field.
+e.g. u32Resets = SspGetRecoveryCount(USART1);
+
+u32 SspReadByte(SspPeripheralType* psSspPeripheral_, u8* pu8Byte_)
+Master mode only.  Clocks out one SSP_DUMMY_BYTE and puts the byte received at the same time in *pu8Byte_.  Returns 
+the message token; the byte is valid once the token is COMPLETE.  Same as SspTransfer(psSsp, NULL, pu8Byte_, 1).
+e.g. u32CurrentMessageToken = SspReadByte(&MyTaskSsp, &u8Status);
+
+u32 SspReadData(SspPeripheralType* psSspPeripheral_, u8* pu8RxData_, u32 u32Size_)
+Master mode only.  Clocks out u32Size_ SSP_DUMMY_BYTEs and puts the bytes received at the same time in pu8RxData_.  
+Returns the message token; the data is valid once the token is COMPLETE.  Same as SspTransfer() with no transmit data.
+e.g. u32CurrentMessageToken = SspReadData(&MyTaskSsp, au8Block, sizeof(au8Block));
+
+u16 SspGetRxIndex(SspPeripheralType* psSspPeripheral_)
+Returns the producer index of a Slave's receive ring: the index in the receive buffer where the next received byte 
+will be written.  Every byte from the client's own parsing index up to (not including) this one has been received.
+e.g. while(u16MyParser != SspGetRxIndex(MyTaskSsp)) {...}
 
 
 INITIALIZATION (should take place in application's initialization function):
 1. Create a variable of SspConfigurationType in your application and initialize it to the desired SSP peripheral,
-and the size & address of the receive buffer in the application.
+and the size & address of the receive buffer in the application.  A Master that uses transactions with a segment
+pin sets pSegmentGpioAddress and u32SegmentPin (the pin must already be a GPIO output).  A Master sets u32BaudRate
+to its clock rate in Hz, or leaves it 0 to use the USARTx_US_BRGR_INIT divider from configuration.h.  Clients that
+release and request the peripheral again can keep their current rate in the configuration variable.
 
 2. Call SspRequest() with pointer to the configuration variable created in step 1.  The returned pointer is the
 SspPeripheralType object created that will be used by your application.
@@ -64,16 +120,36 @@ transmit and receive data simultaneously.  Regardless, the SPI protocol always r
 byte.  This may be a defined dummy byte, or it may be 0xFF or 0x00 depending on the idle state of the MISO line.
 Your application must process the received bytes and determine if they are dummy bytes or useful data.
 
-Received bytes on the allocated peripheral will be dropped into the application's designated receive
-buffer.  The buffer is written circularly, with no provision to monitor bytes that are overwritten.  The 
-application is responsible for processing all received data.  The application must provide its own parsing
-pointer to read the receive buffer and properly wrap around.  This pointer will not be impacted by the interrupt
-service routine that may add additional characters at any time.
-
-SSP traffic is always full duplex, but protocols are typically half duplex.  To receive
-data requested from an SSP slave, call SspReadByte() for a single byte or SspReadData() for multiple
-bytes.  These functions will automatically queue SSP_DUMMY bytes to transmit and activate the clock
-to receive data into your application's receive buffer.
+SSP traffic is always full duplex, but protocols are typically half duplex.  The bytes received during 
+SspWriteByte(), SspWriteData() and SspWriteDataNoCopy() messages are not kept.  To receive data from an SSP slave, 
+call SspTransfer(): the PDC receiver runs alongside the transmitter and drops the received bytes straight into the 
+buffer passed with the message, so the application reads them from a known place once the token is COMPLETE.  Pass 
+NULL for the transmit data to clock out SSP_DUMMY_BYTEs, e.g. to read a data block; SspReadByte() and SspReadData() 
+are shorthand for exactly that.
+
+Messages queued back to back are started by the end-of-transfer interrupt without waiting for the task.  For a 
+Master every message that is not part of a transaction gets its own CS assertion: the interrupt waits for the shift 
+register to empty, releases CS and then asserts it again for the next message, so a slave never sees two unrelated 
+messages under one CS however fast they were queued.  A Slave has no CS to release, so its messages are streamed 
+without a gap: while one is being sent the one behind it is loaded in the PDC "next" registers (TNPR/TNCR).
+
+A client that needs several messages under one CS, or a GPIO changed between them, uses a transaction 
+(SspBeginTransaction(), SspQueueSegment() and SspEndTransaction()).  Segments with the same segment pin level are 
+chained in TNPR/TNCR like a Slave's messages.  The end marker releases CS once the last segment has left the shift 
+register, and a message queued after it starts with a new CS edge.  The segment pin is only changed after the shift 
+register is empty, so the segments before and after a change are not chained together.
+
+A queued message that is no longer needed can be dropped with CancelMessage(token).  If the transfer has already
+started, a Master stops the PDC and deasserts CS; the rest of the message is not clocked out.  Cancelling a segment
+that has started therefore breaks its transaction: the segments after it run under a new CS.  End markers are not
+meant to be cancelled.
+
+TIMEOUTS:
+Every Master transfer has a deadline worked out from its byte count and the clock rate, plus SSP_WATCHDOG_MARGIN_MS.
+If the end-of-transfer interrupt has not come by then (e.g. it was lost), SspSM_Error() stops the PDC, resets the 
+USART transmitter and receiver, releases CS and sets the message to TIMEOUT.  A chained message that had not started 
+goes back to WAITING and the queue carries on from it.  A timed out segment breaks its transaction like a cancelled 
+one.  Slaves are clocked by their Master and can wait any length of time, so they have no deadline.
 
 
 SLAVE MODE DATA TRANSFER:
@@ -86,6 +162,13 @@ provide its own parsing pointer to read the receive buffer and properly wrap aro
 This pointer will not be impacted by the interrupt service routine that may add additional 
 characters at any time.
 
+A Slave without flow control receives with the PDC into two halves of the buffer: while one half is being filled 
+the other is loaded in the "next" registers, and the interrupt at the end of each half only reloads the half that 
+was just filled.  That is one interrupt per half buffer instead of one per byte.  SspGetRxIndex() reads the 
+producer index straight from the PDC pointer so a client can read it at any time.  _SSP_RX_COMPLETE is set at the 
+end of each half and when CS is deasserted, so the bytes of a burst that did not fill a half are noticed too.  If 
+the interrupt is held off for a whole half the ring restarts from [0] and _SSP_RX_OVERFLOW is set.
+
 Transmitted data is queued using one of two functions, SspWriteByte() and SspWriteData().  Once the data
 is queued, it is sent as soon as possible.  Different SSP resources may transmit and receive data simultaneously.  
 Per the SPI protocol, a receive byte is always read with every transmit byte.  Your application must process the received bytes
@@ -128,11 +211,12 @@ static SspPeripheralType SSP_Peripheral0;        /* SSP0 peripheral object */
 static SspPeripheralType SSP_Peripheral1;        /* SSP1 peripheral object */
 static SspPeripheralType SSP_Peripheral2;        /* SSP2 peripheral object */
 
-static SspPeripheralType* SSP_psCurrentSsp;      /* Current SSP peripheral being processed task */
+static SspPeripheralType* const SSP_apsPeripherals[SSP_PERIPHERALS] = {&SSP_Peripheral0, &SSP_Peripheral1, &SSP_Peripheral2};
+static u32 SSP_u32PendingPeripherals;            /* Bit (1 << u8PeripheralId) set when a peripheral has messages to start */
 static SspPeripheralType* SSP_psCurrentISR;      /* Current SSP peripheral being processed in ISR */
 static u32* SSP_pu32SspApplicationFlagsISR;      /* Current SSP application status flags in ISR */
 
-static u8 SSP_au8Dummies[MAX_TX_MESSAGE_LENGTH]; /* Array of dummy bytes sent to receive bytes from a slave */
+static u8 SSP_au8Dummies[SSP_DUMMY_BUFFER_SIZE]; /* Array of dummy bytes sent to receive bytes from a slave */
 
 static u32 SSP_u32Int0Count = 0;                 /* Debug counter for SSP0 interrupts */
 static u32 SSP_u32Int1Count = 0;                 /* Debug counter for SSP1 interrupts */
@@ -163,10 +247,13 @@ Requires:
     different SSP configurations for multiple slaves on the same bus - all peripherals on the bus must work with
     the same setup.
   - psSspConfig_ has the SSP peripheral number, address of the RxBuffer and the RxBuffer size
+  - psSspConfig_ has the transmit queue slot reservation and priority class
+  - psSspConfig_->u32BaudRate is the SPI clock for a Master, or 0 for the USARTx_US_BRGR_INIT divider
   - the calling application is ready to start using the peripheral
 
 Promises:
-  - Returns a pointer to the requested SSP peripheral object if the resource is available; otherwise returns NULL
+  - Returns a pointer to the requested SSP peripheral object if the resource is available and the transmit queue
+    reservation fits in the message pool; otherwise returns NULL
   - Peripheral is enabled
   - Peripheral interrupts are enabled.
 */
@@ -224,11 +311,46 @@ SspPeripheralType* SspRequest(SspConfigurationType* psSspConfig_)
     return(NULL);
   }
 
+  /* A Slave receive ring is made of two equal halves */
+  if( (psSspConfig_->SpiMode == SPI_SLAVE) && 
+      ((psSspConfig_->u16RxBufferSize < 2) || (psSspConfig_->u16RxBufferSize & 0x0001)) )
+  {
+    return(NULL);
+  }
+
+  /* A Master runs at its client's clock rate */
+  if( (psSspConfig_->SpiMode == SPI_MASTER) && (psSspConfig_->u32BaudRate != 0) )
+  {
+    u32TargetBRGR = SspBaudRateToBrgr(psSspConfig_->u32BaudRate);
+  }
+  
+  /* Set up the transmit queue's share of the message pool */
+  if( !MessageQueueConfigure(&psRequestedSsp->sTransmitQueue, psSspConfig_->u8TxReservedSlots, psSspConfig_->eTxPriority) )
+  {
+    return(NULL);
+  }
+  
+  /* Data copied into the queue of an LSB-first client is reversed on the way in so the PDC can send it */
+  if(psSspConfig_->BitOrder == LSB_FIRST)
+  {
+    psRequestedSsp->sTransmitQueue.u8Options = _MSG_QUEUE_BIT_REVERSE;
+  }
+  else
+  {
+    psRequestedSsp->sTransmitQueue.u8Options = 0;
+  }
+
   /* Activate and configure the peripheral */
   AT91C_BASE_PMC->PMC_PCER |= (1 << psRequestedSsp->u8PeripheralId);
   
   psRequestedSsp->pCsGpioAddress  = psSspConfig_->pCsGpioAddress;
   psRequestedSsp->u32CsPin        = psSspConfig_->u32CsPin;
+  psRequestedSsp->pSegmentGpioAddress = psSspConfig_->pSegmentGpioAddress;
+  psRequestedSsp->u32SegmentPin   = psSspConfig_->u32SegmentPin;
+  psRequestedSsp->bTransactionOpen = FALSE;
+  psRequestedSsp->u32Brgr         = u32TargetBRGR;
+  psRequestedSsp->u32CrInit       = u32TargetCR;
+  psRequestedSsp->u16RxReadyIndex = 0;
   psRequestedSsp->BitOrder        = psSspConfig_->BitOrder;
   psRequestedSsp->SpiMode         = psSspConfig_->SpiMode;
   psRequestedSsp->fnSlaveTxFlowCallback = psSspConfig_->fnSlaveTxFlowCallback;
@@ -246,16 +368,16 @@ SspPeripheralType* SspRequest(SspConfigurationType* psSspConfig_)
   
   if(psRequestedSsp->SpiMode == SPI_SLAVE)
   {
-    /* Preset the PDC pointers and counters; the receive buffer must be starting from [0] and be at least 2 bytes long)*/
+    /* Preset the PDC with the two halves of the receive ring, starting from [0] */
     psRequestedSsp->pBaseAddress->US_RPR  = (u32)psSspConfig_->pu8RxBufferAddress;
-    psRequestedSsp->pBaseAddress->US_RNPR = (u32)(psSspConfig_->pu8RxBufferAddress + 1);
-    psRequestedSsp->pBaseAddress->US_RCR  = 1;
-    psRequestedSsp->pBaseAddress->US_RNCR = 1;
-    psRequestedSsp->ppu8RxNextByte = NULL; /* not used for SPI_SLAVE */
+    psRequestedSsp->pBaseAddress->US_RCR  = psSspConfig_->u16RxBufferSize / 2;
+    psRequestedSsp->pBaseAddress->US_RNPR = (u32)(psSspConfig_->pu8RxBufferAddress + (psSspConfig_->u16RxBufferSize / 2));
+    psRequestedSsp->pBaseAddress->US_RNCR = psSspConfig_->u16RxBufferSize / 2;
+    psRequestedSsp->ppu8RxNextByte = NULL; /* not used for SPI_SLAVE: see SspGetRxIndex() */
 
     /* Enable the receiver and transmitter requests so they are ready to go if the Master starts clocking */
     psRequestedSsp->pBaseAddress->US_PTCR = AT91C_PDC_RXTEN | AT91C_PDC_TXTEN;
-    psRequestedSsp->pBaseAddress->US_IER = AT91C_US_CTSIC;
+    psRequestedSsp->pBaseAddress->US_IER = AT91C_US_CTSIC | AT91C_US_ENDRX;
   }
 
   if(psRequestedSsp->SpiMode == SPI_SLAVE_FLOW_CONTROL)
@@ -290,32 +412,55 @@ Promises:
 */
 void SspRelease(SspPeripheralType* psSspPeripheral_)
 {
+  MessageType* psMessage;
+  
   /* Check to see if the peripheral is already released */
   if(psSspPeripheral_->pu8RxBuffer == NULL)
   {
     return;
   }
   
-  /* First disable the interrupts */
+  /* Stop a Master transfer that is still running, then disable the interrupts */
+  SspAbortTransfer(&psSspPeripheral_->sTransmitQueue);
   NVIC_DisableIRQ( (IRQn_Type)(psSspPeripheral_->u8PeripheralId) );
   NVIC_ClearPendingIRQ( (IRQn_Type)(psSspPeripheral_->u8PeripheralId) );
+  
+  /* A transaction that was left open must not keep the slave selected */
+  if(psSspPeripheral_->SpiMode == SPI_MASTER)
+  {
+    psSspPeripheral_->pCsGpioAddress->PIO_SODR = psSspPeripheral_->u32CsPin;
+  }
+  
+  /* A Slave's receive ring must stop before the client's buffer is given back */
+  if(psSspPeripheral_->SpiMode == SPI_SLAVE)
+  {
+    psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
+    psSspPeripheral_->pBaseAddress->US_IDR  = AT91C_US_CTSIC | AT91C_US_ENDRX;
+  }
  
   /* Now it's safe to release all of the resources in the target peripheral */
   psSspPeripheral_->pCsGpioAddress = NULL;
+  psSspPeripheral_->pSegmentGpioAddress = NULL;
+  psSspPeripheral_->bTransactionOpen = FALSE;
   psSspPeripheral_->pu8RxBuffer    = NULL;
   psSspPeripheral_->ppu8RxNextByte  = NULL;
   psSspPeripheral_->u32PrivateFlags = 0;
+  psSspPeripheral_->u8TxLoaded      = 0;
   psSspPeripheral_->fnSlaveTxFlowCallback = NULL;
   psSspPeripheral_->fnSlaveRxFlowCallback = NULL;
 
   /* Empty the transmit buffer if there were leftover messages */
-  while(psSspPeripheral_->psTransmitBuffer != NULL)
+  while( (psMessage = MessageQueuePeek(&psSspPeripheral_->sTransmitQueue)) != NULL )
   {
-    UpdateMessageStatus(psSspPeripheral_->psTransmitBuffer->u32Token, ABANDONED);
-    DeQueueMessage(&psSspPeripheral_->psTransmitBuffer);
+    UpdateMessageStatus(psMessage->u32Token, ABANDONED);
+    DeQueueMessage(&psSspPeripheral_->sTransmitQueue);
   }
   
-  /* Ensure the SM is in the Idle state */
+  /* Give the reserved message slots back to the pool */
+  MessageQueueConfigure(&psSspPeripheral_->sTransmitQueue, 0, MSG_PRIORITY_NORMAL);
+  
+  /* Ensure the SM is in the Idle state with nothing to start on this peripheral */
+  SSP_u32PendingPeripherals &= ~((u32)1 << psSspPeripheral_->u8PeripheralId);
   Ssp_pfnStateMachine = SspSM_Idle;
   
 } /* end SspRelease() */
@@ -332,7 +477,7 @@ Requires:
   - The chip select line of the SSP device should be asserted
 
 Promises:
-  - Creates a 1-byte message at psSspPeripheral_->psTransmitBuffer that will be sent by the SSP application
+  - Creates a 1-byte message at psSspPeripheral_->sTransmitQueue that will be sent by the SSP application
     when it is available.
   - Returns the message token assigned to the message
 */
@@ -341,9 +486,11 @@ u32 SspWriteByte(SspPeripheralType* psSspPeripheral_, u8 u8Byte_)
   u32 u32Token;
   u8 u8Data = u8Byte_;
   
-  u32Token = QueueMessage(&psSspPeripheral_->psTransmitBuffer, 1, &u8Data);
+  u32Token = QueueMessage(&psSspPeripheral_->sTransmitQueue, 1, &u8Data);
   if( u32Token != 0 )
   {
+    SSP_u32PendingPeripherals |= (u32)1 << psSspPeripheral_->u8PeripheralId;
+    
     /* If the system is initializing, we want to manually cycle the SSP task through one iteration
     to send the message */
     if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
@@ -371,7 +518,7 @@ Requires:
   - u8Data_ points to the first byte of the data array
 
 Promises:
-  - adds the data message at psSspPeripheral_->psTransmitBuffer that will be sent by the SSP application
+  - adds the data message at psSspPeripheral_->sTransmitQueue that will be sent by the SSP application
     when it is available.
   - Returns the message token assigned to the message; 0 is returned if the message cannot be queued in which case
     G_u32MessagingFlags can be checked for the reason
@@ -380,12 +527,14 @@ u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_
 {
   u32 u32Token;
 
-  u32Token = QueueMessage(&psSspPeripheral_->psTransmitBuffer, u32Size_, pu8Data_);
+  u32Token = QueueMessage(&psSspPeripheral_->sTransmitQueue, u32Size_, pu8Data_);
   if( u32Token == 0 )
   {
     return(0);
   }
   
+  SSP_u32PendingPeripherals |= (u32)1 << psSspPeripheral_->u8PeripheralId;
+  
   /* If the system is initializing, manually cycle the SSP task through one iteration to send the message */
   if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
   {
@@ -397,6 +546,46 @@ u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* pu8Data_
 } /* end SspWriteData() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspWriteDataNoCopy
+
+Description:
+Queues a data array for transfer on the target SSP peripheral without copying it.  
+
+Requires:
+  - psSspPeripheral_ has been requested and holds a valid pointer to a transmit buffer
+  - u32Size_ is the number of bytes in the data array
+  - pu8Data_ points to the first byte of the data array which must not change until the message is COMPLETE
+
+Promises:
+  - adds a message at psSspPeripheral_->sTransmitQueue that points to pu8Data_ and will be sent by the SSP application
+    when it is available.
+  - Returns the message token assigned to the message; 0 is returned if the message cannot be queued in which case
+    G_u32MessagingFlags can be checked for the reason
+*/
+u32 SspWriteDataNoCopy(SspPeripheralType* psSspPeripheral_, u32 u32Size_, const u8* pu8Data_)
+{
+  u32 u32Token;
+
+  u32Token = QueueMessageNoCopy(&psSspPeripheral_->sTransmitQueue, u32Size_, pu8Data_);
+  if( u32Token == 0 )
+  {
+    return(0);
+  }
+  
+  SSP_u32PendingPeripherals |= (u32)1 << psSspPeripheral_->u8PeripheralId;
+  
+  /* If the system is initializing, manually cycle the SSP task through one iteration to send the message */
+  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+  {
+    SspManualMode();
+  }
+
+  return(u32Token);
+
+} /* end SspWriteDataNoCopy() */
+
+
 /*----------------------------------------------------------------------------------------------------------------------
 Function: SspReadByte
 
@@ -404,19 +593,18 @@ Description:
 Master mode only.  Gets a single byte from the slave on the target SSP peripheral.  
 
 Requires:
-  - psSspPeripheral_ has been requested.
-  - The chip select line of the SSP device should be asserted
-  - 
+  - psSspPeripheral_ has been requested as an SPI_MASTER
+  - pu8Byte_ points to where the received byte goes and is not touched by the application until the message is no 
+    longer WAITING or RECEIVING
 
 Promises:
-  - Creates a message with one SSP_DUMMY_BYTE at psSspPeripheral_->psTransmitBuffer that will be sent by the SSP application
-    when it is available and thus clock in a received byte to the target receive buffer.
-  - Returns the Token of the transmitted dummy message used to read data.
-
+  - Queues a one byte transfer (see SspTransfer()) that clocks out SSP_DUMMY_BYTE and puts the byte clocked in at 
+    *pu8Byte_
+  - Returns the message token; 0 if the transfer could not be queued
 */
-u32 SspReadByte(SspPeripheralType* psSspPeripheral_)
+u32 SspReadByte(SspPeripheralType* psSspPeripheral_, u8* pu8Byte_)
 {
-  return( QueueMessage(&psSspPeripheral_->psTransmitBuffer, 1, &SSP_au8Dummies[0]) );
+  return( SspTransfer(psSspPeripheral_, NULL, pu8Byte_, 1) );
 
 } /* end SspReadByte() */
 
@@ -425,34 +613,295 @@ u32 SspReadByte(SspPeripheralType* psSspPeripheral_)
 Function: SspReadData
 
 Description:
-Gets multiple bytes from the slave on the target SSP peripheral.  
+Master mode only.  Gets multiple bytes from the slave on the target SSP peripheral.  
 
 Requires:
-  - psSspPeripheral_ has been requested and holds a valid pointer to a transmit buffer; even if a transmission is
-    in progress, the node in the buffer that is currently being sent will not be destroyed during this function.
-  - The chip select line of the SSP device should be asserted
-  - u32Size_ is the number of bytes in the data array
+  - psSspPeripheral_ has been requested as an SPI_MASTER
+  - pu8RxData_ points to room for u32Size_ bytes and is not touched by the application until the message is no 
+    longer WAITING or RECEIVING
+  - u32Size_ is 1 to SSP_MAX_TRANSFER_SIZE
+
+Promises:
+  - Queues a transfer (see SspTransfer()) that clocks out u32Size_ SSP_DUMMY_BYTEs and puts the bytes clocked in 
+    at pu8RxData_
+  - Returns the message token; 0 if the transfer could not be queued
+*/
+u32 SspReadData(SspPeripheralType* psSspPeripheral_, u8* pu8RxData_, u32 u32Size_)
+{
+  return( SspTransfer(psSspPeripheral_, NULL, pu8RxData_, u32Size_) );
+
+} /* end SspReadData() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspTransfer
+
+Description:
+Master mode only.  Queues a full-duplex transfer: u32Size_ bytes are clocked out and the u32Size_ bytes clocked in at 
+the same time are put in pu8RxData_ by the PDC.  Neither buffer is copied.
+
+Requires:
+  - psSspPeripheral_ has been requested as an SPI_MASTER
+  - pu8TxData_ points to u32Size_ bytes to send (it may be in flash), or is NULL to send SSP_DUMMY_BYTEs
+  - pu8RxData_ points to room for u32Size_ bytes
+  - u32Size_ is 1 to SSP_MAX_TRANSFER_SIZE
+  - Neither buffer is touched by the application until the message is no longer WAITING or RECEIVING
 
 Promises:
-  - Adds a dummy byte message at psSspPeripheral_->psTransmitBuffer that will be sent by the SSP application
-    when it is available and thus clock in the received bytes to the designated Rx buffer.
-  - Returns the message token of the dummy message used to read data
-  - If the peripheral is busy reading data already, then returns 0.
+  - Adds a transfer message at psSspPeripheral_->sTransmitQueue that will be run by the SSP application
+    when it is available; it has a CS assertion of its own unless it is part of a transaction
+  - Returns the message token assigned to the message; 0 is returned if the peripheral is not a Master, the size
+    is out of range or the message cannot be queued (G_u32MessagingFlags has the reason)
 */
-u32 SspReadData(SspPeripheralType* psSspPeripheral_, u32 u32Size_)
+u32 SspTransfer(SspPeripheralType* psSspPeripheral_, const u8* pu8TxData_, u8* pu8RxData_, u32 u32Size_)
 {
-  u8 au8MsgTooBig[] = "\r\nSSP message to large\n\r";
+  u32 u32Token;
+
+  if( (psSspPeripheral_->SpiMode != SPI_MASTER) || (pu8RxData_ == NULL) ||
+      (u32Size_ == 0) || (u32Size_ > SSP_MAX_TRANSFER_SIZE) )
+  {
+    return(0);
+  }
+  
+  u32Token = QueueMessageTransfer(&psSspPeripheral_->sTransmitQueue, u32Size_, pu8TxData_, pu8RxData_, 0);
+  if( u32Token == 0 )
+  {
+    return(0);
+  }
   
-  /* Disallow if requested size is too large */
-  if(u32Size_ > MAX_TX_MESSAGE_LENGTH)
+  SSP_u32PendingPeripherals |= (u32)1 << psSspPeripheral_->u8PeripheralId;
+  
+  /* If the system is initializing, manually cycle the SSP task through one iteration to send the message */
+  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+  {
+    SspManualMode();
+  }
+
+  return(u32Token);
+
+} /* end SspTransfer() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspSetBaudRate
+
+Description:
+Master mode only.  Changes the SPI clock rate of the peripheral.  The baud rate generator is only reloaded when a
+message starts with CS released (see SspStartNextMessage()), so bytes already queued under the current CS assertion,
+including the rest of an open transaction, are clocked at the old rate.
+
+Requires:
+  - psSspPeripheral_ has been requested as an SPI_MASTER
+  - u32BaudRate_ is the new clock rate in Hz; it is rounded down to MCK / CD and limited to SSP_MAX_BAUD_RATE
+
+Promises:
+  - Returns TRUE and the new rate is used from the next CS assertion; returns FALSE if psSspPeripheral_ is not a 
+    Master or u32BaudRate_ is 0
+*/
+bool SspSetBaudRate(SspPeripheralType* psSspPeripheral_, u32 u32BaudRate_)
+{
+  if( (psSspPeripheral_->SpiMode != SPI_MASTER) || (u32BaudRate_ == 0) )
   {
-    DebugPrintf(au8MsgTooBig);
-    return 0;
+    return(FALSE);
   }
   
-  return( QueueMessage(&psSspPeripheral_->psTransmitBuffer, u32Size_, &SSP_au8Dummies[0]) );
+  /* The ISR only reads u32Brgr, so a single word write is safe at any time */
+  psSspPeripheral_->u32Brgr = SspBaudRateToBrgr(u32BaudRate_);
+  return(TRUE);
+
+} /* end SspSetBaudRate() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspGetRecoveryCount
+
+Description:
+Reports how many times a peripheral has been reset because a Master transfer ran past its deadline.
+
+Requires:
+  - eSspPeripheral_ is USART0, USART1 or USART2
+
+Promises:
+  - Returns the peripheral's u32RecoveryCount, or 0 if eSspPeripheral_ is not an SSP peripheral
+*/
+u32 SspGetRecoveryCount(PeripheralType eSspPeripheral_)
+{
+  switch(eSspPeripheral_)
+  {
+    case USART0:
+    {
+      return(SSP_Peripheral0.u32RecoveryCount);
+    }
+    case USART1:
+    {
+      return(SSP_Peripheral1.u32RecoveryCount);
+    }
+    case USART2:
+    {
+      return(SSP_Peripheral2.u32RecoveryCount);
+    }
     
-} /* end SspReadData() */
+    default:
+    {
+      return(0);
+    }
+  } /* end switch */
+  
+} /* end SspGetRecoveryCount() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspGetRxIndex
+
+Description:
+Reads the producer index of a Slave's receive ring.  For MSB_FIRST it comes straight from the PDC receive pointer: the 
+pointer is only moved on by the PDC after the byte is in memory and is read in one access.  For LSB_FIRST it is the 
+end of the bytes the ISR has already reversed, which is a single u16 written by the ISR.  Either way the value is 
+safe to use from task context.
+
+Requires:
+  - psSspPeripheral_ has been requested as an SPI_SLAVE
+
+Promises:
+  - Returns the index in pu8RxBuffer where the next byte for the client will be (0 to u16RxBufferSize - 1)
+*/
+u16 SspGetRxIndex(SspPeripheralType* psSspPeripheral_)
+{
+  if(psSspPeripheral_->BitOrder == LSB_FIRST)
+  {
+    return(psSspPeripheral_->u16RxReadyIndex);
+  }
+  
+  return( SspRxDmaIndex(psSspPeripheral_) );
+  
+} /* end SspGetRxIndex() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspBeginTransaction
+
+Description:
+Master mode only.  Opens a transaction: the segments queued with SspQueueSegment() until SspEndTransaction() are 
+sent under one CS assertion.
+
+Requires:
+  - psSspPeripheral_ has been requested as an SPI_MASTER
+
+Promises:
+  - Returns TRUE and the transaction is open if psSspPeripheral_ is a Master without a transaction already open;
+    otherwise returns FALSE
+*/
+bool SspBeginTransaction(SspPeripheralType* psSspPeripheral_)
+{
+  if( (psSspPeripheral_->SpiMode != SPI_MASTER) || psSspPeripheral_->bTransactionOpen )
+  {
+    return(FALSE);
+  }
+  
+  psSspPeripheral_->bTransactionOpen = TRUE;
+  return(TRUE);
+
+} /* end SspBeginTransaction() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspQueueSegment
+
+Description:
+Master mode only.  Queues one segment of the open transaction.  A segment is sent like SspWriteDataNoCopy() if 
+pu8RxData_ is NULL or like SspTransfer() otherwise, and the segment pin is set to eSegmentPin_ before it starts.
+
+Requires:
+  - A transaction is open on psSspPeripheral_ (SspBeginTransaction())
+  - pu8TxData_ points to u32Size_ bytes to send, or is NULL to send SSP_DUMMY_BYTEs if pu8RxData_ is not NULL
+  - pu8RxData_ points to room for u32Size_ bytes, or is NULL if the received bytes are not needed
+  - u32Size_ is 1 to SSP_MAX_TRANSFER_SIZE
+  - Neither buffer is touched by the application until the message is no longer WAITING, SENDING or RECEIVING
+  - eSegmentPin_ is ignored if the peripheral was requested without a segment pin
+
+Promises:
+  - Adds the segment to psSspPeripheral_->sTransmitQueue and returns its token
+  - Returns 0 if no transaction is open, the parameters are out of range or the message cannot be queued 
+    (G_u32MessagingFlags has the reason); the transaction stays open so it should still be ended
+*/
+u32 SspQueueSegment(SspPeripheralType* psSspPeripheral_, const u8* pu8TxData_, u8* pu8RxData_, u32 u32Size_, 
+                    SspSegmentPinType eSegmentPin_)
+{
+  u32 u32Token;
+  u8 u8SegmentFlags = _SSP_MSG_SEGMENT;
+
+  if( !psSspPeripheral_->bTransactionOpen || ((pu8TxData_ == NULL) && (pu8RxData_ == NULL)) ||
+      (u32Size_ == 0) || (u32Size_ > SSP_MAX_TRANSFER_SIZE) )
+  {
+    return(0);
+  }
+  
+  if( (psSspPeripheral_->pSegmentGpioAddress != NULL) && (eSegmentPin_ == SSP_SEGMENT_PIN_HIGH) )
+  {
+    u8SegmentFlags |= _SSP_MSG_PIN_HIGH;
+  }
+  
+  u32Token = QueueMessageTransfer(&psSspPeripheral_->sTransmitQueue, u32Size_, pu8TxData_, pu8RxData_, u8SegmentFlags);
+  if( u32Token == 0 )
+  {
+    return(0);
+  }
+  
+  SSP_u32PendingPeripherals |= (u32)1 << psSspPeripheral_->u8PeripheralId;
+  
+  /* If the system is initializing, manually cycle the SSP task through one iteration to send the message */
+  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+  {
+    SspManualMode();
+  }
+
+  return(u32Token);
+
+} /* end SspQueueSegment() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspEndTransaction
+
+Description:
+Master mode only.  Closes the open transaction by queuing an end marker behind its segments.  The marker clocks no
+bytes: when the SSP reaches it, CS is released after the last byte of the transaction has been shifted out.
+
+Requires:
+  - A transaction is open on psSspPeripheral_ (SspBeginTransaction())
+
+Promises:
+  - Returns the token of the end marker, which is COMPLETE once CS has been released, and the transaction is closed
+  - Returns 0 if no transaction is open or the marker cannot be queued; in the second case the transaction is still
+    open so the call can be retried
+*/
+u32 SspEndTransaction(SspPeripheralType* psSspPeripheral_)
+{
+  u32 u32Token;
+
+  if( !psSspPeripheral_->bTransactionOpen )
+  {
+    return(0);
+  }
+  
+  u32Token = QueueMessageTransfer(&psSspPeripheral_->sTransmitQueue, 0, NULL, NULL, _SSP_MSG_END);
+  if( u32Token == 0 )
+  {
+    return(0);
+  }
+  
+  psSspPeripheral_->bTransactionOpen = FALSE;
+  SSP_u32PendingPeripherals |= (u32)1 << psSspPeripheral_->u8PeripheralId;
+  
+  /* If the system is initializing, manually cycle the SSP task through one iteration to release CS */
+  if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+  {
+    SspManualMode();
+  }
+
+  return(u32Token);
+
+} /* end SspEndTransaction() */
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -480,35 +929,50 @@ void SspInitialize(void)
   /* Initialize the SSP peripheral structures */
   SSP_Peripheral0.pBaseAddress     = AT91C_BASE_US0;
   SSP_Peripheral0.pCsGpioAddress   = NULL;
-  SSP_Peripheral0.psTransmitBuffer = NULL;
+  SSP_Peripheral0.sTransmitQueue.u8Head = 0;
+  SSP_Peripheral0.sTransmitQueue.u8Tail = 0;
+  SSP_Peripheral0.sTransmitQueue.pu8Name = "SSP0";
+  SSP_Peripheral0.sTransmitQueue.pfnAbort = SspAbortTransfer;
   SSP_Peripheral0.pu8RxBuffer      = NULL;
   SSP_Peripheral0.u16RxBufferSize  = 0;
   SSP_Peripheral0.ppu8RxNextByte    = NULL;
   SSP_Peripheral0.u32PrivateFlags  = 0;
   SSP_Peripheral0.u8PeripheralId   = AT91C_ID_US0;
+  SSP_Peripheral0.u8TxLoaded       = 0;
+  SSP_Peripheral0.u32RecoveryCount = 0;
   
   SSP_Peripheral1.pBaseAddress     = AT91C_BASE_US1;
   SSP_Peripheral1.pCsGpioAddress   = NULL;
-  SSP_Peripheral1.psTransmitBuffer = NULL;
+  SSP_Peripheral1.sTransmitQueue.u8Head = 0;
+  SSP_Peripheral1.sTransmitQueue.u8Tail = 0;
+  SSP_Peripheral1.sTransmitQueue.pu8Name = "SSP1";
+  SSP_Peripheral1.sTransmitQueue.pfnAbort = SspAbortTransfer;
   SSP_Peripheral1.pu8RxBuffer      = NULL;
   SSP_Peripheral1.u16RxBufferSize  = 0;
   SSP_Peripheral1.ppu8RxNextByte    = NULL;
   SSP_Peripheral1.u32PrivateFlags  = 0;
   SSP_Peripheral1.u8PeripheralId   = AT91C_ID_US1;
+  SSP_Peripheral1.u8TxLoaded       = 0;
+  SSP_Peripheral1.u32RecoveryCount = 0;
 
   SSP_Peripheral2.pBaseAddress     = AT91C_BASE_US2;
   SSP_Peripheral2.pCsGpioAddress   = NULL;
-  SSP_Peripheral2.psTransmitBuffer = NULL;
+  SSP_Peripheral2.sTransmitQueue.u8Head = 0;
+  SSP_Peripheral2.sTransmitQueue.u8Tail = 0;
+  SSP_Peripheral2.sTransmitQueue.pu8Name = "SSP2";
+  SSP_Peripheral2.sTransmitQueue.pfnAbort = SspAbortTransfer;
   SSP_Peripheral2.pu8RxBuffer      = NULL;
   SSP_Peripheral2.u16RxBufferSize  = 0;
   SSP_Peripheral2.ppu8RxNextByte    = NULL;
   SSP_Peripheral2.u32PrivateFlags  = 0;
   SSP_Peripheral2.u8PeripheralId   = AT91C_ID_US2;
+  SSP_Peripheral2.u8TxLoaded       = 0;
+  SSP_Peripheral2.u32RecoveryCount = 0;
 
-  SSP_psCurrentSsp                = &SSP_Peripheral0;
+  SSP_u32PendingPeripherals       = 0;
   
   /* Fill the dummy array with SSP_DUMMY bytes */
-  memset(SSP_au8Dummies, SSP_DUMMY_BYTE, MAX_TX_MESSAGE_LENGTH);
+  memset(SSP_au8Dummies, SSP_DUMMY_BYTE, SSP_DUMMY_BUFFER_SIZE);
 
   /* Set application pointer */
   Ssp_pfnStateMachine = SspSM_Idle;
@@ -556,9 +1020,8 @@ void SspManualMode(void)
 {
   /* Set up for manual mode */
   SSP_u32Flags |= _SSP_MANUAL_MODE;
-  SSP_psCurrentSsp = &SSP_Peripheral0;
 
-  /* Run a full cycle of the SSP state machine so all SSP peripherals send their current message */  
+  /* Run a cycle of the SSP state machine so all SSP peripherals start their current message */  
   while(SSP_u32Flags & _SSP_MANUAL_MODE)
   {
     Ssp_pfnStateMachine();
@@ -574,36 +1037,774 @@ void SspManualMode(void)
 /* Private functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 
-
 /*----------------------------------------------------------------------------------------------------------------------
-Interrupt Service Routine: SSP0_IRQHandler
+Function: SspAbortTransfer
 
 Description:
-Handles the enabled SSP0 interrupts. 
-
-Transmit: An End Transmit interrupt will occur when the PDC has finished sending all of the bytes.
-Receive: An End Receive interrupt will occur when the PDC has finished receiving all of the expected bytes.
+Stops the transfer of the message at the front of an SSP transmit queue (the pfnAbort function of the queues).
+Only Master transfers are stopped: a Slave is clocked by its Master so stopping the PDC part way would leave the 
+Master reading whatever is left in the shift register.
 
 Requires:
-  - ISRs cannot require anything
+  - Called from task context by CancelMessage()
+  - psQueue_ is the sTransmitQueue of one of the SSP peripherals
 
 Promises:
-  - Status of message that has completed transferring will be set to COMPLETE.
-  - Peripheral CS line is cleared and the PDC is disabled
-  - _SSP_PERIPHERAL_RX/TX is cleared
+  - If a Master transfer is in progress it is stopped by SspStopTransfer() with status ABANDONED and TRUE is returned
+  - Otherwise returns FALSE and nothing is changed
 */
-void SSP0_IRQHandler(void)
+bool SspAbortTransfer(void* psQueue_)
 {
-  /* Set the current ISR pointers to SSP0 targets */
-  SSP_psCurrentISR = &SSP_Peripheral0;                         /* Current SSP ISR */
-  SSP_pu32SspApplicationFlagsISR = &G_u32Ssp0ApplicationFlags; /* Current SSP application status flags */
-  SSP_u32Int0Count++;
-
-  /* Go to common SSP interrupt using psCurrentSspISR since the SSP cannot interrupt itself */
-  SspGenericHandler();
+  SspPeripheralType* psSsp;
   
-} /* end SSP0_IRQHandler() */
-
+  /* Find the peripheral that owns the queue */
+  if(psQueue_ == &SSP_Peripheral0.sTransmitQueue)
+  {
+    psSsp = &SSP_Peripheral0;
+  }
+  else if(psQueue_ == &SSP_Peripheral1.sTransmitQueue)
+  {
+    psSsp = &SSP_Peripheral1;
+  }
+  else if(psQueue_ == &SSP_Peripheral2.sTransmitQueue)
+  {
+    psSsp = &SSP_Peripheral2;
+  }
+  else
+  {
+    return(FALSE);
+  }
+  
+  if(psSsp->SpiMode != SPI_MASTER)
+  {
+    return(FALSE);
+  }
+  
+  /* Hold off the peripheral's interrupt so the transfer cannot complete while it is being stopped */
+  NVIC_DisableIRQ( (IRQn_Type)(psSsp->u8PeripheralId) );
+  
+  /* The message may have finished just before the interrupt was disabled */
+  if( !(psSsp->u32PrivateFlags & (_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX)) )
+  {
+    NVIC_EnableIRQ( (IRQn_Type)(psSsp->u8PeripheralId) );
+    return(FALSE);
+  }
+  
+  SspStopTransfer(psSsp, ABANDONED);
+  
+  NVIC_EnableIRQ( (IRQn_Type)(psSsp->u8PeripheralId) );
+  return(TRUE);
+  
+} /* end SspAbortTransfer() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspStopTransfer
+
+Description:
+Stops the Master transfer at the front of the queue part way through and finishes its message with eReason_.
+
+Requires:
+  - psSspPeripheral_ is a Master with _SSP_PERIPHERAL_TX set
+  - The peripheral's interrupt is disabled
+
+Promises:
+  - The PDC and its interrupts are disabled and the PDC counters are cleared
+  - CS is deasserted once the shift register is empty (or SspWaitTxEmpty() gives up)
+  - The front message status is eReason_ and it is dequeued.  A message chained behind it in TNPR/TNCR has not 
+    started so it is put back to WAITING and will be sent on its own.
+  - _SSP_PERIPHERAL_TX/RX are cleared and the peripheral is flagged in SSP_u32PendingPeripherals
+*/
+void SspStopTransfer(SspPeripheralType* psSspPeripheral_, MessageStateType eReason_)
+{
+  /* Stop the PDC and clear the counters so nothing else is clocked */
+  psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS | AT91C_PDC_RXTDIS;
+  psSspPeripheral_->pBaseAddress->US_IDR  = AT91C_US_ENDTX | AT91C_US_TXBUFE | AT91C_US_ENDRX;
+  psSspPeripheral_->pBaseAddress->US_TCR  = 0;
+  psSspPeripheral_->pBaseAddress->US_TNCR = 0;
+  psSspPeripheral_->pBaseAddress->US_RCR  = 0;
+  
+  if(psSspPeripheral_->u8TxLoaded == 2)
+  {
+    MessageUnclaim(MessageQueuePeekNext(&psSspPeripheral_->sTransmitQueue));
+  }
+  psSspPeripheral_->u8TxLoaded = 0;
+  psSspPeripheral_->u32CurrentTxBytesRemaining = 0;
+  
+  /* Let the byte in the shift register finish before CS is deasserted */
+  SspWaitTxEmpty(psSspPeripheral_);
+  psSspPeripheral_->pCsGpioAddress->PIO_SODR = psSspPeripheral_->u32CsPin;
+  
+  UpdateMessageStatus(MessageQueuePeek(&psSspPeripheral_->sTransmitQueue)->u32Token, eReason_);
+  DeQueueMessage(&psSspPeripheral_->sTransmitQueue);
+  psSspPeripheral_->u32PrivateFlags &= ~(_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX);
+  
+  /* Anything queued behind it is started by the next SspSM_Idle() pass */
+  SSP_u32PendingPeripherals |= (u32)1 << psSspPeripheral_->u8PeripheralId;
+  
+} /* end SspStopTransfer() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspRecoverPeripheral
+
+Description:
+Gets a Master going again after its transfer has run past its deadline.  The transfer is stopped and the USART 
+transmitter and receiver are reset in case the peripheral itself is what got stuck.
+
+Requires:
+  - psSspPeripheral_ is a Master with _SSP_PERIPHERAL_TX set whose deadline has passed
+  - The peripheral's interrupt is disabled
+
+Promises:
+  - The transfer is stopped by SspStopTransfer() with status TIMEOUT
+  - The USART transmitter, receiver and status bits are reset and US_CR is loaded with u32CrInit again
+  - u32RecoveryCount is incremented
+*/
+void SspRecoverPeripheral(SspPeripheralType* psSspPeripheral_)
+{
+  SspStopTransfer(psSspPeripheral_, TIMEOUT);
+  
+  psSspPeripheral_->pBaseAddress->US_CR = AT91C_US_RSTTX | AT91C_US_RSTRX | AT91C_US_RSTSTA;
+  psSspPeripheral_->pBaseAddress->US_CR = psSspPeripheral_->u32CrInit;
+  
+  psSspPeripheral_->u32RecoveryCount++;
+  
+} /* end SspRecoverPeripheral() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspBaudRateToBrgr
+
+Description:
+Works out the US_BRGR value for an SPI Master clock rate.  The divider is rounded up so the clock is never faster
+than asked for.
+
+Requires:
+  - u32BaudRate_ is not 0
+
+Promises:
+  - Returns CD = MCK / u32BaudRate_ rounded up and limited to SSP_MIN_MASTER_CD .. SSP_MAX_MASTER_CD
+*/
+u32 SspBaudRateToBrgr(u32 u32BaudRate_)
+{
+  u32 u32Cd;
+  
+  u32Cd = ((PCLK_VALUE) + u32BaudRate_ - 1) / u32BaudRate_;
+  if(u32Cd < SSP_MIN_MASTER_CD)
+  {
+    u32Cd = SSP_MIN_MASTER_CD;
+  }
+  
+  if(u32Cd > SSP_MAX_MASTER_CD)
+  {
+    u32Cd = SSP_MAX_MASTER_CD;
+  }
+  
+  return(u32Cd);
+  
+} /* end SspBaudRateToBrgr() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspTransferTimeMs
+
+Description:
+Works out how long a Master takes to clock out u32Size_ bytes at its current clock rate.
+
+Requires:
+  - US_BRGR holds the divider in use
+
+Promises:
+  - Returns the time in ms rounded up, at least 1; 0 if there is no divider (a Slave is clocked by its Master and 
+    has no deadline)
+*/
+u32 SspTransferTimeMs(SspPeripheralType* psSspPeripheral_, u32 u32Size_)
+{
+  u32 u32Cd;
+  u32 u32BitsPerMs;
+  
+  u32Cd = psSspPeripheral_->pBaseAddress->US_BRGR & SSP_MAX_MASTER_CD;
+  if(u32Cd == 0)
+  {
+    return(0);
+  }
+  
+  u32BitsPerMs = ((PCLK_VALUE) / 1000) / u32Cd;
+  if(u32BitsPerMs == 0)
+  {
+    u32BitsPerMs = 1;
+  }
+  
+  return( ((u32Size_ * 8) / u32BitsPerMs) + 1 );
+  
+} /* end SspTransferTimeMs() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspRxDmaIndex
+
+Description:
+Works out where the PDC will write the next byte of a Slave's receive ring.
+
+Requires:
+  - psSspPeripheral_ is an SPI_SLAVE
+
+Promises:
+  - Returns US_RPR as an index in pu8RxBuffer (0 to u16RxBufferSize - 1)
+*/
+u16 SspRxDmaIndex(SspPeripheralType* psSspPeripheral_)
+{
+  u32 u32Index;
+  
+  u32Index = psSspPeripheral_->pBaseAddress->US_RPR - (u32)psSspPeripheral_->pu8RxBuffer;
+  
+  /* The pointer sits at the end of the buffer when the last byte is in but the ISR has not reloaded [0] yet */
+  if(u32Index >= psSspPeripheral_->u16RxBufferSize)
+  {
+    u32Index = 0;
+  }
+  
+  return( (u16)u32Index );
+  
+} /* end SspRxDmaIndex() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspRxRingRelease
+
+Description:
+Hands received bytes of an LSB_FIRST Slave's ring to the client: the bits of the bytes from u16RxReadyIndex up to 
+u16Index_ (wrapping at the end of the buffer) are reversed and u16RxReadyIndex is moved on.
+
+Requires:
+  - psSspPeripheral_ is an LSB_FIRST SPI_SLAVE; called from its ISR
+  - Every byte from u16RxReadyIndex up to u16Index_ has been written by the PDC
+
+Promises:
+  - The bytes are reversed in place and u16RxReadyIndex is u16Index_
+*/
+void SspRxRingRelease(SspPeripheralType* psSspPeripheral_, u16 u16Index_)
+{
+  u16 u16Start = psSspPeripheral_->u16RxReadyIndex;
+  
+  if(u16Index_ < u16Start)
+  {
+    ReverseBits(psSspPeripheral_->pu8RxBuffer + u16Start, psSspPeripheral_->pu8RxBuffer + u16Start, 
+                psSspPeripheral_->u16RxBufferSize - u16Start);
+    u16Start = 0;
+  }
+  
+  ReverseBits(psSspPeripheral_->pu8RxBuffer + u16Start, psSspPeripheral_->pu8RxBuffer + u16Start, u16Index_ - u16Start);
+  psSspPeripheral_->u16RxReadyIndex = u16Index_;
+  
+} /* end SspRxRingRelease() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspStartNextMessage
+
+Description:
+Starts the message at the front of the queue of a peripheral that has nothing loaded in the PDC.  Transaction end 
+markers met on the way are completed here: each one waits for the last byte of its transaction to leave the shift 
+register and releases CS, so whatever follows starts with a new CS edge.  This is also the only place a Master's 
+clock rate is changed: CS is released and the shift register is empty, so no slave sees the rate change.
+
+Requires:
+  - psSspPeripheral_ is a Master or a Slave without flow control with nothing loaded in the PDC
+  - Called from the peripheral's ISR, or from task context while _SSP_PERIPHERAL_TX and _SSP_PERIPHERAL_RX are clear
+
+Promises:
+  - Returns TRUE if a message was claimed and started: for a Master US_BRGR is loaded with u32Brgr if CS was 
+    released, then CS is asserted, _SSP_PERIPHERAL_TX is set and the message is started by SspStartMessage()
+  - Returns FALSE if nothing was started because the queue is empty or its front message could not be claimed
+*/
+bool SspStartNextMessage(SspPeripheralType* psSspPeripheral_)
+{
+  MessageType* psMessage;
+  
+  while( (psMessage = MessageQueuePeek(&psSspPeripheral_->sTransmitQueue)) != NULL )
+  {
+    if( !MessageClaim(psMessage) )
+    {
+      return(FALSE);
+    }
+    
+    if( !(psMessage->u8Flags & _SSP_MSG_END) )
+    {
+      if(psSspPeripheral_->SpiMode == SPI_MASTER)
+      {
+        /* A new clock rate only takes effect between CS assertions */
+        if( (psSspPeripheral_->pCsGpioAddress->PIO_ODSR & psSspPeripheral_->u32CsPin) &&
+            (psSspPeripheral_->pBaseAddress->US_BRGR != psSspPeripheral_->u32Brgr) )
+        {
+          psSspPeripheral_->pBaseAddress->US_BRGR = psSspPeripheral_->u32Brgr;
+        }
+        
+        psSspPeripheral_->pCsGpioAddress->PIO_CODR = psSspPeripheral_->u32CsPin;
+      }
+      
+      psSspPeripheral_->u32PrivateFlags |= _SSP_PERIPHERAL_TX;
+      SspStartMessage(psSspPeripheral_, psMessage);
+      return(TRUE);
+    }
+    
+    /* End of a transaction: release CS once its last byte is out */
+    SspWaitTxEmpty(psSspPeripheral_);
+    psSspPeripheral_->pCsGpioAddress->PIO_SODR = psSspPeripheral_->u32CsPin;
+    
+    UpdateMessageStatus(psMessage->u32Token, COMPLETE);
+    DeQueueMessage(&psSspPeripheral_->sTransmitQueue);
+  }
+  
+  return(FALSE);
+  
+} /* end SspStartNextMessage() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspStartMessage
+
+Description:
+Starts the PDC on the message at the front of the queue: a transfer message (one with a receive buffer) runs the 
+receiver and transmitter together, any other message is only transmitted.  A transaction segment sets the 
+segment pin first.
+
+Requires:
+  - As SspStartTransmit(); a transfer message is only queued on a Master
+
+Promises:
+  - The segment pin is set for psMessage_ (see SspSetSegmentPin())
+  - The watchdog deadline is restarted for psMessage_
+  - psMessage_ is started by SspStartTransfer() or SspStartTransmit()
+*/
+void SspStartMessage(SspPeripheralType* psSspPeripheral_, MessageType* psMessage_)
+{
+  SspSetSegmentPin(psSspPeripheral_, psMessage_);
+  
+  psSspPeripheral_->u32WatchdogStart = G_u32SystemTime1ms;
+  psSspPeripheral_->u32WatchdogMs = SSP_WATCHDOG_MARGIN_MS + SspTransferTimeMs(psSspPeripheral_, psMessage_->u32Size);
+  
+  if(psMessage_->pu8RxData != NULL)
+  {
+    SspStartTransfer(psSspPeripheral_, psMessage_);
+  }
+  else
+  {
+    SspStartTransmit(psSspPeripheral_, psMessage_);
+  }
+  
+} /* end SspStartMessage() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspSetSegmentPin
+
+Description:
+Sets the segment pin to the level a transaction segment asks for.  If the level changes, the byte of the previous 
+segment that may still be in the shift register is let out first so the slave samples it with the old level.
+
+Requires:
+  - psMessage_ is the message about to be started on psSspPeripheral_ with nothing else loaded in the PDC
+
+Promises:
+  - If psMessage_ is a segment and the peripheral has a segment pin, the pin is high if _SSP_MSG_PIN_HIGH is set 
+    and low otherwise; other messages leave the pin alone
+*/
+void SspSetSegmentPin(SspPeripheralType* psSspPeripheral_, MessageType* psMessage_)
+{
+  if( !(psMessage_->u8Flags & _SSP_MSG_SEGMENT) || (psSspPeripheral_->pSegmentGpioAddress == NULL) )
+  {
+    return;
+  }
+  
+  if(psMessage_->u8Flags & _SSP_MSG_PIN_HIGH)
+  {
+    if( !(psSspPeripheral_->pSegmentGpioAddress->PIO_ODSR & psSspPeripheral_->u32SegmentPin) )
+    {
+      SspWaitTxEmpty(psSspPeripheral_);
+      psSspPeripheral_->pSegmentGpioAddress->PIO_SODR = psSspPeripheral_->u32SegmentPin;
+    }
+  }
+  else if(psSspPeripheral_->pSegmentGpioAddress->PIO_ODSR & psSspPeripheral_->u32SegmentPin)
+  {
+    SspWaitTxEmpty(psSspPeripheral_);
+    psSspPeripheral_->pSegmentGpioAddress->PIO_CODR = psSspPeripheral_->u32SegmentPin;
+  }
+  
+} /* end SspSetSegmentPin() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspWaitTxEmpty
+
+Description:
+Waits for the transmitter to finish the byte in its holding and shift registers.  The limit is SSP_TXEMPTY_BYTES 
+byte times at the clock in US_BRGR: the CPU runs from MCK, so a bit is CD CPU cycles (about 960 cycles a byte at 
+400 kHz).  The wait is never shorter than SSP_TXEMPTY_TIMEOUT loops, the old fixed limit.
+
+Requires:
+  - Nothing new is being loaded into the transmitter
+  - US_BRGR holds the divider in use for a Master
+
+Promises:
+  - Returns when TXEMPTY is set or the time for SSP_TXEMPTY_BYTES bytes has passed
+*/
+void SspWaitTxEmpty(SspPeripheralType* psSspPeripheral_)
+{
+  u32 u32Timeout = 0;
+  u32 u32MaxLoops;
+  
+  u32MaxLoops = (SSP_TXEMPTY_BYTES * 8 * (psSspPeripheral_->pBaseAddress->US_BRGR & SSP_MAX_MASTER_CD)) / 
+                SSP_TXEMPTY_LOOP_CYCLES;
+  if(u32MaxLoops < SSP_TXEMPTY_TIMEOUT)
+  {
+    u32MaxLoops = SSP_TXEMPTY_TIMEOUT;
+  }
+  
+  while ( !(psSspPeripheral_->pBaseAddress->US_CSR & AT91C_US_TXEMPTY) && 
+          u32Timeout < u32MaxLoops)
+  {
+    u32Timeout++;
+  } 
+  
+} /* end SspWaitTxEmpty() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspStartTransfer
+
+Description:
+Starts a full-duplex transfer of the message at the front of the queue.  The receiver PDC is loaded with the message's 
+receive buffer and ENDRX marks the end of the transfer.  The transmitter sends the message data, or dummy bytes 
+from SSP_au8Dummies that are topped up by SspLoadDummies() until the whole size has been loaded.
+
+Requires:
+  - psSspPeripheral_ is a Master with nothing loaded in the PDC
+  - psMessage_ is the front of psSspPeripheral_->sTransmitQueue, has been claimed and has a receive buffer
+  - CS is asserted
+
+Promises:
+  - psMessage_ is RECEIVING, _SSP_PERIPHERAL_TX and _SSP_PERIPHERAL_RX are set
+  - Any byte left in the receiver by a previous message has been discarded
+  - ENDRX is enabled and both PDC channels are running
+*/
+void SspStartTransfer(SspPeripheralType* psSspPeripheral_, MessageType* psMessage_)
+{
+  psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS | AT91C_PDC_RXTDIS;
+  psSspPeripheral_->pBaseAddress->US_IDR  = AT91C_US_ENDTX | AT91C_US_TXBUFE;
+
+  /* A message sent just before may still be shifting: let it finish so the byte it receives is not taken as the
+  first byte of this transfer, then empty the receiver */
+  SspWaitTxEmpty(psSspPeripheral_);
+  (void)psSspPeripheral_->pBaseAddress->US_RHR;
+  psSspPeripheral_->pBaseAddress->US_CR = AT91C_US_RSTSTA;
+  
+  UpdateMessageStatus(psMessage_->u32Token, RECEIVING);
+  psSspPeripheral_->u32PrivateFlags |= (_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX);
+  
+  /* Loading RCR clears ENDRX so it is safe to enable the interrupt */
+  psSspPeripheral_->pBaseAddress->US_RPR = (unsigned int)psMessage_->pu8RxData; 
+  psSspPeripheral_->pBaseAddress->US_RCR = psMessage_->u32Size;
+  psSspPeripheral_->pBaseAddress->US_IER = AT91C_US_ENDRX;
+  
+  if(psMessage_->pu8Message != NULL)
+  {
+    psSspPeripheral_->pBaseAddress->US_TPR = (unsigned int)psMessage_->pu8Message; 
+    psSspPeripheral_->pBaseAddress->US_TCR = psMessage_->u32Size;
+    psSspPeripheral_->u32CurrentTxBytesRemaining = 0;
+  }
+  else
+  {
+    psSspPeripheral_->pBaseAddress->US_TCR = 0;
+    psSspPeripheral_->u32CurrentTxBytesRemaining = psMessage_->u32Size;
+    SspLoadDummies(psSspPeripheral_);
+  }
+  
+  /* Start the receiver first so it is ready for the first byte clocked out */
+  psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_RXTEN;
+  psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
+  
+} /* end SspStartTransfer() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspLoadDummies
+
+Description:
+Keeps the transmitter of a transfer without transmit data supplied with blocks of up to SSP_DUMMY_BUFFER_SIZE dummy 
+bytes.  A block goes in TPR/TCR if the PDC has run dry or in TNPR/TNCR behind the current one, with the same byte of 
+margin as SspChainNextMessage().  ENDTX then asks for the next block as soon as one is used up; if only TPR/TCR could 
+be loaded TXBUFE is used instead.
+
+Requires:
+  - u32CurrentTxBytesRemaining is the number of dummy bytes still to be loaded
+  - Called with the peripheral's interrupt unable to run (from its ISR or before the PDC is enabled)
+
+Promises:
+  - Up to two blocks are loaded and u32CurrentTxBytesRemaining is reduced to match
+  - ENDTX or TXBUFE is enabled while dummy bytes are left to load; neither is enabled once they have all been loaded
+*/
+void SspLoadDummies(SspPeripheralType* psSspPeripheral_)
+{
+  u32 u32Block;
+  
+  /* Restart the transmitter if it has run out */
+  if( (psSspPeripheral_->u32CurrentTxBytesRemaining != 0) && (psSspPeripheral_->pBaseAddress->US_TCR == 0) )
+  {
+    u32Block = psSspPeripheral_->u32CurrentTxBytesRemaining;
+    if(u32Block > SSP_DUMMY_BUFFER_SIZE)
+    {
+      u32Block = SSP_DUMMY_BUFFER_SIZE;
+    }
+    
+    psSspPeripheral_->pBaseAddress->US_TPR = (unsigned int)&SSP_au8Dummies[0]; 
+    psSspPeripheral_->pBaseAddress->US_TCR = u32Block;
+    psSspPeripheral_->u32CurrentTxBytesRemaining -= u32Block;
+  }
+  
+  /* Queue the next block behind it */
+  if( (psSspPeripheral_->u32CurrentTxBytesRemaining != 0) && (psSspPeripheral_->pBaseAddress->US_TNCR == 0) &&
+      (!(psSspPeripheral_->pBaseAddress->US_PTSR & AT91C_PDC_TXTEN) || (psSspPeripheral_->pBaseAddress->US_TCR > 1)) )
+  {
+    u32Block = psSspPeripheral_->u32CurrentTxBytesRemaining;
+    if(u32Block > SSP_DUMMY_BUFFER_SIZE)
+    {
+      u32Block = SSP_DUMMY_BUFFER_SIZE;
+    }
+    
+    psSspPeripheral_->pBaseAddress->US_TNPR = (unsigned int)&SSP_au8Dummies[0]; 
+    psSspPeripheral_->pBaseAddress->US_TNCR = u32Block;
+    psSspPeripheral_->u32CurrentTxBytesRemaining -= u32Block;
+  }
+  
+  /* Ask for the next block when there is room for it */
+  if(psSspPeripheral_->u32CurrentTxBytesRemaining == 0)
+  {
+    psSspPeripheral_->pBaseAddress->US_IDR = AT91C_US_ENDTX | AT91C_US_TXBUFE;
+  }
+  else if(psSspPeripheral_->pBaseAddress->US_TNCR != 0)
+  {
+    psSspPeripheral_->pBaseAddress->US_IDR = AT91C_US_TXBUFE;
+    psSspPeripheral_->pBaseAddress->US_IER = AT91C_US_ENDTX;
+  }
+  else
+  {
+    psSspPeripheral_->pBaseAddress->US_IDR = AT91C_US_ENDTX;
+    psSspPeripheral_->pBaseAddress->US_IER = AT91C_US_TXBUFE;
+  }
+  
+} /* end SspLoadDummies() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspStartTransmit
+
+Description:
+Starts a PDC transmit of the message at the front of the queue and chains the message behind it if there is one.
+Used by SspSM_Idle() to start a peripheral and by the end-of-transfer interrupt to carry on with messages that were
+queued while the PDC was busy.
+
+Requires:
+  - psSspPeripheral_ is a Master or a Slave without flow control and is not transmitting or is in its ISR with 
+    nothing left loaded in the PDC
+  - psMessage_ is the front of psSspPeripheral_->sTransmitQueue and has been claimed
+  - For a Master, CS is asserted
+
+Promises:
+  - psMessage_ is SENDING and is loaded in TPR/TCR; the next message may be loaded in TNPR/TNCR 
+    (see SspChainNextMessage())
+  - The matching end-of-transfer interrupt is enabled and the PDC transmitter is running
+*/
+void SspStartTransmit(SspPeripheralType* psSspPeripheral_, MessageType* psMessage_)
+{
+  /* Hold the PDC while both register pairs are loaded */
+  psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+  
+  UpdateMessageStatus(psMessage_->u32Token, SENDING);
+  psSspPeripheral_->pBaseAddress->US_TPR = (unsigned int)psMessage_->pu8Message; 
+  psSspPeripheral_->pBaseAddress->US_TCR = psMessage_->u32Size;
+  psSspPeripheral_->u8TxLoaded = 1;
+  
+  /* Loading TCR cleared ENDTX and TXBUFE so the interrupt chosen here cannot fire early */
+  SspChainNextMessage(psSspPeripheral_);
+  
+  /* Enable the transmitter to start the transfer */
+  psSspPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
+  
+} /* end SspStartTransmit() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspChainNextMessage
+
+Description:
+Loads the message behind the one being sent into TNPR/TNCR so the PDC continues with it as soon as TCR reaches 0.  
+The end-of-transfer interrupt is chosen to match: with two messages loaded ENDTX marks the end of the first one 
+(the PDC has already moved on to the second); with one message loaded TXBUFE marks the end of it since ENDTX is 
+still set from an earlier reload.  Only a message sent the same way as the one in TPR/TCR can follow it without a 
+gap: a transfer needs the receiver, a transaction end marker releases CS and a segment pin change has to wait for 
+the shift register.  A Master only chains the segments of a transaction since any other message gets its own CS.
+
+Requires:
+  - psSspPeripheral_ has 1 message loaded in TPR/TCR (u8TxLoaded is 1)
+  - Called with the peripheral's interrupt unable to run (from its ISR or before the PDC is enabled)
+
+Promises:
+  - If the second message in the queue is a transmit-only message with the same segment flags as the front one (and 
+    not an end marker), the front one is a segment or the peripheral is a Slave, the message can be claimed and TNCR can be written safely (the PDC is stopped or more than one byte is 
+    left in TCR), it is loaded in TNPR/TNCR, its time is added to the watchdog deadline, u8TxLoaded is 2 and ENDTX 
+    is the enabled interrupt
+  - Otherwise TXBUFE is the enabled interrupt
+*/
+void SspChainNextMessage(SspPeripheralType* psSspPeripheral_)
+{
+  MessageType* psMessage;
+  u8 u8CurrentFlags;
+  
+  /* Writing TNCR as the PDC reloads from it could lose the message, so leave a byte of margin */
+  if( !(psSspPeripheral_->pBaseAddress->US_PTSR & AT91C_PDC_TXTEN) || 
+      (psSspPeripheral_->pBaseAddress->US_TCR > 1) )
+  {
+    u8CurrentFlags = MessageQueuePeek(&psSspPeripheral_->sTransmitQueue)->u8Flags;
+    psMessage = MessageQueuePeekNext(&psSspPeripheral_->sTransmitQueue);
+    if( (psMessage != NULL) && (psMessage->pu8RxData == NULL) && !(psMessage->u8Flags & _SSP_MSG_END) &&
+        !((psMessage->u8Flags ^ u8CurrentFlags) & (_SSP_MSG_SEGMENT | _SSP_MSG_PIN_HIGH)) &&
+        ( (psSspPeripheral_->SpiMode != SPI_MASTER) || (u8CurrentFlags & _SSP_MSG_SEGMENT) ) && MessageClaim(psMessage) )
+    {
+      /* Writing TNCR also clears ENDTX from the reload that got us here */
+      psSspPeripheral_->pBaseAddress->US_TNPR = (unsigned int)psMessage->pu8Message; 
+      psSspPeripheral_->pBaseAddress->US_TNCR = psMessage->u32Size;
+      psSspPeripheral_->u8TxLoaded = 2;
+      psSspPeripheral_->u32WatchdogMs += SspTransferTimeMs(psSspPeripheral_, psMessage->u32Size);
+      
+      psSspPeripheral_->pBaseAddress->US_IDR = AT91C_US_TXBUFE;
+      psSspPeripheral_->pBaseAddress->US_IER = AT91C_US_ENDTX;
+      return;
+    }
+  }
+  
+  psSspPeripheral_->pBaseAddress->US_IDR = AT91C_US_ENDTX;
+  psSspPeripheral_->pBaseAddress->US_IER = AT91C_US_TXBUFE;
+  
+} /* end SspChainNextMessage() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: SspServicePeripheral
+
+Description:
+Starts the message at the front of a peripheral's transmit queue if the peripheral is not busy.
+Slave devices receive outside of the state machine.
+For SSP SPI Master mode, the peripheral will have a message queued regardless of whether the intent is send or receive.
+A Master transfer that receives data has a receive buffer in psMessage->pu8RxData (see SspTransfer()).
+The busy flags are checked first so the front of the queue is only looked at when it is not in progress.
+Once a PDC transmit is running, messages queued behind it are picked up by the ISR.  A transaction whose segments
+have all been sent keeps CS asserted with the PDC idle; its next segment or end marker is started from here.
+
+Requires:
+  - Called from SspSM_Idle() for a peripheral flagged in SSP_u32PendingPeripherals
+
+Promises:
+  - If the peripheral is idle and its front message can be claimed, the message is started
+  - Returns FALSE if the peripheral still needs attention: the front message could not be claimed (it is being 
+    cancelled and will be released by the next MessageQueuePeek()) or a flow-control Slave is busy; otherwise TRUE 
+    since the queue is empty, its front message has been started or the rest is left to the ISR
+*/
+bool SspServicePeripheral(SspPeripheralType* psSspPeripheral_)
+{
+  u32 u32Byte;
+  MessageType* psMessage;
+  
+  /* A running PDC picks up the messages queued behind it in the ISR, but a flow-control Slave has to be looked at 
+  again once its current message is done */
+  if(psSspPeripheral_->u32PrivateFlags & (_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX))
+  {
+    return(psSspPeripheral_->SpiMode != SPI_SLAVE_FLOW_CONTROL);
+  }
+  
+  /* A Master or Slave device without flow control uses the PDC: load the message (and the next one if it is already
+  queued) and start the transfer.  A Master asserts chip select first, unless the queue starts with the end of a
+  transaction which releases it. */
+  if(psSspPeripheral_->SpiMode != SPI_SLAVE_FLOW_CONTROL)
+  {
+    if( SspStartNextMessage(psSspPeripheral_) )
+    {
+      return(TRUE);
+    }
+    
+    /* Nothing was started: done unless the front message is being cancelled */
+    return( MessageQueuePeek(&psSspPeripheral_->sTransmitQueue) == NULL );
+  }
+  
+  psMessage = MessageQueuePeek(&psSspPeripheral_->sTransmitQueue);
+  if(psMessage == NULL)
+  {
+    return(TRUE);
+  }
+  
+  if( !MessageClaim(psMessage) )
+  {
+    return(FALSE);
+  }
+  
+  /* Transmitting: flag that the peripheral is now busy */
+  psSspPeripheral_->u32PrivateFlags |= _SSP_PERIPHERAL_TX;    
+  
+  /* A Slave device with flow control uses interrupt-driven single byte transfers */
+  UpdateMessageStatus(psMessage->u32Token, SENDING);
+
+  /* At this point, CS is asserted and the master is waiting for flow control.
+  Load in the message parameters. */
+  psSspPeripheral_->u32CurrentTxBytesRemaining = psMessage->u32Size;
+  psSspPeripheral_->pu8CurrentTxData = psMessage->pu8Message;
+
+  /* An LSB_FIRST message was reversed when it was queued */
+  u32Byte = 0x000000FF & *psSspPeripheral_->pu8CurrentTxData;
+  
+  /* Reset the transmitter since we have not been managing dummy bytes and it tends to be
+  in the middle of a transmission or something that causes the wrong byte to get sent (at least on startup). */
+  psSspPeripheral_->pBaseAddress->US_CR = (AT91C_US_RSTTX);
+  psSspPeripheral_->pBaseAddress->US_CR = (AT91C_US_TXEN);
+  psSspPeripheral_->pBaseAddress->US_THR = (u8)u32Byte;
+  psSspPeripheral_->pBaseAddress->US_IDR = AT91C_US_RXRDY;
+  psSspPeripheral_->pBaseAddress->US_IER = AT91C_US_TXEMPTY;
+  psSspPeripheral_->fnSlaveTxFlowCallback();
+  
+  return(TRUE);
+  
+} /* end SspServicePeripheral() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Interrupt Service Routine: SSP0_IRQHandler
+
+Description:
+Handles the enabled SSP0 interrupts. 
+
+Transmit: An End Transmit interrupt will occur when the PDC has finished sending all of the bytes.
+Receive: An End Receive interrupt will occur when the PDC has finished receiving all of the expected bytes.
+
+Requires:
+  - ISRs cannot require anything
+
+Promises:
+  - Status of message that has completed transferring will be set to COMPLETE.
+  - Peripheral CS line is cleared and the PDC is disabled
+  - _SSP_PERIPHERAL_RX/TX is cleared
+*/
+void SSP0_IRQHandler(void)
+{
+  /* Set the current ISR pointers to SSP0 targets */
+  SSP_psCurrentISR = &SSP_Peripheral0;                         /* Current SSP ISR */
+  SSP_pu32SspApplicationFlagsISR = &G_u32Ssp0ApplicationFlags; /* Current SSP application status flags */
+  SSP_u32Int0Count++;
+
+  /* Go to common SSP interrupt using psCurrentSspISR since the SSP cannot interrupt itself */
+  SspGenericHandler();
+  
+} /* end SSP0_IRQHandler() */
+
 
 /*----------------------------------------------------------------------------------------------------------------------
 Interrupt Service Routine: SSP1_IRQHandler
@@ -658,9 +1859,11 @@ Handles the enabled interrupts for the current SSP.
 
 Chip select: only enabled for SLAVE peripherals.  A Slave peripheral needs this signal to know it is communicating.  
 If it is supposed to be transmitting and does not have any flow control, the data should already be ready.
-Transmit: An End Transmit interrupt will occur when the PDC has finished sending all of the bytes for Master or Slave.
-Receive: An End Receive interrupt will occur when the PDC has finished receiving all of the expected bytes for Master or a single byte for Slave.
-Receive RXBUFF: An Rx Buffer empty interrupt occurs on a Slave when both the current and next send counters are 0.
+Transmit: An End Transmit (ENDTX) interrupt occurs when the PDC has finished the current message and moved on to the 
+message chained in TNPR/TNCR; a Tx Buffer Empty (TXBUFE) interrupt occurs when the last loaded message is done.
+Either way the finished messages are completed and the PDC is kept busy with whatever has been queued since.
+Receive: An End Receive interrupt will occur when the PDC has finished receiving all of the expected bytes for Master 
+or one half of the receive ring for Slave.  RXBUFF is also set on a Slave if both halves ran out before the ISR.
 
 Requires:
   - SSP_psCurrentISR points to the SSP peripheral who has triggered the interrupt
@@ -669,14 +1872,19 @@ Requires:
 
 Promises:
   - Status of message that has completed transferring will be set to COMPLETE.
-  - For Master peripherals, the CS line is cleared and the PDC is disabled
+  - Queued transmit messages are loaded into the PDC as the loaded ones finish
+  - For Master peripherals the CS line is cleared after every message that is not a segment of a transaction that 
+    has not ended, before the next message is started
+  - Once nothing is left to send the PDC is disabled
   - _SSP_PERIPHERAL_RX/TX is cleared
 */
 void SspGenericHandler(void)
 {
   u32 u32Byte;
-  u32 u32Timeout;
   u32 u32Current_CSR;
+  u16 u16RxHalf;
+  u8 u8LastFlags;
+  MessageType* psMessage;
   
   /* Get a copy of CSR because reading it changes it */
   u32Current_CSR = SSP_psCurrentISR->pBaseAddress->US_CSR;
@@ -697,10 +1905,14 @@ void SspGenericHandler(void)
       /* Flag that CS is deasserted */
       *SSP_pu32SspApplicationFlagsISR &= ~_SSP_CS_ASSERTED;
      
-      /* Make sure RCR is 1 for next transmission on Slave - no flow control devices only */
+      /* The end of a burst: any bytes that did not fill a half of the ring are ready to read (no flow control) */
       if(SSP_psCurrentISR->SpiMode == SPI_SLAVE)
       {
-        SSP_psCurrentISR->pBaseAddress->US_RCR  = 1;
+        if(SSP_psCurrentISR->BitOrder == LSB_FIRST)
+        {
+          SspRxRingRelease(SSP_psCurrentISR, SspRxDmaIndex(SSP_psCurrentISR));
+        }
+        *SSP_pu32SspApplicationFlagsISR |= _SSP_RX_COMPLETE;
       }
     }
   } /* end CS change state interrupt */
@@ -715,15 +1927,9 @@ void SspGenericHandler(void)
     
     if(SSP_psCurrentISR->u32CurrentTxBytesRemaining != 0)
     {
-      /* Advance the pointer (non-circular buffer), load the next byte and use the callback */
+      /* Advance the pointer (non-circular buffer), load the next byte (already in bit order) and use the callback */
       SSP_psCurrentISR->pu8CurrentTxData++;
       u32Byte = 0x000000FF & *SSP_psCurrentISR->pu8CurrentTxData;
-
-      /* If we need LSB first, use inline assembly to flip bits with a single instruction. */
-      if(SSP_psCurrentISR->BitOrder == LSB_FIRST)
-      {
-        u32Byte = __RBIT(u32Byte)>>24;
-      }
     
       SSP_psCurrentISR->pBaseAddress->US_THR = (u8)u32Byte; /* Clears interrupt flag */
       SSP_psCurrentISR->fnSlaveTxFlowCallback();
@@ -735,8 +1941,8 @@ void SspGenericHandler(void)
       
       /* Clean up the message status and flags */
       SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;  
-      UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-      DeQueueMessage(&SSP_psCurrentISR->psTransmitBuffer);
+      UpdateMessageStatus(MessageQueuePeek(&SSP_psCurrentISR->sTransmitQueue)->u32Token, COMPLETE);
+      DeQueueMessage(&SSP_psCurrentISR->sTransmitQueue);
  
       /* Re-enable Rx interrupt and clean-up the operation */    
       SSP_psCurrentISR->pBaseAddress->US_IER = AT91C_US_RXRDY;
@@ -781,65 +1987,130 @@ void SspGenericHandler(void)
     /* Master mode and Slave mode operate differently */
     if(SSP_psCurrentISR->SpiMode == SPI_MASTER)
     {
-      /* Update this message token status and then DeQueue it */
-      UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-      DeQueueMessage( &SSP_psCurrentISR->psTransmitBuffer );
-      SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_RX;
-    
-      /* Shut down hardware */
-      SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
+      /* The last byte of the transfer is in: stop both channels and complete the message */
+      SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_RXTDIS | AT91C_PDC_TXTDIS;
+      SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDRX | AT91C_US_ENDTX | AT91C_US_TXBUFE;
+      SSP_psCurrentISR->u32CurrentTxBytesRemaining = 0;
+      
+      psMessage = MessageQueuePeek(&SSP_psCurrentISR->sTransmitQueue);
+      if(SSP_psCurrentISR->BitOrder == LSB_FIRST)
+      {
+        ReverseBits(psMessage->pu8RxData, psMessage->pu8RxData, psMessage->u32Size);
+      }
+      
+      u8LastFlags = psMessage->u8Flags;
+      UpdateMessageStatus(psMessage->u32Token, COMPLETE);
+      DeQueueMessage( &SSP_psCurrentISR->sTransmitQueue );
+      SSP_psCurrentISR->u32PrivateFlags &= ~(_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX);
+      *SSP_pu32SspApplicationFlagsISR |= _SSP_RX_COMPLETE;
       
-      /* Disable the receiver */
-      SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_RXTDIS;
-      SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDRX;
+      /* The transmit flags seen on entry belong to the transfer, not to whatever is started next */
+      u32Current_CSR &= ~(AT91C_US_ENDTX | AT91C_US_TXBUFE);
+    
+      /* Release CS (the shift register is already empty since the last byte has been received) unless a 
+      transaction is waiting for more segments, then carry on with the next message */
+      if( !(u8LastFlags & _SSP_MSG_SEGMENT) )
+      {
+        SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
+      }
+      (void)SspStartNextMessage(SSP_psCurrentISR);
     }
-    /* Otherwise the peripheral is a Slave that just received a byte */
-    /* ENDRX Interrupt when a byte has been received (RNCR is moved to RCR; RNPR is copied to RPR))*/
+    /* Otherwise the peripheral is a Slave that just filled one half of its receive ring */
+    /* ENDRX Interrupt when RCR reaches 0 (RNCR is moved to RCR; RNPR is copied to RPR) */
     else
     {
-      /* Flag that a byte has arrived */
-      *SSP_pu32SspApplicationFlagsISR |= _SSP_RX_COMPLETE;
-
-      /* Update the pointer to the next valid Rx location (always leap-frogs the immediate next byte since it will be filled by the other DMA proces */
-      SSP_psCurrentISR->pBaseAddress->US_RNPR ++;
-      if(SSP_psCurrentISR->pBaseAddress->US_RPR == (u32)(SSP_psCurrentISR->pu8RxBuffer + (u32)SSP_psCurrentISR->u16RxBufferSize) )
+      u16RxHalf = SSP_psCurrentISR->u16RxBufferSize / 2;
+      
+      /* If the ISR was held off for a whole half, both counters have run out: bytes were lost so start the ring 
+      again from [0] */
+      if(u32Current_CSR & AT91C_US_RXBUFF)
       {
-        SSP_psCurrentISR->pBaseAddress->US_RPR = (u32)SSP_psCurrentISR->pu8RxBuffer;  /* !!!!! CHECK */
+        SSP_psCurrentISR->pBaseAddress->US_RPR = (u32)SSP_psCurrentISR->pu8RxBuffer;
+        SSP_psCurrentISR->pBaseAddress->US_RCR = u16RxHalf;
+        SSP_psCurrentISR->u16RxReadyIndex = 0;
+        *SSP_pu32SspApplicationFlagsISR |= _SSP_RX_OVERFLOW;
       }
       
-      /* Write RNCR to 1 to clear the ENDRX flag */
-      SSP_psCurrentISR->pBaseAddress->US_RNCR = 1;
+      /* The half that was just filled goes behind the one being filled; writing RNCR clears ENDRX.  An LSB_FIRST 
+      ring has the rest of the filled half reversed, unless a CS release already went past the end of it. */
+      if(SSP_psCurrentISR->pBaseAddress->US_RPR < (u32)(SSP_psCurrentISR->pu8RxBuffer + u16RxHalf))
+      {
+        SSP_psCurrentISR->pBaseAddress->US_RNPR = (u32)(SSP_psCurrentISR->pu8RxBuffer + u16RxHalf);
+        if( (SSP_psCurrentISR->BitOrder == LSB_FIRST) && (SSP_psCurrentISR->u16RxReadyIndex >= u16RxHalf) )
+        {
+          SspRxRingRelease(SSP_psCurrentISR, 0);
+        }
+      }
+      else
+      {
+        SSP_psCurrentISR->pBaseAddress->US_RNPR = (u32)SSP_psCurrentISR->pu8RxBuffer;
+        if( (SSP_psCurrentISR->BitOrder == LSB_FIRST) && (SSP_psCurrentISR->u16RxReadyIndex < u16RxHalf) )
+        {
+          SspRxRingRelease(SSP_psCurrentISR, u16RxHalf);
+        }
+      }
+      SSP_psCurrentISR->pBaseAddress->US_RNCR = u16RxHalf;
+      
+      /* Flag that a half of the ring is ready to read */
+      *SSP_pu32SspApplicationFlagsISR |= _SSP_RX_COMPLETE;
     }  
   } /* end ENDRX handling */
 
 
-  /* ENDTX Interrupt when all requested transmit bytes have been sent (if enabled) */
-  if( (SSP_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDTX) && 
-      (u32Current_CSR & AT91C_US_ENDTX) )
+  /* During a transfer ENDTX or TXBUFE asks for more dummy bytes; the transfer itself ends with ENDRX */
+  if( (SSP_psCurrentISR->u32PrivateFlags & _SSP_PERIPHERAL_RX) && 
+      (SSP_psCurrentISR->pBaseAddress->US_IMR & u32Current_CSR & (AT91C_US_ENDTX | AT91C_US_TXBUFE)) )
   {
-    /* Update this message token status and then DeQueue it */
-    UpdateMessageStatus(SSP_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-    DeQueueMessage( &SSP_psCurrentISR->psTransmitBuffer );
-    SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;
-        
-    /* Disable the transmitter and interrupt source */
-    SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
-    SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX;
-
-    /* Allow the peripheral to finish clocking out the Tx byte */
-    u32Timeout = 0;
-    while ( !(SSP_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_TXEMPTY) && 
-            u32Timeout < SSP_TXEMPTY_TIMEOUT)
+    SspLoadDummies(SSP_psCurrentISR);
+  }
+  
+  /* ENDTX (two messages loaded) or TXBUFE (one message loaded) interrupt when a transmit message has been sent */
+  else if( SSP_psCurrentISR->pBaseAddress->US_IMR & u32Current_CSR & (AT91C_US_ENDTX | AT91C_US_TXBUFE) )
+  {
+    /* Complete the front message, and the chained one too if it has also finished */
+    do
     {
-      u32Timeout++;
-    } 
+      psMessage = MessageQueuePeek(&SSP_psCurrentISR->sTransmitQueue);
+      u8LastFlags = psMessage->u8Flags;
+      UpdateMessageStatus(psMessage->u32Token, COMPLETE);
+      DeQueueMessage( &SSP_psCurrentISR->sTransmitQueue );
+      SSP_psCurrentISR->u8TxLoaded--;
+      
+      /* The PDC has already moved on to the chained message */
+      if(SSP_psCurrentISR->u8TxLoaded != 0)
+      {
+        UpdateMessageStatus(MessageQueuePeek(&SSP_psCurrentISR->sTransmitQueue)->u32Token, SENDING);
+      }
+    } while( (SSP_psCurrentISR->u8TxLoaded != 0) && (SSP_psCurrentISR->pBaseAddress->US_TCR == 0) );
     
-    if(SSP_psCurrentISR->SpiMode == SPI_MASTER)
+    /* Keep the PDC going with anything queued since the last messages were loaded */
+    if(SSP_psCurrentISR->u8TxLoaded != 0)
+    {
+      SspChainNextMessage(SSP_psCurrentISR);
+    }
+    else
     {
-      /* Deassert chip select when the buffer and shift register are totally empty */
-      SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
+      /* A Master deasserts chip select once the shift register is empty unless the transaction of the last segment 
+      has not ended yet, so the next message starts with a CS edge of its own */
+      if( (SSP_psCurrentISR->SpiMode == SPI_MASTER) && !(u8LastFlags & _SSP_MSG_SEGMENT) )
+      {
+        SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+        SspWaitTxEmpty(SSP_psCurrentISR);
+        SSP_psCurrentISR->pCsGpioAddress->PIO_SODR = SSP_psCurrentISR->u32CsPin;
+      }
+      
+      if( !SspStartNextMessage(SSP_psCurrentISR) )
+      {
+        /* Nothing left to send: disable the transmitter and interrupt sources */
+        SSP_psCurrentISR->u32PrivateFlags &= ~_SSP_PERIPHERAL_TX;
+        SSP_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+        SSP_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX | AT91C_US_TXBUFE;
+    
+        /* Allow the peripheral to finish clocking out the Tx byte */
+        SspWaitTxEmpty(SSP_psCurrentISR);
+      }
     }
-  } /* end ENDTX interrupt handling */
+  } /* end ENDTX / TXBUFE interrupt handling */
 
   
 } /* end SspGenericHandler() */
@@ -856,118 +2127,74 @@ simultaneously.
 
 /*-------------------------------------------------------------------------------------------------------------------*/
 /* Wait for a transmit message to be queued -- this can include a dummy transmission to receive bytes.
-Half duplex transmissions are always assumed. Check one peripheral per iteration. */
+Half duplex transmissions are always assumed. Every peripheral with new messages is started in the same pass. 
+A Master transfer that runs past its deadline sends the SM to SspSM_Error(). */
 void SspSM_Idle(void)
 {
- static u8 au8SspErrorInvalidSsp[] = "Invalid SSP attempt\r\n";
- u32 u32Byte;
+  u32 u32PeripheralBit;
+  SspPeripheralType* psSsp;
   
-  /* Check all SPI/SSP peripherals for message activity or skip the current peripheral if it is already busy.
-  Slave devices receive outside of the state machine
-  For SSP SPI Master mode, the peripheral will have a message queued regardless of whether the intent is send or receive.
-  For Master devices sending a message, SSP_psCurrentSsp->psTransmitBuffer->pu8Message will point to the application transmit buffer
-  For Master devices receiving a message, SSP_psCurrentSsp->psTransmitBuffer->pu8Message will point to SSP_au8Dummies */
-  if( (SSP_psCurrentSsp->psTransmitBuffer != NULL) && 
-     !(SSP_psCurrentSsp->u32PrivateFlags & (_SSP_PERIPHERAL_TX | _SSP_PERIPHERAL_RX) ) )
+  /* Only the peripherals flagged in SSP_u32PendingPeripherals have anything to start.  A flag stays set while its
+  front message cannot be claimed so the queue is looked at again next pass. */
+  for(u8 i = 0; i < SSP_PERIPHERALS; i++)
   {
-    /* For a Master device, start by asserting chip select */
-    if(SSP_psCurrentSsp->SpiMode == SPI_MASTER)
+    psSsp = SSP_apsPeripherals[i];
+    u32PeripheralBit = (u32)1 << psSsp->u8PeripheralId;
+    if( (SSP_u32PendingPeripherals & u32PeripheralBit) && SspServicePeripheral(psSsp) )
     {
-      SSP_psCurrentSsp->pCsGpioAddress->PIO_CODR = SSP_psCurrentSsp->u32CsPin;
+      SSP_u32PendingPeripherals &= ~u32PeripheralBit;
     }
-       
-    /* Check if the message is receiving based on what psTransmitBuffer is pointing to */
-    if(SSP_psCurrentSsp->psTransmitBuffer->pu8Message == &SSP_au8Dummies[0])
+    
+    /* The ISR may restart the deadline while it is read here, so SspSM_Error() checks again before acting */
+    if( (psSsp->SpiMode == SPI_MASTER) && (psSsp->u32PrivateFlags & _SSP_PERIPHERAL_TX) && 
+        IsTimeUp(&psSsp->u32WatchdogStart, psSsp->u32WatchdogMs) )
     {
-      /* Receiving: update the message's status and flag that the peripheral is now busy */
-      UpdateMessageStatus(SSP_psCurrentSsp->psTransmitBuffer->u32Token, RECEIVING);
-      SSP_psCurrentSsp->u32PrivateFlags |= _SSP_PERIPHERAL_RX;    
-      
-      /* Load the PDC counter and pointer registers */
-      SSP_psCurrentSsp->pBaseAddress->US_RPR = (unsigned int)SSP_psCurrentSsp->psTransmitBuffer->pu8Message; 
-      SSP_psCurrentSsp->pBaseAddress->US_RCR = SSP_psCurrentSsp->psTransmitBuffer->u32Size;
-      
-      /* When RCR is loaded, the ENDRX flag is cleared so it is safe to enable the interrupt */
-      SSP_psCurrentSsp->pBaseAddress->US_IER = AT91C_US_ENDRX;
-      
-      /* Enable the receiver to start the transfer */
-      SSP_psCurrentSsp->pBaseAddress->US_PTCR = AT91C_PDC_RXTEN;
-    }
-    else
-    {
-      /* Transmitting: update the message's status and flag that the peripheral is now busy */
-      UpdateMessageStatus(SSP_psCurrentSsp->psTransmitBuffer->u32Token, SENDING);
-      SSP_psCurrentSsp->u32PrivateFlags |= _SSP_PERIPHERAL_TX;    
-      
-      /* A Slave device with flow control uses interrupt-driven single byte transfers */
-      if(SSP_psCurrentSsp->SpiMode == SPI_SLAVE_FLOW_CONTROL)
-      {
-        /* At this point, CS is asserted and the master is waiting for flow control.
-        Load in the message parameters. */
-        SSP_psCurrentSsp->u32CurrentTxBytesRemaining = SSP_psCurrentSsp->psTransmitBuffer->u32Size;
-        SSP_psCurrentSsp->pu8CurrentTxData = SSP_psCurrentSsp->psTransmitBuffer->pu8Message;
-
-        /* If we need LSB first, use inline assembly to flip bits with a single instruction. */
-        u32Byte = 0x000000FF & *SSP_psCurrentSsp->pu8CurrentTxData;
-        if(SSP_psCurrentSsp->BitOrder == LSB_FIRST)
-        {
-          u32Byte = __RBIT(u32Byte)>>24;
-        }
-        
-        /* Reset the transmitter since we have not been managing dummy bytes and it tends to be
-        in the middle of a transmission or something that causes the wrong byte to get sent (at least on startup). */
-        SSP_psCurrentSsp->pBaseAddress->US_CR = (AT91C_US_RSTTX);
-        SSP_psCurrentSsp->pBaseAddress->US_CR = (AT91C_US_TXEN);
-        SSP_psCurrentSsp->pBaseAddress->US_THR = (u8)u32Byte;
-        SSP_psCurrentSsp->pBaseAddress->US_IDR = AT91C_US_RXRDY;
-        SSP_psCurrentSsp->pBaseAddress->US_IER = AT91C_US_TXEMPTY;
-        SSP_psCurrentSsp->fnSlaveTxFlowCallback();
-      }
-      /* A Master or Slave device without flow control uses the PDC */
-      else
-      {
-        /* Load the PDC counter and pointer registers */
-        SSP_psCurrentSsp->pBaseAddress->US_TPR = (unsigned int)SSP_psCurrentSsp->psTransmitBuffer->pu8Message; 
-        SSP_psCurrentSsp->pBaseAddress->US_TCR = SSP_psCurrentSsp->psTransmitBuffer->u32Size;
-   
-        /* When TCR is loaded, the ENDTX flag is cleared so it is safe to enable the interrupt */
-        SSP_psCurrentSsp->pBaseAddress->US_IER = AT91C_US_ENDTX;
-        
-        /* Enable the transmitter to start the transfer */
-        SSP_psCurrentSsp->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
-      }
+      SSP_u32Flags |= _SSP_ERROR_TIMEOUT;
     }
   }
   
-  /* Adjust to check the next peripheral next time through */
-  switch (SSP_psCurrentSsp->u8PeripheralId)
+  /* A manual cycle is done once every peripheral has been looked at */
+  SSP_u32Flags &= ~_SSP_MANUAL_MODE;
+  
+  if(SSP_u32Flags & SSP_ERROR_FLAG_MASK)
   {
-    case AT91C_ID_US0:
-      SSP_psCurrentSsp = &SSP_Peripheral1;
-      break;
-
-    case AT91C_ID_US1:
-      SSP_psCurrentSsp = &SSP_Peripheral2;
-      break;
-
-    case AT91C_ID_US2:
-      SSP_psCurrentSsp = &SSP_Peripheral0;
-      SSP_u32Flags &= ~_SSP_MANUAL_MODE;
-      break;
-
-    default:
-      DebugPrintf(au8SspErrorInvalidSsp);
-      SSP_psCurrentSsp = &SSP_Peripheral0;
-      break;
-  } /* end switch */
+    Ssp_pfnStateMachine = SspSM_Error;
+  }
   
 } /* end SspSM_Idle() */
 
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Handle an error (!!!!!FUTURE) */
+/* Handle an error: every Master transfer that is still past its deadline with its interrupt held off is stopped and 
+its peripheral reset.  The queues carry on from the next SspSM_Idle() pass. */
 void SspSM_Error(void)          
 {
+  static u8 au8SspTimeoutMessage[] = "SSP transfer timed out: peripheral reset\n\r";
+  SspPeripheralType* psSsp;
+  
+  if(SSP_u32Flags & _SSP_ERROR_TIMEOUT)
+  {
+    for(u8 i = 0; i < SSP_PERIPHERALS; i++)
+    {
+      psSsp = SSP_apsPeripherals[i];
+      if( (psSsp->SpiMode == SPI_MASTER) && (psSsp->u32PrivateFlags & _SSP_PERIPHERAL_TX) )
+      {
+        NVIC_DisableIRQ( (IRQn_Type)(psSsp->u8PeripheralId) );
+        
+        /* The transfer may have finished, or the next one started, just before the interrupt was disabled */
+        if( (psSsp->u32PrivateFlags & _SSP_PERIPHERAL_TX) &&
+            IsTimeUp(&psSsp->u32WatchdogStart, psSsp->u32WatchdogMs) )
+        {
+          SspRecoverPeripheral(psSsp);
+          DebugPrintf(au8SspTimeoutMessage);
+        }
+        
+        NVIC_EnableIRQ( (IRQn_Type)(psSsp->u8PeripheralId) );
+      }
+    }
+  }
+  
+  SSP_u32Flags &= ~SSP_ERROR_FLAG_MASK;
   Ssp_pfnStateMachine = SspSM_Idle;
   
 } /* end SspSM_Error() */
@@ -15,19 +15,25 @@ Type Definitions
 **********************************************************************************************************************/
 typedef enum {MSB_FIRST, LSB_FIRST} SspBitOrderType;
 typedef enum {SPI_MASTER, SPI_SLAVE, SPI_SLAVE_FLOW_CONTROL} SpiModeType;
+typedef enum {SSP_SEGMENT_PIN_LOW, SSP_SEGMENT_PIN_HIGH} SspSegmentPinType;
 
 typedef struct 
 {
   PeripheralType SspPeripheral;       /* Easy name of peripheral */
   AT91PS_PIO pCsGpioAddress;          /* Base address for GPIO port for chip select line */
   u32 u32CsPin;                       /* Pin location for SSEL line */
-  SspBitOrderType BitOrder;           /* MSB_FIRST or LSB_FIRST: this is only available in SPI_SLAVE_FLOW_CONTROL mode */
+  AT91PS_PIO pSegmentGpioAddress;     /* Base address for GPIO port of the transaction segment pin (e.g. LCD A0); NULL if not used */
+  u32 u32SegmentPin;                  /* Pin location of the segment pin set by SspQueueSegment() */
+  SspBitOrderType BitOrder;           /* MSB_FIRST or LSB_FIRST (bits reversed in software: see ReverseBits()) */
   SpiModeType SpiMode;                /* Type of SPI configured */
+  u32 u32BaudRate;                    /* SPI_MASTER clock in Hz (rounded down to a divider of MCK); 0 uses USARTx_US_BRGR_INIT */
   fnCode_type fnSlaveTxFlowCallback;  /* Callback function for SPI_SLAVE_FLOW_CONTROL transmit */
   fnCode_type fnSlaveRxFlowCallback;  /* Callback function for SPI_SLAVE_FLOW_CONTROL receive */
   u8* pu8RxBufferAddress;             /* Address to circular receive buffer */
   u8** ppu8RxNextByte;                /* Location of pointer to next byte to write in buffer for SPI_SLAVE_FLOW_CONTROL*/
-  u16 u16RxBufferSize;                /* Size of receive buffer in bytes */
+  u16 u16RxBufferSize;                /* Size of receive buffer in bytes (SPI_SLAVE: even and at least 2) */
+  u8 u8TxReservedSlots;               /* Message pool slots kept for this peripheral's transmit queue */
+  MessagePriorityType eTxPriority;    /* Priority class of the transmit queue when it needs more than its reserved slots */
 } SspConfigurationType;
 
 typedef struct 
@@ -35,19 +41,29 @@ typedef struct
   AT91PS_USART pBaseAddress;          /* Base address of the associated peripheral */
   AT91PS_PIO pCsGpioAddress;          /* Base address for GPIO port for chip select line */
   u32 u32CsPin;                       /* Pin location for SSEL line */
-  SspBitOrderType BitOrder;           /* MSB_FIRST or LSB_FIRST: this is only available in SPI_SLAVE_FLOW_CONTROL mode */
+  AT91PS_PIO pSegmentGpioAddress;     /* Base address for GPIO port of the transaction segment pin; NULL if not used */
+  u32 u32SegmentPin;                  /* Pin location of the transaction segment pin */
+  SspBitOrderType BitOrder;           /* MSB_FIRST or LSB_FIRST */
   SpiModeType SpiMode;                /* Type of SPI configured */
-  u16 u16Pad;                         /* Preserve 4-byte alignment */
+  bool bTransactionOpen;              /* TRUE between SspBeginTransaction() and SspEndTransaction() (task context only) */
+  u8 u8Pad;                           /* Preserve 4-byte alignment */
+  u32 u32Brgr;                        /* US_BRGR value for the client's clock rate: loaded while CS is released */
+  u32 u32CrInit;                      /* US_CR value the peripheral was requested with: applied again after a reset */
+  u32 u32WatchdogStart;               /* G_u32SystemTime1ms when the transfer loaded in the PDC was started */
+  u32 u32WatchdogMs;                  /* Time in ms the loaded transfer may take before the peripheral is reset */
+  u32 u32RecoveryCount;               /* Number of timed out transfers since SspInitialize() (kept across requests) */
   u32 u32PrivateFlags;                /* Private peripheral flags */
   fnCode_type fnSlaveTxFlowCallback;  /* Callback function for SPI SLAVE transmit that uses flow control */
   fnCode_type fnSlaveRxFlowCallback;  /* Callback function for SPI SLAVE receive that uses flow control */
   u8* pu8RxBuffer;                    /* Pointer to circular receive buffer in user application */
   u8** ppu8RxNextByte;                /* Pointer to buffer location where next received byte will be placed (SPI_SLAVE_FLOW_CONTROL) */
   u16 u16RxBufferSize;                /* Size of receive buffer in bytes */
+  u16 u16RxReadyIndex;                /* SPI_SLAVE LSB_FIRST: ring bytes before this index have been bit reversed */
+  u16 u16Pad;                         /* Preserve 4-byte alignment */
   u8 u8PeripheralId;                  /* Simple peripheral ID number */
-  u8 u8Pad;                           /* Preserve 4-byte alignment */
-  MessageType* psTransmitBuffer;      /* Pointer to the transmit message struct linked list */
-  u32 u32CurrentTxBytesRemaining;     /* Counter for bytes remaining in current transfer */
+  u8 u8TxLoaded;                      /* Messages loaded in the PDC transmit registers: current and next (0 to 2) */
+  MessageQueueType sTransmitQueue;    /* Transmit message queue (ring of pool indexes) */
+  u32 u32CurrentTxBytesRemaining;     /* Counter for bytes remaining in current transfer (dummy bytes not yet loaded for a Master) */
   u8* pu8CurrentTxData;               /* Pointer to current location in the Tx buffer */
 } SspPeripheralType;
 
@@ -56,6 +72,11 @@ typedef struct
 #define _SSP_PERIPHERAL_TX            (u32)0x00200000    /* Set when the peripheral is transmitting */
 #define _SSP_PERIPHERAL_RX            (u32)0x00400000    /* Set when the peripheral is receiving */
 
+/* MessageType u8Flags bits used by this driver (within _MESSAGE_DRIVER_MASK) */
+#define _SSP_MSG_SEGMENT              (u8)0x20           /* Part of a transaction: CS stays asserted after it */
+#define _SSP_MSG_PIN_HIGH             (u8)0x40           /* The segment pin is set high for this segment (low if clear) */
+#define _SSP_MSG_END                  (u8)0x80           /* Zero-length marker that ends a transaction and releases CS */
+
 
 /**********************************************************************************************************************
 Constants / Definitions
@@ -71,13 +92,23 @@ Constants / Definitions
 #define _SSP_MANUAL_MODE              (u32)0x00000001   /* Set to push a cycle during initialization mode */
 
 #define _SSP_ERROR_INVALID_SSP        (u32)0x01000000   /* Set if a function case switches to default */
+#define _SSP_ERROR_TIMEOUT            (u32)0x02000000   /* Set when a Master transfer has run past its deadline */
 
 #define SSP_ERROR_FLAG_MASK           (u32)0xFF000000   /* AND to SSP_u32Flags to get just error flags */
 /* end of SSP_u32Flags flags */
 
 #define SSP_DUMMY_BYTE                (u8)0xFF          /* Byte to send for dummy */
+#define SSP_DUMMY_BUFFER_SIZE         (u16)128          /* Dummy bytes the PDC is given at a time for a transfer with no transmit data */
+#define SSP_MAX_TRANSFER_SIZE         (u32)65535        /* Max bytes in one SspTransfer() (size of the PDC counters) */
 
-#define SSP_TXEMPTY_TIMEOUT           (u32)100           /* Instruction cycles of a while loop that waits for a register to clear */
+#define SSP_PERIPHERALS               (u8)3             /* Number of USARTs that can be used as SSP peripherals */
+#define SSP_MIN_MASTER_CD             (u32)6            /* Smallest baud rate divider used for an SPI Master */
+#define SSP_MAX_MASTER_CD             (u32)0xFFFF       /* Largest baud rate divider (16-bit CD field) */
+#define SSP_MAX_BAUD_RATE             (u32)((PCLK_VALUE) / SSP_MIN_MASTER_CD) /* Fastest SPI Master clock in Hz (8 MHz) */
+#define SSP_TXEMPTY_TIMEOUT           (u32)100           /* Fewest loops SspWaitTxEmpty() waits whatever the clock rate */
+#define SSP_TXEMPTY_BYTES             (u32)2            /* Byte times SspWaitTxEmpty() waits: holding register + shift register */
+#define SSP_TXEMPTY_LOOP_CYCLES       (u32)4            /* Fewest CPU cycles in one SspWaitTxEmpty() loop (rounds the wait up) */
+#define SSP_WATCHDOG_MARGIN_MS        (u32)10           /* Time added to every transfer deadline for interrupt latency and the 1ms tick */
 
 
 /**********************************************************************************************************************
@@ -95,9 +126,18 @@ void SspDeAssertCS(SspPeripheralType* psSspPeripheral_);
 
 u32 SspWriteByte(SspPeripheralType* psSspPeripheral_, u8 u8Byte_);
 u32 SspWriteData(SspPeripheralType* psSspPeripheral_, u32 u32Size_, u8* u8Data_);
+u32 SspWriteDataNoCopy(SspPeripheralType* psSspPeripheral_, u32 u32Size_, const u8* pu8Data_);
 
-u32 SspReadByte(SspPeripheralType* psSspPeripheral_);
-u32 SspReadData(SspPeripheralType* psSspPeripheral_, u32 u32Size_);
+u32 SspReadByte(SspPeripheralType* psSspPeripheral_, u8* pu8Byte_);
+u32 SspReadData(SspPeripheralType* psSspPeripheral_, u8* pu8RxData_, u32 u32Size_);
+u16 SspGetRxIndex(SspPeripheralType* psSspPeripheral_);
+u32 SspTransfer(SspPeripheralType* psSspPeripheral_, const u8* pu8TxData_, u8* pu8RxData_, u32 u32Size_);
+bool SspSetBaudRate(SspPeripheralType* psSspPeripheral_, u32 u32BaudRate_);
+u32 SspGetRecoveryCount(PeripheralType eSspPeripheral_);
+
+bool SspBeginTransaction(SspPeripheralType* psSspPeripheral_);
+u32 SspQueueSegment(SspPeripheralType* psSspPeripheral_, const u8* pu8TxData_, u8* pu8RxData_, u32 u32Size_, SspSegmentPinType eSegmentPin_);
+u32 SspEndTransaction(SspPeripheralType* psSspPeripheral_);
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -112,6 +152,23 @@ void SspManualMode(void);
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Private functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
+bool SspAbortTransfer(void* psQueue_);
+void SspStopTransfer(SspPeripheralType* psSspPeripheral_, MessageStateType eReason_);
+void SspRecoverPeripheral(SspPeripheralType* psSspPeripheral_);
+u32 SspBaudRateToBrgr(u32 u32BaudRate_);
+u32 SspTransferTimeMs(SspPeripheralType* psSspPeripheral_, u32 u32Size_);
+u16 SspRxDmaIndex(SspPeripheralType* psSspPeripheral_);
+void SspRxRingRelease(SspPeripheralType* psSspPeripheral_, u16 u16Index_);
+bool SspStartNextMessage(SspPeripheralType* psSspPeripheral_);
+void SspStartMessage(SspPeripheralType* psSspPeripheral_, MessageType* psMessage_);
+void SspSetSegmentPin(SspPeripheralType* psSspPeripheral_, MessageType* psMessage_);
+void SspWaitTxEmpty(SspPeripheralType* psSspPeripheral_);
+void SspStartTransfer(SspPeripheralType* psSspPeripheral_, MessageType* psMessage_);
+void SspLoadDummies(SspPeripheralType* psSspPeripheral_);
+void SspStartTransmit(SspPeripheralType* psSspPeripheral_, MessageType* psMessage_);
+void SspChainNextMessage(SspPeripheralType* psSspPeripheral_);
+bool SspServicePeripheral(SspPeripheralType* psSspPeripheral_);
+
 void SSP0_IRQHandler(void);
 void SSP1_IRQHandler(void);
 void SSP2_IRQHandler(void);
@@ -38,16 +38,43 @@ e.g.
 u8 au8Sting[] = "Send this string!\n\r";
 u32CurrentMessageToken = UartWriteData(&MyTaskUart, strlen(au8Sting), au8Sting);
 
+u32 UartWriteDataNoCopy(UartPeripheralType* psUartPeripheral_, u32 u32Size_, const u8* pu8Data_);
+Same as UartWriteData but the data is not copied into the message queue: the PDC sends directly from pu8Data_.
+The data must not change until the message token is COMPLETE so this is best for constant strings.
+e.g. 
+static u8 au8Sting[] = "Send this string!\n\r";
+u32CurrentMessageToken = UartWriteDataNoCopy(&MyTaskUart, strlen(au8Sting), au8Sting);
+
+Small writes are appended to the last queued message if it has not started sending, so a client that writes 
+a byte at a time does not use a message slot and a PDC transfer per byte.  The appended write returns the token 
+of that message.
+
+A message that is no longer needed can be dropped with CancelMessage(u32CurrentMessageToken).  If it is already 
+sending, the PDC is stopped after the current byte.
+
+void UartRxConsumed(UartPeripheralType* psUartPeripheral_, u16 u16Count_);
+With UART_FLOW_RTS_CTS, tells the driver that the client has finished with u16Count_ more of the bytes reported to 
+fnRxCallback so their half of the receive buffer can be given back to the PDC.  Not needed without flow control.
+e.g. UartRxConsumed(MyTaskUart, u16BytesParsed);
+
 All receive functionality is automatic. Incoming bytes are deposited to the 
 buffer specified in psUartConfig_
 
-Both Tx and Rx use the peripheral DMA controller, though received bytes
-are always received one at a time to allow use of a circular buffer by the
-client task.
+Both Tx and Rx use the peripheral DMA controller.  The receive buffer is split into two halves: while one half 
+is being filled the other is loaded in the "next" registers, and the interrupt at the end of each half only 
+reloads the half that was just filled.  The USART receiver time-out (US_RTOR) interrupts once the line has been 
+idle for UART_RX_TIMEOUT_BITS after a character, so the bytes of a burst that did not fill a half are not held 
+back.  Either way fnRxCallback is called once with the number of new bytes instead of once per byte.  The DBGU 
+has no receiver time-out so its partial data is flushed by the state machine instead.
 
 INITIALIZATION (should take place in application's initialization function):
 1. Create a variable of UartConfigurationType in your application and initialize it to the desired UART peripheral,
-the address of the receive buffer for the application and the size in bytes of the receive buffer.
+the address of the receive buffer for the application and the size in bytes of the receive buffer.  Set u32BaudRate
+to the line rate in bps, or 0 to keep the *_US_BRGR_INIT divider from configuration.h.  The USARTs have a fractional
+divider so most standard rates up to 921600 are within 0.2%; the DBGU only has an integer divider (e.g. 230400, 
+500000 and 1000000 are fine, 460800 and 921600 are not) and UartRequest() fails if the rate is off by more than 
+UART_MAX_BAUD_ERROR_PERMIL.  Set FlowControl to UART_FLOW_RTS_CTS to use hardware handshaking on a USART whose
+RTS and CTS pins are assigned to the peripheral in the board's PIO setup.
 
 2. Call UartRequest() with pointer to the configuration variable created in step 1.  The returned pointer is the
 UartPeripheralType object created that will be used by your application and should be assigned to a variable
@@ -60,12 +87,21 @@ DATA TRANSFER:
 buffer.  The buffer is written circularly, with no provision to monitor bytes that are overwritten.  The 
 application is responsible for processing all received data.  The application must provide its own parsing
 pointer to read the receive buffer and properly wrap around.  This pointer will not be impacted by the interrupt
-service routine that may add additional characters at any time.
+service routine that may add additional characters at any time.  fnRxCallback(u16Count_) tells the application
+that u16Count_ more bytes have been written after the ones already reported.  If the buffer fills before the 
+interrupt can reload it, the ring carries on from the next half and _UART_RX_BUFFER_OVERRUN is set.
+
+With UART_FLOW_RTS_CTS, a filled half is handed to fnRxCallback by the ISR but is only given back to the PDC once the
+client has released all of its bytes with UartRxConsumed().  The state machine checks on every pass, so the half 
+goes back on the first pass after the client is done with it.  If the client has not caught up by the time the 
+other half fills, the USART raises RTS and the sender waits, so no bytes are lost and none are overwritten before 
+the client has read them.  Transmission pauses while CTS is high.
 
 2. Transmitted data is queued using one of two functions, UartWriteByte() and UartWriteData().  Once the data
-is queued, it is sent as soon as possible.  Each UART resource has a transmit queue, but only one UART resource
-will send data at any given time from this state machine.  However, all UART resources may receive data simultaneously
-through their respective interrupt handlers based on interrupt priority.
+is queued, it is sent as soon as possible.  Each UART resource has a transmit queue and its own PDC transmitter, so
+all UART resources send and receive at the same time.  Messages queued back to back are streamed without a gap: 
+while one message is being sent, the one behind it is loaded in the PDC "next" registers (TNPR/TNCR) so the PDC 
+moves straight on to it, and the end-of-transfer interrupt starts the one after that.
 
 **********************************************************************************************************************/
 
@@ -100,12 +136,13 @@ static fnCode_type Uart_pfnStateMachine;        /* The UART application state ma
 
 static u32 UART_u32Timer;                       /* Counter used across states */
 static u32 UART_u32Flags;                       /* Application flags for UART */
-static u8 UART_u8ActiveUarts = 0;               /* Counting semaphore for # of active UARTs */
 
 static UartPeripheralType UART_Peripheral;      /* UART peripheral object */
 static UartPeripheralType UART_Peripheral0;     /* USART0 peripheral object (used as UART) */
 static UartPeripheralType UART_Peripheral1;     /* USART1 peripheral object (used as UART) */
 static UartPeripheralType UART_Peripheral2;     /* USART2 peripheral object (used as UART) */
+static UartPeripheralType* const UART_apsPeripherals[UART_PERIPHERALS] = {&UART_Peripheral, &UART_Peripheral0, 
+                                                                          &UART_Peripheral1, &UART_Peripheral2};
 
 static UartPeripheralType* UART_psCurrentUart;   /* Current UART peripheral being processed */
 static UartPeripheralType* UART_psCurrentISR;    /* Current UART peripheral being processed in ISR */
@@ -248,10 +285,16 @@ Requires:
   - UART peripheral register initialization values in configuration.h must be set correctly
   - psUartConfig_ has the UART peripheral number, address of the RxBuffer, and the RxBuffer size and the calling
     application is ready to start using the peripheral.
+  - psUartConfig_ has the transmit queue slot reservation and priority class
+  - The RxBuffer size is even and at least 2 so it can be split in two PDC halves
+  - psUartConfig_->u32BaudRate is the line rate in bps or 0 for the *_US_BRGR_INIT divider from configuration.h
+  - psUartConfig_->FlowControl is UART_FLOW_RTS_CTS only for a USART whose RTS and CTS pins are assigned to it
   - UART/USART peripheral registers configured here are available and at the same address offset regardless of the peripheral. 
 
 Promises:
-  - Returns NULL if a resource cannot be assigned; OR
+  - Returns NULL if a resource cannot be assigned, the RxBuffer size is not valid, the baud rate cannot be made 
+    within UART_MAX_BAUD_ERROR_PERMIL, RTS/CTS is asked of the DBGU, or the transmit queue reservation does not fit 
+    in the message pool; OR
   - Returns a pointer to the requested UART peripheral object if the resource is available
   - Peripheral is configured and enabled 
   - Peripheral interrupts are enabled.
@@ -323,6 +366,42 @@ UartPeripheralType* UartRequest(UartConfigurationType* psUartConfig_)
   {
     return(NULL);
   }
+
+  /* The receive ring is two equal PDC halves */
+  if( (psUartConfig_->u16RxBufferSize < 2) || (psUartConfig_->u16RxBufferSize & 0x0001) )
+  {
+    return(NULL);
+  }
+
+  /* A requested line rate replaces the default divider and runs the peripheral at 16x oversampling */
+  if(psUartConfig_->u32BaudRate != 0)
+  {
+    u32TargetBRGR = UartBaudRateToBrgr(psRequestedUart, psUartConfig_->u32BaudRate);
+    if(u32TargetBRGR == 0)
+    {
+      return(NULL);
+    }
+    
+    u32TargetMR &= ~AT91C_US_OVER;
+  }
+  
+  /* In hardware handshaking mode the USART raises RTS while the receive PDC has no room (RXBUFF) and only 
+  transmits while CTS is low */
+  if(psUartConfig_->FlowControl == UART_FLOW_RTS_CTS)
+  {
+    if(psRequestedUart->u8PeripheralId == AT91C_ID_DBGU)
+    {
+      return(NULL);
+    }
+    
+    u32TargetMR = (u32TargetMR & ~AT91C_US_USMODE) | AT91C_US_USMODE_HWHSH;
+  }
+  
+  /* Set up the transmit queue's share of the message pool */
+  if( !MessageQueueConfigure(&psRequestedUart->sTransmitQueue, psUartConfig_->u8TxReservedSlots, psUartConfig_->eTxPriority) )
+  {
+    return(NULL);
+  }
   
   /* Activate and configure the peripheral */
   AT91C_BASE_PMC->PMC_PCER |= (1 << psRequestedUart->u8PeripheralId);
@@ -331,7 +410,13 @@ UartPeripheralType* UartRequest(UartConfigurationType* psUartConfig_)
   psRequestedUart->u16RxBufferSize = psUartConfig_->u16RxBufferSize;
   psRequestedUart->pu8RxNextByte   = psUartConfig_->pu8RxNextByte;
   psRequestedUart->fnRxCallback    = psUartConfig_->fnRxCallback;
+  psRequestedUart->u16RxIndex      = 0;
+  psRequestedUart->u16RxUnconsumed = 0;
   psRequestedUart->u32PrivateFlags |= _UART_PERIPHERAL_ASSIGNED;
+  if(psUartConfig_->FlowControl == UART_FLOW_RTS_CTS)
+  {
+    psRequestedUart->u32PrivateFlags |= _UART_PERIPHERAL_RTS_CTS;
+  }
   
   psRequestedUart->pBaseAddress->US_CR   = u32TargetCR;
   psRequestedUart->pBaseAddress->US_MR   = u32TargetMR;
@@ -339,11 +424,23 @@ UartPeripheralType* UartRequest(UartConfigurationType* psUartConfig_)
   psRequestedUart->pBaseAddress->US_IDR  = u32TargetIDR;
   psRequestedUart->pBaseAddress->US_BRGR = u32TargetBRGR;
 
-  /* Preset the receive PDC pointers and counters; the receive buffer must be starting from [0] and be at least 2 bytes long)*/
+  /* Preset the receive PDC with the first half of the buffer and the second half as "next" */
   psRequestedUart->pBaseAddress->US_RPR  = (unsigned int)psUartConfig_->pu8RxBufferAddress;
-  psRequestedUart->pBaseAddress->US_RNPR = (unsigned int)((psUartConfig_->pu8RxBufferAddress) + 1);
-  psRequestedUart->pBaseAddress->US_RCR  = 1;
-  psRequestedUart->pBaseAddress->US_RNCR = 1;
+  psRequestedUart->pBaseAddress->US_RNPR = (unsigned int)(psUartConfig_->pu8RxBufferAddress + (psUartConfig_->u16RxBufferSize / 2));
+  psRequestedUart->pBaseAddress->US_RCR  = psUartConfig_->u16RxBufferSize / 2;
+  psRequestedUart->pBaseAddress->US_RNCR = psUartConfig_->u16RxBufferSize / 2;
+  
+  /* The USARTs flush a partial half when the line goes idle; the time-out starts with the next character */
+  if(psRequestedUart->u8PeripheralId != AT91C_ID_DBGU)
+  {
+    psRequestedUart->pBaseAddress->US_RTOR = UART_RX_TIMEOUT_BITS;
+    psRequestedUart->pBaseAddress->US_CR   = AT91C_US_STTTO;
+    psRequestedUart->pBaseAddress->US_IER  = AT91C_US_TIMEOUT;
+  }
+  
+  /* Every ring needs the end of each half to be seen so it can be reloaded: the *_US_IER_INIT values do not all 
+  have ENDRX (BLADE_US_IER_INIT is 0) and the IDR_INIT values above mask it */
+  psRequestedUart->pBaseAddress->US_IER  = AT91C_US_ENDRX;
   
   /* Enable the receiver and transmitter requests */
   psRequestedUart->pBaseAddress->US_PTCR = AT91C_PDC_RXTEN | AT91C_PDC_TXTEN;
@@ -374,15 +471,21 @@ Promises:
 */
 void UartRelease(UartPeripheralType* psUartPeripheral_)
 {
+  MessageType* psMessage;
+  
   /* Check to see if the peripheral is already released */
   if(psUartPeripheral_->pu8RxBuffer == NULL)
   {
     return;
   }
   
-  /* First disable the interrupts */
+  /* Stop a transfer that is still running, then disable the interrupts */
+  UartAbortTransfer(&psUartPeripheral_->sTransmitQueue);
   NVIC_DisableIRQ( (IRQn_Type)(psUartPeripheral_->u8PeripheralId) );
   NVIC_ClearPendingIRQ( (IRQn_Type)(psUartPeripheral_->u8PeripheralId) );
+  
+  /* Stop the receive PDC so it no longer writes to the application's buffer */
+  psUartPeripheral_->pBaseAddress->US_PTCR = AT91C_PDC_RXTDIS;
  
   /* Now it's safe to release all of the resources in the target peripheral */
   psUartPeripheral_->pu8RxBuffer    = NULL;
@@ -391,12 +494,15 @@ void UartRelease(UartPeripheralType* psUartPeripheral_)
   psUartPeripheral_->u32PrivateFlags = 0;
 
   /* Empty the transmit buffer if there were leftover messages */
-  while(psUartPeripheral_->psTransmitBuffer != NULL)
+  while( (psMessage = MessageQueuePeek(&psUartPeripheral_->sTransmitQueue)) != NULL )
   {
-    UpdateMessageStatus(psUartPeripheral_->psTransmitBuffer->u32Token, ABANDONED);
-    DeQueueMessage(&psUartPeripheral_->psTransmitBuffer);
+    UpdateMessageStatus(psMessage->u32Token, ABANDONED);
+    DeQueueMessage(&psUartPeripheral_->sTransmitQueue);
   }
   
+  /* Give the reserved message slots back to the pool */
+  MessageQueueConfigure(&psUartPeripheral_->sTransmitQueue, 0, MSG_PRIORITY_NORMAL);
+  
   /* Ensure the SM is in the Idle state */
   Uart_pfnStateMachine = UartSM_Idle;
  
@@ -422,7 +528,7 @@ u32 UartWriteByte(UartPeripheralType* psUartPeripheral_, u8 u8Byte_)
   u32 u32Token;
   u8 u8Data = u8Byte_;
   
-  u32Token = QueueMessage(&psUartPeripheral_->psTransmitBuffer, 1, &u8Data);
+  u32Token = QueueMessage(&psUartPeripheral_->sTransmitQueue, 1, &u8Data);
   if( u32Token != 0 )
   {
     /* If the system is initializing, we want to manually cycle the UART task through one iteration
@@ -460,7 +566,7 @@ u32 UartWriteData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* u8Dat
 {
   u32 u32Token;
 
-  u32Token = QueueMessage(&psUartPeripheral_->psTransmitBuffer, u32Size_, u8Data_);
+  u32Token = QueueMessage(&psUartPeripheral_->sTransmitQueue, u32Size_, u8Data_);
   if(u32Token)
   {
     /* If the system is initializing, manually cycle the UART task through one iteration to send the message */
@@ -475,6 +581,92 @@ u32 UartWriteData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* u8Dat
 } /* end UartWriteData() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartWriteDataNoCopy
+
+Description:
+Queues a data array for transfer on the target UART peripheral without copying it.  
+
+Requires:
+  - psUartPeripheral_ has been requested and holds a valid pointer to a transmit buffer
+  - u32Size_ is the number of bytes in the data array
+  - pu8Data_ points to the first byte of the data array which must not change until the message is COMPLETE
+
+Promises:
+  - adds a message at psUartPeripheral_->sTransmitQueue that points to pu8Data_ and will be sent by the UART application
+    when it is available.
+  - Returns the message token assigned to the message; 0 is returned if the message cannot be queued in which case
+    G_u32MessagingFlags can be checked for the reason
+*/
+u32 UartWriteDataNoCopy(UartPeripheralType* psUartPeripheral_, u32 u32Size_, const u8* pu8Data_)
+{
+  u32 u32Token;
+
+  u32Token = QueueMessageNoCopy(&psUartPeripheral_->sTransmitQueue, u32Size_, pu8Data_);
+  if(u32Token)
+  {
+    /* If the system is initializing, manually cycle the UART task through one iteration to send the message */
+    if(G_u32SystemFlags & _SYSTEM_INITIALIZING)
+    {
+      UartManualMode();
+    }
+  }
+  
+  return(u32Token);
+  
+} /* end UartWriteDataNoCopy() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartRxConsumed
+
+Description:
+Releases received bytes that the client has finished with.  With UART_FLOW_RTS_CTS a receive half is only given back 
+to the PDC once all of its bytes have been released, so the sender is held off instead of the data being overwritten.
+
+Requires:
+  - u16Count_ is the number of bytes the client has read since its last call, in the order fnRxCallback reported them
+  - May be called from fnRxCallback
+
+Promises:
+  - Does nothing unless psUartPeripheral_ is assigned and uses UART_FLOW_RTS_CTS
+  - The bytes are no longer counted as unread; the state machine gives a half back to the PDC on its next pass once 
+    none of its bytes are unread
+  - The peripheral's interrupt is left enabled or disabled as it was found
+*/
+void UartRxConsumed(UartPeripheralType* psUartPeripheral_, u16 u16Count_)
+{
+  u32 u32IrqBit;
+  bool bIrqEnabled;
+  
+  if( (psUartPeripheral_->u32PrivateFlags & (_UART_PERIPHERAL_ASSIGNED | _UART_PERIPHERAL_RTS_CTS)) != 
+      (_UART_PERIPHERAL_ASSIGNED | _UART_PERIPHERAL_RTS_CTS) )
+  {
+    return;
+  }
+  
+  /* The ISR adds to the count as it reports new bytes */
+  u32IrqBit = (u32)1 << (psUartPeripheral_->u8PeripheralId & 0x1F);
+  bIrqEnabled = (bool)( (NVIC->ISER[psUartPeripheral_->u8PeripheralId >> 5] & u32IrqBit) != 0 );
+  NVIC_DisableIRQ( (IRQn_Type)(psUartPeripheral_->u8PeripheralId) );
+  
+  if(u16Count_ < psUartPeripheral_->u16RxUnconsumed)
+  {
+    psUartPeripheral_->u16RxUnconsumed -= u16Count_;
+  }
+  else
+  {
+    psUartPeripheral_->u16RxUnconsumed = 0;
+  }
+  
+  if(bIrqEnabled)
+  {
+    NVIC_EnableIRQ( (IRQn_Type)(psUartPeripheral_->u8PeripheralId) );
+  }
+  
+} /* end UartRxConsumed() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Protected Functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -561,35 +753,55 @@ void UartInitialize(void)
   
   /* Initialize the UART peripheral structures */
   UART_Peripheral.pBaseAddress     = (AT91S_USART*)AT91C_BASE_DBGU;
-  UART_Peripheral.psTransmitBuffer = NULL;
+  UART_Peripheral.sTransmitQueue.u8Head = 0;
+  UART_Peripheral.sTransmitQueue.u8Tail = 0;
+  UART_Peripheral.sTransmitQueue.pu8Name = "UART";
+  UART_Peripheral.sTransmitQueue.pfnAbort = UartAbortTransfer;
+  UART_Peripheral.sTransmitQueue.u8Options = _MSG_QUEUE_COALESCE;
   UART_Peripheral.pu8RxBuffer      = NULL;
   UART_Peripheral.u16RxBufferSize  = 0;
   UART_Peripheral.pu8RxNextByte    = NULL;
   UART_Peripheral.u32PrivateFlags  = 0;
+  UART_Peripheral.u8TxLoaded       = 0;
   UART_Peripheral.u8PeripheralId  = AT91C_ID_DBGU;
 
   UART_Peripheral0.pBaseAddress    = AT91C_BASE_US0;
-  UART_Peripheral0.psTransmitBuffer = NULL;
+  UART_Peripheral0.sTransmitQueue.u8Head = 0;
+  UART_Peripheral0.sTransmitQueue.u8Tail = 0;
+  UART_Peripheral0.sTransmitQueue.pu8Name = "UART0";
+  UART_Peripheral0.sTransmitQueue.pfnAbort = UartAbortTransfer;
+  UART_Peripheral0.sTransmitQueue.u8Options = _MSG_QUEUE_COALESCE;
   UART_Peripheral0.pu8RxBuffer     = NULL;
   UART_Peripheral0.u16RxBufferSize = 0;
   UART_Peripheral0.pu8RxNextByte   = NULL;
   UART_Peripheral0.u32PrivateFlags = 0;
+  UART_Peripheral0.u8TxLoaded      = 0;
   UART_Peripheral0.u8PeripheralId  = AT91C_ID_US0;
 
   UART_Peripheral1.pBaseAddress    = AT91C_BASE_US1;
-  UART_Peripheral1.psTransmitBuffer = NULL;
+  UART_Peripheral1.sTransmitQueue.u8Head = 0;
+  UART_Peripheral1.sTransmitQueue.u8Tail = 0;
+  UART_Peripheral1.sTransmitQueue.pu8Name = "UART1";
+  UART_Peripheral1.sTransmitQueue.pfnAbort = UartAbortTransfer;
+  UART_Peripheral1.sTransmitQueue.u8Options = _MSG_QUEUE_COALESCE;
   UART_Peripheral1.pu8RxBuffer     = NULL;
   UART_Peripheral1.u16RxBufferSize = 0;
   UART_Peripheral1.pu8RxNextByte   = NULL;
   UART_Peripheral1.u32PrivateFlags = 0;
+  UART_Peripheral1.u8TxLoaded      = 0;
   UART_Peripheral1.u8PeripheralId  = AT91C_ID_US1;
 
   UART_Peripheral2.pBaseAddress    = AT91C_BASE_US2;
-  UART_Peripheral2.psTransmitBuffer = NULL;
+  UART_Peripheral2.sTransmitQueue.u8Head = 0;
+  UART_Peripheral2.sTransmitQueue.u8Tail = 0;
+  UART_Peripheral2.sTransmitQueue.pu8Name = "UART2";
+  UART_Peripheral2.sTransmitQueue.pfnAbort = UartAbortTransfer;
+  UART_Peripheral2.sTransmitQueue.u8Options = _MSG_QUEUE_COALESCE;
   UART_Peripheral2.pu8RxBuffer     = NULL;
   UART_Peripheral2.u16RxBufferSize = 0;
   UART_Peripheral2.pu8RxNextByte   = NULL;
   UART_Peripheral2.u32PrivateFlags = 0;
+  UART_Peripheral2.u8TxLoaded      = 0;
   UART_Peripheral2.u8PeripheralId  = AT91C_ID_US2;
   
   UART_psCurrentUart               = &UART_Peripheral;
@@ -628,6 +840,423 @@ void UartRunActiveState(void)
 /* Private functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartAbortTransfer
+
+Description:
+Stops the transfer of the message at the front of a UART transmit queue (the pfnAbort function of the queues).
+
+Requires:
+  - Called from task context by CancelMessage()
+  - psQueue_ is the sTransmitQueue of one of the UART peripherals
+
+Promises:
+  - If a transfer is in progress: the PDC and its interrupts are disabled, the message status is ABANDONED, 
+    the message is dequeued, _UART_PERIPHERAL_TX is cleared and TRUE is returned.  A message chained behind it in 
+    TNPR/TNCR has not started so it is put back to WAITING and will be sent on its own.
+  - Otherwise returns FALSE and nothing is changed
+*/
+bool UartAbortTransfer(void* psQueue_)
+{
+  UartPeripheralType* psUart;
+  
+  /* Find the peripheral that owns the queue */
+  if(psQueue_ == &UART_Peripheral.sTransmitQueue)
+  {
+    psUart = &UART_Peripheral;
+  }
+  else if(psQueue_ == &UART_Peripheral0.sTransmitQueue)
+  {
+    psUart = &UART_Peripheral0;
+  }
+  else if(psQueue_ == &UART_Peripheral1.sTransmitQueue)
+  {
+    psUart = &UART_Peripheral1;
+  }
+  else if(psQueue_ == &UART_Peripheral2.sTransmitQueue)
+  {
+    psUart = &UART_Peripheral2;
+  }
+  else
+  {
+    return(FALSE);
+  }
+  
+  /* Hold off the peripheral's interrupt so the transfer cannot complete while it is being stopped */
+  NVIC_DisableIRQ( (IRQn_Type)(psUart->u8PeripheralId) );
+  
+  /* The message may have finished just before the interrupt was disabled */
+  if( !(psUart->u32PrivateFlags & _UART_PERIPHERAL_TX) )
+  {
+    NVIC_EnableIRQ( (IRQn_Type)(psUart->u8PeripheralId) );
+    return(FALSE);
+  }
+  
+  /* Stop the PDC; the byte already in the shift register still goes out */
+  psUart->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+  psUart->pBaseAddress->US_IDR  = AT91C_US_ENDTX | AT91C_US_TXBUFE;
+  psUart->pBaseAddress->US_TCR  = 0;
+  psUart->pBaseAddress->US_TNCR = 0;
+  
+  if(psUart->u8TxLoaded == 2)
+  {
+    MessageUnclaim(MessageQueuePeekNext(&psUart->sTransmitQueue));
+  }
+  psUart->u8TxLoaded = 0;
+  
+  UpdateMessageStatus(MessageQueuePeek(&psUart->sTransmitQueue)->u32Token, ABANDONED);
+  DeQueueMessage(&psUart->sTransmitQueue);
+  psUart->u32PrivateFlags &= ~_UART_PERIPHERAL_TX;
+  
+  NVIC_EnableIRQ( (IRQn_Type)(psUart->u8PeripheralId) );
+  return(TRUE);
+  
+} /* end UartAbortTransfer() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartStartNextMessage
+
+Description:
+Starts a PDC transmit of the message at the front of the queue and chains the message behind it if there is one.
+Used by UartSM_Idle() to start an idle peripheral and by the end-of-transfer interrupt to carry on with messages 
+that were queued while the PDC was busy.
+
+Requires:
+  - psUart_ has nothing loaded in the PDC transmit registers
+  - Called from the peripheral's ISR, or from task context while _UART_PERIPHERAL_TX is clear
+
+Promises:
+  - Returns TRUE if the front message was claimed: it is SENDING and loaded in TPR/TCR, the next message may be 
+    loaded in TNPR/TNCR (see UartChainNextMessage()), _UART_PERIPHERAL_TX is set and the PDC transmitter is running
+  - Returns FALSE if the queue is empty or its front message cannot be claimed yet
+*/
+bool UartStartNextMessage(UartPeripheralType* psUart_)
+{
+  MessageType* psMessage;
+  
+  psMessage = MessageQueuePeek(&psUart_->sTransmitQueue);
+  if( (psMessage == NULL) || !MessageClaim(psMessage) )
+  {
+    return(FALSE);
+  }
+  
+  /* Hold the PDC while both register pairs are loaded */
+  psUart_->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+  psUart_->u32PrivateFlags |= _UART_PERIPHERAL_TX;
+  
+  UpdateMessageStatus(psMessage->u32Token, SENDING);
+  psUart_->pBaseAddress->US_TPR = (unsigned int)psMessage->pu8Message;
+  psUart_->pBaseAddress->US_TCR = psMessage->u32Size;
+  psUart_->u8TxLoaded = 1;
+  
+  /* Loading TCR cleared ENDTX and TXBUFE so the interrupt chosen here cannot fire early */
+  UartChainNextMessage(psUart_);
+  
+  /* Enable the transmitter to start the transfer */
+  psUart_->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
+  
+  return(TRUE);
+  
+} /* end UartStartNextMessage() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartChainNextMessage
+
+Description:
+Loads the message behind the one being sent into TNPR/TNCR so the PDC continues with it as soon as TCR reaches 0.  
+The end-of-transfer interrupt is chosen to match: with two messages loaded ENDTX marks the end of the first one 
+(the PDC has already moved on to the second); with one message loaded TXBUFE marks the end of it since ENDTX may
+still be set from an earlier reload.
+
+Requires:
+  - psUart_ has 1 message loaded in TPR/TCR (u8TxLoaded is 1)
+  - Called with the peripheral's interrupt unable to run (from its ISR, before the PDC is enabled or with the 
+    interrupt disabled)
+
+Promises:
+  - If there is a second message in the queue, it can be claimed and TNCR can be written safely (the PDC is stopped 
+    or more than one byte is left in TCR), it is loaded in TNPR/TNCR, u8TxLoaded is 2 and ENDTX is the enabled 
+    interrupt
+  - Otherwise TXBUFE is the enabled interrupt
+*/
+void UartChainNextMessage(UartPeripheralType* psUart_)
+{
+  MessageType* psMessage;
+  
+  /* Writing TNCR as the PDC reloads from it could lose the message, so leave a byte of margin */
+  if( !(psUart_->pBaseAddress->US_PTSR & AT91C_PDC_TXTEN) || (psUart_->pBaseAddress->US_TCR > 1) )
+  {
+    psMessage = MessageQueuePeekNext(&psUart_->sTransmitQueue);
+    if( (psMessage != NULL) && MessageClaim(psMessage) )
+    {
+      /* Writing TNCR also clears ENDTX from the reload that got us here */
+      psUart_->pBaseAddress->US_TNPR = (unsigned int)psMessage->pu8Message;
+      psUart_->pBaseAddress->US_TNCR = psMessage->u32Size;
+      psUart_->u8TxLoaded = 2;
+      
+      psUart_->pBaseAddress->US_IDR = AT91C_US_TXBUFE;
+      psUart_->pBaseAddress->US_IER = AT91C_US_ENDTX;
+      return;
+    }
+  }
+  
+  psUart_->pBaseAddress->US_IDR = AT91C_US_ENDTX;
+  psUart_->pBaseAddress->US_IER = AT91C_US_TXBUFE;
+  
+} /* end UartChainNextMessage() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartRxDmaIndex
+
+Description:
+Returns the index in the receive buffer where the PDC will write the next byte.
+
+Requires:
+  - psUart_ has been requested
+
+Promises:
+  - Returns the index of RPR in the receive buffer (0 when RPR has reached the end of the buffer)
+*/
+u16 UartRxDmaIndex(UartPeripheralType* psUart_)
+{
+  u32 u32Index;
+  
+  u32Index = psUart_->pBaseAddress->US_RPR - (u32)psUart_->pu8RxBuffer;
+  
+  /* The pointer sits at the end of the buffer when the last byte is in but the ISR has not reloaded [0] yet */
+  if(u32Index >= psUart_->u16RxBufferSize)
+  {
+    u32Index = 0;
+  }
+  
+  return( (u16)u32Index );
+  
+} /* end UartRxDmaIndex() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartRxFlush
+
+Description:
+Passes the bytes received since the last call to the client with one call to fnRxCallback.
+
+Requires:
+  - psUart_ has been requested
+  - Called from the peripheral's ISR, or with the peripheral's interrupt disabled
+
+Promises:
+  - If new bytes are in the buffer, fnRxCallback is called with their number and u16RxIndex is moved past them
+  - If both halves filled since the last call (RXBUFF with RPR back at u16RxIndex), the whole ring is passed on once;
+    _UART_PERIPHERAL_RX_FULL is set until UartRxReload() restarts the PDC so it is not passed on again
+*/
+void UartRxFlush(UartPeripheralType* psUart_)
+{
+  u16 u16DmaIndex;
+  u16 u16Count;
+  
+  /* Read RPR before RCR: if RPR has reached the last byte, RCR (and RNCR) already show RXBUFF */
+  u16DmaIndex = UartRxDmaIndex(psUart_);
+  if(u16DmaIndex >= psUart_->u16RxIndex)
+  {
+    u16Count = u16DmaIndex - psUart_->u16RxIndex;
+  }
+  else
+  {
+    u16Count = psUart_->u16RxBufferSize - psUart_->u16RxIndex + u16DmaIndex;
+  }
+  
+  /* With both counters run out and RPR back where the last flush stopped, the ring is either all new or all 
+  reported already; the flag tells which */
+  if(psUart_->pBaseAddress->US_RCR == 0)
+  {
+    if( (u16Count == 0) && !(psUart_->u32PrivateFlags & _UART_PERIPHERAL_RX_FULL) )
+    {
+      u16Count = psUart_->u16RxBufferSize;
+    }
+    psUart_->u32PrivateFlags |= _UART_PERIPHERAL_RX_FULL;
+  }
+  
+  if(u16Count != 0)
+  {
+    psUart_->u16RxIndex = u16DmaIndex;
+    if(psUart_->u32PrivateFlags & _UART_PERIPHERAL_RTS_CTS)
+    {
+      psUart_->u16RxUnconsumed += u16Count;
+    }
+    
+    if(psUart_->fnRxCallback != NULL)
+    {
+      psUart_->fnRxCallback(u16Count);
+    }
+  }
+  
+} /* end UartRxFlush() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartRxReload
+
+Description:
+Passes the bytes received so far to the client and gives the half that was just filled back to the receive PDC.
+
+Requires:
+  - psUart_ has been requested and ENDRX is set (RCR has run out at least once since RNCR was last written)
+  - Called from the peripheral's ISR, or with the peripheral's interrupt disabled
+
+Promises:
+  - fnRxCallback is called with any new bytes
+  - If both counters had run out (RXBUFF), the PDC restarts at the half after the last byte received and TRUE is 
+    returned; otherwise FALSE
+  - The half after the one being filled is loaded in RNPR/RNCR, which clears ENDRX (and RXBUFF)
+*/
+bool UartRxReload(UartPeripheralType* psUart_)
+{
+  u16 u16RxHalf;
+  bool bRestarted = FALSE;
+  
+  u16RxHalf = psUart_->u16RxBufferSize / 2;
+  UartRxFlush(psUart_);
+  
+  /* Both halves are full: u16RxIndex is now at the start of one of them so the ring carries on from there */
+  if(psUart_->pBaseAddress->US_RCR == 0)
+  {
+    psUart_->pBaseAddress->US_RPR = (u32)(psUart_->pu8RxBuffer + psUart_->u16RxIndex);
+    psUart_->pBaseAddress->US_RCR = u16RxHalf;
+    psUart_->u32PrivateFlags &= ~_UART_PERIPHERAL_RX_FULL;
+    bRestarted = TRUE;
+  }
+
+  /* The half that was just filled goes behind the one being filled */
+  if(psUart_->pBaseAddress->US_RPR < (u32)(psUart_->pu8RxBuffer + u16RxHalf))
+  {
+    psUart_->pBaseAddress->US_RNPR = (u32)(psUart_->pu8RxBuffer + u16RxHalf);
+  }
+  else
+  {
+    psUart_->pBaseAddress->US_RNPR = (u32)psUart_->pu8RxBuffer;
+  }
+  psUart_->pBaseAddress->US_RNCR = u16RxHalf;
+  
+  return(bRestarted);
+  
+} /* end UartRxReload() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartRxGiveBack
+
+Description:
+Gives the receive halves of an RTS/CTS peripheral back to the PDC once the client has consumed them.  The ISR takes
+a half out of the PDC when it fills; it stays out until none of its bytes are counted in u16RxUnconsumed.
+
+Requires:
+  - psUart_ has been requested with UART_FLOW_RTS_CTS and ENDRX is masked (a half is out of the PDC)
+  - Called with the peripheral's interrupt disabled
+
+Promises:
+  - Any new bytes are passed to fnRxCallback
+  - If both halves had filled (RXBUFF) and the older one has been consumed, the PDC restarts in it 
+  - If the half that is out of the PDC has been consumed, it is loaded in RNPR/RNCR and ENDRX is enabled again
+*/
+void UartRxGiveBack(UartPeripheralType* psUart_)
+{
+  u16 u16RxHalf;
+  u16 u16CurrentHalf;
+  
+  u16RxHalf = psUart_->u16RxBufferSize / 2;
+  UartRxFlush(psUart_);
+  
+  /* Both halves are full: u16RxIndex is at the start of the older half, which is free once only the newer half's 
+  bytes are unread */
+  if(psUart_->pBaseAddress->US_RCR == 0)
+  {
+    if(psUart_->u16RxUnconsumed > u16RxHalf)
+    {
+      return;
+    }
+    
+    psUart_->pBaseAddress->US_RPR = (u32)(psUart_->pu8RxBuffer + psUart_->u16RxIndex);
+    psUart_->pBaseAddress->US_RCR = u16RxHalf;
+    psUart_->u32PrivateFlags &= ~_UART_PERIPHERAL_RX_FULL;
+  }
+  
+  /* The other half is free once every unread byte is in the half being filled */
+  u16CurrentHalf = 0;
+  if(psUart_->pBaseAddress->US_RPR >= (u32)(psUart_->pu8RxBuffer + u16RxHalf))
+  {
+    u16CurrentHalf = u16RxHalf;
+  }
+  
+  if( (psUart_->pBaseAddress->US_RNCR == 0) &&
+      (psUart_->u16RxUnconsumed <= (psUart_->u16RxIndex - u16CurrentHalf)) )
+  {
+    psUart_->pBaseAddress->US_RNPR = (u32)(psUart_->pu8RxBuffer + (u16RxHalf - u16CurrentHalf));
+    psUart_->pBaseAddress->US_RNCR = u16RxHalf;
+    psUart_->pBaseAddress->US_IER  = AT91C_US_ENDRX;
+  }
+  
+} /* end UartRxGiveBack() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: UartBaudRateToBrgr
+
+Description:
+Works out the US_BRGR value for a line rate at 16x oversampling: BAUD = MCK / (16(CD + FP / 8)).  The USARTs 
+use the fractional part to get closer to the rate; the DBGU only has CD.
+
+Requires:
+  - u32BaudRate_ is not 0
+
+Promises:
+  - Returns CD and FP for the nearest rate the peripheral can make; 0 if that is more than 
+    UART_MAX_BAUD_ERROR_PERMIL away from u32BaudRate_ or needs a divider outside UART_MIN_CD .. UART_MAX_CD
+*/
+u32 UartBaudRateToBrgr(UartPeripheralType* psUart_, u32 u32BaudRate_)
+{
+  u32 u32Eighths;
+  u32 u32ActualRate;
+  u32 u32Error;
+  
+  /* The divider in eighths of CD, rounded to the nearest one the peripheral has */
+  if(psUart_->u8PeripheralId == AT91C_ID_DBGU)
+  {
+    u32Eighths = ( ((PCLK_VALUE) + (8 * u32BaudRate_)) / (16 * u32BaudRate_) ) * 8;
+  }
+  else
+  {
+    u32Eighths = ((PCLK_VALUE) + u32BaudRate_) / (2 * u32BaudRate_);
+  }
+  
+  if( (u32Eighths < (8 * UART_MIN_CD)) || ((u32Eighths / 8) > UART_MAX_CD) )
+  {
+    return(0);
+  }
+  
+  /* Reject a rate the other end would not be able to receive */
+  u32ActualRate = (PCLK_VALUE) / (2 * u32Eighths);
+  if(u32ActualRate > u32BaudRate_)
+  {
+    u32Error = u32ActualRate - u32BaudRate_;
+  }
+  else
+  {
+    u32Error = u32BaudRate_ - u32ActualRate;
+  }
+  
+  if( (u32Error * 1000) > (u32BaudRate_ * UART_MAX_BAUD_ERROR_PERMIL) )
+  {
+    return(0);
+  }
+  
+  return( ((u32Eighths & 0x07) << 16) | (u32Eighths / 8) );
+  
+} /* end UartBaudRateToBrgr() */
+
+
 #if 0
 /*----------------------------------------------------------------------------------------------------------------------
 Function: UartFillTxBuffer
@@ -731,7 +1360,6 @@ Promises:
 static void UartManualMode(void)
 {
   UART_u32Flags |=_UART_MANUAL_MODE;
-  UART_psCurrentUart = &UART_Peripheral;
   
   while(UART_u32Flags &_UART_MANUAL_MODE)
   {
@@ -923,72 +1551,98 @@ Generic Interrupt Service Routine
 
 Description:
 Receive: A requested UART peripheral is always enabled and ready to receive data.  Receive interrupts will occur when a
-new byte has been read by the peripheral. All incoming data is dumped into the circular receive data buffer configured.
-No processing is done on the data - it is up to the processing application to parse incoming data to find useful information
-and to manage dummy bytes.  All data reception is done with DMA, but only 1 byte at a time.  Receiving is done by using
-the two reception pointers to ensure no data is missed.
-
-Transmit: All data bytes in the transmit buffer are sent using DMA and interrupts. Once the full message has been sent,
-the message status is updated.
+half of the receive buffer has been filled or, on the USARTs, when the line goes idle after a burst (TIMEOUT). All incoming 
+data is dumped into the circular receive data buffer configured. No processing is done on the data - it is up to the 
+processing application to parse incoming data to find useful information and to manage dummy bytes.  All data reception 
+is done with DMA using the two reception pointers, one per half of the buffer, to ensure no data is missed.
+
+Transmit: All data bytes in the transmit buffer are sent using DMA and interrupts.  An End Transmit (ENDTX) interrupt 
+occurs when the PDC has finished the current message and moved on to the message chained in TNPR/TNCR; a Tx Buffer 
+Empty (TXBUFE) interrupt occurs when the last loaded message is done.  Either way the finished messages are completed 
+and the PDC is kept busy with whatever has been queued since.
 */
 void UartGenericHandler(void)
 {
-  /* ENDRX Interrupt when a byte has been received (RNCR is moved to RCR; RNPR is copied to RPR))*/
-  if( (UART_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDRX) && 
-      (UART_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_ENDRX) )
+  u32 u32Current_CSR;
+  
+  /* Read the status once: the IMR mask keeps only the enabled sources */
+  u32Current_CSR = UART_psCurrentISR->pBaseAddress->US_CSR;
+  
+  /* ENDRX Interrupt when a half of the buffer has been filled (RNCR is moved to RCR; RNPR is copied to RPR) */
+  if(UART_psCurrentISR->pBaseAddress->US_IMR & u32Current_CSR & AT91C_US_ENDRX)
   {
-    /* Flag that a byte has arrived */
-    *UART_pu32ApplicationFlagsISR |= _UART_RX_COMPLETE;
-
-    /* Update the "next" DMA pointer to the next valid Rx location */
-    UART_psCurrentISR->pBaseAddress->US_RNPR++;
-    if(UART_psCurrentISR->pBaseAddress->US_RNPR == (u32)(UART_psCurrentISR->pu8RxBuffer + (u32)UART_psCurrentISR->u16RxBufferSize) )
+    if(UART_psCurrentISR->u32PrivateFlags & _UART_PERIPHERAL_RTS_CTS)
+    {
+      /* Hand the filled half to the client but leave it out of the PDC until the client has consumed it (see 
+      UartRxGiveBack()): if the client falls behind, the other half fills, RXBUFF raises RTS and the sender waits 
+      instead of the ring being overwritten.  ENDRX stays set until RNCR is written so the interrupt is masked 
+      meanwhile. */
+      UartRxFlush(UART_psCurrentISR);
+      UART_psCurrentISR->pBaseAddress->US_IDR = AT91C_US_ENDRX;
+    }
+    else if( UartRxReload(UART_psCurrentISR) )
     {
-      UART_psCurrentISR->pBaseAddress->US_RNPR = (u32)UART_psCurrentISR->pu8RxBuffer;  /* !!!!! CHECK */
+      /* The ISR was held off for a whole half so bytes were lost */
+      *UART_pu32ApplicationFlagsISR |= _UART_RX_BUFFER_OVERRUN;
     }
 
-    /* Invoke the callback */
-    UART_psCurrentISR->fnRxCallback();
-    
-    /* Write RNCR to 1 to clear the ENDRX flag */
-    UART_psCurrentISR->pBaseAddress->US_RNCR = 1;
+    /* Flag that bytes have arrived */
+    *UART_pu32ApplicationFlagsISR |= _UART_RX_COMPLETE;
   }
 
+  /* TIMEOUT Interrupt when the line has been idle for UART_RX_TIMEOUT_BITS after a character */
+  if(UART_psCurrentISR->pBaseAddress->US_IMR & u32Current_CSR & AT91C_US_TIMEOUT)
+  {
+    /* Hand the rest of the burst to the client */
+    UartRxFlush(UART_psCurrentISR);
+    
+    /* Clear TIMEOUT; the next time-out is only started by the next character */
+    UART_psCurrentISR->pBaseAddress->US_CR = AT91C_US_STTTO;
+    *UART_pu32ApplicationFlagsISR |= _UART_RX_COMPLETE;
+  }
   
-  /* ENDTX Interrupt when all requested transmit bytes have been sent (if enabled) */
-  if( (UART_psCurrentISR->pBaseAddress->US_IMR & AT91C_US_ENDTX) && 
-      (UART_psCurrentISR->pBaseAddress->US_CSR & AT91C_US_ENDTX) )
+  /* ENDTX (two messages loaded) or TXBUFE (one message loaded) interrupt when a transmit message has been sent */
+  if(UART_psCurrentISR->pBaseAddress->US_IMR & u32Current_CSR & (AT91C_US_ENDTX | AT91C_US_TXBUFE))
   {
-    /* Update this message token status and then DeQueue it */
-    UpdateMessageStatus(UART_psCurrentISR->psTransmitBuffer->u32Token, COMPLETE);
-    DeQueueMessage( &UART_psCurrentISR->psTransmitBuffer );
-    UART_psCurrentISR->u32PrivateFlags &= ~_UART_PERIPHERAL_TX;
-        
-    /* Disable the transmitter and interrupt source */
-    UART_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
-    UART_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX;
+    /* Complete the front message, and the chained one too if it has also finished */
+    do
+    {
+      UpdateMessageStatus(MessageQueuePeek(&UART_psCurrentISR->sTransmitQueue)->u32Token, COMPLETE);
+      DeQueueMessage( &UART_psCurrentISR->sTransmitQueue );
+      UART_psCurrentISR->u8TxLoaded--;
+      
+      /* The PDC has already moved on to the chained message */
+      if(UART_psCurrentISR->u8TxLoaded != 0)
+      {
+        UpdateMessageStatus(MessageQueuePeek(&UART_psCurrentISR->sTransmitQueue)->u32Token, SENDING);
+      }
+    } while( (UART_psCurrentISR->u8TxLoaded != 0) && (UART_psCurrentISR->pBaseAddress->US_TCR == 0) );
     
-    /* Decrement # of active UARTs */
-    if(UART_u8ActiveUarts != 0)
+    /* Keep the PDC going with anything queued since the last messages were loaded */
+    if(UART_psCurrentISR->u8TxLoaded != 0)
     {
-      UART_u8ActiveUarts--;
+      UartChainNextMessage(UART_psCurrentISR);
     }
-    else
+    else if( !UartStartNextMessage(UART_psCurrentISR) )
     {
-      /* If UART_u8ActiveUarts is already 0, then we are not properly synchronized */
-      DebugPrintf("\n\rUART counter out of sync\n\r");
+      /* Nothing left to send: disable the transmitter and interrupt sources */
+      UART_psCurrentISR->u32PrivateFlags &= ~_UART_PERIPHERAL_TX;
+      UART_psCurrentISR->pBaseAddress->US_PTCR = AT91C_PDC_TXTDIS;
+      UART_psCurrentISR->pBaseAddress->US_IDR  = AT91C_US_ENDTX | AT91C_US_TXBUFE;
     }
   }
   
-} /* end SspGenericHandler() */
+} /* end UartGenericHandler() */
 
 
 /***********************************************************************************************************************
 State Machine Function Definitions
 
 The UART state machine monitors messaging activity on the available UART peripherals.  It manages outgoing messages and will
-transmit any bytes that has been queued.  Only one message will be transferred at once (e.g. UART1 and UART2 will not both 
-send at the same time, though both peripherals will continue to receive simultaneously).
+transmit any bytes that has been queued.  Every peripheral is looked at on each pass and each one has its own PDC 
+transmitter, so all UARTs send at the same time at their full line rate (and continue to receive simultaneously).
+Once a peripheral is sending, the messages queued behind it are picked up by its ISR; the SM only starts idle 
+peripherals and chains a newly queued message behind a lone one that is already sending.
 Since all transmit and receive bytes are transferred using interrupts, the SM does not have to worry about prioritizing.
 
 Transmitting on USART 0:
@@ -1009,6 +1663,8 @@ assume they won't.
 /* Wait for a transmit message to be queued.  Received data is handled in interrupts. */
 void UartSM_Idle(void)
 {
+  bool bSending = FALSE;
+  
 #if USE_SIMPLE_USART0
   u8 u8Temp;
 
@@ -1032,57 +1688,58 @@ void UartSM_Idle(void)
   }
 #endif /* USE_SIMPLE_USART0 */
 
-  /* Check all UART peripherals for message activity or skip the current peripheral if it is already busy sending.
-  All receive functions take place outside of the state machine.
-  Devices sending a message will have UART_psCurrentSsp->psTransmitBuffer->pu8Message pointing to the message to send. */
-  if( (UART_psCurrentUart->psTransmitBuffer != NULL) && 
-     !(UART_psCurrentUart->u32PrivateFlags & _UART_PERIPHERAL_TX ) )
+  /* Check all UART peripherals for message activity.  All receive functions take place outside of the state machine.
+  The busy flag is checked first so the front of the queue is only looked at when it is not in progress. */
+  for(u8 i = 0; i < UART_PERIPHERALS; i++)
   {
-    /* Transmitting: update the message's status and flag that the peripheral is now busy */
-    UpdateMessageStatus(UART_psCurrentUart->psTransmitBuffer->u32Token, SENDING);
-    UART_psCurrentUart->u32PrivateFlags |= _UART_PERIPHERAL_TX;    
-      
-    /* Load the PDC counter and pointer registers */
-    UART_psCurrentUart->pBaseAddress->US_TPR = (unsigned int)UART_psCurrentUart->psTransmitBuffer->pu8Message; /* CHECK */
-    UART_psCurrentUart->pBaseAddress->US_TCR = UART_psCurrentUart->psTransmitBuffer->u32Size;
-
-    /* When TCR is loaded, the ENDTX flag is cleared so it is safe to enable the interrupt */
-    UART_psCurrentUart->pBaseAddress->US_IER = AT91C_US_ENDTX;
+    UART_psCurrentUart = UART_apsPeripherals[i];
     
-    /* Update active UART count and enable the transmitter to start the transfer */
-    UART_u8ActiveUarts++;
-    UART_psCurrentUart->pBaseAddress->US_PTCR = AT91C_PDC_TXTEN;
-  }
-  
-  /* Adjust to check the next peripheral next time through */
-  switch (UART_psCurrentUart->u8PeripheralId)
-  {
-    case AT91C_ID_DBGU:
-      UART_psCurrentUart = &UART_Peripheral0;
-      break;
-
-    case AT91C_ID_US0:
-      UART_psCurrentUart = &UART_Peripheral1;
-      break;
-
-    case AT91C_ID_US1:
-      UART_psCurrentUart = &UART_Peripheral2;
-      break;
-
-    case AT91C_ID_US2:
-      UART_psCurrentUart = &UART_Peripheral;
-      
-      /* Only clear _UART_MANUAL_MODE if all UARTs are done sending to ensure messages are sent during initialization */
-      if( (G_u32SystemFlags & _SYSTEM_INITIALIZING) && !UART_u8ActiveUarts)
+    if( !(UART_psCurrentUart->u32PrivateFlags & _UART_PERIPHERAL_TX) )
+    {
+      UartStartNextMessage(UART_psCurrentUart);
+    }
+    else if(UART_psCurrentUart->u8TxLoaded == 1)
+    {
+      /* A message queued while a lone one is sending goes in TNPR/TNCR now so the PDC does not stop for the ISR.
+      The ISR may finish the transfer before it is held off, so check again. */
+      NVIC_DisableIRQ( (IRQn_Type)(UART_psCurrentUart->u8PeripheralId) );
+      if( (UART_psCurrentUart->u32PrivateFlags & _UART_PERIPHERAL_TX) && (UART_psCurrentUart->u8TxLoaded == 1) )
       {
-        UART_u32Flags &= ~_UART_MANUAL_MODE;
+        UartChainNextMessage(UART_psCurrentUart);
       }
-      break;
+      NVIC_EnableIRQ( (IRQn_Type)(UART_psCurrentUart->u8PeripheralId) );
+    }
+    
+    if(UART_psCurrentUart->u32PrivateFlags & _UART_PERIPHERAL_TX)
+    {
+      bSending = TRUE;
+    }
 
-    default:
-      UART_psCurrentUart = &UART_Peripheral;
-      break;
-  } /* end switch */
+    /* With RTS/CTS a filled receive half is only given back once the client has consumed it.  This pass runs before
+    the client's task, so a half reported this pass is only given back on a later one. */
+    if( (UART_psCurrentUart->u32PrivateFlags & _UART_PERIPHERAL_RTS_CTS) &&
+        !(UART_psCurrentUart->pBaseAddress->US_IMR & AT91C_US_ENDRX) )
+    {
+      NVIC_DisableIRQ( (IRQn_Type)(UART_psCurrentUart->u8PeripheralId) );
+      UartRxGiveBack(UART_psCurrentUart);
+      NVIC_EnableIRQ( (IRQn_Type)(UART_psCurrentUart->u8PeripheralId) );
+    }
+
+    /* The DBGU has no receiver time-out, so the bytes of a burst that did not fill a half are flushed here */
+    if( (UART_psCurrentUart->u8PeripheralId == AT91C_ID_DBGU) && 
+        (UART_psCurrentUart->u32PrivateFlags & _UART_PERIPHERAL_ASSIGNED) )
+    {
+      NVIC_DisableIRQ( (IRQn_Type)(UART_psCurrentUart->u8PeripheralId) );
+      UartRxFlush(UART_psCurrentUart);
+      NVIC_EnableIRQ( (IRQn_Type)(UART_psCurrentUart->u8PeripheralId) );
+    }
+  }
+  
+  /* Only clear _UART_MANUAL_MODE if all UARTs are done sending to ensure messages are sent during initialization */
+  if( (G_u32SystemFlags & _SYSTEM_INITIALIZING) && !bSending)
+  {
+    UART_u32Flags &= ~_UART_MANUAL_MODE;
+  }
   
 } /* end UartSM_Idle() */
 
@@ -13,32 +13,43 @@ Header file for sam3u_uart.c
 /**********************************************************************************************************************
 Type Definitions
 **********************************************************************************************************************/
+typedef void (*fnUartRxCallbackType)(u16 u16Count_);  /* Receive callback: u16Count_ new bytes are in the buffer */
+typedef enum {UART_FLOW_NONE, UART_FLOW_RTS_CTS} UartFlowControlType;
+
 typedef struct 
 {
   PeripheralType UartPeripheral;      /* Easy name of peripheral */
-  u16 u16RxBufferSize;                /* Size of receive buffer in bytes */
+  u32 u32BaudRate;                    /* Line rate in bps (within UART_MAX_BAUD_ERROR_PERMIL); 0 uses the *_US_BRGR_INIT divider */
+  UartFlowControlType FlowControl;    /* UART_FLOW_RTS_CTS for hardware handshaking (USARTs only: the DBGU has no RTS/CTS) */
+  u16 u16RxBufferSize;                /* Size of receive buffer in bytes (even, at least 2) */
   u8* pu8RxBufferAddress;             /* Address to circular receive buffer */
   u8** pu8RxNextByte;                 /* Pointer to buffer location where next received byte will be placed */
-  fnCode_type fnRxCallback;           /* Callback function for receiving data */
+  fnUartRxCallbackType fnRxCallback;  /* Callback function for receiving data */
+  u8 u8TxReservedSlots;               /* Message pool slots kept for this peripheral's transmit queue */
+  MessagePriorityType eTxPriority;    /* Priority class of the transmit queue when it needs more than its reserved slots */
 } UartConfigurationType;
 
 typedef struct 
 {
   AT91PS_USART pBaseAddress;          /* Base address of the associated peripheral */
   u32 u32PrivateFlags;            /* Flags for peripheral */
-  MessageType* psTransmitBuffer;      /* Pointer to the transmit message linked list */
+  MessageQueueType sTransmitQueue;    /* Transmit message queue (ring of pool indexes) */
   u32 u32CurrentTxBytesRemaining;     /* Counter for bytes remaining in current transfer */
   u8* pu8CurrentTxData;               /* Pointer to current location in the Tx buffer */
   u8* pu8RxBuffer;                    /* Pointer to circular receive buffer in user application */
   u8** pu8RxNextByte;                 /* Pointer to buffer location where next received byte will be placed */
-  fnCode_type fnRxCallback;           /* Callback function for receiving data */
+  fnUartRxCallbackType fnRxCallback;  /* Callback function for receiving data */
   u16 u16RxBufferSize;                /* Size of receive buffer in bytes */
+  u16 u16RxIndex;                     /* Index of the first received byte not yet passed to fnRxCallback */
+  u16 u16RxUnconsumed;                /* Bytes passed to fnRxCallback that the client has not released (RTS/CTS only) */
   u8 u8PeripheralId;                  /* Simple peripheral ID number */
-  u8 u8Pad;
+  u8 u8TxLoaded;                      /* Messages loaded in the PDC transmit registers: current and next (0 to 2) */
 } UartPeripheralType;
 
 /* u32PrivateFlags */
 #define   _UART_PERIPHERAL_ASSIGNED     (u32)0x00000001   /* Set when the peripheral is in use */
+#define   _UART_PERIPHERAL_RTS_CTS      (u32)0x00000002   /* Set when the peripheral uses hardware handshaking */
+#define   _UART_PERIPHERAL_RX_FULL      (u32)0x00000004   /* Set when UartRxFlush() has passed on a full receive ring (RXBUFF) */
 #define   _UART_PERIPHERAL_TX           (u32)0x00200000   /* Set when the peripheral is transmitting */
 
 /**********************************************************************************************************************
@@ -74,7 +85,13 @@ casted back to integers for comparisons as far as we could tell! */
 #define UART_BASE_US2                   (u32)0x40098000
 #define UART_BASE_US3                   (u32)0x4009C000
 
+#define UART_PERIPHERALS                (u8)4               /* Number of UART peripherals serviced by the state machine */
 #define UART_INIT_MSG_TIMEOUT           (u32)1000           /* Time in ms for init message to send */
+#define UART_RX_TIMEOUT_BITS            (u32)20             /* Idle bit periods (2 chars at 8-N-1) before a partial receive is flushed */
+
+#define UART_MIN_CD                     (u32)1              /* Smallest baud rate divider */
+#define UART_MAX_CD                     (u32)0xFFFF         /* Largest baud rate divider (16-bit CD field) */
+#define UART_MAX_BAUD_ERROR_PERMIL      (u32)20             /* Largest baud rate error accepted by UartRequest() (2%) */
 
 
 /***********************************************************************************************************************
@@ -98,6 +115,8 @@ void UartRelease(UartPeripheralType* psUartPeripheral_);
 
 u32 UartWriteByte(UartPeripheralType* psUartPeripheral_, u8 u8Byte_);
 u32 UartWriteData(UartPeripheralType* psUartPeripheral_, u32 u32Size_, u8* u8Data_);
+u32 UartWriteDataNoCopy(UartPeripheralType* psUartPeripheral_, u32 u32Size_, const u8* pu8Data_);
+void UartRxConsumed(UartPeripheralType* psUartPeripheral_, u16 u16Count_);
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -114,6 +133,14 @@ void UartManualMode(void);
 /*--------------------------------------------------------------------------------------------------------------------*/
 //static void UartFillTxBuffer(UartPeripheralType* UartPeripheral_);
 //static void UartReadRxBuffer(UartPeripheralType* psTargetUart_);
+bool UartAbortTransfer(void* psQueue_);
+bool UartStartNextMessage(UartPeripheralType* psUart_);
+void UartChainNextMessage(UartPeripheralType* psUart_);
+u16 UartRxDmaIndex(UartPeripheralType* psUart_);
+void UartRxFlush(UartPeripheralType* psUart_);
+bool UartRxReload(UartPeripheralType* psUart_);
+void UartRxGiveBack(UartPeripheralType* psUart_);
+u32 UartBaudRateToBrgr(UartPeripheralType* psUart_, u32 u32BaudRate_);
 
 void UART_IRQHandler(void);
 void UART0_IRQHandler(void);
@@ -16,6 +16,20 @@ if( !IsTimeUp(&u32ApplicationTimer, 1000)
   u32ApplicationTimer = G_u32SystemTime1ms;
 }
 
+void ReverseBits(u8* pu8Destination_, const u8* pu8Source_, u32 u32Size_)
+Copies a buffer with the bit order of every byte reversed (bit 0 <-> bit 7), e.g. to send it LSB first on a 
+peripheral that only shifts MSB first.  The source and destination can be the same buffer.
+e.g. ReverseBits(au8Data, au8Data, sizeof(au8Data));
+
+u16 Crc16Ccitt(u16 u16Crc_, const u8* pu8Data_, u32 u32Size_)
+Continues a CRC-16/CCITT (polynomial 0x1021, MSB first) over u32Size_ bytes.  Start a new CRC with CRC16_CCITT_INIT.
+e.g. u16Crc = Crc16Ccitt(CRC16_CCITT_INIT, au8Data, sizeof(au8Data));
+
+u32 CobsEncode(u8* pu8Destination_, const u8* pu8Source_, u32 u32Size_)
+Consistent Overhead Byte Stuffing: copies u32Size_ bytes to pu8Destination_ with every 0x00 removed so that 0x00 
+can delimit frames.  The output is at most COBS_ENCODED_SIZE(u32Size_) bytes; the encoded size is returned.
+e.g. u32Encoded = CobsEncode(au8Frame, au8Data, sizeof(au8Data));
+
 
 ***********************************************************************************************************************/
 
@@ -329,6 +343,142 @@ bool SearchString(u8* pu8TargetString_, u8* pu8MatchString_)
 } /* end SearchString */
 
 
+/*-----------------------------------------------------------------------------/
+Function: ReverseBits
+
+Description:
+Reverses the bit order of every byte of a buffer.  Whole words are done four bytes at a time: RBIT reverses all 32 
+bits, which also swaps the byte order, and REV swaps the bytes back.
+
+Requires:
+  - pu8Source_ points to u32Size_ bytes
+  - pu8Destination_ has room for u32Size_ bytes and is either pu8Source_ or does not overlap it
+ 
+Promises:
+  - pu8Destination_[i] is pu8Source_[i] with its bits reversed for i = 0 to u32Size_ - 1
+*/
+void ReverseBits(u8* pu8Destination_, const u8* pu8Source_, u32 u32Size_)
+{
+  u32* pu32Destination;
+  const u32* pu32Source;
+  
+  /* Single bytes up to a word boundary of the destination */
+  while( (u32Size_ != 0) && ((u32)pu8Destination_ & 0x00000003) )
+  {
+    *pu8Destination_++ = (u8)(__RBIT(*pu8Source_++) >> 24);
+    u32Size_--;
+  }
+  
+  /* Whole words if the source is also word aligned */
+  if( !((u32)pu8Source_ & 0x00000003) )
+  {
+    pu32Destination = (u32*)pu8Destination_;
+    pu32Source = (const u32*)pu8Source_;
+    while(u32Size_ >= 4)
+    {
+      *pu32Destination++ = __REV(__RBIT(*pu32Source++));
+      u32Size_ -= 4;
+    }
+    
+    pu8Destination_ = (u8*)pu32Destination;
+    pu8Source_ = (const u8*)pu32Source;
+  }
+  
+  /* Whatever is left */
+  while(u32Size_ != 0)
+  {
+    *pu8Destination_++ = (u8)(__RBIT(*pu8Source_++) >> 24);
+    u32Size_--;
+  }
+
+} /* end ReverseBits() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: Crc16Ccitt
+
+Description:
+Adds bytes to a CRC-16/CCITT (polynomial 0x1021, MSB first, no reflection).  Each byte is folded in with shifts 
+instead of a 512-byte table.
+
+Requires:
+  - u16Crc_ is CRC16_CCITT_INIT for a new CRC or the result of the previous call
+  - pu8Data_ points to u32Size_ bytes
+ 
+Promises:
+  - Returns the CRC of everything passed so far
+*/
+u16 Crc16Ccitt(u16 u16Crc_, const u8* pu8Data_, u32 u32Size_)
+{
+  u8 u8Index;
+  
+  while(u32Size_ != 0)
+  {
+    u8Index = (u8)(u16Crc_ >> 8) ^ *pu8Data_++;
+    u8Index ^= u8Index >> 4;
+    u16Crc_ = (u16)((u16Crc_ << 8) ^ ((u16)u8Index << 12) ^ ((u16)u8Index << 5) ^ u8Index);
+    u32Size_--;
+  }
+  
+  return(u16Crc_);
+
+} /* end Crc16Ccitt() */
+
+
+/*-----------------------------------------------------------------------------/
+Function: CobsEncode
+
+Description:
+Encodes a buffer with Consistent Overhead Byte Stuffing.  The data is cut at every 0x00 (and after every 254 
+non-zero bytes) and each piece is sent as a code byte that holds its length + 1 followed by its non-zero bytes.  
+The output never contains 0x00, so a 0x00 can mark the end of a frame, and it is only one byte per 254 longer.
+
+Requires:
+  - pu8Source_ points to u32Size_ bytes
+  - pu8Destination_ has room for COBS_ENCODED_SIZE(u32Size_) bytes and does not overlap pu8Source_
+ 
+Promises:
+  - The encoded data (without a delimiter) is in pu8Destination_ and its size is returned
+*/
+u32 CobsEncode(u8* pu8Destination_, const u8* pu8Source_, u32 u32Size_)
+{
+  u8* pu8Code = pu8Destination_;
+  u8* pu8Output = pu8Destination_ + 1;
+  u8 u8Code = 1;
+  
+  while(u32Size_ != 0)
+  {
+    if(*pu8Source_ == 0)
+    {
+      /* Close the piece at the zero */
+      *pu8Code = u8Code;
+      pu8Code = pu8Output++;
+      u8Code = 1;
+    }
+    else
+    {
+      *pu8Output++ = *pu8Source_;
+      u8Code++;
+      
+      /* A full piece has no zero behind it; only start another one if more data follows */
+      if( (u8Code == 0xFF) && (u32Size_ != 1) )
+      {
+        *pu8Code = u8Code;
+        pu8Code = pu8Output++;
+        u8Code = 1;
+      }
+    }
+    
+    pu8Source_++;
+    u32Size_--;
+  }
+  
+  *pu8Code = u8Code;
+  return( (u32)(pu8Output - pu8Destination_) );
+
+} /* end CobsEncode() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* Protected Functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
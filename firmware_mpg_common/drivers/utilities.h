@@ -21,6 +21,9 @@ Constants / Definitions
 #define ASCII_LINEFEED          (u8)0x0A      /* ASCII LF char \n */
 #define ASCII_BACKSPACE         (u8)0x08      /* ASCII Backspace char */
 
+#define CRC16_CCITT_INIT        (u16)0xFFFF   /* Starting value for Crc16Ccitt */
+#define COBS_ENCODED_SIZE(x)    ((x) + ((x) / 254) + 1)   /* Max bytes from CobsEncode for x bytes of data */
+
 #define RESET_TARGET_TIMER      (u8)0x1       /* Switch for IsTimeUp to reset the reference timer */
 #define NO_RESET_TARGET_TIMER   (u8)0x0       /* Switch for IsTimeUp to not reset the reference timer */
 
@@ -53,6 +56,9 @@ u8 HexToASCIICharUpper(u8 u8Char_);
 u8 HexToASCIICharLower(u8 u8Char_);
 u8 NumberToAscii(u32 u32Number_, u8* pu8AsciiString_);
 bool SearchString(u8* pu8TargetString_, u8* pu8MatchString_);
+void ReverseBits(u8* pu8Destination_, const u8* pu8Source_, u32 u32Size_);
+u16 Crc16Ccitt(u16 u16Crc_, const u8* pu8Data_, u32 u32Size_);
+u32 CobsEncode(u8* pu8Destination_, const u8* pu8Source_, u32 u32Size_);
 
 
 /*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,89 @@
+/**********************************************************************************************************************
+File: configuration.h (host)
+
+Description:
+Stand-in for ../configuration.h so the peripheral-free firmware files (messaging.c, utilities.c) can be compiled
+with a PC compiler for the tests and benchmarks in this folder.  The Makefile puts this folder first on the include
+path so the firmware's own #include "configuration.h" finds this file.
+
+The types are fixed-width so that u32 is 32 bits on a 64-bit PC (token rollover depends on it) and the Cortex-M3
+intrinsics are single-threaded C versions: LDREX/STREX become plain loads and stores that always succeed.
+**********************************************************************************************************************/
+
+#ifndef __CONFIGURATION_H
+#define __CONFIGURATION_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Some firmware code compares characters with NULL, which the target compiler accepts */
+#undef NULL
+#define NULL 0
+
+/* Keep ../typedefs.h out: its u32 is an unsigned long */
+#define __TYPEDEFS_H
+
+typedef void(*fnCode_type)(void);
+
+typedef int32_t s32;
+typedef int16_t s16;
+typedef int8_t s8;
+
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t u8;
+
+typedef enum {FALSE = 0, TRUE = !FALSE} bool;
+
+
+/***********************************************************************************************************************
+Cortex-M3 intrinsics
+***********************************************************************************************************************/
+#define __CLZ(x)                ((u32)((x) == 0 ? 32 : __builtin_clz(x)))
+#define __RBIT(x)               HostRbit(x)
+#define __REV(x)                ((u32)__builtin_bswap32(x))
+#define __LDREXB(p)             (*(p))
+#define __STREXB(v, p)          ((*(p) = (v)), 0)
+#define __LDREXW(p)             (*(p))
+#define __STREXW(v, p)          ((*(p) = (v)), 0)
+#define __CLREX()               ((void)0)
+#define __DMB()                 __sync_synchronize()
+#define __disable_interrupt()   ((void)0)
+#define __enable_interrupt()    ((void)0)
+#define __get_PRIMASK()         ((u32)0)
+#define __set_PRIMASK(x)        ((void)(x))
+
+static inline u32 HostRbit(u32 u32Value_)
+{
+  u32 u32Result = 0;
+
+  for(u8 i = 0; i < 32; i++)
+  {
+    u32Result = (u32Result << 1) | (u32Value_ & 1);
+    u32Value_ >>= 1;
+  }
+
+  return(u32Result);
+}
+
+
+/***********************************************************************************************************************
+Firmware headers used on the host
+***********************************************************************************************************************/
+#include "utilities.h"
+#include "messaging.h"
+
+/* System globals normally defined by main.c and the board file (see host_globals.c) */
+extern volatile u32 G_u32SystemTime1ms;
+extern volatile u32 G_u32SystemTime1s;
+extern volatile u32 G_u32SystemFlags;
+extern volatile u32 G_u32ApplicationFlags;
+
+
+#endif /* __CONFIGURATION_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
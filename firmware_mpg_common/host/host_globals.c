@@ -0,0 +1,19 @@
+/**********************************************************************************************************************
+File: host_globals.c
+
+Description:
+The system globals that main.c and the board file define on the target.  Host programs advance
+G_u32SystemTime1ms themselves.
+**********************************************************************************************************************/
+
+#include "configuration.h"
+
+volatile u32 G_u32SystemTime1ms;                 /* Advanced by the host program */
+volatile u32 G_u32SystemTime1s;                  /* Advanced by the host program */
+volatile u32 G_u32SystemFlags;                   /* System flags (unused on the host) */
+volatile u32 G_u32ApplicationFlags;              /* Application flags (unused on the host) */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,225 @@
+/***********************************************************************************************************************
+File: messaging_bench.c
+
+Description:
+Host benchmark for messaging.c.  Run with "make bench".
+
+1. Throughput and per-call cost of QueueMessage() (copied and no-copy), MessageQueuePeek() + DeQueueMessage() and
+   QueryMessageStatus(), each measured with the queue nearly empty and nearly full to show that the cost does not
+   depend on the queue depth.  Times are host CPU cycles (TSC on x86, otherwise ns); they compare the operations with
+   each other and across changes, they are not Cortex-M3 cycles.  The median is the typical cost; the max includes
+   host noise such as interrupts so the 99.9th percentile is the better worst case.
+2. Arena capacity: how many copied messages of a given size fit at once, and the bytes of pool + arena RAM per
+   message on the target (a MessageType is 28 bytes with 32-bit pointers).  The same figures for the fixed-slot pool
+   that the arena replaced (16 slots of 144 bytes, each with a 128-byte payload) show the RAM saved.
+***********************************************************************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+#include "../drivers/messaging.c"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNITS   "cycles"
+static inline u32 BenchNow(void) { return( (u32)__rdtsc() ); }
+#else
+#define BENCH_UNITS   "ns"
+static inline u32 BenchNow(void)
+{
+  struct timespec sTime;
+  clock_gettime(CLOCK_MONOTONIC, &sTime);
+  return( (u32)(sTime.tv_sec * 1000000000ull + sTime.tv_nsec) );
+}
+#endif
+
+#define BENCH_SAMPLES           (u32)200000       /* Calls timed for each result */
+#define BENCH_TARGET_MSG_SIZE   (u32)28           /* sizeof(MessageType) on the Cortex-M3 */
+#define BENCH_BASELINE_SLOTS    (u32)16           /* Slots in the fixed-slot pool before the arena */
+#define BENCH_BASELINE_PAYLOAD  (u32)128          /* Payload bytes in each fixed slot */
+#define BENCH_BASELINE_SLOT     (u32)144          /* bFree + token + size + payload + next pointer on the Cortex-M3 */
+
+static MessageQueueType Bench_sQueue;             /* Queue used for all measurements */
+static u8 Bench_au8Data[MAX_TX_MESSAGE_LENGTH];   /* Message data */
+static u32 Bench_au32Samples[BENCH_SAMPLES];      /* Cost of each timed call */
+
+
+/***********************************************************************************************************************
+Helpers
+***********************************************************************************************************************/
+static int BenchCompare(const void* pvA_, const void* pvB_)
+{
+  u32 u32A = *(const u32*)pvA_;
+  u32 u32B = *(const u32*)pvB_;
+
+  return( (u32A > u32B) - (u32A < u32B) );
+}
+
+
+static void BenchReport(const char* pcName_, u32 u32Depth_)
+{
+  qsort(Bench_au32Samples, BENCH_SAMPLES, sizeof(u32), BenchCompare);
+  printf("  %-26s depth %2u: median %5u  p99.9 %5u  max %6u %s\n", pcName_, u32Depth_,
+         Bench_au32Samples[BENCH_SAMPLES / 2], Bench_au32Samples[(BENCH_SAMPLES / 1000) * 999], 
+         Bench_au32Samples[BENCH_SAMPLES - 1], BENCH_UNITS);
+}
+
+
+static double BenchSeconds(void)
+{
+  struct timespec sTime;
+
+  clock_gettime(CLOCK_MONOTONIC, &sTime);
+  return(sTime.tv_sec + sTime.tv_nsec / 1e9);
+}
+
+
+static void BenchReset(u32 u32Depth_)
+{
+  memset(&Bench_sQueue, 0, sizeof(Bench_sQueue));
+  MessagingInitialize();
+  MessageQueueConfigure(&Bench_sQueue, 0, MSG_PRIORITY_HIGH);
+
+  /* Messages left in front of the ones being measured */
+  for(u32 i = 0; i < u32Depth_; i++)
+  {
+    QueueMessageNoCopy(&Bench_sQueue, 1, Bench_au8Data);
+  }
+}
+
+
+/***********************************************************************************************************************
+Measurements
+***********************************************************************************************************************/
+static void BenchQueue(u32 u32Size_, bool bNoCopy_)
+{
+  if(bNoCopy_)
+  {
+    QueueMessageNoCopy(&Bench_sQueue, u32Size_, Bench_au8Data);
+  }
+  else
+  {
+    QueueMessage(&Bench_sQueue, u32Size_, Bench_au8Data);
+  }
+}
+
+
+/* Queue one message and take it off again.  The dequeue takes the oldest message so the queue depth stays at 
+u32Depth_.  The first pass measures throughput without any timing in the loop, the second times each call. */
+static void BenchQueueDequeue(u32 u32Depth_, u32 u32Size_, bool bNoCopy_)
+{
+  static u32 au32Dequeue[BENCH_SAMPLES];
+  u32 u32Start;
+  double dStart;
+
+  BenchReset(u32Depth_);
+  dStart = BenchSeconds();
+  for(u32 i = 0; i < BENCH_SAMPLES; i++)
+  {
+    BenchQueue(u32Size_, bNoCopy_);
+    MessageQueuePeek(&Bench_sQueue);
+    DeQueueMessage(&Bench_sQueue);
+  }
+  printf("%s %u B, depth %u: %.1f M queue + dequeue pairs/s\n", bNoCopy_ ? "QueueMessageNoCopy" : "QueueMessage",
+         u32Size_, u32Depth_, BENCH_SAMPLES / (BenchSeconds() - dStart) / 1e6);
+
+  for(u32 i = 0; i < BENCH_SAMPLES; i++)
+  {
+    u32Start = BenchNow();
+    BenchQueue(u32Size_, bNoCopy_);
+    Bench_au32Samples[i] = BenchNow() - u32Start;
+
+    u32Start = BenchNow();
+    MessageQueuePeek(&Bench_sQueue);
+    DeQueueMessage(&Bench_sQueue);
+    au32Dequeue[i] = BenchNow() - u32Start;
+  }
+
+  BenchReport(bNoCopy_ ? "QueueMessageNoCopy" : "QueueMessage", u32Depth_);
+  memcpy(Bench_au32Samples, au32Dequeue, sizeof(au32Dequeue));
+  BenchReport("Peek + DeQueueMessage", u32Depth_);
+}
+
+
+static void BenchQuery(u32 u32Depth_)
+{
+  volatile MessageStateType eState;
+  u32 u32Token;
+  u32 u32Start;
+  double dStart;
+
+  BenchReset(u32Depth_);
+  u32Token = QueueMessageNoCopy(&Bench_sQueue, 1, Bench_au8Data);
+  dStart = BenchSeconds();
+  for(u32 i = 0; i < BENCH_SAMPLES; i++)
+  {
+    eState = QueryMessageStatus(u32Token);
+  }
+  printf("QueryMessageStatus, depth %u: %.1f M/s\n", u32Depth_, BENCH_SAMPLES / (BenchSeconds() - dStart) / 1e6);
+  
+  for(u32 i = 0; i < BENCH_SAMPLES; i++)
+  {
+    u32Start = BenchNow();
+    eState = QueryMessageStatus(u32Token);
+    Bench_au32Samples[i] = BenchNow() - u32Start;
+  }
+  (void)eState;
+
+  BenchReport("QueryMessageStatus", u32Depth_);
+}
+
+
+static void BenchArenaCapacity(void)
+{
+  static const u32 au32Sizes[] = {1, 4, 8, 16, 32, 64, 128, 256};
+  u32 u32Count;
+  u32 u32BaselineCount;
+  u32 u32Ram = TX_QUEUE_SIZE * BENCH_TARGET_MSG_SIZE + MSG_ARENA_SIZE;
+  u32 u32BaselineRam = BENCH_BASELINE_SLOTS * BENCH_BASELINE_SLOT;
+
+  printf("\ncopied messages held at once (pool of %u slots, %u byte arena):\n", TX_QUEUE_SIZE, MSG_ARENA_SIZE);
+  for(u32 i = 0; i < sizeof(au32Sizes) / sizeof(au32Sizes[0]); i++)
+  {
+    BenchReset(0);
+    u32Count = 0;
+    while(QueueMessage(&Bench_sQueue, au32Sizes[i], Bench_au8Data) != 0)
+    {
+      u32Count++;
+    }
+
+    /* A fixed slot holds one message of up to BENCH_BASELINE_PAYLOAD bytes; longer ones took several slots */
+    u32BaselineCount = BENCH_BASELINE_SLOTS / ((au32Sizes[i] + BENCH_BASELINE_PAYLOAD - 1) / BENCH_BASELINE_PAYLOAD);
+    printf("  %3u B: %2u messages, %5.1f per KB of pool + arena RAM (fixed slots: %2u, %5.1f per KB)\n", au32Sizes[i], 
+           u32Count, u32Count * 1024.0 / u32Ram, u32BaselineCount, u32BaselineCount * 1024.0 / u32BaselineRam);
+  }
+  printf("  target RAM: %u x %u B slots + %u B arena = %u B\n", TX_QUEUE_SIZE, BENCH_TARGET_MSG_SIZE, MSG_ARENA_SIZE,
+         u32Ram);
+  printf("  fixed slots: %u x %u B = %u B, so the arena saves %d B\n", BENCH_BASELINE_SLOTS, BENCH_BASELINE_SLOT, 
+         u32BaselineRam, (int)u32BaselineRam - (int)u32Ram);
+  printf("  longest copied message: %u B (fixed slots: %u B)\n", MSG_MAX_COPIED_LENGTH, 
+         BENCH_BASELINE_SLOTS * BENCH_BASELINE_PAYLOAD);
+}
+
+
+/***********************************************************************************************************************
+Main
+***********************************************************************************************************************/
+int main(void)
+{
+  static const u32 au32Depths[] = {0, TX_QUEUE_SIZE - 2};
+
+  for(u32 i = 0; i < sizeof(au32Depths) / sizeof(au32Depths[0]); i++)
+  {
+    BenchQueueDequeue(au32Depths[i], 4, FALSE);
+    BenchQueueDequeue(au32Depths[i], 64, FALSE);
+    BenchQueueDequeue(au32Depths[i], 64, TRUE);
+    BenchQuery(au32Depths[i]);
+  }
+
+  BenchArenaCapacity();
+  return(0);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,716 @@
+/***********************************************************************************************************************
+File: messaging_test.c
+
+Description:
+Host regression tests for messaging.c.  messaging.c is included directly so the tests can check its static counters
+(pool use, token counter) as well as the public API.  Run with "make test"; the program prints one line per test
+and returns non-zero if any check failed.
+
+Tests:
+- Token rollover: the token after 0xFFFFFFFF is 1 and both statuses can be found.
+- Split messages: a long message stays in one piece unless the arena's free space is split by its end; then the 
+  pieces take consecutive slots and tokens, the data is intact across them, the message is queued completely or not 
+  at all, and cancelling it by either token drops every piece unless one has started.  Empty and too-long messages 
+  are refused without counting as full.
+- Queue full: QueueMessage() fails cleanly when the pool or the arena is full, flags _MESSAGING_TX_QUEUE_FULL,
+  counts the rejection and works again once a message is dequeued.  Reservations and priority headroom hold.
+- Sweeper: WAITING messages are timed out and dropped, claimed ones are left to the peripheral, and a message whose
+  status entry was reused by a later token is aged from when it was queued.
+- Coalescing and claims: appends share the token and stop once the message is claimed.
+- Notify: SetMessageNotify() fires once on COMPLETE, TIMEOUT and ABANDONED, fires straight away for a message that
+  has already finished, and a second notification replaces the first.
+- Statistics: the high-water mark keeps the most slots a queue has held, the latency bins split at 0, 1, 2^n - 1 
+  and 2^n ms and cap at MSG_LATENCY_BUCKETS - 1, and only WAITING -> SENDING/RECEIVING and SENDING/RECEIVING ->
+  COMPLETE are counted.
+- Stress: random enqueue / dequeue / cancel / coalesce on three queues ends with every slot and record returned.
+***********************************************************************************************************************/
+
+#include <stdio.h>
+#include "../drivers/messaging.c"
+
+
+/***********************************************************************************************************************
+Test helpers
+***********************************************************************************************************************/
+static u32 Test_u32Checks;                       /* Checks run */
+static u32 Test_u32Failures;                     /* Checks that failed */
+static MessageQueueType Test_asQueues[3];        /* Queues used by the tests */
+static u32 Test_u32Callbacks;                    /* Calls to TestNotifyCallback() */
+static volatile u32 Test_u32Events;              /* Event flags set by notifications */
+static u8 Test_au8Data[MSG_MAX_COPIED_LENGTH + 1];  /* Source data */
+
+#define CHECK(x)  TestCheck((x), #x, __LINE__)
+
+static void TestCheck(bool bPassed_, const char* pcExpression_, int iLine_)
+{
+  Test_u32Checks++;
+  if(!bPassed_)
+  {
+    Test_u32Failures++;
+    printf("  FAILED line %d: %s\n", iLine_, pcExpression_);
+  }
+}
+
+
+/* Starts each test from an empty pool: queue 0 HIGH with 4 reserved slots, queue 1 LOW, queue 2 NORMAL */
+static void TestReset(void)
+{
+  memset(Test_asQueues, 0, sizeof(Test_asQueues));
+  MessagingInitialize();
+  G_u32SystemTime1ms = 1000;
+  MessageQueueConfigure(&Test_asQueues[0], 4, MSG_PRIORITY_HIGH);
+  MessageQueueConfigure(&Test_asQueues[1], 0, MSG_PRIORITY_LOW);
+  MessageQueueConfigure(&Test_asQueues[2], 0, MSG_PRIORITY_NORMAL);
+}
+
+
+static void TestDrain(MessageQueueType* psQueue_)
+{
+  while(MessageQueuePeek(psQueue_) != NULL)
+  {
+    DeQueueMessage(psQueue_);
+  }
+}
+
+
+/* Leaves u16EndWords_ free arena words before the end and the start of the arena free up to a 2-word record held
+on queue 1, so a copied message too long for either space is split at the end of the arena */
+static void TestSplitArena(u16 u16EndWords_)
+{
+  QueueMessage(&Test_asQueues[1], (MSG_ARENA_WORDS - u16EndWords_ - 3) * 4, Test_au8Data);
+  QueueMessage(&Test_asQueues[1], 4, Test_au8Data);
+  DeQueueMessage(&Test_asQueues[1]);
+}
+
+
+static void TestNotifyCallback(void)
+{
+  Test_u32Callbacks++;
+}
+
+
+/* The pool and arena are back to empty */
+static bool TestAllFree(void)
+{
+  for(u8 i = 0; i < 3; i++)
+  {
+    TestDrain(&Test_asQueues[i]);
+    if( (Test_asQueues[i].u8InUse != 0) || (Test_asQueues[i].u8ReservedInUse != 0) )
+    {
+      return(FALSE);
+    }
+  }
+
+  return( (bool)((Msg_u8QueuedMessageCount == 0) && (Msg_u8SharedInUse == 0)) );
+}
+
+
+/***********************************************************************************************************************
+Tests
+***********************************************************************************************************************/
+static void TestTokenRollover(void)
+{
+  u32 u32First, u32Second, u32Third;
+
+  TestReset();
+  Msg_u32Token = 0xFFFFFFFE;
+  u32First  = QueueMessage(&Test_asQueues[0], 1, Test_au8Data);
+  u32Second = QueueMessage(&Test_asQueues[0], 1, Test_au8Data);
+  u32Third  = QueueMessageNoCopy(&Test_asQueues[0], 1, Test_au8Data);
+
+  CHECK(u32First == 0xFFFFFFFE);
+  CHECK(u32Second == 0xFFFFFFFF);
+  CHECK(u32Third == 1);
+  CHECK(QueryMessageStatus(u32Second) == WAITING);
+  CHECK(QueryMessageStatus(u32Third) == WAITING);
+
+  UpdateMessageStatus(u32Second, COMPLETE);
+  CHECK(QueryMessageStatus(u32Second) == COMPLETE);
+  CHECK(QueryMessageStatus(u32Second) == NOT_FOUND);
+  CHECK(TestAllFree());
+
+  /* The pieces of a split message across the rollover skip token 0 */
+  TestSplitArena(16);
+  Msg_u32Token = 0xFFFFFFFF;
+  u32First = QueueMessage(&Test_asQueues[0], 960, Test_au8Data);
+  CHECK(u32First == 1);
+  CHECK(QueryMessageStatus(0xFFFFFFFF) == WAITING);
+  CHECK(MessageQueuePeek(&Test_asQueues[0])->u32Token == 0xFFFFFFFF);
+  CHECK(Msg_u32Token == 2);
+  CHECK(TestAllFree());
+}
+
+
+static void TestSplitMessages(void)
+{
+  MessageType* psMessage;
+  u32 u32Size = 960;
+  u32 u32Token, u32TokenBefore, u32Offset = 0;
+  u32 u32Rejected;
+  u8 u8CountBefore;
+  bool bDataOk = TRUE;
+
+  /* The longest copied message goes out as one piece */
+  TestReset();
+  u32TokenBefore = Msg_u32Token;
+  u32Token = QueueMessage(&Test_asQueues[2], MSG_MAX_COPIED_LENGTH, Test_au8Data);
+  CHECK(u32Token == u32TokenBefore);
+  CHECK(Msg_u8QueuedMessageCount == 1);
+  psMessage = MessageQueuePeek(&Test_asQueues[2]);
+  CHECK( (psMessage != NULL) && !(psMessage->u8Flags & _MESSAGE_SPLIT) && 
+         (psMessage->u32Size == MSG_MAX_COPIED_LENGTH) &&
+         (memcmp(psMessage->pu8Message, Test_au8Data, MSG_MAX_COPIED_LENGTH) == 0) );
+  CHECK(TestAllFree());
+
+  /* Split where the arena wraps: two pieces with consecutive tokens; the last token is returned */
+  TestSplitArena(16);
+  u32TokenBefore = Msg_u32Token;
+  u32Token = QueueMessage(&Test_asQueues[2], u32Size, Test_au8Data);
+  CHECK(u32Token == u32TokenBefore + 1);
+  for(u8 i = 0; i < 2; i++)
+  {
+    psMessage = MessageQueuePeek(&Test_asQueues[2]);
+    CHECK(psMessage != NULL);
+    if(psMessage == NULL)
+    {
+      return;
+    }
+
+    CHECK(psMessage->u32Token == u32TokenBefore + i);
+    CHECK( (i == 0) == ((psMessage->u8Flags & _MESSAGE_SPLIT) != 0) );
+    CHECK(psMessage->u32Size == ((i == 0) ? 15 * 4 : u32Size - 15 * 4));
+    if(memcmp(psMessage->pu8Message, &Test_au8Data[u32Offset], psMessage->u32Size) != 0)
+    {
+      bDataOk = FALSE;
+    }
+    u32Offset += psMessage->u32Size;
+    DeQueueMessage(&Test_asQueues[2]);
+  }
+  CHECK(bDataOk);
+  CHECK(u32Offset == u32Size);
+  CHECK(TestAllFree());
+
+  /* All or nothing: the end of the arena is taken but the rest does not fit at the start, so no pieces are left 
+  and no tokens are used */
+  TestSplitArena(16);
+  u8CountBefore  = Msg_u8QueuedMessageCount;
+  u32TokenBefore = Msg_u32Token;
+  CHECK(QueueMessage(&Test_asQueues[2], MSG_MAX_COPIED_LENGTH, Test_au8Data) == 0);
+  CHECK(Msg_u8QueuedMessageCount == u8CountBefore);
+  CHECK(Msg_u32Token == u32TokenBefore);
+  CHECK(MessageQueuePeek(&Test_asQueues[2]) == NULL);
+  CHECK(Test_asQueues[2].sStats.u32Rejected == 1);
+  CHECK(TestAllFree());
+
+  /* Too long to ever fit, or empty: neither is counted as the queue being full */
+  G_u32MessagingFlags = 0;
+  u32Rejected = Test_asQueues[2].sStats.u32Rejected;
+  CHECK(QueueMessage(&Test_asQueues[2], MSG_MAX_COPIED_LENGTH + 1, Test_au8Data) == 0);
+  CHECK(G_u32MessagingFlags == _MESSAGING_TX_TOO_LONG);
+  G_u32MessagingFlags = 0;
+  CHECK(QueueMessage(&Test_asQueues[2], 0, Test_au8Data) == 0);
+  CHECK(G_u32MessagingFlags == 0);
+  CHECK(Test_asQueues[2].sStats.u32Rejected == u32Rejected);
+
+  /* Cancelling the last piece drops the piece in front of it but not the message before */
+  TestSplitArena(16);
+  u32TokenBefore = QueueMessage(&Test_asQueues[2], 1, Test_au8Data);
+  u32Token = QueueMessage(&Test_asQueues[2], u32Size, Test_au8Data);
+  CHECK(MessageQueuePeekNext(&Test_asQueues[2])->u8Flags & _MESSAGE_SPLIT);
+  CHECK(CancelMessage(u32Token));
+  CHECK(QueryMessageStatus(u32Token) == ABANDONED);
+  CHECK(QueryMessageStatus(u32Token - 1) == ABANDONED);
+  CHECK(QueryMessageStatus(u32TokenBefore) == WAITING);
+  psMessage = MessageQueuePeek(&Test_asQueues[2]);
+  CHECK( (psMessage != NULL) && (psMessage->u32Token == u32TokenBefore) );
+  DeQueueMessage(&Test_asQueues[2]);
+  CHECK(MessageQueuePeek(&Test_asQueues[2]) == NULL);
+  CHECK(TestAllFree());
+
+  /* The token of the first piece drops the piece behind it too */
+  TestSplitArena(16);
+  u32Token = QueueMessage(&Test_asQueues[2], u32Size, Test_au8Data);
+  CHECK(CancelMessage(u32Token - 1));
+  CHECK(QueryMessageStatus(u32Token - 1) == ABANDONED);
+  CHECK(QueryMessageStatus(u32Token) == ABANDONED);
+  CHECK(MessageQueuePeek(&Test_asQueues[2]) == NULL);
+  CHECK(TestAllFree());
+
+  /* Once the first piece has started the message is left alone so it is not cut short */
+  TestSplitArena(16);
+  u32Token = QueueMessage(&Test_asQueues[2], u32Size, Test_au8Data);
+  psMessage = MessageQueuePeek(&Test_asQueues[2]);
+  CHECK(MessageClaim(psMessage));
+  UpdateMessageStatus(u32Token - 1, SENDING);
+  CHECK(!CancelMessage(u32Token));
+  CHECK(!CancelMessage(u32Token - 1));
+  CHECK(QueryMessageStatus(u32Token) == WAITING);
+  CHECK(psMessage->u8Flags & _MESSAGE_STARTED);
+  CHECK( !(MessageQueuePeekNext(&Test_asQueues[2])->u8Flags & (_MESSAGE_STARTED | _MESSAGE_CANCELLED)) );
+  UpdateMessageStatus(u32Token - 1, COMPLETE);
+  DeQueueMessage(&Test_asQueues[2]);
+  psMessage = MessageQueuePeek(&Test_asQueues[2]);
+  CHECK( (psMessage != NULL) && (psMessage->u32Token == u32Token) && MessageClaim(psMessage) );
+  CHECK(TestAllFree());
+}
+
+
+static void TestQueueFull(void)
+{
+  u32 u32Rejected;
+  u32 u32Count = 0;
+
+  /* Slot limit: a NORMAL queue gets every slot except the reservation and its headroom */
+  TestReset();
+  G_u32MessagingFlags = 0;
+  while(QueueMessageNoCopy(&Test_asQueues[2], 1, Test_au8Data) != 0)
+  {
+    u32Count++;
+  }
+  CHECK(u32Count == TX_QUEUE_SIZE - 4 - MSG_SHARED_HEADROOM_NORMAL);
+  CHECK(G_u32MessagingFlags & _MESSAGING_TX_QUEUE_FULL);
+  CHECK(Test_asQueues[2].sStats.u32Rejected == 1);
+
+  /* The LOW queue gets nothing now, the HIGH queue still has its reservation and the last shared slots */
+  CHECK(QueueMessageNoCopy(&Test_asQueues[1], 1, Test_au8Data) == 0);
+  u32Count = 0;
+  while(QueueMessage(&Test_asQueues[0], 1, Test_au8Data) != 0)
+  {
+    u32Count++;
+  }
+  CHECK(u32Count == 4 + MSG_SHARED_HEADROOM_NORMAL);
+  CHECK(Msg_u8QueuedMessageCount == TX_QUEUE_SIZE);
+
+  /* Completely full: everything fails and nothing changes */
+  u32Rejected = Test_asQueues[0].sStats.u32Rejected;
+  CHECK(QueueMessage(&Test_asQueues[0], 1, Test_au8Data) == 0);
+  CHECK(QueueMessageNoCopy(&Test_asQueues[0], 1, Test_au8Data) == 0);
+  CHECK(Test_asQueues[0].sStats.u32Rejected == u32Rejected + 2);
+  CHECK(Msg_u8QueuedMessageCount == TX_QUEUE_SIZE);
+
+  /* One slot back and the queue works again */
+  DeQueueMessage(&Test_asQueues[0]);
+  CHECK(QueueMessage(&Test_asQueues[0], 1, Test_au8Data) != 0);
+  CHECK(TestAllFree());
+
+  /* Arena limit: full-size copied messages run out of arena before slots */
+  TestReset();
+  u32Count = 0;
+  while(QueueMessage(&Test_asQueues[0], MAX_TX_MESSAGE_LENGTH, Test_au8Data) != 0)
+  {
+    u32Count++;
+  }
+  CHECK(u32Count == (MSG_ARENA_WORDS - 1) / (1 + MAX_TX_MESSAGE_LENGTH / 4));
+  CHECK(Msg_u8QueuedMessageCount == u32Count);
+
+  /* Space freed at the tail of the arena is reused once there is a word to spare before the tail */
+  DeQueueMessage(&Test_asQueues[0]);
+  CHECK(QueueMessage(&Test_asQueues[0], MAX_TX_MESSAGE_LENGTH, Test_au8Data) == 0);
+  DeQueueMessage(&Test_asQueues[0]);
+  CHECK(QueueMessage(&Test_asQueues[0], MAX_TX_MESSAGE_LENGTH, Test_au8Data) != 0);
+  CHECK(TestAllFree());
+}
+
+
+static void TestSweeper(void)
+{
+  u32 u32Sending, u32Waiting;
+  MessageType* psMessage;
+
+  TestReset();
+  u32Sending = QueueMessage(&Test_asQueues[1], 2, Test_au8Data);
+  u32Waiting = QueueMessage(&Test_asQueues[1], 2, Test_au8Data);
+  psMessage = MessageQueuePeek(&Test_asQueues[1]);
+  CHECK(MessageClaim(psMessage));
+  UpdateMessageStatus(u32Sending, SENDING);
+
+  /* Nothing happens before the limits */
+  G_u32SystemTime1ms += MSG_STATUS_WAITING_TIME;
+  for(u8 i = 0; i < TX_QUEUE_SIZE; i++)
+  {
+    MessageSweepSlot(i);
+  }
+  CHECK(QueryMessageStatus(u32Waiting) == WAITING);
+  CHECK(QueryMessageStatus(u32Sending) == SENDING);
+
+  G_u32SystemTime1ms += MSG_STATUS_SENDING_TIME;
+  for(u8 i = 0; i < TX_QUEUE_SIZE; i++)
+  {
+    MessageSweepSlot(i);
+  }
+
+  /* Both time out; the claimed one stays with the peripheral and the waiting one is dropped when reached */
+  CHECK(QueryMessageStatus(u32Waiting) == TIMEOUT);
+  CHECK(QueryMessageStatus(u32Sending) == TIMEOUT);
+  CHECK(G_u32MessagingFlags & _MESSAGING_SENDING_TIMEOUT);
+  psMessage = MessageQueuePeek(&Test_asQueues[1]);
+  CHECK( (psMessage != NULL) && (psMessage->u32Token == u32Sending) );
+  DeQueueMessage(&Test_asQueues[1]);
+  CHECK(MessageQueuePeek(&Test_asQueues[1]) == NULL);
+  CHECK(TestAllFree());
+
+  /* A young message whose status entry was taken over by a later token is aged from when it was queued */
+  TestReset();
+  u32Waiting = QueueMessage(&Test_asQueues[2], 2, Test_au8Data);
+  psMessage = MessageQueuePeek(&Test_asQueues[2]);
+  for(u32 i = 0; i < STATUS_QUEUE_SIZE; i++)
+  {
+    QueueMessage(&Test_asQueues[1], 2, Test_au8Data);
+    DeQueueMessage(&Test_asQueues[1]);
+  }
+  CHECK(Msg_StatusQueue[u32Waiting & STATUS_QUEUE_MASK].u32Token != u32Waiting);
+
+  G_u32SystemTime1ms += MSG_STATUS_WAITING_TIME;
+  for(u8 i = 0; i < TX_QUEUE_SIZE; i++)
+  {
+    MessageSweepSlot(i);
+  }
+  CHECK( !(psMessage->u8Flags & _MESSAGE_CANCELLED) );
+  CHECK(MessageQueuePeek(&Test_asQueues[2]) == psMessage);
+
+  G_u32SystemTime1ms += 1;
+  for(u8 i = 0; i < TX_QUEUE_SIZE; i++)
+  {
+    MessageSweepSlot(i);
+  }
+  CHECK(psMessage->u8Flags & _MESSAGE_CANCELLED);
+  CHECK(MessageQueuePeek(&Test_asQueues[2]) == NULL);
+  CHECK(TestAllFree());
+}
+
+
+static void TestCoalesceAndClaim(void)
+{
+  MessageType* psMessage;
+  u8 au8Text[3] = {'a', 'b', 'c'};
+  u32 u32First, u32Next;
+
+  TestReset();
+  Test_asQueues[0].u8Options = _MSG_QUEUE_COALESCE;
+  u32First = QueueMessage(&Test_asQueues[0], 1, &au8Text[0]);
+  CHECK(QueueMessage(&Test_asQueues[0], 2, &au8Text[1]) == u32First);
+  CHECK(Msg_u8QueuedMessageCount == 1);
+  CHECK(Test_asQueues[0].sStats.u32Appended == 1);
+
+  psMessage = MessageQueuePeek(&Test_asQueues[0]);
+  CHECK( (psMessage->u32Size == 3) && (memcmp(psMessage->pu8Message, au8Text, 3) == 0) );
+
+  /* Once claimed, the message does not grow and cannot be cancelled in place */
+  CHECK(MessageClaim(psMessage));
+  CHECK(!MessageClaim(psMessage));
+  u32Next = QueueMessage(&Test_asQueues[0], 1, &au8Text[0]);
+  CHECK(u32Next != u32First);
+  CHECK(psMessage->u32Size == 3);
+  CHECK(!CancelMessage(u32First));
+
+  /* A no-copy message is never appended to */
+  u32First = QueueMessageNoCopy(&Test_asQueues[0], 1, au8Text);
+  CHECK(QueueMessage(&Test_asQueues[0], 1, au8Text) != u32First);
+  CHECK(Msg_u8QueuedMessageCount == 4);
+
+  /* A cancelled message cannot be claimed */
+  CHECK(CancelMessage(u32Next));
+  CHECK(!MessageClaim(MessageQueuePeekNext(&Test_asQueues[0])));
+  Test_asQueues[0].u8Options = 0;
+  CHECK(TestAllFree());
+}
+
+
+/* Random traffic on three queues; returns the number of messages accepted */
+static u32 TestStress(u32 u32Iterations_)
+{
+  MessageType* psMessage;
+  u32 u32Seed = 1;
+  u32 au32Offset[3] = {0, 0, 0};
+  u32 au32NextToken[3] = {0, 0, 0};
+  u32 au32Tokens[8] = {0};
+  u32 u32Accepted = 0;
+  u32 u32Size;
+  u32 u32Token;
+  u8 u8Queue;
+  bool bDataOk = TRUE;
+
+  TestReset();
+  Test_asQueues[1].u8Options = _MSG_QUEUE_COALESCE;
+
+  for(u32 i = 0; i < u32Iterations_; i++)
+  {
+    u32Seed = u32Seed * 1103515245 + 12345;
+    u8Queue = (u8)((u32Seed >> 16) % 3);
+
+    switch( (u32Seed >> 8) & 7 )
+    {
+      case 0:
+      case 1:
+      {
+        /* Consume the front message, checking copied data that was not coalesced.  The second piece of a split 
+        message carries on from where the first one stopped. */
+        psMessage = MessageQueuePeek(&Test_asQueues[u8Queue]);
+        if(psMessage != NULL)
+        {
+          if(psMessage->u32Token != au32NextToken[u8Queue])
+          {
+            au32Offset[u8Queue] = 0;
+          }
+          if( !(psMessage->u8Flags & _MESSAGE_NO_COPY) && (u8Queue != 1) &&
+              (memcmp(psMessage->pu8Message, &Test_au8Data[au32Offset[u8Queue]], psMessage->u32Size) != 0) )
+          {
+            bDataOk = FALSE;
+          }
+          au32Offset[u8Queue] = (psMessage->u8Flags & _MESSAGE_SPLIT) ? au32Offset[u8Queue] + psMessage->u32Size : 0;
+          au32NextToken[u8Queue] = psMessage->u32Token + 1;
+          UpdateMessageStatus(psMessage->u32Token, COMPLETE);
+          DeQueueMessage(&Test_asQueues[u8Queue]);
+        }
+        break;
+      }
+
+      case 2:
+      {
+        /* Cancel one of the last tokens handed out: it may or may not still be queued */
+        CancelMessage(au32Tokens[(u32Seed >> 20) & 7]);
+        break;
+      }
+
+      case 3:
+      {
+        u32Token = QueueMessageNoCopy(&Test_asQueues[u8Queue], 1 + ((u32Seed >> 4) & 63), Test_au8Data);
+        if(u32Token != 0)
+        {
+          au32Tokens[u32Accepted++ & 7] = u32Token;
+        }
+        break;
+      }
+
+      default:
+      {
+        u32Size = 1 + ((u32Seed >> 4) % ( ((u32Seed >> 20) & 7) == 0 ? 600 : 6 ));
+        u32Token = QueueMessage(&Test_asQueues[u8Queue], u32Size, Test_au8Data);
+        if(u32Token != 0)
+        {
+          au32Tokens[u32Accepted++ & 7] = u32Token;
+        }
+        break;
+      }
+    }
+  }
+
+  CHECK(bDataOk);
+  CHECK(TestAllFree());
+
+  return(u32Accepted);
+}
+
+
+static void TestNotify(void)
+{
+  MessageNotifyType sNotify = {TestNotifyCallback, &Test_u32Events, 0x01};
+  MessageNotifyType sOther = {NULL, &Test_u32Events, 0x02};
+  u32 u32Token;
+
+  TestReset();
+  Test_u32Callbacks = 0;
+  Test_u32Events = 0;
+
+  /* Unknown tokens are refused */
+  CHECK(!SetMessageNotify(0, &sNotify));
+  CHECK(!SetMessageNotify(Msg_u32Token, &sNotify));
+
+  /* COMPLETE: nothing while the message is in progress, then exactly once */
+  u32Token = QueueMessage(&Test_asQueues[0], 4, Test_au8Data);
+  CHECK(SetMessageNotify(u32Token, &sNotify));
+  UpdateMessageStatus(u32Token, SENDING);
+  CHECK( (Test_u32Callbacks == 0) && (Test_u32Events == 0) );
+  UpdateMessageStatus(u32Token, COMPLETE);
+  CHECK( (Test_u32Callbacks == 1) && (Test_u32Events == 0x01) );
+  UpdateMessageStatus(u32Token, COMPLETE);
+  DeQueueMessage(&Test_asQueues[0]);
+  CHECK(Test_u32Callbacks == 1);
+
+  /* TIMEOUT */
+  u32Token = QueueMessage(&Test_asQueues[0], 4, Test_au8Data);
+  CHECK(SetMessageNotify(u32Token, &sNotify));
+  UpdateMessageStatus(u32Token, TIMEOUT);
+  UpdateMessageStatus(u32Token, TIMEOUT);
+  CHECK(Test_u32Callbacks == 2);
+  DeQueueMessage(&Test_asQueues[0]);
+  CHECK(Test_u32Callbacks == 2);
+
+  /* ABANDONED by CancelMessage() */
+  u32Token = QueueMessage(&Test_asQueues[0], 4, Test_au8Data);
+  CHECK(SetMessageNotify(u32Token, &sNotify));
+  CHECK(CancelMessage(u32Token));
+  CHECK(QueryMessageStatus(u32Token) == ABANDONED);
+  CHECK(Test_u32Callbacks == 3);
+
+  /* A message that has already finished fires as soon as the notification is set, and only then */
+  u32Token = QueueMessage(&Test_asQueues[0], 4, Test_au8Data);
+  UpdateMessageStatus(u32Token, COMPLETE);
+  DeQueueMessage(&Test_asQueues[0]);
+  CHECK(Test_u32Callbacks == 3);
+  CHECK(SetMessageNotify(u32Token, &sNotify));
+  CHECK(Test_u32Callbacks == 4);
+  UpdateMessageStatus(u32Token, COMPLETE);
+  CHECK(Test_u32Callbacks == 4);
+  CHECK(Msg_StatusQueue[u32Token & STATUS_QUEUE_MASK].u8NotifyArmed == 0);
+
+  /* A second notification replaces the first; only the second fires */
+  Test_u32Events = 0;
+  u32Token = QueueMessage(&Test_asQueues[0], 4, Test_au8Data);
+  CHECK(SetMessageNotify(u32Token, &sNotify));
+  CHECK(SetMessageNotify(u32Token, &sOther));
+  UpdateMessageStatus(u32Token, COMPLETE);
+  DeQueueMessage(&Test_asQueues[0]);
+  CHECK( (Test_u32Callbacks == 4) && (Test_u32Events == 0x02) );
+
+  /* A reused status entry does not keep the old notification */
+  u32Token = QueueMessage(&Test_asQueues[0], 4, Test_au8Data);
+  CHECK(SetMessageNotify(u32Token, &sNotify));
+  CHECK(CancelMessage(u32Token));
+  Msg_u32Token = u32Token + STATUS_QUEUE_SIZE - 1;
+  u32Token = QueueMessage(&Test_asQueues[0], 4, Test_au8Data);
+  CHECK(Msg_StatusQueue[u32Token & STATUS_QUEUE_MASK].u8NotifyArmed == 0);
+  UpdateMessageStatus(u32Token, COMPLETE);
+  DeQueueMessage(&Test_asQueues[0]);
+  CHECK(Test_u32Callbacks == 5);
+  CHECK(TestAllFree());
+}
+
+
+/* Queues a message on queue 2 at the current time, starts it u32WaitMs_ later as eStart_ and completes it 
+u32SendMs_ after that */
+static void TestLatency(u32 u32WaitMs_, u32 u32SendMs_, MessageStateType eStart_)
+{
+  u32 u32Token;
+
+  u32Token = QueueMessage(&Test_asQueues[2], 4, Test_au8Data);
+  G_u32SystemTime1ms += u32WaitMs_;
+  UpdateMessageStatus(u32Token, eStart_);
+  G_u32SystemTime1ms += u32SendMs_;
+  UpdateMessageStatus(u32Token, COMPLETE);
+  DeQueueMessage(&Test_asQueues[2]);
+}
+
+
+static void TestStats(void)
+{
+  MessageQueueStatsType* psStats = &Test_asQueues[2].sStats;
+  u32 u32Token;
+  u32 u32Total;
+
+  /* Bins: 0ms, 1ms, then 2^(n-1) to 2^n - 1 ms, with everything from 64ms in the last one */
+  CHECK(MessageLatencyBin(0) == 0);
+  CHECK(MessageLatencyBin(1) == 1);
+  CHECK(MessageLatencyBin(2) == 2);
+  CHECK(MessageLatencyBin(3) == 2);
+  CHECK(MessageLatencyBin(4) == 3);
+  CHECK(MessageLatencyBin(7) == 3);
+  CHECK(MessageLatencyBin(8) == 4);
+  CHECK(MessageLatencyBin(31) == 5);
+  CHECK(MessageLatencyBin(32) == 6);
+  CHECK(MessageLatencyBin(63) == 6);
+  CHECK(MessageLatencyBin(64) == MSG_LATENCY_BUCKETS - 1);
+  CHECK(MessageLatencyBin(1000) == MSG_LATENCY_BUCKETS - 1);
+  CHECK(MessageLatencyBin(0xFFFFFFFF) == MSG_LATENCY_BUCKETS - 1);
+
+  /* High-water mark: the most slots held at once, kept when the queue drains */
+  TestReset();
+  for(u8 i = 0; i < 3; i++)
+  {
+    QueueMessage(&Test_asQueues[2], 4, Test_au8Data);
+  }
+  CHECK(psStats->u8HighWater == 3);
+  DeQueueMessage(&Test_asQueues[2]);
+  DeQueueMessage(&Test_asQueues[2]);
+  QueueMessage(&Test_asQueues[2], 4, Test_au8Data);
+  CHECK( (Test_asQueues[2].u8InUse == 2) && (psStats->u8HighWater == 3) );
+  QueueMessage(&Test_asQueues[2], 4, Test_au8Data);
+  QueueMessage(&Test_asQueues[2], 4, Test_au8Data);
+  CHECK(psStats->u8HighWater == 4);
+  TestDrain(&Test_asQueues[2]);
+  CHECK( (Test_asQueues[2].u8InUse == 0) && (psStats->u8HighWater == 4) );
+  CHECK(Test_asQueues[0].sStats.u8HighWater == 0);
+
+  /* Wait and send times land in the bin for their length on both sides of each edge */
+  TestLatency(0, 1, SENDING);
+  CHECK( (psStats->au32WaitLatency[0] == 1) && (psStats->au32SendLatency[1] == 1) );
+  TestLatency(1, 0, RECEIVING);
+  CHECK( (psStats->au32WaitLatency[1] == 1) && (psStats->au32SendLatency[0] == 1) );
+  TestLatency(3, 4, SENDING);
+  CHECK( (psStats->au32WaitLatency[2] == 1) && (psStats->au32SendLatency[3] == 1) );
+  TestLatency(4, 3, SENDING);
+  CHECK( (psStats->au32WaitLatency[3] == 1) && (psStats->au32SendLatency[2] == 1) );
+  TestLatency(63, 64, RECEIVING);
+  CHECK( (psStats->au32WaitLatency[6] == 1) && (psStats->au32SendLatency[MSG_LATENCY_BUCKETS - 1] == 1) );
+  TestLatency(5000, 63, SENDING);
+  CHECK( (psStats->au32WaitLatency[MSG_LATENCY_BUCKETS - 1] == 1) && (psStats->au32SendLatency[6] == 1) );
+
+  /* Each message is counted once on each side */
+  u32Total = 0;
+  for(u8 i = 0; i < MSG_LATENCY_BUCKETS; i++)
+  {
+    u32Total += psStats->au32WaitLatency[i] + psStats->au32SendLatency[i];
+  }
+  CHECK(u32Total == 12);
+
+  /* Messages that never started, or that end another way, are not counted */
+  u32Token = QueueMessage(&Test_asQueues[2], 4, Test_au8Data);
+  G_u32SystemTime1ms += 2;
+  UpdateMessageStatus(u32Token, COMPLETE);
+  DeQueueMessage(&Test_asQueues[2]);
+  u32Token = QueueMessage(&Test_asQueues[2], 4, Test_au8Data);
+  G_u32SystemTime1ms += 2;
+  UpdateMessageStatus(u32Token, TIMEOUT);
+  DeQueueMessage(&Test_asQueues[2]);
+  u32Token = QueueMessage(&Test_asQueues[2], 4, Test_au8Data);
+  UpdateMessageStatus(u32Token, SENDING);
+  G_u32SystemTime1ms += 2;
+  UpdateMessageStatus(u32Token, ABANDONED);
+  DeQueueMessage(&Test_asQueues[2]);
+  CHECK( (psStats->au32WaitLatency[0] == 2) && (psStats->au32WaitLatency[2] == 1) );
+  CHECK(psStats->au32SendLatency[2] == 1);
+  CHECK(Test_asQueues[0].sStats.au32WaitLatency[0] == 0);
+  CHECK(TestAllFree());
+}
+
+
+/***********************************************************************************************************************
+Main
+***********************************************************************************************************************/
+
+
+int main(void)
+{
+  u32 u32Accepted;
+
+  for(u32 i = 0; i < sizeof(Test_au8Data); i++)
+  {
+    Test_au8Data[i] = (u8)(i * 7 + 1);
+  }
+
+  printf("token rollover\n");
+  TestTokenRollover();
+  printf("split messages\n");
+  TestSplitMessages();
+  printf("queue full\n");
+  TestQueueFull();
+  printf("sweeper\n");
+  TestSweeper();
+  printf("coalesce and claim\n");
+  TestCoalesceAndClaim();
+  printf("notify\n");
+  TestNotify();
+  printf("statistics\n");
+  TestStats();
+  printf("stress\n");
+  u32Accepted = TestStress(2000000);
+  printf("  %u messages accepted\n", u32Accepted);
+
+  printf("%u checks, %u failed\n", Test_u32Checks, Test_u32Failures);
+  return( (Test_u32Failures == 0) ? 0 : 1 );
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
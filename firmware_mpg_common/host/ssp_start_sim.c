@@ -0,0 +1,317 @@
+/***********************************************************************************************************************
+File: ssp_start_sim.c
+
+Description:
+Host simulation of the SSP start latency: the time from queuing a message to the SspSM_Idle pass that starts it on
+an idle peripheral.  Run with "make bench".
+
+Messages are queued at random times on a random one of the three SSP USARTs and the SSP task runs once per 1 ms
+pass.  Two ways of running SspSM_Idle are compared:
+- all pending: the driver itself.  sam3u_ssp.c and messaging.c are included directly and run against the register
+  stand-ins below: each pass calls SspRunActiveState() and the start of a message is seen in its status.
+- round robin: each pass looks at one USART, the next one on the following pass (the driver before user-015).  That
+  code is gone, so this one is modelled.
+Transfer times are left out: as soon as the driver has started a transfer the PDC interrupt is raised as if the
+last byte had gone out, so the peripheral is idle again by the next message and only the state machine adds latency.
+***********************************************************************************************************************/
+
+#include <stdio.h>
+#include "configuration.h"
+
+
+/***********************************************************************************************************************
+SAM3U stand-ins for sam3u_ssp.c
+***********************************************************************************************************************/
+typedef volatile unsigned int AT91_REG;
+
+typedef struct
+{
+  AT91_REG US_CR, US_MR, US_IER, US_IDR, US_IMR, US_CSR, US_RHR, US_THR, US_BRGR;
+  AT91_REG US_RPR, US_RCR, US_TPR, US_TCR, US_RNPR, US_RNCR, US_TNPR, US_TNCR, US_PTCR, US_PTSR;
+} AT91S_USART, *AT91PS_USART;
+
+typedef struct
+{
+  AT91_REG PIO_SODR, PIO_CODR, PIO_ODSR, PIO_PDSR;
+} AT91S_PIO, *AT91PS_PIO;
+
+typedef struct
+{
+  AT91_REG PMC_PCER;
+} AT91S_PMC, *AT91PS_PMC;
+
+typedef int IRQn_Type;
+typedef enum {SPI, UART, USART0, USART1, USART2, USART3} PeripheralType;
+
+static AT91S_USART Sim_asUsart[3];
+static AT91S_PIO Sim_sPio;
+static AT91S_PMC Sim_sPmc;
+
+#define AT91C_BASE_US0          (&Sim_asUsart[0])
+#define AT91C_BASE_US1          (&Sim_asUsart[1])
+#define AT91C_BASE_US2          (&Sim_asUsart[2])
+#define AT91C_BASE_PMC          (&Sim_sPmc)
+
+#define AT91C_ID_US0            (u8)13
+#define AT91C_ID_US1            (u8)14
+#define AT91C_ID_US2            (u8)15
+
+#define AT91C_US_RXRDY          (u32)0x00000001
+#define AT91C_US_RSTRX          (u32)0x00000004
+#define AT91C_US_ENDRX          (u32)0x00000008
+#define AT91C_US_RSTTX          (u32)0x00000008
+#define AT91C_US_ENDTX          (u32)0x00000010
+#define AT91C_US_TXEN           (u32)0x00000040
+#define AT91C_US_RSTSTA         (u32)0x00000100
+#define AT91C_US_TXEMPTY        (u32)0x00000200
+#define AT91C_US_TXBUFE         (u32)0x00000800
+#define AT91C_US_RXBUFF         (u32)0x00001000
+#define AT91C_US_CTSIC          (u32)0x00080000
+
+#define AT91C_PDC_RXTEN         (u32)0x00000001
+#define AT91C_PDC_RXTDIS        (u32)0x00000002
+#define AT91C_PDC_TXTEN         (u32)0x00000100
+#define AT91C_PDC_TXTDIS        (u32)0x00000200
+
+#define NVIC_EnableIRQ(x)       ((void)(x))
+#define NVIC_DisableIRQ(x)      ((void)(x))
+#define NVIC_ClearPendingIRQ(x) ((void)(x))
+
+#define PCLK_VALUE              (u32)48000000
+#define _SYSTEM_INITIALIZING    (u32)0x80000000
+
+#define USART0_US_CR_INIT       (u32)0
+#define USART0_US_MR_INIT       (u32)0
+#define USART0_US_IER_INIT      (u32)0
+#define USART0_US_IDR_INIT      (u32)0
+#define USART0_US_BRGR_INIT     (u32)48
+#define USART1_US_CR_INIT       (u32)0
+#define USART1_US_MR_INIT       (u32)0
+#define USART1_US_IER_INIT      (u32)0
+#define USART1_US_IDR_INIT      (u32)0
+#define USART1_US_BRGR_INIT     (u32)48
+#define USART2_US_CR_INIT       (u32)0
+#define USART2_US_MR_INIT       (u32)0
+#define USART2_US_IER_INIT      (u32)0
+#define USART2_US_IDR_INIT      (u32)0
+#define USART2_US_BRGR_INIT     (u32)48
+
+static u32 DebugPrintf(u8* u8String_)
+{
+  (void)u8String_;
+  return(0);
+}
+
+#include "sam3u_ssp.h"
+#include "../drivers/messaging.c"
+#include "../drivers/sam3u_ssp.c"
+
+
+/***********************************************************************************************************************
+Simulation
+***********************************************************************************************************************/
+#define SIM_MESSAGES          200000u            /* Messages queued */
+#define SIM_PERIPHERALS       3u                 /* USART0 - USART2 */
+#define SIM_TIME_STEPS        1000u              /* Queue time resolution within one 1 ms pass */
+#define SIM_MAX_PER_PASS      2u                 /* Most messages queued between two passes (1 on average) */
+#define SIM_MESSAGE_SIZE      4u                 /* Bytes in each message */
+#define SIM_MAX_WAITING       64u                /* Most messages waiting to start at once */
+
+typedef struct
+{
+  u32 u32Token;                                  /* Token returned by SspWriteData() */
+  double dTime;                                  /* Time the message was queued in ms */
+} SimPendingType;
+
+static double Sim_adRoundRobin[SIM_MESSAGES];    /* Modelled start latency of each message in ms */
+static double Sim_adAllPending[SIM_MESSAGES];    /* Measured start latency of each message in ms */
+static u32 Sim_u32Seed = 1;                      /* LCG state so every run gives the same figures */
+
+static SspPeripheralType* Sim_apsSsp[SIM_PERIPHERALS];
+static SimPendingType Sim_asPending[SIM_MAX_WAITING];
+static u32 Sim_u32PendingCount;
+
+
+/***********************************************************************************************************************
+Helpers
+***********************************************************************************************************************/
+static u32 SimRandom(void)
+{
+  Sim_u32Seed = Sim_u32Seed * 1103515245u + 12345u;
+  return(Sim_u32Seed >> 8);
+}
+
+
+static int SimCompare(const void* pvA_, const void* pvB_)
+{
+  double dA = *(const double*)pvA_;
+  double dB = *(const double*)pvB_;
+
+  return( (dA > dB) - (dA < dB) );
+}
+
+
+/* The round robin pass that starts a message queued at dTime_ ms on u32Peripheral_.  Pass k runs at time k ms and
+looks at USART k % 3; a message queued exactly on a pass boundary is seen by the next pass since the task has
+already run. */
+static u32 SimRoundRobinPass(double dTime_, u32 u32Peripheral_)
+{
+  u32 u32Pass = (u32)dTime_ + 1;
+
+  while( (u32Pass % SIM_PERIPHERALS) != u32Peripheral_ )
+  {
+    u32Pass++;
+  }
+
+  return(u32Pass);
+}
+
+
+/* Stands in for the PDC finishing every transfer the driver has started: the interrupt is raised with the transmit
+counters empty until the driver has nothing more to start on the peripheral */
+static void SimFinishTransfers(void)
+{
+  for(u32 i = 0; i < SIM_PERIPHERALS; i++)
+  {
+    while(Sim_apsSsp[i]->u32PrivateFlags & _SSP_PERIPHERAL_TX)
+    {
+      Sim_asUsart[i].US_TCR  = 0;
+      Sim_asUsart[i].US_TNCR = 0;
+      Sim_asUsart[i].US_PTSR = 0;
+      Sim_asUsart[i].US_CSR  = AT91C_US_ENDTX | AT91C_US_TXBUFE | AT91C_US_TXEMPTY;
+      Sim_asUsart[i].US_IMR  = AT91C_US_ENDTX | AT91C_US_TXBUFE;
+
+      if(i == 0)
+      {
+        SSP0_IRQHandler();
+      }
+      else if(i == 1)
+      {
+        SSP1_IRQHandler();
+      }
+      else
+      {
+        SSP2_IRQHandler();
+      }
+    }
+  }
+}
+
+
+static void SimPrint(const char* pcName_, double* pdLatency_)
+{
+  double dSum = 0;
+
+  for(u32 i = 0; i < SIM_MESSAGES; i++)
+  {
+    dSum += pdLatency_[i];
+  }
+
+  qsort(pdLatency_, SIM_MESSAGES, sizeof(double), SimCompare);
+  printf("  %-24s mean %.2f ms, p99 %.2f ms, max %.2f ms\n", pcName_, dSum / SIM_MESSAGES,
+         pdLatency_[(SIM_MESSAGES / 100) * 99], pdLatency_[SIM_MESSAGES - 1]);
+}
+
+
+/***********************************************************************************************************************
+Main
+***********************************************************************************************************************/
+int main(void)
+{
+  static const PeripheralType aeUsart[SIM_PERIPHERALS] = {USART0, USART1, USART2};
+  static u8 au8Data[SIM_MESSAGE_SIZE] = {1, 2, 3, 4};
+  SspConfigurationType sConfig;
+  u32 u32Queued = 0;
+  u32 u32Started = 0;
+  u32 u32Count;
+  u32 u32Peripheral;
+  double dTime;
+  MessageStateType eStatus;
+
+  MessagingInitialize();
+  SspInitialize();
+
+  memset(&sConfig, 0, sizeof(sConfig));
+  sConfig.pCsGpioAddress    = &Sim_sPio;
+  sConfig.BitOrder          = MSB_FIRST;
+  sConfig.SpiMode           = SPI_MASTER;
+  sConfig.u32BaudRate       = 1000000;
+  sConfig.u8TxReservedSlots = SIM_MAX_PER_PASS;
+  sConfig.eTxPriority       = MSG_PRIORITY_NORMAL;
+  for(u32 i = 0; i < SIM_PERIPHERALS; i++)
+  {
+    sConfig.SspPeripheral = aeUsart[i];
+    sConfig.u32CsPin      = (u32)1 << i;
+    Sim_apsSsp[i] = SspRequest(&sConfig);
+    if(Sim_apsSsp[i] == NULL)
+    {
+      printf("SspRequest() failed for USART%u\n", i);
+      return(1);
+    }
+  }
+
+  printf("SSP start latency, %u messages on %u peripherals, 1 ms task period:\n", SIM_MESSAGES, SIM_PERIPHERALS);
+
+  /* Pass k runs at time k ms after the messages queued since pass k - 1 */
+  for(u32 u32Pass = 1; u32Started < SIM_MESSAGES; u32Pass++)
+  {
+    u32Count = SimRandom() % (SIM_MAX_PER_PASS + 1);
+    for(u32 i = 0; (i < u32Count) && (u32Queued < SIM_MESSAGES); i++)
+    {
+      if(Sim_u32PendingCount == SIM_MAX_WAITING)
+      {
+        printf("Messages are not being started (pass %u)\n", u32Pass);
+        return(1);
+      }
+
+      dTime = (u32Pass - 1) + (double)(SimRandom() % SIM_TIME_STEPS) / SIM_TIME_STEPS;
+      u32Peripheral = SimRandom() % SIM_PERIPHERALS;
+
+      Sim_asPending[Sim_u32PendingCount].u32Token = SspWriteData(Sim_apsSsp[u32Peripheral], SIM_MESSAGE_SIZE, au8Data);
+      Sim_asPending[Sim_u32PendingCount].dTime = dTime;
+      if(Sim_asPending[Sim_u32PendingCount].u32Token == 0)
+      {
+        printf("SspWriteData() failed at pass %u\n", u32Pass);
+        return(1);
+      }
+
+      Sim_adRoundRobin[u32Queued++] = SimRoundRobinPass(dTime, u32Peripheral) - dTime;
+      Sim_u32PendingCount++;
+    }
+
+    G_u32SystemTime1ms = u32Pass;
+    SspRunActiveState();
+    SimFinishTransfers();
+
+    /* A message started by this pass has already been sent; any other state is a driver fault */
+    for(u32 i = 0; i < Sim_u32PendingCount; )
+    {
+      eStatus = QueryMessageStatus(Sim_asPending[i].u32Token);
+      if(eStatus == WAITING)
+      {
+        i++;
+        continue;
+      }
+
+      if(eStatus != COMPLETE)
+      {
+        printf("Message %u is in state %u at pass %u\n", Sim_asPending[i].u32Token, eStatus, u32Pass);
+        return(1);
+      }
+
+      Sim_adAllPending[u32Started++] = u32Pass - Sim_asPending[i].dTime;
+      Sim_asPending[i] = Sim_asPending[--Sim_u32PendingCount];
+    }
+
+    MessagingRunActiveState();
+  }
+
+  SimPrint("round robin (modelled)", Sim_adRoundRobin);
+  SimPrint("all pending (driver)", Sim_adAllPending);
+  return(0);
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
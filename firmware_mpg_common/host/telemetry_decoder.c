@@ -0,0 +1,441 @@
+/***********************************************************************************************************************
+File: telemetry_decoder.c                                                                
+
+Description:
+Host side decoder for the binary telemetry frames that DebugTelemetryWrite() mixes into the debug UART output.  This 
+file is not part of the firmware build: it only needs a C99 compiler and the standard library, so a PC program or 
+a Linux test can include it to read a capture of the debug port or to check that frames survive a round trip.
+
+Frame on the wire:
+0x00, COBS(channel ID, data, CRC16 high byte, CRC16 low byte), 0x00
+The CRC16 is CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF, MSB first, no final XOR) over the channel ID 
+and the data, exactly as Crc16Ccitt() in utilities.c.  COBS removes every 0x00 from the record and ASCII debug 
+strings never contain 0x00, so the stream is split at every 0x00: a run that decodes with a good CRC is a frame and 
+anything else is text.  A damaged frame is passed on as text and the next 0x00 gets the decoder back in step.
+
+------------------------------------------------------------------------------------------------------------------------
+API:
+void TelemetryDecoderInit(TelemetryDecoderType* psDecoder_, TelemetryFrameCallbackType fnFrame_, 
+                          TelemetryTextCallbackType fnText_, void* pvContext_)
+Sets up a stream decoder.  fnFrame_ is called for every good frame; fnText_ (optional) gets everything else.
+
+void TelemetryDecoderFeed(TelemetryDecoderType* psDecoder_, const uint8_t* pu8Data_, uint32_t u32Size_)
+Passes received bytes to the decoder.  Text is given to fnText_ when the next 0x00 arrives or once there is more of 
+it than a frame could hold.
+
+void TelemetryDecoderFlush(TelemetryDecoderType* psDecoder_)
+Passes whatever is left after the last 0x00 to fnText_ (e.g. at the end of a capture).
+
+uint32_t TelemetryEncodeFrame(uint8_t* pu8Frame_, uint8_t u8Channel_, const uint8_t* pu8Data_, uint16_t u16Size_)
+Builds the same bytes as DebugTelemetryWrite() into pu8Frame_ (TELEMETRY_FRAME_SIZE bytes) and returns their 
+number, or 0 if u16Size_ is 0 or more than TELEMETRY_MAX_PAYLOAD.
+
+int32_t TelemetryDecodeFrame(const uint8_t* pu8Encoded_, uint32_t u32Size_, uint8_t* pu8Channel_, uint8_t* pu8Data_)
+Decodes one run (the bytes between two 0x00) into the channel ID and the data (TELEMETRY_MAX_PAYLOAD bytes).  
+Returns the data size or -1 if the run is not a good frame.
+
+e.g. a round trip check:
+u8FrameSize = TelemetryEncodeFrame(au8Frame, 0x01, au8Data, sizeof(au8Data));
+i32Size = TelemetryDecodeFrame(&au8Frame[1], u8FrameSize - 2, &u8Channel, au8Decoded);
+
+Define TELEMETRY_DECODER_MAIN to build a filter that reads a capture on stdin, prints the text and prints each 
+frame as its channel and data in hex:
+gcc -std=c99 -DTELEMETRY_DECODER_MAIN telemetry_decoder.c -o telemetry_decoder   (or "make telemetry_decoder")
+telemetry_decoder < debug_capture.bin
+
+***********************************************************************************************************************/
+
+#include <string.h>
+#include "telemetry_decoder.h"
+
+
+/***********************************************************************************************************************
+* Function Definitions
+***********************************************************************************************************************/
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: TelemetryCrc16
+
+Description:
+Adds bytes to a CRC-16/CCITT; the same computation as Crc16Ccitt() in the firmware.
+
+Requires:
+  - u16Crc_ is TELEMETRY_CRC16_INIT for a new CRC or the result of the previous call
+
+Promises:
+  - Returns the CRC of everything passed so far
+*/
+uint16_t TelemetryCrc16(uint16_t u16Crc_, const uint8_t* pu8Data_, uint32_t u32Size_)
+{
+  uint8_t u8Index;
+  
+  while(u32Size_ != 0)
+  {
+    u8Index = (uint8_t)(u16Crc_ >> 8) ^ *pu8Data_++;
+    u8Index ^= u8Index >> 4;
+    u16Crc_ = (uint16_t)((u16Crc_ << 8) ^ ((uint16_t)u8Index << 12) ^ ((uint16_t)u8Index << 5) ^ u8Index);
+    u32Size_--;
+  }
+  
+  return(u16Crc_);
+  
+} /* end TelemetryCrc16() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: TelemetryCobsEncode
+
+Description:
+COBS encodes a buffer; the same output as CobsEncode() in the firmware.
+
+Requires:
+  - pu8Destination_ has room for u32Size_ + u32Size_ / 254 + 1 bytes and does not overlap pu8Source_
+
+Promises:
+  - The encoded data (without a delimiter) is in pu8Destination_ and its size is returned
+*/
+uint32_t TelemetryCobsEncode(uint8_t* pu8Destination_, const uint8_t* pu8Source_, uint32_t u32Size_)
+{
+  uint8_t* pu8Code = pu8Destination_;
+  uint8_t* pu8Output = pu8Destination_ + 1;
+  uint8_t u8Code = 1;
+  
+  while(u32Size_ != 0)
+  {
+    if(*pu8Source_ == 0)
+    {
+      *pu8Code = u8Code;
+      pu8Code = pu8Output++;
+      u8Code = 1;
+    }
+    else
+    {
+      *pu8Output++ = *pu8Source_;
+      u8Code++;
+      
+      if( (u8Code == 0xFF) && (u32Size_ != 1) )
+      {
+        *pu8Code = u8Code;
+        pu8Code = pu8Output++;
+        u8Code = 1;
+      }
+    }
+    
+    pu8Source_++;
+    u32Size_--;
+  }
+  
+  *pu8Code = u8Code;
+  return( (uint32_t)(pu8Output - pu8Destination_) );
+  
+} /* end TelemetryCobsEncode() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: TelemetryCobsDecode
+
+Description:
+Decodes COBS data (without its delimiter).  Each code byte gives the number of data bytes behind it + 1; a zero 
+follows each piece except a full one (code 0xFF) and the last one.
+
+Requires:
+  - pu8Destination_ has room for u32Size_ bytes
+
+Promises:
+  - Returns the decoded size, or -1 if the data has a 0x00 or a piece runs past the end
+*/
+int32_t TelemetryCobsDecode(uint8_t* pu8Destination_, const uint8_t* pu8Source_, uint32_t u32Size_)
+{
+  uint32_t u32In = 0;
+  uint32_t u32Out = 0;
+  uint8_t u8Code;
+  
+  while(u32In < u32Size_)
+  {
+    u8Code = pu8Source_[u32In++];
+    if(u8Code == 0)
+    {
+      return(-1);
+    }
+    
+    for(uint8_t i = 1; i < u8Code; i++)
+    {
+      if( (u32In >= u32Size_) || (pu8Source_[u32In] == 0) )
+      {
+        return(-1);
+      }
+      pu8Destination_[u32Out++] = pu8Source_[u32In++];
+    }
+    
+    if( (u8Code != 0xFF) && (u32In < u32Size_) )
+    {
+      pu8Destination_[u32Out++] = 0;
+    }
+  }
+  
+  return( (int32_t)u32Out );
+  
+} /* end TelemetryCobsDecode() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: TelemetryEncodeFrame
+
+Description:
+Builds a complete frame with both delimiters, byte for byte as DebugTelemetryWrite() queues it.
+
+Requires:
+  - pu8Frame_ has room for TELEMETRY_FRAME_SIZE bytes
+
+Promises:
+  - Returns the frame size, or 0 if u16Size_ is 0 or more than TELEMETRY_MAX_PAYLOAD
+*/
+uint32_t TelemetryEncodeFrame(uint8_t* pu8Frame_, uint8_t u8Channel_, const uint8_t* pu8Data_, uint16_t u16Size_)
+{
+  uint8_t au8Record[TELEMETRY_RECORD_SIZE];
+  uint32_t u32FrameSize;
+  uint16_t u16Crc;
+  
+  if( (u16Size_ == 0) || (u16Size_ > TELEMETRY_MAX_PAYLOAD) )
+  {
+    return(0);
+  }
+  
+  au8Record[0] = u8Channel_;
+  memcpy(&au8Record[1], pu8Data_, u16Size_);
+  u16Crc = TelemetryCrc16(TELEMETRY_CRC16_INIT, au8Record, u16Size_ + 1);
+  au8Record[u16Size_ + 1] = (uint8_t)(u16Crc >> 8);
+  au8Record[u16Size_ + 2] = (uint8_t)u16Crc;
+  
+  pu8Frame_[0] = 0x00;
+  u32FrameSize = TelemetryCobsEncode(&pu8Frame_[1], au8Record, u16Size_ + 3) + 1;
+  pu8Frame_[u32FrameSize++] = 0x00;
+  
+  return(u32FrameSize);
+  
+} /* end TelemetryEncodeFrame() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: TelemetryDecodeFrame
+
+Description:
+Checks and decodes one run of bytes found between two 0x00 delimiters.
+
+Requires:
+  - pu8Data_ has room for TELEMETRY_MAX_PAYLOAD bytes
+
+Promises:
+  - If the run decodes to a channel ID, 1 to TELEMETRY_MAX_PAYLOAD bytes of data and a matching CRC, the channel ID
+    is in *pu8Channel_, the data in pu8Data_ and the data size is returned
+  - Otherwise returns -1
+*/
+int32_t TelemetryDecodeFrame(const uint8_t* pu8Encoded_, uint32_t u32Size_, uint8_t* pu8Channel_, uint8_t* pu8Data_)
+{
+  uint8_t au8Record[TELEMETRY_ENCODED_SIZE];
+  int32_t i32RecordSize;
+  uint16_t u16Crc;
+  
+  if(u32Size_ > TELEMETRY_ENCODED_SIZE)
+  {
+    return(-1);
+  }
+  
+  i32RecordSize = TelemetryCobsDecode(au8Record, pu8Encoded_, u32Size_);
+  if( (i32RecordSize < 4) || (i32RecordSize > TELEMETRY_RECORD_SIZE) )
+  {
+    return(-1);
+  }
+  
+  u16Crc = TelemetryCrc16(TELEMETRY_CRC16_INIT, au8Record, (uint32_t)i32RecordSize - 2);
+  if( (au8Record[i32RecordSize - 2] != (uint8_t)(u16Crc >> 8)) || (au8Record[i32RecordSize - 1] != (uint8_t)u16Crc) )
+  {
+    return(-1);
+  }
+  
+  *pu8Channel_ = au8Record[0];
+  memcpy(pu8Data_, &au8Record[1], (uint32_t)i32RecordSize - 3);
+  
+  return(i32RecordSize - 3);
+  
+} /* end TelemetryDecodeFrame() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: TelemetryDecoderInit
+
+Description:
+Sets up a stream decoder.
+
+Promises:
+  - psDecoder_ is empty with its counters cleared and the callbacks set
+*/
+void TelemetryDecoderInit(TelemetryDecoderType* psDecoder_, TelemetryFrameCallbackType fnFrame_, 
+                          TelemetryTextCallbackType fnText_, void* pvContext_)
+{
+  memset(psDecoder_, 0, sizeof(TelemetryDecoderType));
+  psDecoder_->fnFrame = fnFrame_;
+  psDecoder_->fnText = fnText_;
+  psDecoder_->pvContext = pvContext_;
+  
+} /* end TelemetryDecoderInit() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: TelemetryDecoderText
+
+Description:
+Passes the current run on as text and empties it.
+*/
+static void TelemetryDecoderText(TelemetryDecoderType* psDecoder_)
+{
+  if( (psDecoder_->u32RunSize != 0) && (psDecoder_->fnText != NULL) )
+  {
+    psDecoder_->fnText(psDecoder_->pvContext, psDecoder_->au8Run, psDecoder_->u32RunSize);
+  }
+  psDecoder_->u32RunSize = 0;
+  
+} /* end TelemetryDecoderText() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: TelemetryDecoderFeed
+
+Description:
+Splits received bytes at every 0x00 and hands each run on as a frame or as text.
+
+Requires:
+  - psDecoder_ was set up with TelemetryDecoderInit()
+
+Promises:
+  - fnFrame is called for every good frame that is completed by these bytes and fnText for the text
+*/
+void TelemetryDecoderFeed(TelemetryDecoderType* psDecoder_, const uint8_t* pu8Data_, uint32_t u32Size_)
+{
+  uint8_t au8Data[TELEMETRY_MAX_PAYLOAD];
+  uint8_t u8Channel;
+  int32_t i32Size;
+  
+  while(u32Size_ != 0)
+  {
+    if(*pu8Data_ == 0x00)
+    {
+      /* End of a run: back to back delimiters give an empty run, which is skipped */
+      if(psDecoder_->u32RunSize != 0)
+      {
+        i32Size = -1;
+        if(!psDecoder_->bTextRun)
+        {
+          i32Size = TelemetryDecodeFrame(psDecoder_->au8Run, psDecoder_->u32RunSize, &u8Channel, au8Data);
+        }
+        
+        if(i32Size > 0)
+        {
+          psDecoder_->u32Frames++;
+          psDecoder_->fnFrame(psDecoder_->pvContext, u8Channel, au8Data, (uint16_t)i32Size);
+          psDecoder_->u32RunSize = 0;
+        }
+        else
+        {
+          if(!psDecoder_->bTextRun)
+          {
+            psDecoder_->u32TextRuns++;
+          }
+          TelemetryDecoderText(psDecoder_);
+        }
+      }
+      psDecoder_->bTextRun = false;
+    }
+    else
+    {
+      /* A run longer than any frame is text: pass it on in pieces until the next 0x00 */
+      if(psDecoder_->u32RunSize == sizeof(psDecoder_->au8Run))
+      {
+        if(!psDecoder_->bTextRun)
+        {
+          psDecoder_->u32TextRuns++;
+          psDecoder_->bTextRun = true;
+        }
+        TelemetryDecoderText(psDecoder_);
+      }
+      psDecoder_->au8Run[psDecoder_->u32RunSize++] = *pu8Data_;
+    }
+    
+    pu8Data_++;
+    u32Size_--;
+  }
+  
+} /* end TelemetryDecoderFeed() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: TelemetryDecoderFlush
+
+Description:
+Passes the bytes received since the last 0x00 on as text.
+
+Promises:
+  - The decoder is empty
+*/
+void TelemetryDecoderFlush(TelemetryDecoderType* psDecoder_)
+{
+  if( (psDecoder_->u32RunSize != 0) && !psDecoder_->bTextRun )
+  {
+    psDecoder_->u32TextRuns++;
+  }
+  TelemetryDecoderText(psDecoder_);
+  psDecoder_->bTextRun = false;
+  
+} /* end TelemetryDecoderFlush() */
+
+
+#ifdef TELEMETRY_DECODER_MAIN
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* Capture filter: text goes to stdout as it is and each frame is printed on its own line */
+/*--------------------------------------------------------------------------------------------------------------------*/
+#include <stdio.h>
+
+static void TelemetryPrintFrame(void* pvContext_, uint8_t u8Channel_, const uint8_t* pu8Data_, uint16_t u16Size_)
+{
+  (void)pvContext_;
+  printf("\n[telemetry ch 0x%02X, %u bytes]", u8Channel_, u16Size_);
+  for(uint16_t i = 0; i < u16Size_; i++)
+  {
+    printf(" %02X", pu8Data_[i]);
+  }
+  printf("\n");
+  
+} /* end TelemetryPrintFrame() */
+
+
+static void TelemetryPrintText(void* pvContext_, const uint8_t* pu8Text_, uint32_t u32Size_)
+{
+  (void)pvContext_;
+  fwrite(pu8Text_, 1, u32Size_, stdout);
+  
+} /* end TelemetryPrintText() */
+
+
+int main(void)
+{
+  TelemetryDecoderType sDecoder;
+  uint8_t au8Buffer[256];
+  size_t Size;
+  
+  TelemetryDecoderInit(&sDecoder, TelemetryPrintFrame, TelemetryPrintText, NULL);
+  while( (Size = fread(au8Buffer, 1, sizeof(au8Buffer), stdin)) != 0 )
+  {
+    TelemetryDecoderFeed(&sDecoder, au8Buffer, (uint32_t)Size);
+  }
+  TelemetryDecoderFlush(&sDecoder);
+  
+  fprintf(stderr, "%u frames, %u text runs\n", sDecoder.u32Frames, sDecoder.u32TextRuns);
+  return(0);
+  
+} /* end main() */
+#endif /* TELEMETRY_DECODER_MAIN */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
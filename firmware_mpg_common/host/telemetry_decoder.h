@@ -0,0 +1,66 @@
+/***********************************************************************************************************************
+File: telemetry_decoder.h                                                                
+
+Description:
+Header file for telemetry_decoder.c (host side, not part of the firmware build)
+***********************************************************************************************************************/
+
+#ifndef __TELEMETRY_DECODER_H
+#define __TELEMETRY_DECODER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/***********************************************************************************************************************
+Constants / Definitions
+***********************************************************************************************************************/
+#define TELEMETRY_MAX_PAYLOAD         200       /* Must match DEBUG_TELEMETRY_MAX_PAYLOAD in debug.h */
+#define TELEMETRY_RECORD_SIZE         (TELEMETRY_MAX_PAYLOAD + 3)                               /* Channel ID + payload + CRC16 */
+#define TELEMETRY_ENCODED_SIZE        (TELEMETRY_RECORD_SIZE + (TELEMETRY_RECORD_SIZE / 254) + 1) /* Record after COBS */
+#define TELEMETRY_FRAME_SIZE          (TELEMETRY_ENCODED_SIZE + 2)                              /* With both delimiters */
+
+#define TELEMETRY_CRC16_INIT          (uint16_t)0xFFFF    /* CRC-16/CCITT starting value, as CRC16_CCITT_INIT */
+
+
+/**********************************************************************************************************************
+Type Definitions
+**********************************************************************************************************************/
+typedef void (*TelemetryFrameCallbackType)(void* pvContext_, uint8_t u8Channel_, const uint8_t* pu8Data_, uint16_t u16Size_);
+typedef void (*TelemetryTextCallbackType)(void* pvContext_, const uint8_t* pu8Text_, uint32_t u32Size_);
+
+typedef struct
+{
+  uint8_t au8Run[TELEMETRY_ENCODED_SIZE];   /* Bytes since the last 0x00 */
+  uint32_t u32RunSize;                      /* Number of bytes in au8Run */
+  bool bTextRun;                            /* The run is too long for a frame: text until the next 0x00 */
+  TelemetryFrameCallbackType fnFrame;       /* Called for every good frame */
+  TelemetryTextCallbackType fnText;         /* Called for the bytes that are not frames (may be NULL) */
+  void* pvContext;                          /* Passed back to the callbacks */
+  uint32_t u32Frames;                       /* Good frames decoded */
+  uint32_t u32TextRuns;                     /* Runs passed on as text (includes frames that were damaged) */
+} TelemetryDecoderType;
+
+
+/**********************************************************************************************************************
+* Function Declarations
+**********************************************************************************************************************/
+uint16_t TelemetryCrc16(uint16_t u16Crc_, const uint8_t* pu8Data_, uint32_t u32Size_);
+uint32_t TelemetryCobsEncode(uint8_t* pu8Destination_, const uint8_t* pu8Source_, uint32_t u32Size_);
+int32_t TelemetryCobsDecode(uint8_t* pu8Destination_, const uint8_t* pu8Source_, uint32_t u32Size_);
+
+uint32_t TelemetryEncodeFrame(uint8_t* pu8Frame_, uint8_t u8Channel_, const uint8_t* pu8Data_, uint16_t u16Size_);
+int32_t TelemetryDecodeFrame(const uint8_t* pu8Encoded_, uint32_t u32Size_, uint8_t* pu8Channel_, uint8_t* pu8Data_);
+
+void TelemetryDecoderInit(TelemetryDecoderType* psDecoder_, TelemetryFrameCallbackType fnFrame_, 
+                          TelemetryTextCallbackType fnText_, void* pvContext_);
+void TelemetryDecoderFeed(TelemetryDecoderType* psDecoder_, const uint8_t* pu8Data_, uint32_t u32Size_);
+void TelemetryDecoderFlush(TelemetryDecoderType* psDecoder_);
+
+
+#endif /* __TELEMETRY_DECODER_H */
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
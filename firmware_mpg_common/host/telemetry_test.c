@@ -0,0 +1,277 @@
+/***********************************************************************************************************************
+File: telemetry_test.c
+
+Description:
+Host round trip test of the debug telemetry frames.  The frames are built with the firmware's own Crc16Ccitt() and
+CobsEncode() from utilities.c, the same way DebugTelemetryWrite() builds them, and checked against
+telemetry_decoder.c.  Run with "make test"; the program returns non-zero if any check failed.
+
+Tests:
+- CRC: Crc16Ccitt() gives the CRC-16/CCITT-FALSE check value and matches TelemetryCrc16() on random data.
+- COBS: CobsEncode() matches TelemetryCobsEncode() byte for byte for lengths 0-600 (past the 254-byte block), on
+  random data, data with no zeros and all-zero data, and TelemetryCobsDecode() gets the data back.
+- Frames: for every payload size 1 to TELEMETRY_MAX_PAYLOAD the firmware frame is the same as TelemetryEncodeFrame()
+  byte for byte, decodes to the same channel and data, and fails to decode with any single byte changed.
+- Stream: frames mixed with ASCII text go through TelemetryDecoderFeed() in odd-sized pieces and come out in order.
+***********************************************************************************************************************/
+
+#include <stdio.h>
+#include "configuration.h"
+#include "telemetry_decoder.h"
+
+
+/***********************************************************************************************************************
+Test helpers
+***********************************************************************************************************************/
+#define TEST_MAX_COBS_LENGTH  (u32)600           /* Longest buffer for the COBS comparison */
+#define TEST_STREAM_FRAMES    (u32)50            /* Frames in the stream test */
+
+static u32 Test_u32Checks;                       /* Checks run */
+static u32 Test_u32Failures;                     /* Checks that failed */
+static u32 Test_u32Seed = 1;                     /* LCG state so every run uses the same data */
+
+#define CHECK(x)  TestCheck((x), #x, __LINE__)
+
+static void TestCheck(bool bPassed_, const char* pcExpression_, int iLine_)
+{
+  Test_u32Checks++;
+  if(!bPassed_)
+  {
+    Test_u32Failures++;
+    printf("  FAILED line %d: %s\n", iLine_, pcExpression_);
+  }
+}
+
+
+static u8 TestRandomByte(void)
+{
+  Test_u32Seed = Test_u32Seed * 1103515245u + 12345u;
+  return( (u8)(Test_u32Seed >> 16) );
+}
+
+
+/* Random data with plenty of zeros so COBS has work to do */
+static void TestFill(u8* pu8Data_, u32 u32Size_)
+{
+  for(u32 i = 0; i < u32Size_; i++)
+  {
+    pu8Data_[i] = (TestRandomByte() & 0x03) ? TestRandomByte() : 0x00;
+  }
+}
+
+
+/* The frame DebugTelemetryWrite() queues, built with the firmware utilities */
+static u32 TestFirmwareFrame(u8* pu8Frame_, u8 u8Channel_, const u8* pu8Data_, u32 u32Size_)
+{
+  u8 au8Record[TELEMETRY_RECORD_SIZE];
+  u32 u32FrameSize;
+  u16 u16Crc;
+
+  au8Record[0] = u8Channel_;
+  memcpy(&au8Record[1], pu8Data_, u32Size_);
+  u16Crc = Crc16Ccitt(CRC16_CCITT_INIT, au8Record, u32Size_ + 1);
+  au8Record[u32Size_ + 1] = (u8)(u16Crc >> 8);
+  au8Record[u32Size_ + 2] = (u8)u16Crc;
+
+  pu8Frame_[0] = 0x00;
+  u32FrameSize = CobsEncode(&pu8Frame_[1], au8Record, u32Size_ + 3) + 1;
+  pu8Frame_[u32FrameSize++] = 0x00;
+
+  return(u32FrameSize);
+}
+
+
+/***********************************************************************************************************************
+Tests
+***********************************************************************************************************************/
+static void TestCrc(void)
+{
+  static const u8 au8Check[] = "123456789";
+  u8 au8Data[256];
+
+  CHECK(Crc16Ccitt(CRC16_CCITT_INIT, au8Check, 9) == 0x29B1);
+  CHECK(TelemetryCrc16(TELEMETRY_CRC16_INIT, au8Check, 9) == 0x29B1);
+  CHECK(CRC16_CCITT_INIT == TELEMETRY_CRC16_INIT);
+
+  for(u32 u32Size = 0; u32Size <= sizeof(au8Data); u32Size += 7)
+  {
+    TestFill(au8Data, u32Size);
+    CHECK(Crc16Ccitt(CRC16_CCITT_INIT, au8Data, u32Size) == TelemetryCrc16(TELEMETRY_CRC16_INIT, au8Data, u32Size));
+  }
+}
+
+
+static void TestCobs(void)
+{
+  static u8 au8Data[TEST_MAX_COBS_LENGTH];
+  static u8 au8Firmware[COBS_ENCODED_SIZE(TEST_MAX_COBS_LENGTH)];
+  static u8 au8Host[COBS_ENCODED_SIZE(TEST_MAX_COBS_LENGTH)];
+  static u8 au8Decoded[TEST_MAX_COBS_LENGTH];
+  u32 u32FirmwareSize, u32HostSize;
+  bool bNoZeros;
+
+  CHECK(COBS_ENCODED_SIZE(TELEMETRY_RECORD_SIZE) == TELEMETRY_ENCODED_SIZE);
+
+  for(u8 u8Pattern = 0; u8Pattern < 3; u8Pattern++)
+  {
+    for(u32 u32Size = 0; u32Size <= TEST_MAX_COBS_LENGTH; u32Size++)
+    {
+      switch(u8Pattern)
+      {
+        case 0:  TestFill(au8Data, u32Size); break;
+        case 1:  for(u32 i = 0; i < u32Size; i++) { au8Data[i] = (u8)(i % 255 + 1); } break;
+        default: memset(au8Data, 0, u32Size); break;
+      }
+
+      u32FirmwareSize = CobsEncode(au8Firmware, au8Data, u32Size);
+      u32HostSize = TelemetryCobsEncode(au8Host, au8Data, u32Size);
+
+      bNoZeros = TRUE;
+      for(u32 i = 0; i < u32FirmwareSize; i++)
+      {
+        if(au8Firmware[i] == 0x00)
+        {
+          bNoZeros = FALSE;
+        }
+      }
+
+      CHECK(u32FirmwareSize <= COBS_ENCODED_SIZE(u32Size));
+      CHECK( (u32FirmwareSize == u32HostSize) && (memcmp(au8Firmware, au8Host, u32HostSize) == 0) );
+      CHECK(bNoZeros);
+      CHECK( (TelemetryCobsDecode(au8Decoded, au8Firmware, u32FirmwareSize) == (int32_t)u32Size) &&
+             (memcmp(au8Decoded, au8Data, u32Size) == 0) );
+    }
+  }
+}
+
+
+static void TestFrames(void)
+{
+  u8 au8Data[TELEMETRY_MAX_PAYLOAD];
+  u8 au8Firmware[TELEMETRY_FRAME_SIZE];
+  u8 au8Host[TELEMETRY_FRAME_SIZE];
+  u8 au8Decoded[TELEMETRY_MAX_PAYLOAD];
+  u32 u32FirmwareSize, u32HostSize;
+  u8 u8Channel, u8Saved;
+  bool bDamageFound;
+
+  for(u32 u32Size = 1; u32Size <= TELEMETRY_MAX_PAYLOAD; u32Size++)
+  {
+    TestFill(au8Data, u32Size);
+    u32FirmwareSize = TestFirmwareFrame(au8Firmware, (u8)u32Size, au8Data, u32Size);
+    u32HostSize = TelemetryEncodeFrame(au8Host, (u8)u32Size, au8Data, (uint16_t)u32Size);
+
+    CHECK( (u32FirmwareSize == u32HostSize) && (memcmp(au8Firmware, au8Host, u32HostSize) == 0) );
+    CHECK(u32FirmwareSize <= TELEMETRY_FRAME_SIZE);
+    CHECK( (TelemetryDecodeFrame(&au8Firmware[1], u32FirmwareSize - 2, &u8Channel, au8Decoded) == (int32_t)u32Size) &&
+           (u8Channel == (u8)u32Size) && (memcmp(au8Decoded, au8Data, u32Size) == 0) );
+
+    /* Any single changed byte (other than to 0x00, which would split the run) is caught */
+    bDamageFound = TRUE;
+    for(u32 i = 1; i < u32FirmwareSize - 1; i++)
+    {
+      u8Saved = au8Firmware[i];
+      au8Firmware[i] = (u8Saved == 0xFF) ? 0x01 : (u8)(u8Saved + 1);
+      if(TelemetryDecodeFrame(&au8Firmware[1], u32FirmwareSize - 2, &u8Channel, au8Decoded) >= 0)
+      {
+        bDamageFound = FALSE;
+      }
+      au8Firmware[i] = u8Saved;
+    }
+    CHECK(bDamageFound);
+  }
+
+  /* Sizes DebugTelemetryWrite() refuses */
+  CHECK(TelemetryEncodeFrame(au8Host, 1, au8Data, 0) == 0);
+  CHECK(TelemetryEncodeFrame(au8Host, 1, au8Data, TELEMETRY_MAX_PAYLOAD + 1) == 0);
+}
+
+
+/* Stream test: frames and text are checked off in the order they were sent */
+static u8 Test_au8StreamData[TEST_STREAM_FRAMES][TELEMETRY_MAX_PAYLOAD];
+static u32 Test_au32StreamSize[TEST_STREAM_FRAMES];
+static u32 Test_u32FramesSeen;
+static u32 Test_u32FramesMatched;
+static u32 Test_u32TextBytes;
+
+static void TestStreamFrame(void* pvContext_, uint8_t u8Channel_, const uint8_t* pu8Data_, uint16_t u16Size_)
+{
+  (void)pvContext_;
+  if( (Test_u32FramesSeen < TEST_STREAM_FRAMES) && (u8Channel_ == (u8)Test_u32FramesSeen) &&
+      (u16Size_ == Test_au32StreamSize[Test_u32FramesSeen]) &&
+      (memcmp(pu8Data_, Test_au8StreamData[Test_u32FramesSeen], u16Size_) == 0) )
+  {
+    Test_u32FramesMatched++;
+  }
+  Test_u32FramesSeen++;
+}
+
+
+static void TestStreamText(void* pvContext_, const uint8_t* pu8Text_, uint32_t u32Size_)
+{
+  (void)pvContext_;
+  (void)pu8Text_;
+  Test_u32TextBytes += u32Size_;
+}
+
+
+static void TestStream(void)
+{
+  static u8 au8Stream[TEST_STREAM_FRAMES * (TELEMETRY_FRAME_SIZE + 32)];
+  static const u8 au8Text[] = "Debug text between frames\r\n";
+  TelemetryDecoderType sDecoder;
+  u32 u32StreamSize = 0;
+  u32 u32TextSize = 0;
+  u32 u32Piece;
+
+  for(u32 i = 0; i < TEST_STREAM_FRAMES; i++)
+  {
+    memcpy(&au8Stream[u32StreamSize], au8Text, sizeof(au8Text) - 1);
+    u32StreamSize += sizeof(au8Text) - 1;
+    u32TextSize += sizeof(au8Text) - 1;
+
+    Test_au32StreamSize[i] = 1 + (TestRandomByte() % TELEMETRY_MAX_PAYLOAD);
+    TestFill(Test_au8StreamData[i], Test_au32StreamSize[i]);
+    u32StreamSize += TestFirmwareFrame(&au8Stream[u32StreamSize], (u8)i, Test_au8StreamData[i], Test_au32StreamSize[i]);
+  }
+
+  TelemetryDecoderInit(&sDecoder, TestStreamFrame, TestStreamText, NULL);
+  for(u32 i = 0; i < u32StreamSize; i += u32Piece)
+  {
+    u32Piece = 1 + (TestRandomByte() % 37);
+    if(u32Piece > u32StreamSize - i)
+    {
+      u32Piece = u32StreamSize - i;
+    }
+    TelemetryDecoderFeed(&sDecoder, &au8Stream[i], u32Piece);
+  }
+  TelemetryDecoderFlush(&sDecoder);
+
+  CHECK(Test_u32FramesSeen == TEST_STREAM_FRAMES);
+  CHECK(Test_u32FramesMatched == TEST_STREAM_FRAMES);
+  CHECK(Test_u32TextBytes == u32TextSize);
+}
+
+
+/***********************************************************************************************************************
+Main
+***********************************************************************************************************************/
+int main(void)
+{
+  printf("CRC\n");
+  TestCrc();
+  printf("COBS\n");
+  TestCobs();
+  printf("frames\n");
+  TestFrames();
+  printf("stream\n");
+  TestStream();
+
+  printf("%u checks, %u failed\n", Test_u32Checks, Test_u32Failures);
+  return( (Test_u32Failures == 0) ? 0 : 1 );
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
@@ -0,0 +1,158 @@
+/***********************************************************************************************************************
+File: utilities_test.c
+
+Description:
+Host regression tests for utilities.c.  Run with "make test"; the program returns non-zero if any check failed.
+
+Tests:
+- ReverseBits: matches a per-byte reference reversal for every source and destination alignment (0-3 bytes off a
+  word boundary), for lengths 0-39 and for in-place use, and never writes outside the destination.
+***********************************************************************************************************************/
+
+#include <stdio.h>
+#include "configuration.h"
+
+
+/***********************************************************************************************************************
+Test helpers
+***********************************************************************************************************************/
+#define TEST_MAX_LENGTH       (u32)40            /* Lengths 0 to TEST_MAX_LENGTH - 1 are checked */
+#define TEST_GUARD            (u8)0xA5           /* Fill around the destination to catch overruns */
+
+static u32 Test_u32Checks;                       /* Checks run */
+static u32 Test_u32Failures;                     /* Checks that failed */
+
+#define CHECK(x)  TestCheck((x), #x, __LINE__)
+
+static void TestCheck(bool bPassed_, const char* pcExpression_, int iLine_)
+{
+  Test_u32Checks++;
+  if(!bPassed_)
+  {
+    Test_u32Failures++;
+    printf("  FAILED line %d: %s\n", iLine_, pcExpression_);
+  }
+}
+
+
+/* One bit at a time */
+static u8 TestReverseByte(u8 u8Byte_)
+{
+  u8 u8Result = 0;
+
+  for(u8 i = 0; i < 8; i++)
+  {
+    u8Result = (u8)((u8Result << 1) | (u8Byte_ & 0x01));
+    u8Byte_ >>= 1;
+  }
+
+  return(u8Result);
+}
+
+
+/***********************************************************************************************************************
+Tests
+***********************************************************************************************************************/
+static void TestReverseBitsCopy(void)
+{
+  static u32 au32Source[(TEST_MAX_LENGTH + 8) / 4];
+  static u32 au32Destination[(TEST_MAX_LENGTH + 16) / 4];
+  u8* pu8Source;
+  u8* pu8Destination;
+  u8* pu8Guard = (u8*)au32Destination;
+  bool bMatch;
+  bool bGuardIntact;
+
+  for(u32 u32SourceOffset = 0; u32SourceOffset < 4; u32SourceOffset++)
+  {
+    for(u32 u32DestinationOffset = 0; u32DestinationOffset < 4; u32DestinationOffset++)
+    {
+      for(u32 u32Length = 0; u32Length < TEST_MAX_LENGTH; u32Length++)
+      {
+        pu8Source = (u8*)au32Source + u32SourceOffset;
+        pu8Destination = (u8*)au32Destination + 4 + u32DestinationOffset;
+        for(u32 i = 0; i < TEST_MAX_LENGTH; i++)
+        {
+          pu8Source[i] = (u8)(i * 37 + u32Length + 1);
+        }
+        memset(au32Destination, TEST_GUARD, sizeof(au32Destination));
+
+        ReverseBits(pu8Destination, pu8Source, u32Length);
+
+        bMatch = TRUE;
+        for(u32 i = 0; i < u32Length; i++)
+        {
+          if(pu8Destination[i] != TestReverseByte(pu8Source[i]))
+          {
+            bMatch = FALSE;
+          }
+        }
+
+        bGuardIntact = TRUE;
+        for(u32 i = 0; i < sizeof(au32Destination); i++)
+        {
+          if( ((&pu8Guard[i] < pu8Destination) || (&pu8Guard[i] >= pu8Destination + u32Length)) &&
+              (pu8Guard[i] != TEST_GUARD) )
+          {
+            bGuardIntact = FALSE;
+          }
+        }
+
+        CHECK(bMatch);
+        CHECK(bGuardIntact);
+      }
+    }
+  }
+} /* end TestReverseBitsCopy() */
+
+
+static void TestReverseBitsInPlace(void)
+{
+  static u32 au32Buffer[(TEST_MAX_LENGTH + 8) / 4];
+  u8 au8Expected[TEST_MAX_LENGTH];
+  u8* pu8Buffer;
+
+  for(u32 u32Offset = 0; u32Offset < 4; u32Offset++)
+  {
+    for(u32 u32Length = 0; u32Length < TEST_MAX_LENGTH; u32Length++)
+    {
+      pu8Buffer = (u8*)au32Buffer + u32Offset;
+      for(u32 i = 0; i < u32Length; i++)
+      {
+        pu8Buffer[i] = (u8)(i * 53 + u32Offset);
+        au8Expected[i] = TestReverseByte(pu8Buffer[i]);
+      }
+
+      ReverseBits(pu8Buffer, pu8Buffer, u32Length);
+      CHECK(memcmp(pu8Buffer, au8Expected, u32Length) == 0);
+
+      /* Twice is the original data */
+      ReverseBits(pu8Buffer, pu8Buffer, u32Length);
+      for(u32 i = 0; i < u32Length; i++)
+      {
+        au8Expected[i] = TestReverseByte(au8Expected[i]);
+      }
+      CHECK(memcmp(pu8Buffer, au8Expected, u32Length) == 0);
+    }
+  }
+} /* end TestReverseBitsInPlace() */
+
+
+/***********************************************************************************************************************
+Main
+***********************************************************************************************************************/
+int main(void)
+{
+  printf("ReverseBits copy\n");
+  TestReverseBitsCopy();
+  printf("ReverseBits in place\n");
+  TestReverseBitsInPlace();
+
+  printf("%u checks, %u failed\n", Test_u32Checks, Test_u32Failures);
+  return( (Test_u32Failures == 0) ? 0 : 1 );
+}
+
+
+/*--------------------------------------------------------------------------------------------------------------------*/
+/* End of File */
+/*--------------------------------------------------------------------------------------------------------------------*/
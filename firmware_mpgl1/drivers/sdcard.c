@@ -64,9 +64,8 @@ static u8* SD_NextCommand;                         /* Saved command to be execut
 static SspConfigurationType SD_sSspConfig;        /* Configuration information for SSP peripheral */
 static SspPeripheralType* SD_Ssp;                  /* Pointer to SSP peripheral object */
 
-static u8 SD_au8RxBuffer[SDCARD_RX_BUFFER_SIZE];   /* Space for incoming bytes from the SD card */
-static u8 *SD_pu8RxBufferNextByte;                 /* Pointer to next spot in RxBuffer to write a byte */
-static u8 *SD_pu8RxBufferParser;                   /* Pointer to loop through the Rx buffer to read bytes */
+static u8 SD_au8RxBuffer[SDCARD_RX_BUFFER_SIZE];   /* Bytes received during the last exchange with the SD card */
+static u8 *SD_pu8RxBufferParser;                   /* Points to the last byte received (the response byte) */
 
 static u32 SD_u32Timeout;                          /* Timeout counter used across states */
 static u32 SD_u32CurrentMsgToken;                  /* Token of message currently being sent */
@@ -280,7 +279,6 @@ void SdCardInitialize(void)
   }
 
   /* Initailze startup values and the command array */
-  SD_pu8RxBufferNextByte = &SD_au8RxBuffer[0];
   SD_pu8RxBufferParser   = &SD_au8RxBuffer[0];
 
   /* Configure the SSP resource to be used for the SD Card application */
@@ -288,10 +286,13 @@ void SdCardInitialize(void)
   SD_sSspConfig.pCsGpioAddress     = SD_BASE_PORT;
   SD_sSspConfig.u32CsPin           = SD_CS_PIN;
   SD_sSspConfig.pu8RxBufferAddress = SD_au8RxBuffer;
-  SD_sSspConfig.ppu8RxNextByte     = &SD_pu8RxBufferNextByte;
+  SD_sSspConfig.ppu8RxNextByte     = NULL;
   SD_sSspConfig.u16RxBufferSize    = SDCARD_RX_BUFFER_SIZE;
   SD_sSspConfig.BitOrder           = MSB_FIRST;
   SD_sSspConfig.SpiMode            = SPI_MASTER;
+  SD_sSspConfig.u32BaudRate        = SD_INIT_BAUD_RATE;
+  SD_sSspConfig.u8TxReservedSlots  = SDCARD_TX_RESERVED_SLOTS;
+  SD_sSspConfig.eTxPriority        = MSG_PRIORITY_NORMAL;
 
   SD_Ssp = SspRequest(&SD_sSspConfig);
 
@@ -352,8 +353,7 @@ Requires:
 Promises:
   - Requested command is queued
   - SD_u32CurrentMsgToken updated with the corresponding message token
-  - SD_pu8RxBufferParser is positioned to point to where the response byte from the command will be once the
-    commmand has been sent from by SSP task (a bit dangerous...)
+  - SD_pu8RxBufferParser points to where the response byte will be once the exchange is COMPLETE
   - SD_u32Timeout loaded to start counting the timeout period for the command
   - State machine set to wait command
 */
@@ -365,7 +365,7 @@ void SdCommand(u8* pau8Command_)
   /* DeAssert the chip select line and queue a dummy read to query the card */
   SspDeAssertCS(SD_Ssp);
   SD_u32Timeout = G_u32SystemTime1ms;
-  SD_u32CurrentMsgToken = SspReadByte(SD_Ssp);
+  SD_u32CurrentMsgToken = SdExchange(NULL, 1);
   if(SD_u32CurrentMsgToken)
   {
     SD_pfnStateMachine = SdCardWaitReady;
@@ -411,48 +411,29 @@ void CheckTimeout(u32 u32Time_)
 
 
 /*--------------------------------------------------------------------------------------------------------------------
-Function: AdvanceSD_pu8RxBufferParser
+Function: SdExchange
 
 Description:
-Safely advances SD_pu8RxBufferParser by the number of bytes required.
+Queues a full-duplex exchange with the card.  The bytes the card sends back land at the start of SD_au8RxBuffer
+so they can be read in place once the message is COMPLETE.
 
 Requires:
-  - u32NumBytes_ is the number of bytes that the buffer pointer will be advanced
+  - SD_Ssp has been requested and no other exchange is in progress (SD_au8RxBuffer is reused by every exchange)
+  - pu8TxData_ points to u32Size_ bytes to send, or is NULL to send dummy bytes
+  - u32Size_ is 1 to SDCARD_RX_BUFFER_SIZE
 
 Promises:
-  - SD_pu8RxBufferParser moved u32NumBytes_ with wrap-around protection.
+  - The exchange is queued and its message token is returned; 0 if it could not be queued
+  - SD_pu8RxBufferParser points to the last byte of the exchange, which is where a command's response (or a polled
+    status byte) will be
 */
-void AdvanceSD_pu8RxBufferParser(u32 u32NumBytes_)
+u32 SdExchange(const u8* pu8TxData_, u32 u32Size_)
 {
-  for(u32 i = 0; i < u32NumBytes_; i++)
-  {
-    SD_pu8RxBufferParser++;
-    if(SD_pu8RxBufferParser == &SD_au8RxBuffer[SDCARD_RX_BUFFER_SIZE])
-    {
-      SD_pu8RxBufferParser = &SD_au8RxBuffer[0];
-    }
-  }
+  SD_pu8RxBufferParser = &SD_au8RxBuffer[u32Size_ - 1];
   
-} /* end AdvanceSD_pu8RxBufferParser() */
-
-
-/*--------------------------------------------------------------------------------------------------------------------
-Function: FlushSdRxBuffer
-
-Description:
-Skips all new bytes currently in the RxBuffer.
-
-Requires:
-  - 
-
-Promises:
-  - SD_pu8RxBufferParser set to SD_pu8RxBufferNextByte
-*/
-void FlushSdRxBuffer(void)
-{
-  SD_pu8RxBufferParser = SD_pu8RxBufferNextByte;
+  return( SspTransfer(SD_Ssp, pu8TxData_, SD_au8RxBuffer, u32Size_) );
   
-} /* end FlushSdRxBuffer() */
+} /* end SdExchange() */
 
 
 /**********************************************************************************************************************
@@ -466,7 +447,8 @@ static void SdIdleNoCard(void)
 #if 0
   if( SdIsCardInserted() )
   {
-    /* Request the SSP resource to talk to the card */
+    /* Request the SSP resource to talk to the card at the identification clock rate */
+    SD_sSspConfig.u32BaudRate = SD_INIT_BAUD_RATE;
     SD_Ssp = SspRequest(&SD_sSspConfig);
     if(SD_Ssp == NULL)
     {
@@ -481,13 +463,12 @@ static void SdIdleNoCard(void)
       /* If card is in, set flag and then try to talk to card.  Note that the SSP peripheral will 
       be allocated to the SD card for this whole initialization process. */
       SD_u32Flags &= SD_CLEAR_CARD_TYPE_BITS;
-      FlushSdRxBuffer();
       
       SD_CardStatusLed.eBlinkRate = LED_1HZ;
       LedRequest(&SD_CardStatusLed);
 
       /* Queue up a set of dummy transfers to make sure the card is awake; */
-      SD_u32CurrentMsgToken = SspReadData(SD_Ssp, SD_WAKEUP_BYTES);
+      SD_u32CurrentMsgToken = SdExchange(NULL, SD_WAKEUP_BYTES);
       if(SD_u32CurrentMsgToken)
       {
         SspAssertCS(SD_Ssp);
@@ -512,10 +493,8 @@ static void SdCardDummies(void)
 {
   if( QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE )
   { 
-    /* Advance the buffer parser past the dummy read byte responses since we don't care about them */
-    AdvanceSD_pu8RxBufferParser(SD_WAKEUP_BYTES);
-
-    /* Queue CMD0 to be sent. The message token from here will be used to  */
+    /* The bytes received during the wake up dummies are not needed.
+    Queue CMD0 to be sent. The message token from here will be used to  */
     SdCommand(&SD_au8CMD0[0]);
     SD_WaitReturnState = SdCardResponseCMD0;
   }
@@ -539,9 +518,6 @@ static void SdCardResponseCMD0(void)
     SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
     SD_pfnStateMachine = SdError;
   }
-  
-  /* In any case, advance the buffer pointer */
-  AdvanceSD_pu8RxBufferParser(1);
        
 } /* end SdCardResponseCMD0() */
 
@@ -555,7 +531,7 @@ static void SdCardResponseCMD8(void)
   {
     /* Command is good which means the card is at least SDv2 so we can read 4 more bytes of the CMD8 response */
     SD_u32Flags |= _SD_TYPE_SD2;
-    SD_u32CurrentMsgToken = SspReadData(SD_Ssp, 4);
+    SD_u32CurrentMsgToken = SdExchange(NULL, 4);
     if(SD_u32CurrentMsgToken)
     {
       SD_pfnStateMachine = SdCardReadCMD8;
@@ -574,9 +550,6 @@ static void SdCardResponseCMD8(void)
     SdCommand(&SD_au8CMD55[0]);
     SD_WaitReturnState = SdCardACMD41;
   }
-    
-  /* In either case, advance the buffer pointer */
-  AdvanceSD_pu8RxBufferParser(1);
    
 } /* end SdCardResponseCMD8() */
      
@@ -589,17 +562,14 @@ static void SdCardReadCMD8(void)
   if( QueryMessageStatus(SD_u32CurrentMsgToken) == COMPLETE )
   {
     /* Process the four response bytes (only the last two matter) */
-    AdvanceSD_pu8RxBufferParser(2);
-    if(*SD_pu8RxBufferParser == SD_VHS_VALUE)
+    if(SD_au8RxBuffer[2] == SD_VHS_VALUE)
     {
-      AdvanceSD_pu8RxBufferParser(1);
-      if(*SD_pu8RxBufferParser == SD_CHECK_PATTERN)
+      if(SD_au8RxBuffer[3] == SD_CHECK_PATTERN)
       {
         /* Card supports VCC 2.7 - 3.6V so we're good to go */
         SdCommand(&SD_au8CMD55[0]);
         SD_WaitReturnState = SdCardACMD41;
       }
-      AdvanceSD_pu8RxBufferParser(1);
     }
     else
     {
@@ -636,9 +606,6 @@ static void SdCardACMD41(void)
     SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
     SD_pfnStateMachine = SdError;
   }
-  
-  /* In any case, advance the buffer pointer */
-  AdvanceSD_pu8RxBufferParser(1);
        
 } /* end SdCardACMD41() */
      
@@ -674,9 +641,6 @@ static void SdCardResponseACMD41(void)
     SdCommand(&SD_au8CMD55[0]);
     SD_WaitReturnState = SdCardACMD41;
   }
-  
-  /* In any case, advance the buffer pointer */
-  AdvanceSD_pu8RxBufferParser(1);
        
 } /* end SdCardACMD41() */     
 
@@ -689,7 +653,7 @@ static void SdCardResponseCMD58(void)
   if(*SD_pu8RxBufferParser == SD_STATUS_READY)
   {
     /* Command is good so we can read 4 more bytes of the CMD58 response */
-    SD_u32CurrentMsgToken = SspReadData(SD_Ssp, 4);
+    SD_u32CurrentMsgToken = SdExchange(NULL, 4);
     if(SD_u32CurrentMsgToken)
     {
       SD_pfnStateMachine = SdCardReadCMD58;
@@ -706,9 +670,6 @@ static void SdCardResponseCMD58(void)
     SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
     SD_pfnStateMachine = SdError;
   }
-    
-  /* In either case, advance the buffer pointer */
-  AdvanceSD_pu8RxBufferParser(1);
        
 } /* end SdCardResponseCMD8() */
      
@@ -720,9 +681,11 @@ static void SdCardResponseCMD16(void)
   /* Check the response byte (response R1) */
   if(*SD_pu8RxBufferParser == SD_STATUS_READY)
   {
-    /* Success! Card is ready for read/write operations */
+    /* Success! Card is ready for read/write operations at full speed.  The SSP is released here, so the new rate
+    goes in the configuration for the next SspRequest(). */
     SspDeAssertCS(SD_Ssp);
     SspRelease(SD_Ssp);
+    SD_sSspConfig.u32BaudRate = SD_FAST_BAUD_RATE;
 
     SD_CardState = SD_IDLE;
     //SD_CardStatusLed.eBlinkRate = LED_ON;
@@ -736,15 +699,12 @@ static void SdCardResponseCMD16(void)
     SD_u8ErrorCode = SD_ERROR_BAD_RESPONSE;
     SD_pfnStateMachine = SdError;
   }
-    
-  /* In either case, advance the buffer pointer */
-  AdvanceSD_pu8RxBufferParser(1);
        
 } /* end SdCardResponseCMD8() */
      
 
 /*-------------------------------------------------------------------------------------------------------------------*/
-/* Wait for a data for CMD58. RxBuffer pointer is at first of four response bytes when SSP is complete. */
+/* Wait for a data for CMD58. The four response bytes are at the start of SD_au8RxBuffer when SSP is complete. */
 static void SdCardReadCMD58(void)
 {
   /* Check to see if the SSP peripheral has sent the command */
@@ -752,13 +712,14 @@ static void SdCardReadCMD58(void)
   {
     /* Determine card capacity */
     SD_u32Flags &= ~_SD_CARD_HC;
-    if(*SD_pu8RxBufferParser & _SD_OCR_CCS_BIT)
+    if(SD_au8RxBuffer[0] & _SD_OCR_CCS_BIT)
     {
       SD_u32Flags |= _SD_CARD_HC;
       
-      /* Success! Card is ready for read/write operations */
+      /* Success! Card is ready for read/write operations at full speed (CMD16 is not needed) */
       SspDeAssertCS(SD_Ssp);
       SspRelease(SD_Ssp);
+      SD_sSspConfig.u32BaudRate = SD_FAST_BAUD_RATE;
   
       SD_CardState = SD_IDLE;
       //SD_CardStatusLed.eBlinkRate = LED_ON;
@@ -773,9 +734,6 @@ static void SdCardReadCMD58(void)
       SdCommand(&SD_au8CMD16[0]);
       SD_WaitReturnState = SdCardResponseCMD16;
     }
-    
-    /* Ignore the other 3 response bytes */
-    AdvanceSD_pu8RxBufferParser(4);
   }
   
   /* Watch for SSP timeout */
@@ -795,23 +753,18 @@ static void SdCardWaitReady(void)
   {  
     if( *SD_pu8RxBufferParser != 0xFF )
     {
-      SD_u32CurrentMsgToken = SspReadByte(SD_Ssp);
+      SD_u32CurrentMsgToken = SdExchange(NULL, 1);
       if( !SD_u32CurrentMsgToken )
       {
         /* We didn't get a return token, so abort */
         SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
         SD_pfnStateMachine = SdError;
       }
-
-      AdvanceSD_pu8RxBufferParser(1);
     }
-    /* The card is ready for the command */
+    /* The card is ready for the command: the response will be in the last byte of the exchange */
     else
     {
-      SD_u32CurrentMsgToken = SspWriteData(SD_Ssp, SD_CMD_SIZE, SD_NextCommand);
-      
-      /* Pre-emptively move RxBufferParser so it will point to command response */
-      AdvanceSD_pu8RxBufferParser(SD_CMD_SIZE);
+      SD_u32CurrentMsgToken = SdExchange(SD_NextCommand, SD_CMD_SIZE);
     
       /* Set up time-outs and next state */
       SD_u32Timeout = G_u32SystemTime1ms;
@@ -829,8 +782,7 @@ static void SdCardWaitReady(void)
 /* Kill time waiting for a command to finish sending; the first byte from all completed commands
 is response R1 which has BIT7 clear.
      
-REQUIRES: RxBufferParser pre-emptively set to be pointing at the last response byte that comes in as a result of the
-command being sent. 
+REQUIRES: RxBufferParser points at the last byte received by the command exchange (see SdExchange()). 
      
 PROMISES: returns with RxBuffer pointer pointing at response byte */
      
@@ -846,15 +798,13 @@ static void SdCardWaitCommand(void)
     {
       u8Retries--;
       
-      SD_u32CurrentMsgToken = SspReadByte(SD_Ssp);
+      SD_u32CurrentMsgToken = SdExchange(NULL, 1);
       if( !SD_u32CurrentMsgToken )
       {
         /* We didn't get a return token, so abort */
         SD_u8ErrorCode = SD_ERROR_NO_TOKEN;
         SD_pfnStateMachine = SdError;
       }
-
-      AdvanceSD_pu8RxBufferParser(1);
     }
     else
     {
@@ -955,7 +905,7 @@ static void SdCardResponseCMD17(void)
   if(*SD_pu8RxBufferParser == SD_STATUS_READY)
   {
     /* Queue a read looking to get TOKEN_START_BLOCK back from the card */
-    SD_u32CurrentMsgToken = SspReadByte(SD_Ssp);
+    SD_u32CurrentMsgToken = SdExchange(NULL, 1);
  
     SD_u32Timeout = G_u32SystemTime1ms;
     SD_pfnStateMachine = SdCardWaitStartToken;
@@ -967,9 +917,6 @@ static void SdCardResponseCMD17(void)
     SD_pfnStateMachine = SdFailedDataTransfer;
   }
 
-  /* Either way, advance the RxBuffer pointer */  
-  AdvanceSD_pu8RxBufferParser(1);
-
 } /* end SdCardResponseCMD17() */
 
 
@@ -983,19 +930,15 @@ static void SdCardWaitStartToken(void)
     /* Check the response byte */
     if(*SD_pu8RxBufferParser == TOKEN_START_BLOCK)
     {
-      /* Set the RxBuffer pointers to the start of the RxBuffer so the sector data occupies the beginning */
-      SD_pu8RxBufferNextByte = &SD_au8RxBuffer[0];
-      SD_pu8RxBufferParser   = &SD_au8RxBuffer[0];
-      
-      /* Queue a read for the entire sector plus two checksum bytes */
-      SD_u32CurrentMsgToken = SspReadData(SD_Ssp, 514);    
+      /* Read the entire sector plus two checksum bytes in one transfer: the sector data occupies the
+      beginning of SD_au8RxBuffer */
+      SD_u32CurrentMsgToken = SdExchange(NULL, 514);    
       SD_pfnStateMachine = SdCardDataTransfer;
     }
     else
     {
       /* Queue a read looking to get TOKEN_START_BLOCK back from the card */
-      SD_u32CurrentMsgToken = SspReadByte(SD_Ssp);    
-      AdvanceSD_pu8RxBufferParser(1);
+      SD_u32CurrentMsgToken = SdExchange(NULL, 1);    
     }
   }
   
@@ -1021,10 +964,6 @@ static void SdCardDataTransfer(void)
     SspDeAssertCS(SD_Ssp);
     SspRelease(SD_Ssp);
 
-    /* Reset the RxBuffer pointers to the start of the RxBuffer */
-    SD_pu8RxBufferNextByte = &SD_au8RxBuffer[0];
-    SD_pu8RxBufferParser   = &SD_au8RxBuffer[0];
-
     SD_pfnStateMachine = SdCardReadyIdle;
   }
 
@@ -1042,10 +981,11 @@ static void SdCardDataTransfer(void)
 /* Handle a failed data transfer */
 static void SdFailedDataTransfer(void)
 {
-  /* Reset the system variables */
+  /* Stop the transfer that was in progress so it does not keep the bus busy, then reset the system variables */
+  CancelMessage(SD_u32CurrentMsgToken);
+  SD_u32CurrentMsgToken = 0;
   SspDeAssertCS(SD_Ssp);
   SspRelease(SD_Ssp);
-  FlushSdRxBuffer();
   SD_CardState = SD_CARD_ERROR;
   
   SD_u32Timeout = G_u32SystemTime1ms;
@@ -1061,10 +1001,11 @@ static void SdError(void)
   u8* pu8ErrorMessage;
   u8 u8MessageSize;
   
-  /* Reset the system variables */
+  /* Stop the transfer that was in progress so it does not keep the bus busy, then reset the system variables */
+  CancelMessage(SD_u32CurrentMsgToken);
+  SD_u32CurrentMsgToken = 0;
   SspDeAssertCS(SD_Ssp);
   SspRelease(SD_Ssp);
-  FlushSdRxBuffer();
 
   /* Indicate error and return through the SSP delay state to give the system some recovery time */
   //SD_CardStatusLed.eBlinkRate = LED_8HZ;
@@ -1119,6 +1060,8 @@ static void SdError(void)
   
   DebugPrintf(pu8ErrorMessage);
   
+  /* The card must be identified again at the slow clock rate */
+  SD_sSspConfig.u32BaudRate = SD_INIT_BAUD_RATE;
   SD_CardState = SD_NO_CARD;
   SD_u32Timeout = G_u32SystemTime1ms;
   SD_WaitReturnState = SdIdleNoCard;
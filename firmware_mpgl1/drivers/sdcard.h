@@ -30,12 +30,16 @@ Constants / Definitions
 #define _SD_TYPE_SDC		          (_SD_TYPE_SD1 | _SD_TYPE_SD2)	
 
 #define SDCARD_RX_BUFFER_SIZE     (u32)548             /* Size of buffer for incoming SD data */
+#define SDCARD_TX_RESERVED_SLOTS  (u8)2                /* Message pool slots kept for SD card commands and data */
 
 #define SD_RESPONSE_TIMEOUT       (u32)100             /* Time in ms for the SD card to respond to a command */
 #define SD_WAIT_TIME              (u32)1000            /* Time in ms for waiting for SD stuff to occur */
 #define SD_WAKEUP_BYTES           (u32)20              /* Number of dummy bytes sent to wake up new SD card */
 #define SD_CMD_RETRIES            (u8)20               /* Number of polls to retry a command response */
 
+#define SD_INIT_BAUD_RATE         (u32)400000          /* SPI clock in Hz until the card is initialized (400 kHz max in identification mode) */
+#define SD_FAST_BAUD_RATE         SSP_MAX_BAUD_RATE    /* SPI clock in Hz for an initialized card (25 MHz max) */
+
 #define SD_CMD_SIZE               (u8)7                /* Size of an SD card command including a dummy byte to read a resposne */
 
 #define SD_SPI_WAIT_TIME_MS	      (u32)(500)           /* Time to wait for the SPI resource to become available */
@@ -140,8 +144,7 @@ bool SdIsCardInserted(void);
 /* Private functions */
 /*--------------------------------------------------------------------------------------------------------------------*/
 static void SdCommand(u8* pau8Command_);
-static void AdvanceSD_pu8RxBufferParser(u32 u32NumBytes_);
-static void FlushSdRxBuffer(void);
+static u32 SdExchange(const u8* pu8TxData_, u32 u32Size_);
 
 
 /***********************************************************************************************************************
@@ -121,7 +121,7 @@ sEngenuicsImage.u16ColumnSize = 50;
 LcdLoadBitmap(&aau8EngenuicsLogoBlack[0][0], sEngenuicsImage);
 
 bool LcdCommand(u8 u8Command_)
-Sends a control command to the LCD.  
+Sends a control command to the LCD.  Returns FALSE if the previous command has not been sent yet.
 - u8Command_: LCD_DISPLAY_ON, LCD_DISPLAY_OFF, LCD_PIXEL_TEST_ON, LCD_PIXEL_TEST_OFF
 e.g. LcdCommand(PIXEL_TEST_ON);
 
@@ -262,6 +262,11 @@ static u32 Lcd_u32RefreshTimer;                                   /* LCD refresh
 
 fnCode_type Lcd_ReturnState;                                      /* Saved return state */
 static u32 Lcd_u32CurrentMsgToken;                                /* Token of message currently being sent to LCD */
+static volatile u32 Lcd_u32MessageEvents;                         /* Message events set by messaging (interrupt context) */
+static MessageNotifyType Lcd_sMessageNotify;                      /* Notification attached to Lcd_u32CurrentMsgToken */
+static u32 Lcd_u32CommandToken;                                   /* Token of the command queued by LcdCommand() */
+static volatile u32 Lcd_u32CommandEvents;                         /* Command events set by messaging (interrupt context) */
+static MessageNotifyType Lcd_sCommandNotify;                      /* Notification attached to Lcd_u32CommandToken */
 
 static SspConfigurationType Lcd_sSspConfig;                       /* Configuration information for SSP peripheral */
 static SspPeripheralType* Lcd_Ssp;                                /* Pointer to LCD's SSP peripheral object */
@@ -269,6 +274,8 @@ static u8 Lcd_u8PagesToUpdate;                                    /* Counter for
 static u8 Lcd_u8CurrentPage;                                      /* Current page being updated */
 
 static u8 Lcd_au8TxBuffer[LCD_TX_BUFFER_SIZE];                    /* Buffer for outgoing data to LCD during the current refresh cycle */
+static u8 Lcd_au8AddressCommand[LCD_ADDRESS_COMMAND_SIZE];        /* Address commands for the page being refreshed */
+static u8 Lcd_u8Command;                                          /* Command being sent by LcdCommand() */
 static u8 Lcd_au8RxDummyBuffer[LCD_RX_BUFFER_SIZE];               /* Dummy location for LCD receive buffer (LCD does not send data) */
 static u8* Lcd_pu8RxDummyBuffer;                                  /* Dummy buffer pointer */
 
@@ -648,24 +655,26 @@ Function: LcdCommand
 
 Description:
 Simple interface to use to queue a particular command to send to the LCD.  This only
-applies to single-byte commands.
+applies to single-byte commands.  The command is a one-segment SSP transaction so A0 is
+low while it is clocked out even if a page refresh is queued in front of it.  If the SSP
+cannot take the command right now it is queued by LcdSM_Idle on a later pass.
 
 Requires:
  - u8Command_ is a valid A0 type command for the LCD (see list in lcd_NHD-C12864LZ.h)
 
 Promises:
- - A command message is queued to the TxBuffer
+ - Returns FALSE if the previous command has not been sent yet; otherwise returns TRUE and the command
+   is queued now or kept in Lcd_u8Command with _LCD_FLAGS_COMMAND_PENDING set (see LcdQueueCommand())
+ - _LCD_EVENT_COMMAND_DONE is set in Lcd_u32CommandEvents when it finishes; a page refresh that is already
+   running is not affected
 */
 bool LcdCommand(u8 u8Command_)
 {
-  if( !(Lcd_u32Flags & _LCD_FLAGS_COMMAND_IN_QUEUE) )
+  if( !(Lcd_u32Flags & (_LCD_FLAGS_COMMAND_IN_QUEUE | _LCD_FLAGS_COMMAND_PENDING)) )
   {
-    Lcd_u32Flags |= _LCD_FLAGS_COMMAND_IN_QUEUE;
-    Lcd_au8TxBuffer[0] = u8Command_;
-  
-    /* Set hardware for command mode and queue the message */
-    LCD_COMMAND_MODE();
-    Lcd_u32CurrentMsgToken = SspWriteData(Lcd_Ssp, 1, &Lcd_au8TxBuffer[0]);
+    Lcd_u32Flags |= _LCD_FLAGS_COMMAND_PENDING;
+    Lcd_u8Command = u8Command_;
+    LcdQueueCommand();
     
     /* Zero the timer so the command sends immediately and push the command out if initializing */
     Lcd_u32RefreshTimer = 0;
@@ -712,15 +721,29 @@ void LcdInitialize(void)
   Lcd_pfnStateMachine = LcdSM_Idle;
   Lcd_pu8RxDummyBuffer = Lcd_au8RxDummyBuffer;
   
+  Lcd_u32MessageEvents = 0;
+  Lcd_sMessageNotify.fnCallback     = NULL;
+  Lcd_sMessageNotify.pu32EventFlags = &Lcd_u32MessageEvents;
+  Lcd_sMessageNotify.u32EventBit    = _LCD_EVENT_MESSAGE_DONE;
+
+  Lcd_u32CommandEvents = 0;
+  Lcd_sCommandNotify.fnCallback      = NULL;
+  Lcd_sCommandNotify.pu32EventFlags  = &Lcd_u32CommandEvents;
+  Lcd_sCommandNotify.u32EventBit     = _LCD_EVENT_COMMAND_DONE;
+  
   /* Configure the SSP resource to be used for the application */
   Lcd_sSspConfig.SspPeripheral      = USART1;
   Lcd_sSspConfig.pCsGpioAddress     = AT91C_BASE_PIOB;
   Lcd_sSspConfig.u32CsPin           = PB_12_LCD_CS;
+  Lcd_sSspConfig.pSegmentGpioAddress = AT91C_BASE_PIOB;
+  Lcd_sSspConfig.u32SegmentPin      = PB_15_LCD_A0;
   Lcd_sSspConfig.pu8RxBufferAddress = Lcd_au8RxDummyBuffer;
   Lcd_sSspConfig.ppu8RxNextByte     = &Lcd_pu8RxDummyBuffer;
   Lcd_sSspConfig.u16RxBufferSize    = LCD_RX_BUFFER_SIZE;
   Lcd_sSspConfig.BitOrder           = MSB_FIRST;
   Lcd_sSspConfig.SpiMode            = SPI_MASTER;
+  Lcd_sSspConfig.u8TxReservedSlots  = LCD_TX_RESERVED_SLOTS;
+  Lcd_sSspConfig.eTxPriority        = MSG_PRIORITY_HIGH;
 
   Lcd_Ssp = SspRequest(&Lcd_sSspConfig);
         
@@ -896,40 +919,168 @@ void LcdManualMode(void)
 /*--------------------------------------------------------------------------------------------------------------------*/
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: LcdBeginTransaction
+
+Description:
+Opens an SSP transaction on Lcd_Ssp.  A transaction is only left open when its end marker could not be 
+queued; that one is ended here instead and the caller tries again on a later pass.
+
+Requires:
+ - Lcd_Ssp is an SPI_MASTER used only by this driver
+
+Promises:
+ - Returns TRUE if a transaction is open for the caller
+ - Returns FALSE if a transaction left open had to be ended first (an attempt is made to end it)
+*/
+static bool LcdBeginTransaction(void)
+{
+  if( SspBeginTransaction(Lcd_Ssp) )
+  {
+    return TRUE;
+  }
+  
+  (void)SspEndTransaction(Lcd_Ssp);
+  return FALSE;
+
+} /* end LcdBeginTransaction() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: LcdQueueCommand
+
+Description:
+Queues Lcd_u8Command with A0 low as a one-segment SSP transaction and watches it with its own notification 
+so a page refresh in progress keeps watching its own message.  If the command cannot be queued, or the end 
+of its transaction cannot be queued or watched, the command is cancelled and left pending so LcdSM_Idle 
+calls this again on the next pass.  A command is never sent twice: a repeated byte would be taken as the 
+argument of a two-byte command such as LCD_EVOLUME_UNLOCK_.  So a command that has already started when it 
+should be cancelled is watched by its own token instead.
+
+Requires:
+ - _LCD_FLAGS_COMMAND_PENDING is set and Lcd_u8Command is the command to send
+
+Promises:
+ - If the command is queued and can be watched, _LCD_FLAGS_COMMAND_PENDING is cleared, 
+   _LCD_FLAGS_COMMAND_IN_QUEUE is set and Lcd_u32CommandToken is the token whose notification sets 
+   _LCD_EVENT_COMMAND_DONE: the end of the transaction, or the command itself if only that can be watched
+ - Otherwise _LCD_FLAGS_COMMAND_IN_QUEUE is clear and _LCD_FLAGS_COMMAND_PENDING stays set
+*/
+static void LcdQueueCommand(void)
+{
+  u32 u32Segment;
+  
+  Lcd_u32Flags &= ~_LCD_FLAGS_COMMAND_IN_QUEUE;
+  if( !LcdBeginTransaction() )
+  {
+    return;
+  }
+  
+  /* The transaction is ended even if the command was not queued so it does not hold CS */
+  u32Segment = SspQueueSegment(Lcd_Ssp, &Lcd_u8Command, NULL, 1, SSP_SEGMENT_PIN_LOW);
+  Lcd_u32CommandToken = SspEndTransaction(Lcd_Ssp);
+  Lcd_u32CommandEvents = 0;
+  if(u32Segment == 0)
+  {
+    return;
+  }
+  
+  /* A transaction left open here is ended by the next LcdBeginTransaction() */
+  if( (Lcd_u32CommandToken == 0) || !SetMessageNotify(Lcd_u32CommandToken, &Lcd_sCommandNotify) )
+  {
+    if( CancelMessage(u32Segment) )
+    {
+      return;
+    }
+    
+    /* Too late to cancel: the command is going out.  A status that is already gone finished long ago. */
+    Lcd_u32CommandToken = u32Segment;
+    if( !SetMessageNotify(u32Segment, &Lcd_sCommandNotify) )
+    {
+      Lcd_u32CommandEvents = _LCD_EVENT_COMMAND_DONE;
+    }
+  }
+  
+  Lcd_u32Flags &= ~_LCD_FLAGS_COMMAND_PENDING;
+  Lcd_u32Flags |= _LCD_FLAGS_COMMAND_IN_QUEUE;
+
+} /* end LcdQueueCommand() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: LcdQueueNextPage
+
+Description:
+Queues the refresh of page Lcd_u8CurrentPage as one SSP transaction: the address commands with A0 low
+followed straight away by the page data with A0 high, all under one CS assertion.  If the page cannot 
+be queued completely nothing is advanced so the same page can be queued again on a later pass.
+
+Requires:
+ - Lcd_sCurrentUpdateArea has the current area for the update and Lcd_u8PagesToUpdate is not 0
+ - The transaction of the previous page has finished (Lcd_au8TxBuffer and Lcd_au8AddressCommand are free)
+
+Promises:
+ - Returns TRUE if the page transaction is queued: Lcd_u32CurrentMsgToken is the token of its end, which is 
+   watched, Lcd_u32Timer is restarted, Lcd_u8CurrentPage is advanced and Lcd_u8PagesToUpdate is decremented
+ - Returns FALSE otherwise and Lcd_u32MessageEvents is unchanged
+*/
+static bool LcdQueueNextPage(void)
+{
+  bool bQueued = FALSE;
+  u32 u32Token;
+  
+  if( !LcdBeginTransaction() )
+  {
+    return FALSE;
+  }
+  
+  /* The transaction is ended whatever happened to the segments so it does not hold CS */
+  if( LcdSetStartAddressForDataTransfer(Lcd_u8CurrentPage) )
+  {
+    bQueued = LcdLoadPageToBuffer(Lcd_u8CurrentPage);
+  }
+  u32Token = SspEndTransaction(Lcd_Ssp);
+  
+  if( !bQueued || (u32Token == 0) || !LcdWatchCurrentMessage(u32Token) )
+  {
+    return FALSE;
+  }
+  
+  Lcd_u32Timer = G_u32SystemTime1ms;
+  Lcd_u8CurrentPage++;
+  Lcd_u8PagesToUpdate--;
+  
+  return TRUE;
+
+} /* end LcdQueueNextPage() */
+
+
 /*----------------------------------------------------------------------------------------------------------------------
 Function: LcdSetStartAddressForDataTransfer
 
 Description:
-Queues a message to set the LCD cursor to the correct position in preparation 
+Queues the commands to set the LCD cursor to the correct position in preparation 
 for data that will be sent to update the screen.  The starting address is mapped appropriately
 for the actual physical LCD screen.
 
 Requires:
  - Lcd_sUpdateArea is up to date for the new LCD data to be written (used for column address).
  - u8Page_ is page address for this update
+ - An SSP transaction is open on Lcd_Ssp
 
 Promises:
- - Command is queued to SSP
+ - Returns TRUE if the command segment (A0 low) is queued to SSP
 */
 static bool LcdSetStartAddressForDataTransfer(u8 u8LocalRamPage_)          
 {
   u16 u16ColumnStartLcd = LCD_COLUMNS - (Lcd_sCurrentUpdateArea.u16ColumnStart + Lcd_sCurrentUpdateArea.u16ColumnSize);
   
-  if( !(Lcd_u32Flags & _LCD_FLAGS_COMMAND_IN_QUEUE) )
-  {
-    /* Set the message bytes for the current transfer */
-    Lcd_au8TxBuffer[0] = LCD_SET_PAGE_ADDRESSx    | u8LocalRamPage_;
-    Lcd_au8TxBuffer[1] = LCD_SET_COL_ADDRESS_MSNx | ( (u16ColumnStartLcd >> 4) & 0x0F);
-    Lcd_au8TxBuffer[2] = LCD_SET_COL_ADDRESS_LSNx | ( u16ColumnStartLcd & 0x0F);
-      
-    LCD_COMMAND_MODE(); 
-    Lcd_u32Flags |= _LCD_FLAGS_COMMAND_IN_QUEUE;
-    Lcd_u32CurrentMsgToken = SspWriteData(Lcd_Ssp, 3, &Lcd_au8TxBuffer[0]);
-
-    return TRUE;
-  }
-
-  return FALSE;
+  /* Set the message bytes for the current transfer */
+  Lcd_au8AddressCommand[0] = LCD_SET_PAGE_ADDRESSx    | u8LocalRamPage_;
+  Lcd_au8AddressCommand[1] = LCD_SET_COL_ADDRESS_MSNx | ( (u16ColumnStartLcd >> 4) & 0x0F);
+  Lcd_au8AddressCommand[2] = LCD_SET_COL_ADDRESS_LSNx | ( u16ColumnStartLcd & 0x0F);
+    
+  return( SspQueueSegment(Lcd_Ssp, &Lcd_au8AddressCommand[0], NULL, LCD_ADDRESS_COMMAND_SIZE, SSP_SEGMENT_PIN_LOW) != 0 );
 
 } /* end LcdSetStartAddressForDataTransfer() */
 
@@ -952,14 +1103,15 @@ Requires:
  - u8LocalRamPage_ is the LCD page that is to be updated (provides row address for LCD RAM)
  - Lcd_sCurrentUpdateArea has the current area for the update
  - G_aau8LcdRamImage has the correct updated data to send
- - The 
+ - An SSP transaction is open on Lcd_Ssp
            
 Promises:
  - Data from G_aau8LcdRamImage is parsed out by row & column for the current page that requires
    updating.  A maximum of 128 bytes are posted to Lcd_au8TxBuffer (updates a full page).
+ - Returns TRUE if the data segment (A0 high) is queued to SSP
    
 */
-static void LcdLoadPageToBuffer(u8 u8LocalRamPage_) 
+static bool LcdLoadPageToBuffer(u8 u8LocalRamPage_) 
 {
   u16 u16LocalRamCurrentRow; 
   u8* pu8TxBufferParser;
@@ -1005,9 +1157,9 @@ static void LcdLoadPageToBuffer(u8 u8LocalRamPage_)
     }
   }
   
-  /* Lcd_au8TxBuffer now has all of the bytes for the current transfer */
-  LCD_DATA_MODE();
-  Lcd_u32CurrentMsgToken = SspWriteData(Lcd_Ssp, Lcd_sCurrentUpdateArea.u16ColumnSize, &Lcd_au8TxBuffer[0]);
+  /* Lcd_au8TxBuffer now has all of the bytes for the current transfer.  The buffer is not touched again
+  until LcdSM_WaitTransfer sees the page transaction finish, so the SSP can send the page straight from it. */
+  return( SspQueueSegment(Lcd_Ssp, &Lcd_au8TxBuffer[0], NULL, Lcd_sCurrentUpdateArea.u16ColumnSize, SSP_SEGMENT_PIN_HIGH) != 0 );
  
 } /* end LcdLoadPageToBuffer () */
     
@@ -1070,6 +1222,58 @@ static void LcdUpdateScreenRefreshArea(PixelBlockType* sPixelsToUpdate_)
 } /* end LcdUpdateScreenRefreshArea() */      
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+Function: LcdWatchCurrentMessage
+
+Description:
+Arms the message notification for the message that was just queued so LcdSM_WaitTransfer
+sees it finish without polling the status queue.
+
+Requires:
+ - u32Token_ is the token of the message just queued to the SSP
+           
+Promises:
+ - Returns TRUE if the notification is armed: Lcd_u32CurrentMsgToken is u32Token_ and _LCD_EVENT_MESSAGE_DONE 
+   is cleared and will be set when it finishes
+ - Returns FALSE if the token is not in the status queue; _LCD_EVENT_MESSAGE_DONE is left set
+*/
+static bool LcdWatchCurrentMessage(u32 u32Token_)
+{
+  Lcd_u32MessageEvents &= ~_LCD_EVENT_MESSAGE_DONE;
+  if( !SetMessageNotify(u32Token_, &Lcd_sMessageNotify) )
+  {
+    Lcd_u32MessageEvents |= _LCD_EVENT_MESSAGE_DONE;
+    return FALSE;
+  }
+  
+  Lcd_u32CurrentMsgToken = u32Token_;
+  return TRUE;
+  
+} /* end LcdWatchCurrentMessage() */
+
+
+/*----------------------------------------------------------------------------------------------------------------------
+Function: LcdCurrentPageInProgress
+
+Description:
+Checks that the page being watched has really finished.  The notification of a page dropped by the 
+LcdSM_WaitTransfer timeout can still fire later and set _LCD_EVENT_MESSAGE_DONE for the page after it.
+
+Requires:
+ - Lcd_u32CurrentMsgToken is the token of the page being watched
+           
+Promises:
+ - Returns TRUE if Lcd_u32CurrentMsgToken is still WAITING, SENDING or RECEIVING
+*/
+static bool LcdCurrentPageInProgress(void)
+{
+  MessageStateType eStatus = QueryMessageStatus(Lcd_u32CurrentMsgToken);
+  
+  return( (bool)((eStatus == WAITING) || (eStatus == SENDING) || (eStatus == RECEIVING)) );
+  
+} /* end LcdCurrentPageInProgress() */
+
+
 /***********************************************************************************************************************
 State Machine Function Definitions
 
@@ -1083,12 +1287,17 @@ State: LcdSM_Idle()
 
 static void LcdSM_Idle(void)
 {
+  /* A command the SSP could not take is tried again each pass */
+  if(Lcd_u32Flags & _LCD_FLAGS_COMMAND_PENDING)
+  {
+    LcdQueueCommand();
+  }
+  
   /* Check if a command is queued: commands are always sent immediately */
   if(Lcd_u32Flags & _LCD_FLAGS_COMMAND_IN_QUEUE)
   {
     Lcd_u32Timer = G_u32SystemTime1ms;
-    Lcd_ReturnState = LcdSM_Idle;
-    Lcd_pfnStateMachine = LcdSM_WaitTransfer;
+    Lcd_pfnStateMachine = LcdSM_WaitCommand;
   }
   
   /* Monitor the refresh period */
@@ -1120,12 +1329,19 @@ static void LcdSM_Idle(void)
       /* Set the starting page; subsequent pages are incremental */
       Lcd_u8CurrentPage = Lcd_sCurrentUpdateArea.u16RowStart / LCD_PAGE_SIZE;
 
-      /* Start the refresh cycle by loading the command to set the cursor location */
-      LcdSetStartAddressForDataTransfer(Lcd_u8CurrentPage);
-      Lcd_pfnStateMachine = LcdSM_WaitTransfer;
+      /* Start the refresh cycle with the first page, or put the area back and try again next pass */
+      if( LcdQueueNextPage() )
+      {
+        Lcd_pfnStateMachine = LcdSM_WaitTransfer;
+      }
+      else
+      {
+        LcdUpdateScreenRefreshArea(&Lcd_sCurrentUpdateArea);
+        Lcd_u32RefreshTimer = 0;
+      }
     }
   }
-  else
+  else if( !(Lcd_u32Flags & _LCD_FLAGS_COMMAND_PENDING) )
   {
     /* Nothing to do, so just make sure manual mode is not enabled */
     Lcd_u32Flags &= ~_LCD_MANUAL_MODE;
@@ -1136,50 +1352,66 @@ static void LcdSM_Idle(void)
 
 /*----------------------------------------------------------------------------------------------------------------------
 State: LcdSM_WaitTransfer()
-Sends the current queued LCD command or data to the SPI peripheral through the SSP API.
+Sends the current queued LCD refresh data to the SPI peripheral through the SSP API.
 This waits until the message token is complete or a timeout occurs.  We can determine the next step based
-on Lcd_u8PagesToUpdate that will be 0 if the last transfer was a comand or non-zero if we are waiting
-on the screen refresh process.
+on Lcd_u8PagesToUpdate that will be 0 if the last transfer was the last page, or non-zero if 
+more pages of the screen refresh are left.  Each page is a single transaction (address and data).
+A page that cannot be queued is tried again on the next pass.  If the refresh has not moved on 
+LCD_TRANSFER_TIMEOUT ms after its last page was queued, it is dropped and its area is left for the next 
+refresh.
+A command queued by LcdCommand() during the refresh is watched separately and picked up by LcdSM_Idle.
 */
 static void LcdSM_WaitTransfer(void)
 {
-  /* Wait for message to be sent */
-  if(QueryMessageStatus(Lcd_u32CurrentMsgToken) == COMPLETE)
+  /* Wait for message to be sent: the event is set as soon as the SSP interrupt finishes the message */
+  if( (Lcd_u32MessageEvents & _LCD_EVENT_MESSAGE_DONE) && !LcdCurrentPageInProgress() )
   {
     /* The next step depends on what we did last */
     if(Lcd_u8PagesToUpdate != 0)
     {
-      /* If the last transmission was a command, that means it's time to load an LCD page */
-      if(Lcd_u32Flags & _LCD_FLAGS_COMMAND_IN_QUEUE)
-      {
-        Lcd_u32Flags &= ~_LCD_FLAGS_COMMAND_IN_QUEUE;
-        
-        LcdLoadPageToBuffer(Lcd_u8CurrentPage);
-        Lcd_u8CurrentPage++;
-        Lcd_u8PagesToUpdate--;
-      }
-      else
-      {
-        LcdSetStartAddressForDataTransfer(Lcd_u8CurrentPage);
-      }
-      
+      /* If the page is not queued the event stays set so it is tried again next pass */
+      (void)LcdQueueNextPage();
       Lcd_ReturnState = LcdSM_WaitTransfer;
     }
-    /* Either just sent a command, or just sent that last data page */
+    /* Just sent the last data page: manual mode still has to wait for a pending command */
     else
     {
-      Lcd_u32Flags &= ~(_LCD_MANUAL_MODE | _LCD_FLAGS_COMMAND_IN_QUEUE);
+      if( !(Lcd_u32Flags & (_LCD_FLAGS_COMMAND_IN_QUEUE | _LCD_FLAGS_COMMAND_PENDING)) )
+      {
+        Lcd_u32Flags &= ~_LCD_MANUAL_MODE;
+      }
       Lcd_ReturnState = LcdSM_Idle;
     }
 
     Lcd_pfnStateMachine = Lcd_ReturnState;
   }
   
-  /* Check for timeout */
+  /* Check for timeout: the pages not sent are redrawn by the next refresh */
+  if( (Lcd_pfnStateMachine == LcdSM_WaitTransfer) && IsTimeUp(&Lcd_u32Timer, LCD_TRANSFER_TIMEOUT) )
+  {
+    LcdUpdateScreenRefreshArea(&Lcd_sCurrentUpdateArea);
+    Lcd_u8PagesToUpdate = 0;
+    Lcd_pfnStateMachine = LcdSM_Idle;
+  }
   
 } /* end LcdSM_WaitTransfer() */
 
 
+/*----------------------------------------------------------------------------------------------------------------------
+State: LcdSM_WaitCommand()
+Waits for the command queued by LcdCommand() to be sent.  Lcd_u8Command is not reused until then.
+*/
+static void LcdSM_WaitCommand(void)
+{
+  if(Lcd_u32CommandEvents & _LCD_EVENT_COMMAND_DONE)
+  {
+    Lcd_u32Flags &= ~(_LCD_MANUAL_MODE | _LCD_FLAGS_COMMAND_IN_QUEUE);
+    Lcd_pfnStateMachine = LcdSM_Idle;
+  }
+  
+} /* end LcdSM_WaitCommand() */
+
+
 /*--------------------------------------------------------------------------------------------------------------------*/
 /* End of File */
 /*--------------------------------------------------------------------------------------------------------------------*/
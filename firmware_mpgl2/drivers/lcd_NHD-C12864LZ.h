@@ -66,12 +66,21 @@ typedef struct
 * Application Values
 *******************************************************************************/
 /* Lcd_u32Flags */
-#define _LCD_FLAGS_COMMAND_IN_QUEUE   0x00000001      /* Command or data in LCD */
+#define _LCD_FLAGS_COMMAND_IN_QUEUE   0x00000001      /* A command from LcdCommand() is queued */
+#define _LCD_FLAGS_COMMAND_PENDING    0x00000002      /* A command from LcdCommand() could not be queued yet: tried again each pass */
 
 #define _LCD_MANUAL_MODE              0x10000000      /* The task is in manual mode */
 
 /* end Lcd_u32Flags */
 
+/* Lcd_u32MessageEvents */
+#define _LCD_EVENT_MESSAGE_DONE       0x00000001      /* Set by messaging when Lcd_u32CurrentMsgToken has finished */
+/* end Lcd_u32MessageEvents */
+
+/* Lcd_u32CommandEvents */
+#define _LCD_EVENT_COMMAND_DONE       0x00000001      /* Set by messaging when Lcd_u32CommandToken has finished */
+/* end Lcd_u32CommandEvents */
+
 /* LCD hardware definitions */
 #define LCD_PIXEL_BITS                (u8)1
 #define LCD_PAGE_SIZE                 (u8)8
@@ -89,10 +98,13 @@ typedef struct
 
 #define LCD_TX_BUFFER_SIZE            (u16)128   /* Enough for a complete page refresh */
 #define LCD_RX_BUFFER_SIZE            (u16)1   /* Enough for a complete page refresh */
+#define LCD_ADDRESS_COMMAND_SIZE      (u8)3    /* Page and column address commands sent before each page */
+#define LCD_TX_RESERVED_SLOTS         (u8)6    /* Message pool slots kept for LCD refresh messages */
 
 #define LCD_STARTUP_DELAY_200         (u32)205
 #define LCD_STARTUP_DELAY_10          (u32)11
 #define LCD_REFRESH_TIME              (u32)25                /* Time in ms between LCD refreshes */
+#define LCD_TRANSFER_TIMEOUT          (u32)100               /* Time in ms a refresh may wait on one page before it is dropped */
 
 /* Bitmap sizes (x = # of column pixels, y = # of row pixels) */
 #define LCD_SMALL_FONT_COLUMNS        (u8)5
@@ -211,13 +223,19 @@ void LcdRunActiveState(void);
 void LcdManualMode(void);
 
 /* LCD Private Driver Functions */
+static bool LcdBeginTransaction(void);
+static void LcdQueueCommand(void);
+static bool LcdQueueNextPage(void);
 static bool LcdSetStartAddressForDataTransfer(u8 u8Page_);         
-static void LcdLoadPageToBuffer(u8 u8LocalRamPage_); 
+static bool LcdLoadPageToBuffer(u8 u8LocalRamPage_); 
 static void LcdUpdateScreenRefreshArea(PixelBlockType* sPixelsToClear_);
+static bool LcdWatchCurrentMessage(u32 u32Token_);
+static bool LcdCurrentPageInProgress(void);
 
 /* State machine declarations */
 static void LcdSM_Idle(void);
 static void LcdSM_WaitTransfer(void);
+static void LcdSM_WaitCommand(void);
 static void BoardTestSM_WaitPixelTestOn(void);          
 static void BoardTestSM_WaitPixelTestOff(void);          
 